@@ -74,7 +74,10 @@ class KCalCore::Alarm::Private
         mAlarmEnabled( other.mAlarmEnabled ),
         mHasLocationRadius( other.mHasLocationRadius ),
         mLocationRadius( other.mLocationRadius )
-    {}
+    {
+      // Not shared with the copied alarm, see IncidenceBase
+      mAlarmTime.detach();
+    }
 
     Incidence *mParent;  // the incidence which this alarm belongs to
 
@@ -130,6 +133,7 @@ Alarm &Alarm::operator=( const Alarm &a )
     d->mAlarmSnoozeTime = a.d->mAlarmSnoozeTime;
     d->mAlarmRepeatCount = a.d->mAlarmRepeatCount;
     d->mAlarmTime = a.d->mAlarmTime;
+    d->mAlarmTime.detach();
     d->mOffset = a.d->mOffset;
     d->mEndOffset = a.d->mEndOffset;
     d->mHasTime = a.d->mHasTime;
@@ -592,6 +596,7 @@ void Alarm::shiftTimes( const KDateTime::Spec &oldSpec,
   if ( d->mParent ) {
     d->mParent->update();
   }
+  d->mAlarmTime.detach();
   d->mAlarmTime = d->mAlarmTime.toTimeSpec( oldSpec );
   d->mAlarmTime.setTimeSpec( newSpec );
   if ( d->mParent ) {
@@ -37,11 +37,15 @@
 #include "calendar.h"
 #include "calfilter.h"
 #include "icaltimezones.h"
+#include "occurrences_p.h"
+#include "parallel_p.h"
 #include "sorting.h"
 #include "visitor.h"
 
 #include <KDebug>
 
+#include <QtCore/QSet>
+
 extern "C" {
   #include <icaltimezone.h>
 }
@@ -64,6 +68,7 @@ class KCalCore::Calendar::Private
         mNewObserver( false ),
         mObserversEnabled( true ),
         mDefaultFilter( new CalFilter ),
+        mHiddenNotebooks( 0 ),
         batchAddingInProgress( false )
     {
       // Setup default filter, which does nothing
@@ -101,47 +106,35 @@ class KCalCore::Calendar::Private
     CalFilter *mDefaultFilter;
     CalFilter *mFilter;
 
-    // These lists are used to put together related To-dos
-    QMultiHash<QString, Incidence::Ptr> mOrphans;
-    QMultiHash<QString, Incidence::Ptr> mOrphanUids;
+    // Relation graph of the incidences. An incidence is filed under the
+    // uid of its parent whether the parent is in the calendar or not.
+    bool isAncestor( const QString &ancestorUid, const QString &uid ) const;
+    void linkRelation( const Incidence::Ptr &incidence, const QString &parentUid );
+    void unlinkRelation( const Incidence::Ptr &incidence );
+
+    QHash<QString, Incidence::List> mChildren;            // parent uid -> children
+    QHash<QString, QString> mParentUids;                  // uid -> parent uid
+    QHash<const Incidence *, QString> mLinkedParents;     // linked incidence -> parent uid
+
+    // The incidences of a notebook, with the position of each one in the
+    // list so that it can be removed in constant time.
+    struct NotebookIncidences {
+      Incidence::List list;
+      QHash<const Incidence *, int> positions;
+    };
+    void addToNotebook( const QString &notebook, const Incidence::Ptr &incidence );
+    void removeFromNotebook( const QString &notebook, const Incidence::Ptr &incidence );
 
     // Lists for associating incidences to notebooks
-    QMultiHash<QString, Incidence::Ptr >mNotebookIncidences;
+    QHash<QString, NotebookIncidences>mNotebookIncidences;
     QHash<QString, QString>mUidToNotebook;
     QHash<QString, bool>mNotebooks; // name to visibility
-    QHash<Incidence::Ptr, bool>mIncidenceVisibility; // incidence -> visibility
+    int mHiddenNotebooks; // number of notebooks not visible
     QString mDefaultNotebook; // uid of default notebook
-    QMap<QString, Incidence::List > mIncidenceRelations;
     bool batchAddingInProgress;
 
 };
 
-/**
-  Make a QHash::value that returns a QVector.
-*/
-template <typename K, typename V>
-QVector<V> values( const QMultiHash<K,V> &c )
-{
-  QVector<V> v;
-  v.reserve( c.size() );
-  for ( typename QMultiHash<K,V>::const_iterator it = c.begin(), end = c.end(); it != end; ++it ) {
-    v.push_back( it.value() );
-  }
-  return v;
-}
-
-template <typename K, typename V>
-QVector<V> values( const QMultiHash<K,V> &c, const K &x )
-{
-  QVector<V> v;
-  typename QMultiHash<K,V>::const_iterator it = c.find( x );
-  while ( it != c.end() && it.key() == x ) {
-    v.push_back( it.value() );
-    ++it;
-  }
-  return v;
-}
-
 /**
   Template for a class that implements a visitor for adding an Incidence
   to a resource supporting addEvent(), addTodo() and addJournal() calls.
@@ -338,24 +331,74 @@ void Calendar::setTimeZones( ICalTimeZones *zones )
   d->mTimeZones = zones;
 }
 
+//@cond PRIVATE
+// Returns true if all the date/times shifted by Incidence::shiftTimes() can
+// be converted on another thread. Recurrence IDs are not shifted.
+static bool shiftsInParallel( const Incidence::Ptr &incidence )
+{
+  if ( !Parallel::isThreadSafe( incidence->dtStart().timeSpec() ) ||
+       !Parallel::isThreadSafe( incidence->dateTime( Incidence::RoleEnd ).timeSpec() ) ) {
+    return false;
+  }
+  if ( incidence->type() == Incidence::TypeTodo ) {
+    const Todo::Ptr todo = incidence.staticCast<Todo>();
+    if ( !Parallel::isThreadSafe( todo->dtDue( true ).timeSpec() ) ||
+         ( todo->recurs() && !Parallel::isThreadSafe( todo->dtRecurrence().timeSpec() ) ) ||
+         ( todo->hasCompletedDate() && !Parallel::isThreadSafe( todo->completed().timeSpec() ) ) ) {
+      return false;
+    }
+  }
+  foreach ( const Alarm::Ptr &alarm, incidence->alarms() ) {
+    if ( alarm->hasTime() && !Parallel::isThreadSafe( alarm->time().timeSpec() ) ) {
+      return false;
+    }
+  }
+  if ( !incidence->recurs() ) {
+    return true;
+  }
+  const Recurrence *recurrence = incidence->recurrence();
+  if ( !Parallel::isThreadSafe( recurrence->startDateTime().timeSpec() ) ) {
+    return false;
+  }
+  foreach ( const KDateTime &dt, recurrence->rDateTimes() + recurrence->exDateTimes() ) {
+    if ( !Parallel::isThreadSafe( dt.timeSpec() ) ) {
+      return false;
+    }
+  }
+  foreach ( const RecurrenceRule *rule, recurrence->rRules() + recurrence->exRules() ) {
+    // The end is only shifted for rules with an end date
+    if ( !Parallel::isThreadSafe( rule->startDt().timeSpec() ) ||
+         ( rule->duration() == 0 && !Parallel::isThreadSafe( rule->endDt().timeSpec() ) ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+//@endcond
+
 void Calendar::shiftTimes( const KDateTime::Spec &oldSpec, const KDateTime::Spec &newSpec )
 {
   setTimeSpec( newSpec );
 
-  int i, end;
-  Event::List ev = events();
-  for ( i = 0, end = ev.count();  i < end;  ++i ) {
-    ev[i]->shiftTimes( oldSpec, newSpec );
-  }
+  const Incidence::List incidences =
+    mergeIncidenceList( events(), todos(), journals() );
 
-  Todo::List to = todos();
-  for ( i = 0, end = to.count();  i < end;  ++i ) {
-    to[i]->shiftTimes( oldSpec, newSpec );
+  // Incidences are shifted independently of each other, so the work can be
+  // spread over several threads when all the time zones involved allow it.
+  // Change notifications are held back meanwhile and sent from this thread.
+  bool threadSafe = Parallel::isThreadSafe( oldSpec ) && Parallel::isThreadSafe( newSpec );
+  foreach ( const Incidence::Ptr &incidence, incidences ) {
+    incidence->startUpdates();
+    threadSafe = threadSafe && shiftsInParallel( incidence );
   }
 
-  Journal::List jo = journals();
-  for ( i = 0, end = jo.count();  i < end;  ++i ) {
-    jo[i]->shiftTimes( oldSpec, newSpec );
+  Parallel::forEach( incidences.count(), threadSafe,
+                     [&]( int i ) { incidences[i]->shiftTimes( oldSpec, newSpec ); },
+                     [this]( int processed, int total ) {
+                       emit timeSpecChangeProgress( processed, total ); } );
+
+  foreach ( const Incidence::Ptr &incidence, incidences ) {
+    incidence->endUpdates();
   }
 }
 
@@ -432,7 +475,7 @@ Incidence::List Calendar::duplicates( const Incidence::Ptr &incidence )
 {
   if ( incidence ) {
     Incidence::List list;
-    Incidence::List vals = values( d->mNotebookIncidences );
+    Incidence::List vals = incidences( QString() );
     Incidence::List::const_iterator it;
     for ( it = vals.constBegin(); it != vals.constEnd(); ++it ) {
       if ( ( ( incidence->dtStart() == ( *it )->dtStart() ) ||
@@ -447,27 +490,64 @@ Incidence::List Calendar::duplicates( const Incidence::Ptr &incidence )
   }
 }
 
+//@cond PRIVATE
+void Calendar::Private::addToNotebook( const QString &notebook, const Incidence::Ptr &incidence )
+{
+  NotebookIncidences &incidences = mNotebookIncidences[notebook];
+  if ( !incidences.positions.contains( incidence.data() ) ) {
+    incidences.positions.insert( incidence.data(), incidences.list.count() );
+    incidences.list.append( incidence );
+  }
+}
+
+void Calendar::Private::removeFromNotebook( const QString &notebook,
+                                            const Incidence::Ptr &incidence )
+{
+  QHash<QString, NotebookIncidences>::Iterator it = mNotebookIncidences.find( notebook );
+  if ( it == mNotebookIncidences.end() ) {
+    return;
+  }
+  const int position = it->positions.take( incidence.data() );
+  if ( position < 0 || position >= it->list.count() || it->list[position] != incidence ) {
+    return;
+  }
+
+  // Fill the hole with the last incidence
+  const Incidence::Ptr last = it->list.last();
+  it->list.removeLast();
+  if ( last != incidence ) {
+    it->list[position] = last;
+    it->positions.insert( last.data(), position );
+  }
+  if ( it->list.isEmpty() ) {
+    mNotebookIncidences.erase( it );
+  }
+}
+//@endcond
+
 bool Calendar::addNotebook( const QString &notebook, bool isVisible )
 {
   if ( d->mNotebooks.contains( notebook ) ) {
     return false;
   } else {
     d->mNotebooks.insert( notebook, isVisible );
+    if ( !isVisible ) {
+      ++d->mHiddenNotebooks;
+    }
     return true;
   }
 }
 
 bool Calendar::updateNotebook( const QString &notebook, bool isVisible )
 {
-  if ( !d->mNotebooks.contains( notebook ) ) {
+  QHash<QString, bool>::Iterator it = d->mNotebooks.find( notebook );
+  if ( it == d->mNotebooks.end() ) {
     return false;
   } else {
-    d->mNotebooks.insert( notebook, isVisible );
-    const QList<Incidence::Ptr> incidences = d->mNotebookIncidences.values(notebook);
-    for (Incidence::Ptr incidence : incidences) {
-        QHash<Incidence::Ptr, bool>::Iterator it = d->mIncidenceVisibility.find(incidence);
-        if (it != d->mIncidenceVisibility.end())
-            *it = isVisible;
+    // The visibility of incidences is looked up through their notebook
+    if ( *it != isVisible ) {
+      d->mHiddenNotebooks += isVisible ? -1 : 1;
+      *it = isVisible;
     }
     return true;
   }
@@ -475,10 +555,15 @@ bool Calendar::updateNotebook( const QString &notebook, bool isVisible )
 
 bool Calendar::deleteNotebook( const QString &notebook )
 {
-  if ( !d->mNotebooks.contains( notebook ) ) {
+  QHash<QString, bool>::Iterator it = d->mNotebooks.find( notebook );
+  if ( it == d->mNotebooks.end() ) {
     return false;
   } else {
-    return d->mNotebooks.remove( notebook );
+    if ( !*it ) {
+      --d->mHiddenNotebooks;
+    }
+    d->mNotebooks.erase( it );
+    return true;
   }
 }
 
@@ -492,6 +577,19 @@ bool Calendar::setDefaultNotebook( const QString &notebook )
   }
 }
 
+void Calendar::copyNotebooks( const Calendar &other )
+{
+  for ( QHash<QString, bool>::ConstIterator it = other.d->mNotebooks.constBegin();
+        it != other.d->mNotebooks.constEnd(); ++it ) {
+    if ( !addNotebook( it.key(), it.value() ) ) {
+      updateNotebook( it.key(), it.value() );
+    }
+  }
+  if ( !other.d->mDefaultNotebook.isEmpty() ) {
+    setDefaultNotebook( other.d->mDefaultNotebook );
+  }
+}
+
 QString Calendar::defaultNotebook() const
 {
   return d->mDefaultNotebook;
@@ -504,19 +602,11 @@ bool Calendar::hasValidNotebook( const QString &notebook ) const
 
 bool Calendar::isVisible( const Incidence::Ptr &incidence ) const
 {
-  if ( d->mIncidenceVisibility.contains( incidence ) ) {
-    return d->mIncidenceVisibility[incidence];
-  }
-  const QString nuid = notebook( incidence );
-  bool rv;
-  if ( d->mNotebooks.contains( nuid ) ) {
-    rv = d->mNotebooks.value( nuid );
-  } else {
-    // NOTE returns true also for nonexisting notebooks for compatibility
-    rv = true;
+  if ( !d->mHiddenNotebooks || !incidence ) {
+    return true;
   }
-  d->mIncidenceVisibility[incidence] = rv;
-  return rv;
+  // NOTE returns true also for nonexisting notebooks for compatibility
+  return isVisible( d->mUidToNotebook.value( incidence->uid() ) );
 }
 
 bool Calendar::isVisible( const QString &notebook ) const
@@ -529,7 +619,6 @@ void Calendar::clearNotebookAssociations()
 {
   d->mNotebookIncidences.clear();
   d->mUidToNotebook.clear();
-  d->mIncidenceVisibility.clear();
 }
 
 bool Calendar::setNotebook( const Incidence::Ptr &inc, const QString &notebook )
@@ -555,17 +644,17 @@ bool Calendar::setNotebook( const Incidence::Ptr &inc, const QString &notebook )
       Incidence::List list = instances( inc );
       Incidence::List::Iterator it;
       for ( it = list.begin(); it != list.end(); ++it ) {
-        d->mNotebookIncidences.remove( old, *it );
-        d->mNotebookIncidences.insert( notebook, *it );
+        d->removeFromNotebook( old, *it );
+        d->addToNotebook( notebook, *it );
       }
       notifyIncidenceChanged( inc ); // for removing from old notebook
       // don not remove from mUidToNotebook to keep deleted incidences
-      d->mNotebookIncidences.remove( old, inc );
+      d->removeFromNotebook( old, inc );
     }
   }
   if ( !notebook.isEmpty() ) {
     d->mUidToNotebook.insert( inc->uid(), notebook );
-    d->mNotebookIncidences.insert( notebook, inc );
+    d->addToNotebook( notebook, inc );
     kDebug() << "setting notebook" << notebook << "for" << inc->uid();
     notifyIncidenceChanged( inc ); // for inserting into new notebook
   }
@@ -589,15 +678,20 @@ QString Calendar::notebook( const QString &uid ) const
 
 QStringList Calendar::notebooks() const
 {
-  return d->mNotebookIncidences.uniqueKeys();
+  return d->mNotebookIncidences.keys();
 }
 
 Incidence::List Calendar::incidences( const QString &notebook ) const
 {
   if ( notebook.isEmpty() ) {
-    return values( d->mNotebookIncidences );
+    Incidence::List list;
+    for ( QHash<QString, Private::NotebookIncidences>::ConstIterator it =
+            d->mNotebookIncidences.constBegin(); it != d->mNotebookIncidences.constEnd(); ++it ) {
+      list += it->list;
+    }
+    return list;
   } else {
-    return values( d->mNotebookIncidences, notebook );
+    return d->mNotebookIncidences.value( notebook ).list;
   }
 }
 
@@ -683,6 +777,25 @@ Event::List Calendar::events( EventSortField sortField,
   return el;
 }
 
+Calendar::Occurrence::List Calendar::occurrences( const KDateTime &start,
+                                                  const KDateTime &end,
+                                                  const KDateTime::Spec &timeSpec ) const
+{
+  Occurrence::List result;
+  const KDateTime::Spec spec = timeSpec.isValid() ? timeSpec : d->mTimeSpec;
+
+  // A day of margin for the events which start or end in another zone
+  const QVector<Occurrences::Interval> intervals =
+    Occurrences::expand( events( start.toTimeSpec( spec ).date().addDays( -1 ),
+                                 end.toTimeSpec( spec ).date().addDays( 1 ), spec ),
+                         start, end, spec, this );
+  result.reserve( intervals.count() );
+  foreach ( const Occurrences::Interval &interval, intervals ) {
+    result.append( interval.occurrence );
+  }
+  return result;
+}
+
 bool Calendar::addIncidence( const Incidence::Ptr &incidence )
 {
   if ( !incidence ) {
@@ -992,121 +1105,107 @@ Journal::List Calendar::journals( const QDate &date ) const
   return el;
 }
 
-// When this is called, the to-dos have already been added to the calendar.
-// This method is only about linking related to-dos.
-void Calendar::setupRelations( const Incidence::Ptr &forincidence )
+//@cond PRIVATE
+// True if ancestorUid is uid or one of its ancestors, in O(depth). Walks
+// stop after as many steps as there are relations, should a loop exist.
+bool Calendar::Private::isAncestor( const QString &ancestorUid, const QString &uid ) const
 {
-  if ( !forincidence ) {
-    return;
+  QString current = uid;
+  for ( int steps = mParentUids.count(); !current.isEmpty() && steps >= 0; --steps ) {
+    if ( current == ancestorUid ) {
+      return true;
+    }
+    current = mParentUids.value( current );
   }
+  return false;
+}
 
-  const QString uid = forincidence->uid();
+void Calendar::Private::linkRelation( const Incidence::Ptr &incidence, const QString &parentUid )
+{
+  mLinkedParents.insert( incidence.data(), parentUid );
+  if ( !parentUid.isEmpty() ) {
+    mChildren[parentUid].append( incidence );
+  }
 
-  // First, go over the list of orphans and see if this is their parent
-  Incidence::List l = values( d->mOrphans, uid );
-  d->mOrphans.remove( uid );
-  for ( int i = 0, end = l.count();  i < end;  ++i ) {
-    d->mIncidenceRelations[uid].append( l[i] );
-    d->mOrphanUids.remove( l[i]->uid() );
+  // Exceptions of recurring incidences share the parent of the series
+  const QString uid = incidence->uid();
+  if ( !incidence->hasRecurrenceId() || !mParentUids.contains( uid ) ) {
+    if ( parentUid.isEmpty() ) {
+      mParentUids.remove( uid );
+    } else {
+      mParentUids.insert( uid, parentUid );
+    }
   }
+}
 
-  // Now see about this incidences parent
-  if ( forincidence->relatedTo().isEmpty() && !forincidence->relatedTo().isEmpty() ) {
-    // Incidence has a uid it is related to but is not registered to it yet.
-    // Try to find it
-    Incidence::Ptr parent = incidence( forincidence->relatedTo() );
-    if ( parent ) {
-      // Found it
+void Calendar::Private::unlinkRelation( const Incidence::Ptr &incidence )
+{
+  QHash<const Incidence *, QString>::Iterator linked = mLinkedParents.find( incidence.data() );
+  if ( linked == mLinkedParents.end() ) {
+    return;
+  }
 
-      // look for hierarchy loops
-      if ( isAncestorOf( forincidence, parent ) ) {
-        forincidence->setRelatedTo( QString() );
-        kWarning() << "hierarchy loop beetween " << forincidence->uid() << " and " << parent->uid();
-      } else {
-        d->mIncidenceRelations[parent->uid()].append( forincidence );
+  const QString parentUid = linked.value();
+  mLinkedParents.erase( linked );
+  if ( !parentUid.isEmpty() ) {
+    QHash<QString, Incidence::List>::Iterator children = mChildren.find( parentUid );
+    if ( children != mChildren.end() ) {
+      children->erase( std::remove( children->begin(), children->end(), incidence ),
+                       children->end() );
+      if ( children->isEmpty() ) {
+        mChildren.erase( children );
       }
-    } else {
-      // Not found, put this in the mOrphans list
-      // Note that the mOrphans dict might contain multiple entries with the
-      // same key! which are multiple children that wait for the parent
-      // incidence to be inserted.
-      d->mOrphans.insert( forincidence->relatedTo(), forincidence );
-      d->mOrphanUids.insert( forincidence->uid(), forincidence );
     }
   }
+  if ( !incidence->hasRecurrenceId() ) {
+    mParentUids.remove( incidence->uid() );
+  }
 }
+//@endcond
 
-// If a to-do with sub-to-dos is deleted, move it's sub-to-dos to the orphan list
-void Calendar::removeRelations( const Incidence::Ptr &incidence )
+// When this is called, the to-dos have already been added to the calendar.
+// This method is only about linking related to-dos.
+void Calendar::setupRelations( const Incidence::Ptr &forincidence )
 {
-  if ( !incidence ) {
-    kDebug() << "Warning: incidence is 0";
+  if ( !forincidence ) {
     return;
   }
 
-  const QString uid = incidence->uid();
-
-  foreach ( Incidence::Ptr i, d->mIncidenceRelations[uid] ) {
-    if ( !d->mOrphanUids.contains( i->uid() ) ) {
-      d->mOrphans.insert( uid, i );
-      d->mOrphanUids.insert( i->uid(), i );
-      i->setRelatedTo( uid );
+  const QString parentUid = forincidence->relatedTo();
+  QHash<const Incidence *, QString>::ConstIterator linked =
+    d->mLinkedParents.constFind( forincidence.data() );
+  if ( linked != d->mLinkedParents.constEnd() ) {
+    if ( linked.value() == parentUid ) {
+      return;
     }
+    // The incidence was given another parent
+    d->unlinkRelation( forincidence );
   }
 
-  const QString parentUid = incidence->relatedTo();
+  // look for hierarchy loops
+  if ( !parentUid.isEmpty() && d->isAncestor( forincidence->uid(), parentUid ) ) {
+    kWarning() << "hierarchy loop beetween " << forincidence->uid() << " and " << parentUid;
+    // Linked first, the change is notified back to setupRelations()
+    d->mLinkedParents.insert( forincidence.data(), QString() );
+    forincidence->setRelatedTo( QString() );
+    return;
+  }
 
-  // If this incidence is related to something else, tell that about it
-  if ( !parentUid.isEmpty() ) {
-    d->mIncidenceRelations[parentUid].erase(
-      std::remove( d->mIncidenceRelations[parentUid].begin(),
-                   d->mIncidenceRelations[parentUid].end(), incidence ),
-      d->mIncidenceRelations[parentUid].end() );
-  }
-
-  // Remove this one from the orphans list
-  if ( d->mOrphanUids.remove( uid ) ) {
-    // This incidence is located in the orphans list - it should be removed
-    // Since the mOrphans dict might contain the same key (with different
-    // child incidence pointers!) multiple times, take care that we remove
-    // the correct one. So we need to remove all items with the given
-    // parent UID, and readd those that are not for this item. Also, there
-    // might be other entries with differnet UID that point to this
-    // incidence (this might happen when the relatedTo of the item is
-    // changed before its parent is inserted. This might happen with
-    // groupware servers....). Remove them, too
-    QStringList relatedToUids;
-
-    // First, create a list of all keys in the mOrphans list which point
-    // to the removed item
-    relatedToUids << incidence->relatedTo();
-    for ( QMultiHash<QString, Incidence::Ptr>::Iterator it = d->mOrphans.begin();
-          it != d->mOrphans.end(); ++it ) {
-      if ( it.value()->uid() == uid ) {
-        relatedToUids << it.key();
-      }
-    }
+  // Children may be added before their parent, they wait in
+  // mChildren until it comes.
+  d->linkRelation( forincidence, parentUid );
+}
 
-    // now go through all uids that have one entry that point to the incidence
-    for ( QStringList::const_iterator uidit = relatedToUids.constBegin();
-          uidit != relatedToUids.constEnd(); ++uidit ) {
-      Incidence::List tempList;
-      // Remove all to get access to the remaining entries
-      QList<Incidence::Ptr> l = d->mOrphans.values( *uidit );
-      d->mOrphans.remove( *uidit );
-      foreach ( Incidence::Ptr i, l ) {
-        if ( i != incidence ) {
-          tempList.append( i );
-        }
-      }
-      // Readd those that point to a different orphan incidence
-      for ( Incidence::List::Iterator incit = tempList.begin();
-            incit != tempList.end(); ++incit ) {
-        d->mOrphans.insert( *uidit, *incit );
-      }
-    }
+// Sub-to-dos of a deleted to-do stay related to it, as orphans.
+void Calendar::removeRelations( const Incidence::Ptr &incidence )
+{
+  if ( !incidence ) {
+    kDebug() << "Warning: incidence is 0";
+    return;
   }
 
+  d->unlinkRelation( incidence );
+
   // Make sure the deleted incidence doesn't relate to a non-deleted incidence,
   // since that would cause trouble in MemoryCalendar::close(), as the deleted
   // incidences are destroyed after the non-deleted incidences. The destructor
@@ -1123,18 +1222,47 @@ void Calendar::removeRelations( const Incidence::Ptr &incidence )
 bool Calendar::isAncestorOf( const Incidence::Ptr &ancestor,
                              const Incidence::Ptr &incidence ) const
 {
-  if ( !incidence || incidence->relatedTo().isEmpty() ) {
+  if ( !ancestor || !incidence ) {
     return false;
-  } else if ( incidence->relatedTo() == ancestor->uid() ) {
-    return true;
-  } else {
-    return isAncestorOf( ancestor, this->incidence( incidence->relatedTo() ) );
   }
+  return d->isAncestor( ancestor->uid(), incidence->relatedTo() );
 }
 
 Incidence::List Calendar::relations( const QString &uid ) const
 {
-  return d->mIncidenceRelations[uid];
+  return d->mChildren.value( uid );
+}
+
+Incidence::List Calendar::descendants( const QString &uid ) const
+{
+  Incidence::List result;
+  QSet<QString> visited;
+  visited.insert( uid );
+
+  // Depth first, children in the order of relations()
+  QVector<Incidence::List> stack;
+  QVector<int> positions;
+  stack.append( d->mChildren.value( uid ) );
+  positions.append( 0 );
+  while ( !stack.isEmpty() ) {
+    if ( positions.last() == stack.last().count() ) {
+      stack.removeLast();
+      positions.removeLast();
+      continue;
+    }
+    const Incidence::Ptr child = stack.last()[positions.last()++];
+    result.append( child );
+    const QString childUid = child->uid();
+    if ( !visited.contains( childUid ) ) {
+      visited.insert( childUid );
+      const Incidence::List children = d->mChildren.value( childUid );
+      if ( !children.isEmpty() ) {
+        stack.append( children );
+        positions.append( 0 );
+      }
+    }
+  }
+  return result;
 }
 
 Calendar::CalendarObserver::~CalendarObserver()
@@ -1370,7 +1498,6 @@ void Calendar::appendAlarms( Alarm::List &alarms, const Incidence::Ptr &incidenc
     if ( alarmlist[i]->enabled() ) {
       KDateTime dt = alarmlist[i]->nextRepetition( preTime );
       if ( dt.isValid() && dt <= to ) {
-        kDebug() << incidence->summary() << "':" << dt.toString();
         alarms.append( alarmlist[i] );
       }
     }
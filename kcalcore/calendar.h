@@ -56,6 +56,7 @@ This API needs serious cleaning up:
 #include "todo.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QVector>
 
 namespace KCalCore {
 
@@ -137,6 +138,24 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
     */
     typedef QSharedPointer<Calendar> Ptr;
 
+    /**
+      An occurrence of an event, as returned by occurrences().
+
+      @since 4.11
+    */
+    struct Occurrence {
+      Event::Ptr event;    /**< the event, the exception for modified occurrences */
+      KDateTime start;     /**< start of the occurrence */
+      KDateTime end;       /**< end of the occurrence, excluded: the day after
+                                the last day for all-day events, unlike
+                                Event::dtEnd() */
+
+      /**
+        List of occurrences.
+      */
+      typedef QVector<Occurrence> List;
+    };
+
     /**
       Constructs a calendar with a specified time zone @p timeZoneid.
       The time specification is used as the default for creating or
@@ -563,7 +582,8 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
     QString defaultNotebook() const;
 
     /**
-      Check if incidence is visible.
+      Check if incidence is visible, that is if its notebook is visible.
+      This costs nothing while no notebook is hidden.
       @param incidence is a pointer to the Incidence to check for visibility.
       @return true if incidence is visible, false otherwise
     */
@@ -577,9 +597,11 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
     bool isVisible( const QString &notebook ) const;
 
     /**
-      List all notebook incidences in the memory.
+      List all notebook incidences in the memory. The list of a notebook
+      is kept up to date and returned without copying it.
 
-      @param notebook is the notebook uid.
+      @param notebook is the notebook uid, or an empty string for the
+      incidences of all notebooks.
       @return a list of incidences for the notebook.
     */
     virtual Incidence::List incidences( const QString &notebook ) const;
@@ -792,6 +814,31 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
                         EventSortField sortField = EventSortUnsorted,
                         SortDirection sortDirection = SortDirectionAscending ) const;
 
+    /**
+      Returns the filtered occurrences of the events between @p start and
+      @p end, sorted by start, then by end.
+
+      The recurrences of the events are expanded and the occurrences replaced
+      by exceptions, the events with the same UID and a recurrence ID, are
+      left out in favor of the exceptions, which are returned like other
+      events. Exception dates and rules are already taken into account by
+      the recurrences.
+
+      The start and end of an occurrence are in the time specification of
+      the event, date-only for all-day events, and the end is excluded: an
+      all-day occurrence ends on the day after its last day. An occurrence
+      is returned when it overlaps the range, or starts in it for events
+      without duration. All-day events cover whole days in @p timeSpec.
+
+      @param start is the start of the range.
+      @param end is the end of the range, excluded.
+      @param timeSpec is the time specification of all-day and floating
+      date/times, or the calendar's default time spec if none is specified.
+      @since 4.11
+    */
+    Occurrence::List occurrences( const KDateTime &start, const KDateTime &end,
+                                  const KDateTime::Spec &timeSpec = KDateTime::Spec() ) const;
+
     /**
       Returns a sorted, unfiltered list of all Events for this Calendar.
 
@@ -1221,7 +1268,8 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
   // Relations Specific Methods //
 
     /**
-      Setup Relations for an Incidence.
+      Setup Relations for an Incidence. Called again when the incidence
+      changes, to follow a change of its parent.
       @param incidence is a pointer to the Incidence to have a Relation setup.
     */
     virtual void setupRelations( const Incidence::Ptr &incidence );
@@ -1234,7 +1282,8 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
     virtual void removeRelations( const Incidence::Ptr &incidence );
 
     /**
-      Checks if @p ancestor is an ancestor of @p incidence
+      Checks if @p ancestor is an ancestor of @p incidence. This takes a
+      time proportional to the depth of @p incidence in the hierarchy.
 
       @param ancestor is the incidence we are testing to be an ancestor.
       @param incidence is the incidence we are testing to be descended from @p ancestor.
@@ -1244,12 +1293,23 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
 
     /**
        Returns a list of incidences that have a relation of RELTYPE parent
-       to incidence @p uid.
+       to incidence @p uid, including those waiting for @p uid to be added
+       to the calendar.
 
        @param uid The parent identifier whos children we want to obtain.
     */
     Incidence::List relations( const QString &uid ) const;
 
+    /**
+       Returns the incidences descending from incidence @p uid: its
+       children, their children and so on, depth first.
+
+       @param uid The identifier of the root of the subtree.
+       @see relations()
+       @since 4.11
+    */
+    Incidence::List descendants( const QString &uid ) const;
+
   // Filter Specific Methods //
 
     /**
@@ -1433,6 +1493,16 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
     void appendRecurringAlarms( Alarm::List &alarms, const Incidence::Ptr &incidence,
                                 const KDateTime &from, const KDateTime &to ) const;
 
+    /**
+      Registers the notebooks of another calendar, with their visibility
+      and the default notebook, whether or not they contain incidences.
+      Notebooks already known to this calendar are updated.
+
+      @param other is the calendar to copy the notebooks from.
+      @since 4.11
+    */
+    void copyNotebooks( const Calendar &other );
+
     /**
       @copydoc
       IncidenceBase::virtual_hook()
@@ -1445,6 +1515,18 @@ class KCALCORE_EXPORT Calendar : public QObject, public CustomProperties,
       @since 4.11
      */
     void filterChanged();
+
+    /**
+      Emitted while setTimeSpec() or shiftTimes() rehash the incidences of
+      a calendar, so that a progress indicator can be shown for large
+      calendars.
+
+      @param processed the number of incidences handled so far.
+      @param total the number of incidences to handle.
+      @since 4.11
+     */
+    void timeSpecChangeProgress( int processed, int total );
+
   private:
     //@cond PRIVATE
     class Private;
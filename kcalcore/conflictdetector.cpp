@@ -0,0 +1,203 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the ConflictDetector class.
+*/
+#include "conflictdetector.h"
+
+#include "occurrences_p.h"
+
+#include <QtCore/QMap>
+
+#include <algorithm>
+
+using namespace KCalCore;
+
+//@cond PRIVATE
+namespace {
+
+// An occurrence with its bounds in seconds, for comparisons without
+// time zone conversions.
+struct Interval
+{
+  qint64 start;
+  qint64 end;
+  ConflictDetector::Occurrence occurrence;
+};
+
+bool startsBeforeSecs( const Interval &a, qint64 secs )
+{
+  return a.start < secs;
+}
+
+}
+
+class KCalCore::ConflictDetector::Private
+{
+  public:
+    void fill( const QVector<Occurrences::Interval> &occurrences, const KDateTime::Spec &spec );
+
+    QVector<Interval> mIntervals;    // sorted by start, then end
+    qint64 mMaxLength;
+};
+
+void ConflictDetector::Private::fill( const QVector<Occurrences::Interval> &occurrences,
+                                      const KDateTime::Spec &spec )
+{
+  mMaxLength = 0;
+  mIntervals.reserve( occurrences.count() );
+  foreach ( const Occurrences::Interval &occurrence, occurrences ) {
+    const Event::Ptr &event = occurrence.occurrence.event;
+    if ( occurrence.end <= occurrence.start ||
+         event->transparency() == Event::Transparent ||
+         event->status() == Incidence::StatusCanceled ) {
+      continue;
+    }
+    Interval interval;
+    interval.start = occurrence.start;
+    interval.end = occurrence.end;
+    interval.occurrence.event = event;
+    interval.occurrence.start = Occurrences::absolute( occurrence.occurrence.start, spec );
+    interval.occurrence.end = Occurrences::absolute( occurrence.occurrence.end, spec );
+    mMaxLength = qMax( mMaxLength, interval.end - interval.start );
+    mIntervals.append( interval );
+  }
+}
+//@endcond
+
+ConflictDetector::ConflictDetector( const Event::List &events,
+                                    const KDateTime &start, const KDateTime &end,
+                                    const KDateTime::Spec &spec )
+  : d( new KCalCore::ConflictDetector::Private )
+{
+  const KDateTime::Spec detectionSpec = spec.isValid() ? spec : start.timeSpec();
+  d->fill( Occurrences::expand( events, start, end, detectionSpec ), detectionSpec );
+}
+
+ConflictDetector::ConflictDetector( const Calendar::Ptr &calendar,
+                                    const KDateTime &start, const KDateTime &end )
+  : d( new KCalCore::ConflictDetector::Private )
+{
+  // A day of margin for the events which start or end in another zone
+  const KDateTime::Spec spec = calendar->timeSpec();
+  d->fill( Occurrences::expand( calendar->rawEvents( start.toTimeSpec( spec ).date().addDays( -1 ),
+                                                     end.toTimeSpec( spec ).date().addDays( 1 ),
+                                                     spec ),
+                                start, end, spec, calendar.data() ),
+           spec );
+}
+
+ConflictDetector::~ConflictDetector()
+{
+  delete d;
+}
+
+ConflictDetector::Occurrence::List ConflictDetector::occurrences() const
+{
+  Occurrence::List result;
+  result.reserve( d->mIntervals.count() );
+  foreach ( const Interval &interval, d->mIntervals ) {
+    result.append( interval.occurrence );
+  }
+  return result;
+}
+
+ConflictDetector::Conflict::List ConflictDetector::conflicts() const
+{
+  Conflict::List result;
+
+  // Occurrences still running at the current start, by end
+  QMultiMap<qint64, int> active;
+  for ( int i = 0; i < d->mIntervals.count(); ++i ) {
+    const Interval &current = d->mIntervals[i];
+    while ( !active.isEmpty() && active.begin().key() <= current.start ) {
+      active.erase( active.begin() );
+    }
+    for ( QMultiMap<qint64, int>::ConstIterator it = active.constBegin();
+          it != active.constEnd(); ++it ) {
+      const Interval &other = d->mIntervals[it.value()];
+      if ( other.occurrence.event->uid() == current.occurrence.event->uid() ) {
+        continue;
+      }
+      Conflict conflict;
+      conflict.first = other.occurrence;
+      conflict.second = current.occurrence;
+      conflict.start = current.occurrence.start;
+      conflict.end = other.end < current.end ? other.occurrence.end : current.occurrence.end;
+      result.append( conflict );
+    }
+    active.insert( current.end, i );
+  }
+  return result;
+}
+
+QVector<ConflictDetector::Occurrence::List> ConflictDetector::groups() const
+{
+  QVector<Occurrence::List> result;
+  Occurrence::List group;
+  bool severalEvents = false;
+  qint64 groupEnd = 0;
+  for ( int i = 0; i <= d->mIntervals.count(); ++i ) {
+    if ( i == d->mIntervals.count() || ( !group.isEmpty() && d->mIntervals[i].start >= groupEnd ) ) {
+      if ( severalEvents ) {
+        result.append( group );
+      }
+      group.clear();
+      severalEvents = false;
+      if ( i == d->mIntervals.count() ) {
+        break;
+      }
+    }
+
+    const Interval &interval = d->mIntervals[i];
+    if ( group.isEmpty() ) {
+      groupEnd = interval.end;
+    } else {
+      groupEnd = qMax( groupEnd, interval.end );
+      severalEvents = severalEvents ||
+                      interval.occurrence.event->uid() != group.first().event->uid();
+    }
+    group.append( interval.occurrence );
+  }
+  return result;
+}
+
+ConflictDetector::Occurrence::List ConflictDetector::overlapping( const KDateTime &start,
+                                                                  const KDateTime &end ) const
+{
+  Occurrence::List result;
+  const qint64 slotStart = Occurrences::toSecs( start, start.timeSpec() );
+  const qint64 slotEnd = Occurrences::toSecs( end, end.timeSpec() );
+  if ( slotEnd <= slotStart ) {
+    return result;
+  }
+
+  // No occurrence starting before this can reach the slot
+  QVector<Interval>::ConstIterator it =
+    std::lower_bound( d->mIntervals.constBegin(), d->mIntervals.constEnd(),
+                      slotStart - d->mMaxLength, startsBeforeSecs );
+  for ( ; it != d->mIntervals.constEnd() && it->start < slotEnd; ++it ) {
+    if ( it->end > slotStart ) {
+      result.append( it->occurrence );
+    }
+  }
+  return result;
+}
@@ -0,0 +1,158 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the ConflictDetector class.
+*/
+
+#ifndef KCALCORE_CONFLICTDETECTOR_H
+#define KCALCORE_CONFLICTDETECTOR_H
+
+#include "kcalcore_export.h"
+#include "calendar.h"
+
+#include <QtCore/QVector>
+
+namespace KCalCore {
+
+/**
+  @brief
+  Finds the events which overlap in time.
+
+  The occurrences of the events in a time window are expanded once, when
+  the detector is created, and sorted. The double-bookings of the whole
+  window are then found by a single sweep over the occurrences, and the
+  occurrences overlapping a given slot by a binary search.
+
+  Transparent and canceled events do not take time and are left out.
+  All-day events cover whole days, and all-day and floating date/times
+  are taken in the time specification given to the detector. Occurrences
+  are half-open intervals: an occurrence ending when another starts does
+  not overlap it, and an occurrence without duration overlaps nothing.
+
+  The occurrences of a recurring event replaced by an exception, an event
+  with the same UID and a recurrence ID, are skipped when the exception is
+  among the events. Occurrences of the same event, or of an event and its
+  exceptions, are not reported as conflicting with each other.
+
+  @since 4.11
+*/
+class KCALCORE_EXPORT ConflictDetector
+{
+  public:
+    /**
+      An occurrence of an event.
+    */
+    struct Occurrence {
+      Event::Ptr event;    /**< the event */
+      KDateTime start;     /**< start of the occurrence */
+      KDateTime end;       /**< end of the occurrence, excluded */
+
+      /**
+        List of occurrences.
+      */
+      typedef QVector<Occurrence> List;
+    };
+
+    /**
+      Two overlapping occurrences.
+    */
+    struct Conflict {
+      Occurrence first;    /**< the occurrence starting first */
+      Occurrence second;   /**< the occurrence starting second */
+      KDateTime start;     /**< start of the overlap */
+      KDateTime end;       /**< end of the overlap, excluded */
+
+      /**
+        List of conflicts.
+      */
+      typedef QVector<Conflict> List;
+    };
+
+    /**
+      Expands the occurrences of @p events between @p start and @p end.
+
+      @param events are the events to check.
+      @param start is the start of the window.
+      @param end is the end of the window, excluded.
+      @param spec is the time specification of all-day and floating
+      date/times, the one of @p start if invalid.
+    */
+    ConflictDetector( const Event::List &events,
+                      const KDateTime &start, const KDateTime &end,
+                      const KDateTime::Spec &spec = KDateTime::Spec() );
+
+    /**
+      Expands the occurrences of the events of @p calendar between @p start
+      and @p end. All-day and floating date/times are taken in the time
+      specification of the calendar. The occurrences replaced by the
+      exceptions of the calendar are skipped, wherever the exceptions
+      moved to.
+
+      @param calendar is the calendar to check.
+      @param start is the start of the window.
+      @param end is the end of the window, excluded.
+    */
+    ConflictDetector( const Calendar::Ptr &calendar,
+                      const KDateTime &start, const KDateTime &end );
+
+    /**
+      Destroys the detector.
+    */
+    ~ConflictDetector();
+
+    /**
+      Returns the occurrences taking time in the window, sorted by start.
+    */
+    Occurrence::List occurrences() const;
+
+    /**
+      Returns every pair of occurrences of different events which overlap,
+      sorted by the start of the overlap.
+    */
+    Conflict::List conflicts() const;
+
+    /**
+      Returns the groups of occurrences which overlap one another directly
+      or through other occurrences of the group, sorted by start. Only the
+      groups involving several events are returned.
+    */
+    QVector<Occurrence::List> groups() const;
+
+    /**
+      Returns the occurrences overlapping the slot from @p start to @p end,
+      sorted by start. The slot should be within the window.
+
+      @param start is the start of the slot.
+      @param end is the end of the slot, excluded.
+    */
+    Occurrence::List overlapping( const KDateTime &start, const KDateTime &end ) const;
+
+  private:
+    Q_DISABLE_COPY( ConflictDetector )
+    //@cond PRIVATE
+    class Private;
+    Private *const d;
+    //@endcond
+};
+
+}
+
+#endif
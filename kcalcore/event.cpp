@@ -58,7 +58,10 @@ class KCalCore::Event::Private
         mTransparency( other.mTransparency ),
         mMultiDayValid( false ),
         mMultiDay( false )
-    {}
+    {
+      // Not shared with the copied event, see IncidenceBase
+      mDtEnd.detach();
+    }
 
     KDateTime mDtEnd;
     bool mHasEndDate;
@@ -94,6 +97,7 @@ IncidenceBase &Event::assign( const IncidenceBase &other )
     Incidence::assign( other );
     const Event *e = static_cast<const Event*>( &other );
     *d = *( e->d );
+    d->mDtEnd.detach();
   }
   return *this;
 }
@@ -227,6 +231,7 @@ void Event::shiftTimes( const KDateTime::Spec &oldSpec,
 {
   Incidence::shiftTimes( oldSpec, newSpec );
   if ( hasEndDate() ) {
+    d->mDtEnd.detach();
     d->mDtEnd = d->mDtEnd.toTimeSpec( oldSpec );
     d->mDtEnd.setTimeSpec( newSpec );
   }
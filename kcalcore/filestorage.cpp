@@ -35,85 +35,354 @@
 #include "vcalformat.h"
 
 #include <KDebug>
+#include <KSaveFile>
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtConcurrentRun>
+
+#include <stdio.h>
+#include <unistd.h>
 
 using namespace KCalCore;
 
+//@cond PRIVATE
+static const char JournalMagic[] = "KCALJOURNAL";
+
+// Journal records are keyed by incidence, a later change replaces an
+// earlier one which has not been written yet.
+static QString journalKey( const QString &uid, const KDateTime &recurrenceId )
+{
+  if ( recurrenceId.isValid() ) {
+    return uid + QLatin1Char( '\n' ) + recurrenceId.toString( KDateTime::ISODate );
+  }
+  return uid;
+}
+
+static bool syncFile( QFile &file )
+{
+  return file.flush() && fsync( file.handle() ) == 0;
+}
+
+// Replaces @p fileName by @p text atomically, then removes the journal
+// whose records are part of @p text. Runs on a worker thread.
+static bool writeSnapshot( const QByteArray &text, const QString &fileName,
+                           const QString &obsoleteJournal )
+{
+  KSaveFile::backupFile( fileName );
+
+  const QString tempName = fileName + QLatin1String( ".new" );
+  QFile file( tempName );
+  if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ||
+       file.write( text ) != text.size() || !syncFile( file ) ) {
+    kWarning() << "Cannot write" << tempName << ":" << file.errorString();
+    file.close();
+    QFile::remove( tempName );
+    return false;
+  }
+  file.close();
+
+  if ( ::rename( QFile::encodeName( tempName ).constData(),
+                 QFile::encodeName( fileName ).constData() ) != 0 ) {
+    kWarning() << "Cannot replace" << fileName;
+    QFile::remove( tempName );
+    return false;
+  }
+
+  if ( !obsoleteJournal.isEmpty() ) {
+    QFile::remove( obsoleteJournal );
+  }
+  return true;
+}
+
 /*
   Private class that helps to provide binary compatibility between releases.
 */
-//@cond PRIVATE
-class KCalCore::FileStorage::Private
+class KCalCore::FileStorage::Private : public Calendar::CalendarObserver
 {
   public:
+    struct Change
+    {
+      Incidence::Ptr incidence;
+      QString uid;
+      KDateTime recurrenceId;
+      bool deleted;
+    };
+
     Private( const QString &fileName, CalFormat *format )
       : mFileName( fileName ),
-        mSaveFormat( format )
+        mSaveFormat( format ),
+        mJournalEnabled( false ),
+        mCompactionThreshold( 1024 * 1024 ),
+        mSynced( false ),
+        mIgnoreChanges( false )
     {}
     ~Private() { delete mSaveFormat; }
 
+    void calendarIncidenceAdded( const Incidence::Ptr &incidence )
+    {
+      recordChange( incidence, false );
+    }
+
+    void calendarIncidenceChanged( const Incidence::Ptr &incidence )
+    {
+      recordChange( incidence, false );
+    }
+
+    void calendarIncidenceDeleted( const Incidence::Ptr &incidence )
+    {
+      recordChange( incidence, true );
+    }
+
+    void recordChange( const Incidence::Ptr &incidence, bool deleted );
+    void clearChanges();
+    bool journalSupported() const;
+    QByteArray snapshot( const Calendar::Ptr &calendar ) const;
+    bool appendChanges( const Calendar::Ptr &calendar );
+    bool replay( const Calendar::Ptr &calendar, const QString &fileName );
+    bool apply( const Calendar::Ptr &calendar, const QByteArray &operation,
+                const QByteArray &payload );
+    void startCompaction( const Calendar::Ptr &calendar );
+    void waitForCompaction();
+
+    QString compactingFileName() const
+    {
+      return mFileName + QLatin1String( ".journal.compacting" );
+    }
+
     QString mFileName;
     CalFormat *mSaveFormat;
+    bool mJournalEnabled;
+    qint64 mCompactionThreshold;
+    bool mSynced;         // the files hold the calendar apart from mChanges
+    bool mIgnoreChanges;  // set while loading
+    QHash<QString, Change> mChanges;
+    QStringList mChangeOrder;
+    QFuture<bool> mCompaction;
 };
-//@endcond
 
-FileStorage::FileStorage( const Calendar::Ptr &cal, const QString &fileName,
-                          CalFormat *format )
-  : CalStorage( cal ),
-    d( new Private( fileName, format ) )
+void FileStorage::Private::recordChange( const Incidence::Ptr &incidence, bool deleted )
 {
+  if ( mIgnoreChanges || !mSynced ) {
+    return;
+  }
+
+  Change change;
+  change.incidence = deleted ? Incidence::Ptr() : incidence;
+  change.uid = incidence->uid();
+  change.recurrenceId = incidence->recurrenceId();
+  change.deleted = deleted;
+
+  const QString key = journalKey( change.uid, change.recurrenceId );
+  if ( !mChanges.contains( key ) ) {
+    mChangeOrder.append( key );
+  }
+  mChanges.insert( key, change );
 }
 
-FileStorage::~FileStorage()
+void FileStorage::Private::clearChanges()
 {
-  delete d;
+  mChanges.clear();
+  mChangeOrder.clear();
 }
 
-void FileStorage::setFileName( const QString &fileName )
+bool FileStorage::Private::journalSupported() const
 {
-  d->mFileName = fileName;
+  return mJournalEnabled &&
+    ( !mSaveFormat || dynamic_cast<ICalFormat *>( mSaveFormat ) );
 }
 
-QString FileStorage::fileName() const
+QByteArray FileStorage::Private::snapshot( const Calendar::Ptr &calendar ) const
 {
-  return d->mFileName;
+  ICalFormat defaultFormat;
+  ICalFormat *format = mSaveFormat ? static_cast<ICalFormat *>( mSaveFormat ) : &defaultFormat;
+  return format->toString( calendar ).toUtf8();
 }
 
-void FileStorage::setSaveFormat( CalFormat *format )
+bool FileStorage::Private::appendChanges( const Calendar::Ptr &calendar )
 {
-  delete d->mSaveFormat;
-  d->mSaveFormat = format;
+  if ( mChanges.isEmpty() ) {
+    return true;
+  }
+
+  // One record per incidence: a header line with the operation, the size
+  // and a checksum of the payload, then the payload and a newline.
+  QByteArray records;
+  foreach ( const QString &key, mChangeOrder ) {
+    const Change change = mChanges.value( key );
+    QByteArray operation;
+    QByteArray payload;
+    if ( change.deleted ) {
+      operation = "DELETE";
+      payload = change.uid.toUtf8() + '\n' +
+                change.recurrenceId.toString( KDateTime::ISODate ).toLatin1();
+    } else {
+      operation = "ADD";
+      MemoryCalendar::Ptr single( new MemoryCalendar( calendar->timeSpec() ) );
+      single->addIncidence( Incidence::Ptr( change.incidence->clone() ) );
+      payload = snapshot( single );
+    }
+    records += JournalMagic;
+    records += ' ' + operation + ' ' + QByteArray::number( payload.size() ) + ' ' +
+               QByteArray::number( qChecksum( payload.constData(), payload.size() ) ) + '\n';
+    records += payload;
+    records += '\n';
+  }
+
+  QFile journal( mFileName + QLatin1String( ".journal" ) );
+  if ( !journal.open( QIODevice::WriteOnly | QIODevice::Append ) ) {
+    kWarning() << "Cannot open" << journal.fileName() << ":" << journal.errorString();
+    return false;
+  }
+  const qint64 size = journal.size();
+  if ( journal.write( records ) != records.size() || !syncFile( journal ) ) {
+    kWarning() << "Cannot write" << journal.fileName() << ":" << journal.errorString();
+    // Do not leave a partial record in front of the next ones
+    journal.resize( size );
+    return false;
+  }
+
+  clearChanges();
+  return true;
 }
 
-CalFormat *FileStorage::saveFormat() const
+bool FileStorage::Private::replay( const Calendar::Ptr &calendar, const QString &fileName )
 {
-  return d->mSaveFormat;
+  QFile journal( fileName );
+  if ( !journal.exists() ) {
+    return true;
+  }
+  if ( !journal.open( QIODevice::ReadWrite ) ) {
+    kWarning() << "Cannot open" << fileName << ":" << journal.errorString();
+    return false;
+  }
+
+  const QByteArray data = journal.readAll();
+  const QByteArray nextRecord = '\n' + QByteArray( JournalMagic ) + ' ';
+  int pos = 0;
+  while ( pos < data.size() ) {
+    const int newline = data.indexOf( '\n', pos );
+    const QList<QByteArray> header =
+      newline < 0 ? QList<QByteArray>() : data.mid( pos, newline - pos ).split( ' ' );
+    bool ok = header.count() == 4 && header[0] == JournalMagic;
+    const int size = ok ? header[2].toInt( &ok ) : 0;
+    const int end = newline + 1 + size;
+    if ( !ok || size < 0 || end >= data.size() || data[end] != '\n' ) {
+      // Skip a damaged record followed by other ones, only the last one
+      // can be torn
+      const int next = data.indexOf( nextRecord, pos );
+      if ( next < 0 ) {
+        break;
+      }
+      kWarning() << "Skipping damaged journal record at" << pos << "in" << fileName;
+      pos = next + 1;
+      continue;
+    }
+    const QByteArray payload = data.mid( newline + 1, size );
+    if ( qChecksum( payload.constData(), payload.size() ) != header[3].toUShort() ) {
+      kWarning() << "Skipping corrupted journal record at" << pos << "in" << fileName;
+    } else if ( !apply( calendar, header[1], payload ) ) {
+      kWarning() << "Cannot apply journal record" << header[1] << "in" << fileName;
+    }
+    pos = end + 1;
+  }
+
+  if ( pos < data.size() ) {
+    // The end of a record written when the process was interrupted
+    kWarning() << "Discarding incomplete journal record in" << fileName;
+    journal.resize( pos );
+  }
+  return true;
 }
 
-bool FileStorage::open()
+bool FileStorage::Private::apply( const Calendar::Ptr &calendar,
+                                  const QByteArray &operation,
+                                  const QByteArray &payload )
 {
-  return true;
+  if ( operation == "DELETE" ) {
+    const int newline = payload.indexOf( '\n' );
+    const QString uid = QString::fromUtf8( payload.left( newline ) );
+    const KDateTime recurrenceId =
+      KDateTime::fromString( QString::fromLatin1( payload.mid( newline + 1 ) ), KDateTime::ISODate );
+    const Incidence::Ptr incidence = calendar->incidence( uid, recurrenceId );
+    return !incidence || calendar->deleteIncidence( incidence );
+  } else if ( operation == "ADD" ) {
+    MemoryCalendar::Ptr single( new MemoryCalendar( calendar->timeSpec() ) );
+    ICalFormat format;
+    if ( !format.fromRawString( single, payload ) ) {
+      return false;
+    }
+    foreach ( const Incidence::Ptr &incidence, single->rawIncidences() ) {
+      const Incidence::Ptr existing =
+        calendar->incidence( incidence->uid(), incidence->recurrenceId() );
+      if ( existing && existing->type() == incidence->type() ) {
+        // Deleting a recurring incidence would delete its exceptions too
+        static_cast<IncidenceBase &>( *existing ) = *incidence;
+        continue;
+      }
+      if ( existing ) {
+        calendar->deleteIncidence( existing );
+      }
+      calendar->addIncidence( Incidence::Ptr( incidence->clone() ) );
+    }
+    single->close();
+    return true;
+  }
+  return false;
 }
 
-bool FileStorage::load()
+void FileStorage::Private::startCompaction( const Calendar::Ptr &calendar )
 {
-  if ( d->mFileName.isEmpty() ) {
-    kWarning() << "Empty filename while trying to load";
-    return false;
+  waitForCompaction();
+
+  // Later records go to a new journal while the calendar file is written.
+  // The records of a compaction which failed are kept in front of them.
+  const QString journalName = mFileName + QLatin1String( ".journal" );
+  const QString compactingName = compactingFileName();
+  if ( QFile::exists( compactingName ) ) {
+    QFile journal( journalName );
+    QFile compacting( compactingName );
+    if ( !journal.open( QIODevice::ReadOnly ) ||
+         !compacting.open( QIODevice::WriteOnly | QIODevice::Append ) ||
+         compacting.write( journal.readAll() ) != journal.size() ||
+         !syncFile( compacting ) ) {
+      kWarning() << "Cannot merge" << journalName << "into" << compactingName;
+      return;
+    }
+    QFile::remove( journalName );
+  } else if ( !QFile::rename( journalName, compactingName ) ) {
+    kWarning() << "Cannot rename" << journalName;
+    return;
   }
 
+  mCompaction = QtConcurrent::run( writeSnapshot, snapshot( calendar ), mFileName,
+                                   compactingName );
+}
+
+void FileStorage::Private::waitForCompaction()
+{
+  mCompaction.waitForFinished();
+}
+
+// Loads @p fileName with @p format, falling back to iCalendar and vCalendar.
+static bool loadFile( const Calendar::Ptr &calendar, const QString &fileName,
+                      CalFormat *format, QString &productId )
+{
   // Always try to load with iCalendar. It will detect, if it is actually a
   // vCalendar file.
   bool success;
-  QString productId;
   // First try the supplied format. Otherwise fall through to iCalendar, then
   // to vCalendar
-  success = saveFormat() && saveFormat()->load( calendar(), d->mFileName );
+  success = format && format->load( calendar, fileName );
   if ( success ) {
-    productId = saveFormat()->loadedProductId();
+    productId = format->loadedProductId();
   } else {
     ICalFormat iCal;
 
-    success = iCal.load( calendar(), d->mFileName );
+    success = iCal.load( calendar, fileName );
 
     if ( success ) {
       productId = iCal.loadedProductId();
@@ -123,7 +392,7 @@ bool FileStorage::load()
           // Expected non vCalendar file, but detected vCalendar
           kDebug() << "Fallback to VCalFormat";
           VCalFormat vCal;
-          success = vCal.load( calendar(), d->mFileName );
+          success = vCal.load( calendar, fileName );
           productId = vCal.loadedProductId();
         } else {
           return false;
@@ -134,6 +403,132 @@ bool FileStorage::load()
       }
     }
   }
+  return true;
+}
+//@endcond
+
+FileStorage::FileStorage( const Calendar::Ptr &cal, const QString &fileName,
+                          CalFormat *format )
+  : CalStorage( cal ),
+    d( new Private( fileName, format ) )
+{
+}
+
+FileStorage::~FileStorage()
+{
+  d->waitForCompaction();
+  if ( d->mJournalEnabled ) {
+    calendar()->unregisterObserver( d );
+  }
+  delete d;
+}
+
+void FileStorage::setFileName( const QString &fileName )
+{
+  d->waitForCompaction();
+  d->mFileName = fileName;
+  d->mSynced = false;
+  d->clearChanges();
+}
+
+QString FileStorage::fileName() const
+{
+  return d->mFileName;
+}
+
+void FileStorage::setSaveFormat( CalFormat *format )
+{
+  delete d->mSaveFormat;
+  d->mSaveFormat = format;
+}
+
+CalFormat *FileStorage::saveFormat() const
+{
+  return d->mSaveFormat;
+}
+
+void FileStorage::setJournalEnabled( bool enabled )
+{
+  if ( enabled == d->mJournalEnabled ) {
+    return;
+  }
+
+  d->waitForCompaction();
+  d->mJournalEnabled = enabled;
+  d->mSynced = false;
+  d->clearChanges();
+  if ( enabled ) {
+    calendar()->registerObserver( d );
+  } else {
+    calendar()->unregisterObserver( d );
+  }
+}
+
+bool FileStorage::isJournalEnabled() const
+{
+  return d->mJournalEnabled;
+}
+
+QString FileStorage::journalFileName() const
+{
+  return d->mFileName + QLatin1String( ".journal" );
+}
+
+void FileStorage::setCompactionThreshold( qint64 bytes )
+{
+  d->mCompactionThreshold = bytes;
+}
+
+qint64 FileStorage::compactionThreshold() const
+{
+  return d->mCompactionThreshold;
+}
+
+bool FileStorage::compact()
+{
+  if ( d->mFileName.isEmpty() || !d->journalSupported() ) {
+    return false;
+  }
+
+  d->waitForCompaction();
+  if ( !writeSnapshot( d->snapshot( calendar() ), d->mFileName, d->compactingFileName() ) ) {
+    return false;
+  }
+  QFile::remove( journalFileName() );
+  d->clearChanges();
+  d->mSynced = true;
+  calendar()->setModified( false );
+  return true;
+}
+
+bool FileStorage::open()
+{
+  return true;
+}
+
+bool FileStorage::load()
+{
+  if ( d->mFileName.isEmpty() ) {
+    kWarning() << "Empty filename while trying to load";
+    return false;
+  }
+
+  d->waitForCompaction();
+  d->mIgnoreChanges = true;
+  QString productId;
+  bool success = loadFile( calendar(), d->mFileName, saveFormat(), productId );
+  if ( success && d->journalSupported() ) {
+    // Records of an interrupted compaction come before the current ones
+    success = d->replay( calendar(), d->compactingFileName() ) &&
+              d->replay( calendar(), journalFileName() );
+  }
+  d->mIgnoreChanges = false;
+  if ( !success ) {
+    return false;
+  }
+
+  d->clearChanges();
+  d->mSynced = d->journalSupported();
 
   calendar()->setProductId( productId );
   calendar()->setModified( false );
@@ -148,6 +543,20 @@ bool FileStorage::save()
     return false;
   }
 
+  if ( d->journalSupported() ) {
+    if ( !d->mSynced ) {
+      return compact();
+    }
+    if ( !d->appendChanges( calendar() ) ) {
+      return false;
+    }
+    calendar()->setModified( false );
+    if ( QFileInfo( journalFileName() ).size() > d->mCompactionThreshold ) {
+      d->startCompaction( calendar() );
+    }
+    return true;
+  }
+
   CalFormat *format = d->mSaveFormat ? d->mSaveFormat : new ICalFormat;
 
   bool success = format->save( calendar(), d->mFileName );
@@ -171,5 +580,6 @@ bool FileStorage::save()
 
 bool FileStorage::close()
 {
+  d->waitForCompaction();
   return true;
 }
@@ -101,6 +101,66 @@ class KCALCORE_EXPORT FileStorage : public CalStorage
     */
     CalFormat *saveFormat() const;
 
+    /**
+      Enables or disables the journal. With the journal enabled, save()
+      appends the incidences added, changed or deleted since the previous
+      load() or save() to a journal file next to the calendar file, instead
+      of rewriting the whole calendar. load() replays the journal on top of
+      the calendar file. Once the journal grows beyond compactionThreshold(),
+      the calendar file is rewritten in the background and the journal is
+      dropped.
+
+      The journal is only used with the iCalendar format; other save formats
+      always rewrite the whole file.
+
+      @param enabled true to save changes incrementally.
+      @see isJournalEnabled(), journalFileName()
+      @since 4.11
+    */
+    void setJournalEnabled( bool enabled );
+
+    /**
+      Returns true if changes are saved to a journal.
+      @see setJournalEnabled()
+      @since 4.11
+    */
+    bool isJournalEnabled() const;
+
+    /**
+      Returns the name of the journal file, derived from fileName().
+      @see setJournalEnabled()
+      @since 4.11
+    */
+    QString journalFileName() const;
+
+    /**
+      Sets the size of the journal, in bytes, above which save() rewrites the
+      calendar file and drops the journal. The default is 1 MiB.
+
+      @param bytes is the journal size triggering a compaction.
+      @see compactionThreshold(), compact()
+      @since 4.11
+    */
+    void setCompactionThreshold( qint64 bytes );
+
+    /**
+      Returns the size of the journal above which it is compacted.
+      @see setCompactionThreshold()
+      @since 4.11
+    */
+    qint64 compactionThreshold() const;
+
+    /**
+      Rewrites the calendar file with the current content of the calendar
+      and drops the journal, whatever its size.
+
+      @return true if the calendar file was written, false otherwise or if
+      the journal is not in use.
+      @see setCompactionThreshold()
+      @since 4.11
+    */
+    bool compact();
+
     /**
       @copydoc CalStorage::open()
     */
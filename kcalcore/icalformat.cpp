@@ -32,12 +32,17 @@
 #include "icalformat_p.h"
 #include "icaltimezones.h"
 #include "freebusy.h"
+#include "instrumentation.h"
 #include "memorycalendar.h"
+#include "parallel_p.h"
 
 #include <KDebug>
 #include <KSaveFile>
 
 #include <QtCore/QFile>
+#include <QtCore/QTextStream>
+
+#include <string.h>
 
 extern "C" {
   #include <libical/ical.h>
@@ -50,6 +55,103 @@ extern "C" {
 using namespace KCalCore;
 
 //@cond PRIVATE
+static inline bool isAsciiSpace( char c )
+{
+  return c == ' ' || ( c >= '\t' && c <= '\r' );
+}
+
+// Returns true if @p data can be passed to the parser as is: UTF-8 without
+// invalid, overlong or surrogate sequences, and no UTF-16 byte order mark.
+static bool isPlainUtf8( const char *data, qint64 size )
+{
+  const uchar *pos = reinterpret_cast<const uchar *>( data );
+  const uchar *end = pos + size;
+  if ( size >= 2 && ( ( pos[0] == 0xFF && pos[1] == 0xFE ) ||
+                      ( pos[0] == 0xFE && pos[1] == 0xFF ) ) ) {
+    return false;
+  }
+
+  while ( pos < end ) {
+    const uchar c = *pos++;
+    if ( c < 0x80 ) {
+      continue;
+    }
+
+    int extra;
+    uint min;
+    uint code;
+    if ( ( c & 0xE0 ) == 0xC0 ) {
+      extra = 1;
+      min = 0x80;
+      code = c & 0x1F;
+    } else if ( ( c & 0xF0 ) == 0xE0 ) {
+      extra = 2;
+      min = 0x800;
+      code = c & 0x0F;
+    } else if ( ( c & 0xF8 ) == 0xF0 ) {
+      extra = 3;
+      min = 0x10000;
+      code = c & 0x07;
+    } else {
+      return false;
+    }
+    if ( end - pos < extra ) {
+      return false;
+    }
+    for ( ; extra > 0; --extra ) {
+      if ( ( *pos & 0xC0 ) != 0x80 ) {
+        return false;
+      }
+      code = ( code << 6 ) | ( *pos++ & 0x3F );
+    }
+    if ( code < min || code > 0x10FFFF || ( code >= 0xD800 && code <= 0xDFFF ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Line generator for icalparser over a buffer which, unlike the one used by
+// icalparser_parse_string(), needs no terminating null character.
+struct LineReader
+{
+  const char *pos;
+  const char *end;
+};
+
+static char *readLine( char *line, size_t size, void *data )
+{
+  LineReader *reader = static_cast<LineReader *>( data );
+  if ( reader->pos >= reader->end || size < 2 ) {
+    return 0;
+  }
+
+  size_t length = qMin( size_t( reader->end - reader->pos ), size - 1 );
+  const char *newline = static_cast<const char *>( memchr( reader->pos, '\n', length ) );
+  if ( newline ) {
+    length = newline - reader->pos + 1;
+  }
+  memcpy( line, reader->pos, length );
+  line[length] = '\0';
+  reader->pos += length;
+  return line;
+}
+
+static icalcomponent *parseBuffer( const char *data, qint64 size )
+{
+  LineReader reader = { data, data + size };
+  icalparser *parser = icalparser_new();
+  icalparser_set_gen_data( parser, &reader );
+
+  const icalerrorstate state = icalerror_get_error_state( ICAL_MALFORMEDDATA_ERROR );
+  icalerror_set_error_state( ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL );
+  icalcomponent *component = icalparser_parse( parser, readLine );
+  icalerror_set_error_state( ICAL_MALFORMEDDATA_ERROR, state );
+
+  icalparser_free( parser );
+  return component;
+}
+
 class KCalCore::ICalFormat::Private
 {
   public:
@@ -86,21 +188,54 @@ bool ICalFormat::load( const Calendar::Ptr &calendar, const QString &fileName )
     setException( new Exception( Exception::LoadError ) );
     return false;
   }
-  QTextStream ts( &file );
-  ts.setCodec( "UTF-8" );
-  QByteArray text = ts.readAll().trimmed().toUtf8();
-  file.close();
 
-  if ( text.isEmpty() ) {
+  // Calendar files are UTF-8 already, so map them and hand the data to the
+  // parser as is instead of decoding and encoding the whole file again.
+  QByteArray buffer;
+  const char *data = 0;
+  qint64 size = file.size();
+  if ( size > 0 ) {
+    data = reinterpret_cast<const char *>( file.map( 0, size ) );
+  }
+  if ( !data ) {
+    // Not mappable, e.g. a pipe or a file on a special file system
+    buffer = file.readAll();
+    data = buffer.constData();
+    size = buffer.size();
+  }
+
+  if ( !isPlainUtf8( data, size ) ) {
+    // Let QTextStream detect the encoding and replace invalid sequences
+    QTextStream ts( QByteArray::fromRawData( data, size ) );
+    ts.setCodec( "UTF-8" );
+    const QByteArray text = ts.readAll().trimmed().toUtf8();
+    // empty files are valid
+    return text.isEmpty() || fromRawString( calendar, text, false, fileName );
+  }
+
+  if ( size >= 3 && memcmp( data, "\xEF\xBB\xBF", 3 ) == 0 ) {
+    data += 3;
+    size -= 3;
+  }
+  while ( size > 0 && isAsciiSpace( data[0] ) ) {
+    ++data;
+    --size;
+  }
+  while ( size > 0 && isAsciiSpace( data[size - 1] ) ) {
+    --size;
+  }
+
+  if ( size == 0 ) {
     // empty files are valid
     return true;
   } else {
-    return fromRawString( calendar, text, false, fileName );
+    return fromRawString( calendar, QByteArray::fromRawData( data, size ), false, fileName );
   }
 }
 
 bool ICalFormat::save( const Calendar::Ptr &calendar, const QString &fileName )
 {
+  Instrumentation::Scope scope( Instrumentation::Save );
   kDebug() << fileName;
 
   clearException();
@@ -151,8 +286,10 @@ bool ICalFormat::fromRawString( const Calendar::Ptr &cal, const QByteArray &stri
   // TODO: Handle more than one VCALENDAR or non-VCALENDAR top components
   icalcomponent *calendar;
 
-  // Let's defend const correctness until the very gates of hell^Wlibical
-  calendar = icalcomponent_new_from_string( const_cast<char*>( ( const char * )string ) );
+  {
+    Instrumentation::Scope scope( Instrumentation::Parse );
+    calendar = parseBuffer( string.constData(), string.size() );
+  }
   if ( !calendar ) {
     kError() << "parse error ; string is empty?" << string.isEmpty();
     setException( new Exception( Exception::ParseErrorIcal ) );
@@ -273,9 +410,49 @@ QString ICalFormat::toString( const Calendar::Ptr &cal,
     }
   }
 
+  // deleted incidences only recorded by a tombstone, written with just
+  // what identifies them
+  bool tombstones = false;
+  const MemoryCalendar::Ptr memoryCal = cal.dynamicCast<MemoryCalendar>();
+  if ( deleted && memoryCal ) {
+    foreach ( const MemoryCalendar::Tombstone &tombstone, memoryCal->tombstones() ) {
+      if ( cal->deleted( tombstone.uid, tombstone.recurrenceId ) ||
+           cal->incidence( tombstone.uid, tombstone.recurrenceId ) ) {
+        continue;
+      }
+      if ( !notebook.isEmpty() &&
+           ( tombstone.notebook.isEmpty() || !notebook.endsWith( tombstone.notebook ) ) ) {
+        continue;
+      }
+      Incidence::Ptr stub;
+      switch ( tombstone.type ) {
+      case Incidence::TypeEvent:
+        stub = Event::Ptr( new Event() );
+        break;
+      case Incidence::TypeTodo:
+        stub = Todo::Ptr( new Todo() );
+        break;
+      case Incidence::TypeJournal:
+        stub = Journal::Ptr( new Journal() );
+        break;
+      default:
+        continue;
+      }
+      stub->setUid( tombstone.uid );
+      if ( !tombstone.recurrenceId.isNull() ) {
+        stub->setRecurrenceId( tombstone.recurrenceId );
+      }
+      stub->setRevision( tombstone.revision );
+      stub->setLastModified( tombstone.deleted );
+      component = d->mImpl->writeIncidence( stub, iTIPRequest, tzlist, &tzUsedList );
+      icalcomponent_add_component( calendar, component );
+      tombstones = true;
+    }
+  }
+
   // time zones
   ICalTimeZones::ZoneMap zones = tzUsedList.zones();
-  if ( todoList.isEmpty() && events.isEmpty() && journals.isEmpty() ) {
+  if ( todoList.isEmpty() && events.isEmpty() && journals.isEmpty() && !tombstones ) {
     // no incidences means no used timezones, use all timezones
     // this will export a calendar having only timezone definitions
     zones = tzlist->zones();
@@ -348,6 +525,444 @@ QByteArray ICalFormat::toRawString( const Incidence::Ptr &incidence )
   return text;
 }
 
+//@cond PRIVATE
+// The fields a delta can hold, in the order they are applied. The names
+// list the changed fields in the X-KCALCORE-DELTA property of a delta.
+struct DeltaField
+{
+  IncidenceBase::Field field;
+  const char *name;
+};
+
+static const DeltaField deltaFields[] = {
+  { IncidenceBase::FieldUid, "UID" },
+  { IncidenceBase::FieldSchedulingId, "X-KDE-LIBKCAL-ID" },
+  { IncidenceBase::FieldRecurrenceId, "RECURRENCE-ID" },
+  { IncidenceBase::FieldDtStart, "DTSTART" },
+  { IncidenceBase::FieldDtEnd, "DTEND" },
+  { IncidenceBase::FieldDuration, "DURATION" },
+  { IncidenceBase::FieldDtDue, "DUE" },
+  { IncidenceBase::FieldRecurrence, "RRULE" },
+  { IncidenceBase::FieldCompleted, "COMPLETED" },
+  { IncidenceBase::FieldPercentComplete, "PERCENT-COMPLETE" },
+  { IncidenceBase::FieldDescription, "DESCRIPTION" },
+  { IncidenceBase::FieldSummary, "SUMMARY" },
+  { IncidenceBase::FieldLocation, "LOCATION" },
+  { IncidenceBase::FieldCategories, "CATEGORIES" },
+  { IncidenceBase::FieldRelatedTo, "RELATED-TO" },
+  { IncidenceBase::FieldAttachment, "ATTACH" },
+  { IncidenceBase::FieldSecrecy, "CLASS" },
+  { IncidenceBase::FieldStatus, "STATUS" },
+  { IncidenceBase::FieldTransparency, "TRANSP" },
+  { IncidenceBase::FieldResources, "RESOURCES" },
+  { IncidenceBase::FieldPriority, "PRIORITY" },
+  { IncidenceBase::FieldGeoLatitude, "GEO-LATITUDE" },
+  { IncidenceBase::FieldGeoLongitude, "GEO-LONGITUDE" },
+  { IncidenceBase::FieldAlarms, "VALARM" },
+  { IncidenceBase::FieldAttendees, "ATTENDEE" },
+  { IncidenceBase::FieldOrganizer, "ORGANIZER" },
+  { IncidenceBase::FieldContact, "CONTACT" },
+  { IncidenceBase::FieldComment, "COMMENT" },
+  { IncidenceBase::FieldCreated, "CREATED" },
+  { IncidenceBase::FieldRevision, "SEQUENCE" },
+  { IncidenceBase::FieldLastModified, "LAST-MODIFIED" }
+};
+
+static const int deltaFieldCount = sizeof( deltaFields ) / sizeof( deltaFields[0] );
+
+// Returns true if property @p p belongs in a delta of @p fields.
+static bool isDeltaProperty( icalproperty *p, const QSet<IncidenceBase::Field> &fields )
+{
+  switch ( icalproperty_isa( p ) ) {
+  case ICAL_UID_PROPERTY:
+  case ICAL_RECURRENCEID_PROPERTY:
+    // identify the incidence
+    return true;
+  case ICAL_X_PROPERTY:
+    // the real UID, when it differs from the scheduling ID
+    return qstrcmp( icalproperty_get_x_name( p ), "X-KDE-LIBKCAL-ID" ) == 0;
+  case ICAL_DTSTART_PROPERTY:
+    // recurrence rules are read relative to the start
+    return fields.contains( IncidenceBase::FieldDtStart ) ||
+           fields.contains( IncidenceBase::FieldRecurrence );
+  case ICAL_DTEND_PROPERTY:
+    return fields.contains( IncidenceBase::FieldDtEnd );
+  case ICAL_DURATION_PROPERTY:
+    return fields.contains( IncidenceBase::FieldDuration );
+  case ICAL_DUE_PROPERTY:
+    return fields.contains( IncidenceBase::FieldDtDue );
+  case ICAL_RRULE_PROPERTY:
+  case ICAL_EXRULE_PROPERTY:
+  case ICAL_RDATE_PROPERTY:
+  case ICAL_EXDATE_PROPERTY:
+    return fields.contains( IncidenceBase::FieldRecurrence );
+  case ICAL_COMPLETED_PROPERTY:
+    return fields.contains( IncidenceBase::FieldCompleted );
+  case ICAL_PERCENTCOMPLETE_PROPERTY:
+    return fields.contains( IncidenceBase::FieldPercentComplete );
+  case ICAL_DESCRIPTION_PROPERTY:
+    return fields.contains( IncidenceBase::FieldDescription );
+  case ICAL_SUMMARY_PROPERTY:
+    return fields.contains( IncidenceBase::FieldSummary );
+  case ICAL_LOCATION_PROPERTY:
+    return fields.contains( IncidenceBase::FieldLocation );
+  case ICAL_CATEGORIES_PROPERTY:
+    return fields.contains( IncidenceBase::FieldCategories );
+  case ICAL_RELATEDTO_PROPERTY:
+    return fields.contains( IncidenceBase::FieldRelatedTo );
+  case ICAL_ATTACH_PROPERTY:
+    return fields.contains( IncidenceBase::FieldAttachment );
+  case ICAL_CLASS_PROPERTY:
+    return fields.contains( IncidenceBase::FieldSecrecy );
+  case ICAL_STATUS_PROPERTY:
+    return fields.contains( IncidenceBase::FieldStatus );
+  case ICAL_TRANSP_PROPERTY:
+    return fields.contains( IncidenceBase::FieldTransparency );
+  case ICAL_RESOURCES_PROPERTY:
+    return fields.contains( IncidenceBase::FieldResources );
+  case ICAL_PRIORITY_PROPERTY:
+    return fields.contains( IncidenceBase::FieldPriority );
+  case ICAL_GEO_PROPERTY:
+    return fields.contains( IncidenceBase::FieldGeoLatitude ) ||
+           fields.contains( IncidenceBase::FieldGeoLongitude );
+  case ICAL_ATTENDEE_PROPERTY:
+    return fields.contains( IncidenceBase::FieldAttendees );
+  case ICAL_ORGANIZER_PROPERTY:
+    return fields.contains( IncidenceBase::FieldOrganizer );
+  case ICAL_CONTACT_PROPERTY:
+    return fields.contains( IncidenceBase::FieldContact );
+  case ICAL_COMMENT_PROPERTY:
+    return fields.contains( IncidenceBase::FieldComment );
+  case ICAL_CREATED_PROPERTY:
+    return fields.contains( IncidenceBase::FieldCreated );
+  case ICAL_SEQUENCE_PROPERTY:
+    return fields.contains( IncidenceBase::FieldRevision );
+  case ICAL_LASTMODIFIED_PROPERTY:
+    return fields.contains( IncidenceBase::FieldLastModified );
+  default:
+    return false;
+  }
+}
+
+// Copies @p field from @p source to @p target, which have the same type.
+static void copyField( const Incidence::Ptr &target, const Incidence::Ptr &source,
+                       IncidenceBase::Field field )
+{
+  const bool isEvent = target->type() == IncidenceBase::TypeEvent;
+  const bool isTodo = target->type() == IncidenceBase::TypeTodo;
+
+  switch ( field ) {
+  case IncidenceBase::FieldUid:
+    target->setUid( source->uid() );
+    break;
+  case IncidenceBase::FieldSchedulingId:
+    target->setSchedulingID( source->schedulingID() );
+    break;
+  case IncidenceBase::FieldRecurrenceId:
+    target->setRecurrenceId( source->recurrenceId() );
+    break;
+  case IncidenceBase::FieldDtStart:
+    target->setAllDay( source->allDay() );
+    target->setDtStart( source->dtStart() );
+    if ( isTodo ) {
+      target.staticCast<Todo>()->setHasStartDate( source.staticCast<Todo>()->hasStartDate() );
+    }
+    break;
+  case IncidenceBase::FieldDtEnd:
+    if ( isEvent ) {
+      const Event::Ptr event = source.staticCast<Event>();
+      target.staticCast<Event>()->setDtEnd( event->hasEndDate() ? event->dtEnd() : KDateTime() );
+      target.staticCast<Event>()->setHasEndDate( event->hasEndDate() );
+    }
+    break;
+  case IncidenceBase::FieldDuration:
+    if ( source->hasDuration() ) {
+      target->setDuration( source->duration() );
+    } else {
+      target->setHasDuration( false );
+    }
+    break;
+  case IncidenceBase::FieldDtDue:
+    if ( isTodo ) {
+      const Todo::Ptr todo = source.staticCast<Todo>();
+      target.staticCast<Todo>()->setDtDue( todo->dtDue( true ), true );
+      target.staticCast<Todo>()->setHasDueDate( todo->hasDueDate() );
+    }
+    break;
+  case IncidenceBase::FieldRecurrence:
+  {
+    target->clearRecurrence();
+    if ( source->recurs() ) {
+      const Recurrence *from = source->recurrence();
+      Recurrence *to = target->recurrence();
+      to->setStartDateTime( target->dtStart() );
+      to->setAllDay( target->allDay() );
+      foreach ( RecurrenceRule *rule, from->rRules() ) {
+        to->addRRule( new RecurrenceRule( *rule ) );
+      }
+      foreach ( RecurrenceRule *rule, from->exRules() ) {
+        to->addExRule( new RecurrenceRule( *rule ) );
+      }
+      to->setRDateTimes( from->rDateTimes() );
+      to->setRDates( from->rDates() );
+      to->setExDateTimes( from->exDateTimes() );
+      to->setExDates( from->exDates() );
+    }
+    break;
+  }
+  case IncidenceBase::FieldCompleted:
+    if ( isTodo ) {
+      const Todo::Ptr todo = source.staticCast<Todo>();
+      if ( todo->hasCompletedDate() ) {
+        target.staticCast<Todo>()->setCompleted( todo->completed() );
+      } else {
+        target.staticCast<Todo>()->setCompleted( todo->isCompleted() );
+      }
+    }
+    break;
+  case IncidenceBase::FieldPercentComplete:
+    if ( isTodo ) {
+      target.staticCast<Todo>()->setPercentComplete(
+        source.staticCast<Todo>()->percentComplete() );
+    }
+    break;
+  case IncidenceBase::FieldDescription:
+    target->setDescription( source->description(), source->descriptionIsRich() );
+    break;
+  case IncidenceBase::FieldSummary:
+    target->setSummary( source->summary(), source->summaryIsRich() );
+    break;
+  case IncidenceBase::FieldLocation:
+    target->setLocation( source->location(), source->locationIsRich() );
+    break;
+  case IncidenceBase::FieldCategories:
+    target->setCategories( source->categories() );
+    break;
+  case IncidenceBase::FieldRelatedTo:
+    target->setRelatedTo( source->relatedTo( Incidence::RelTypeParent ), Incidence::RelTypeParent );
+    target->setRelatedTo( source->relatedTo( Incidence::RelTypeChild ), Incidence::RelTypeChild );
+    target->setRelatedTo( source->relatedTo( Incidence::RelTypeSibling ),
+                          Incidence::RelTypeSibling );
+    break;
+  case IncidenceBase::FieldAttachment:
+    target->clearAttachments();
+    foreach ( const Attachment::Ptr &attachment, source->attachments() ) {
+      target->addAttachment( Attachment::Ptr( new Attachment( *attachment ) ) );
+    }
+    break;
+  case IncidenceBase::FieldSecrecy:
+    target->setSecrecy( source->secrecy() );
+    break;
+  case IncidenceBase::FieldStatus:
+    if ( source->status() == Incidence::StatusX ) {
+      target->setCustomStatus( source->customStatus() );
+    } else {
+      target->setStatus( source->status() );
+    }
+    break;
+  case IncidenceBase::FieldTransparency:
+    if ( isEvent ) {
+      target.staticCast<Event>()->setTransparency( source.staticCast<Event>()->transparency() );
+    }
+    break;
+  case IncidenceBase::FieldResources:
+    target->setResources( source->resources() );
+    break;
+  case IncidenceBase::FieldPriority:
+    target->setPriority( source->priority() );
+    break;
+  case IncidenceBase::FieldGeoLatitude:
+    target->setHasGeo( source->hasGeo() );
+    target->setGeoLatitude( source->geoLatitude() );
+    break;
+  case IncidenceBase::FieldGeoLongitude:
+    target->setHasGeo( source->hasGeo() );
+    target->setGeoLongitude( source->geoLongitude() );
+    break;
+  case IncidenceBase::FieldAlarms:
+    target->clearAlarms();
+    foreach ( const Alarm::Ptr &alarm, source->alarms() ) {
+      Alarm::Ptr copy( new Alarm( *alarm ) );
+      copy->setParent( target.data() );
+      target->addAlarm( copy );
+    }
+    break;
+  case IncidenceBase::FieldAttendees:
+    target->clearAttendees();
+    foreach ( const Attendee::Ptr &attendee, source->attendees() ) {
+      target->addAttendee( Attendee::Ptr( new Attendee( *attendee ) ) );
+    }
+    break;
+  case IncidenceBase::FieldOrganizer:
+    target->setOrganizer( Person::Ptr( new Person( *source->organizer() ) ) );
+    break;
+  case IncidenceBase::FieldContact:
+    target->clearContacts();
+    foreach ( const QString &contact, source->contacts() ) {
+      target->addContact( contact );
+    }
+    break;
+  case IncidenceBase::FieldComment:
+    target->clearComments();
+    foreach ( const QString &comment, source->comments() ) {
+      target->addComment( comment );
+    }
+    break;
+  case IncidenceBase::FieldCreated:
+    target->setCreated( source->created() );
+    break;
+  case IncidenceBase::FieldRevision:
+    target->setRevision( source->revision() );
+    break;
+  case IncidenceBase::FieldLastModified:
+    target->setLastModified( source->lastModified() );
+    break;
+  default:
+    break;
+  }
+}
+//@endcond
+
+QByteArray ICalFormat::toRawDelta( const Incidence::Ptr &incidence )
+{
+  return toRawDelta( incidence, incidence->dirtyFields() );
+}
+
+QByteArray ICalFormat::toRawDelta( const Incidence::Ptr &incidence,
+                                   const QSet<IncidenceBase::Field> &fields )
+{
+  if ( fields.isEmpty() ) {
+    return QByteArray();
+  }
+
+  ICalTimeZones tzlist;
+  ICalTimeZones tzUsedList;
+  icalcomponent *component;
+  switch ( incidence->type() ) {
+  case IncidenceBase::TypeEvent:
+    component = d->mImpl->writeEvent( incidence.staticCast<Event>(), &tzlist, &tzUsedList );
+    break;
+  case IncidenceBase::TypeTodo:
+    component = d->mImpl->writeTodo( incidence.staticCast<Todo>(), &tzlist, &tzUsedList );
+    break;
+  case IncidenceBase::TypeJournal:
+    component = d->mImpl->writeJournal( incidence.staticCast<Journal>(), &tzlist, &tzUsedList );
+    break;
+  default:
+    return QByteArray();
+  }
+
+  // Drop the properties of the fields which did not change, and note the
+  // time zones the others refer to
+  const bool all = fields.contains( IncidenceBase::FieldUnknown );
+  QList<icalproperty *> unchanged;
+  QSet<QString> tzids;
+  for ( icalproperty *p = icalcomponent_get_first_property( component, ICAL_ANY_PROPERTY );
+        p; p = icalcomponent_get_next_property( component, ICAL_ANY_PROPERTY ) ) {
+    if ( !all && !isDeltaProperty( p, fields ) ) {
+      unchanged.append( p );
+    } else {
+      icalparameter *tzid = icalproperty_get_first_parameter( p, ICAL_TZID_PARAMETER );
+      if ( tzid ) {
+        tzids.insert( QString::fromUtf8( icalparameter_get_tzid( tzid ) ) );
+      }
+    }
+  }
+  foreach ( icalproperty *p, unchanged ) {
+    icalcomponent_remove_property( component, p );
+    icalproperty_free( p );
+  }
+  if ( !all && !fields.contains( IncidenceBase::FieldAlarms ) ) {
+    icalcomponent *alarm;
+    while ( ( alarm = icalcomponent_get_first_component( component, ICAL_VALARM_COMPONENT ) ) ) {
+      icalcomponent_remove_component( component, alarm );
+      icalcomponent_free( alarm );
+    }
+  }
+
+  QStringList names;
+  for ( int i = 0; i < deltaFieldCount; ++i ) {
+    if ( all || fields.contains( deltaFields[i].field ) ) {
+      names.append( QLatin1String( deltaFields[i].name ) );
+    }
+  }
+  icalproperty *list = icalproperty_new_x( names.join( QLatin1String( "," ) ).toUtf8() );
+  icalproperty_set_x_name( list, "X-KCALCORE-DELTA" );
+  icalcomponent_add_property( component, list );
+
+  icalcomponent *calendar = d->mImpl->createCalendarComponent();
+  icalcomponent_add_component( calendar, component );
+
+  ICalTimeZones::ZoneMap zones = tzUsedList.zones();
+  for ( ICalTimeZones::ZoneMap::ConstIterator it = zones.constBegin();
+        it != zones.constEnd(); ++it ) {
+    if ( !tzids.contains( it.key() ) ) {
+      continue;
+    }
+    icaltimezone *tz = ( *it ).icalTimezone();
+    if ( !tz ) {
+      kError() << "bad time zone";
+    } else {
+      icalcomponent_add_component( calendar,
+                                   icalcomponent_new_clone( icaltimezone_get_component( tz ) ) );
+      icaltimezone_free( tz, 1 );
+    }
+  }
+
+  char *const text = icalcomponent_as_ical_string_r( calendar );
+  const QByteArray delta( text );
+  free( text );
+  icalcomponent_free( calendar );
+
+  return delta;
+}
+
+bool ICalFormat::applyDelta( const Incidence::Ptr &incidence, const QByteArray &delta )
+{
+  clearException();
+
+  MemoryCalendar::Ptr cal( new MemoryCalendar( d->mTimeSpec ) );
+  if ( !fromRawString( cal, delta ) ) {
+    return false;
+  }
+
+  const Incidence::List incidences = cal->rawIncidences();
+  if ( incidences.count() != 1 || incidences.first()->type() != incidence->type() ) {
+    kWarning() << "Delta does not hold a single incidence of the expected type";
+    cal->close();
+    return false;
+  }
+  const Incidence::Ptr source = incidences.first();
+
+  const QStringList names =
+    source->nonKDECustomProperty( "X-KCALCORE-DELTA" ).split( QLatin1Char( ',' ) );
+  QSet<IncidenceBase::Field> fields;
+  for ( int i = 0; i < deltaFieldCount; ++i ) {
+    if ( names.contains( QLatin1String( deltaFields[i].name ) ) ) {
+      fields.insert( deltaFields[i].field );
+    }
+  }
+
+  if ( ( !fields.contains( IncidenceBase::FieldUid ) && source->uid() != incidence->uid() ) ||
+       ( !fields.contains( IncidenceBase::FieldRecurrenceId ) &&
+         source->recurrenceId() != incidence->recurrenceId() ) ) {
+    kWarning() << "Delta for" << source->uid() << "applied to" << incidence->uid();
+    cal->close();
+    return false;
+  }
+
+  incidence->startUpdates();
+  for ( int i = 0; i < deltaFieldCount; ++i ) {
+    if ( fields.contains( deltaFields[i].field ) ) {
+      copyField( incidence, source, deltaFields[i].field );
+    }
+  }
+  incidence->endUpdates();
+
+  cal->close();
+  return true;
+}
+
 QString ICalFormat::toString( RecurrenceRule *recurrence )
 {
   icalproperty *property;
@@ -460,80 +1075,55 @@ FreeBusy::Ptr ICalFormat::parseFreeBusy( const QString &str )
   return freeBusy;
 }
 
-ScheduleMessage::Ptr ICalFormat::parseScheduleMessage( const Calendar::Ptr &cal,
-                                                       const QString &messageText )
+//@cond PRIVATE
+// Reads the incidence and the method of a scheduling message, with the time
+// zones of @p tzlist. Only touches the message and @p impl.
+static bool readScheduleMessage( ICalFormatImpl *impl, icalcomponent *message,
+                                 ICalTimeZones *tzlist, IncidenceBase::Ptr &incidence,
+                                 iTIPMethod &method, Exception::ErrorCode &error )
 {
-  setTimeSpec( cal->timeSpec() );
-  clearException();
-
-  if ( messageText.isEmpty() ) {
-    setException(
-      new Exception( Exception::ParseErrorEmptyMessage ) );
-    return ScheduleMessage::Ptr();
-  }
-
-  icalcomponent *message;
-  message = icalparser_parse_string( messageText.toUtf8() );
-
-  if ( !message ) {
-    setException(
-      new Exception( Exception::ParseErrorUnableToParse ) );
-
-    return ScheduleMessage::Ptr();
-  }
-
   icalproperty *m =
     icalcomponent_get_first_property( message, ICAL_METHOD_PROPERTY );
   if ( !m ) {
-    setException(
-      new Exception( Exception::ParseErrorMethodProperty ) );
-
-    return ScheduleMessage::Ptr();
+    error = Exception::ParseErrorMethodProperty;
+    return false;
   }
 
-  // Populate the message's time zone collection with all VTIMEZONE components
-  ICalTimeZones tzlist;
-  ICalTimeZoneSource tzs;
-  tzs.parse( message, tzlist );
-
   icalcomponent *c;
 
-  IncidenceBase::Ptr incidence;
   c = icalcomponent_get_first_component( message, ICAL_VEVENT_COMPONENT );
   if ( c ) {
-    incidence = d->mImpl->readEvent( c, &tzlist ).staticCast<IncidenceBase>();
+    incidence = impl->readEvent( c, tzlist ).staticCast<IncidenceBase>();
   }
 
   if ( !incidence ) {
     c = icalcomponent_get_first_component( message, ICAL_VTODO_COMPONENT );
     if ( c ) {
-      incidence = d->mImpl->readTodo( c, &tzlist ).staticCast<IncidenceBase>();
+      incidence = impl->readTodo( c, tzlist ).staticCast<IncidenceBase>();
     }
   }
 
   if ( !incidence ) {
     c = icalcomponent_get_first_component( message, ICAL_VJOURNAL_COMPONENT );
     if ( c ) {
-      incidence = d->mImpl->readJournal( c, &tzlist ).staticCast<IncidenceBase>();
+      incidence = impl->readJournal( c, tzlist ).staticCast<IncidenceBase>();
     }
   }
 
   if ( !incidence ) {
     c = icalcomponent_get_first_component( message, ICAL_VFREEBUSY_COMPONENT );
     if ( c ) {
-      incidence = d->mImpl->readFreeBusy( c ).staticCast<IncidenceBase>();
+      incidence = impl->readFreeBusy( c ).staticCast<IncidenceBase>();
     }
   }
 
   if ( !incidence ) {
     kDebug() << "object is not a freebusy, event, todo or journal";
-    setException( new Exception( Exception::ParseErrorNotIncidence ) );
-
-    return ScheduleMessage::Ptr();
+    error = Exception::ParseErrorNotIncidence;
+    return false;
   }
 
   icalproperty_method icalmethod = icalproperty_get_method( m );
-  iTIPMethod method;
 
   switch ( icalmethod ) {
   case ICAL_METHOD_PUBLISH:
@@ -570,31 +1160,39 @@ ScheduleMessage::Ptr ICalFormat::parseScheduleMessage( const Calendar::Ptr &cal,
     kWarning() << endl
                << "kcalcore library reported a problem while parsing:";
     kWarning() << ScheduleMessage::methodName( method ) << ":"  //krazy:exclude=kdebug
-               << d->mImpl->extractErrorProperty( c );
+               << impl->extractErrorProperty( c );
   }
 
+  return true;
+}
+
+// Compares a scheduling message with the incidence it refers to in the
+// calendar.
+static ScheduleMessage::Status classifyScheduleMessage( ICalFormatImpl *impl,
+                                                        const Calendar::Ptr &cal,
+                                                        icalcomponent *message,
+                                                        const IncidenceBase::Ptr &incidence )
+{
   Incidence::Ptr existingIncidence = cal->incidence( incidence->uid() );
 
   icalcomponent *calendarComponent = 0;
   if ( existingIncidence ) {
-    calendarComponent = d->mImpl->createCalendarComponent( cal );
+    calendarComponent = impl->createCalendarComponent( cal );
 
     // TODO: check, if cast is required, or if it can be done by virtual funcs.
     // TODO: Use a visitor for this!
     if ( existingIncidence->type() == Incidence::TypeTodo ) {
       Todo::Ptr todo = existingIncidence.staticCast<Todo>();
       icalcomponent_add_component( calendarComponent,
-                                   d->mImpl->writeTodo( todo ) );
+                                   impl->writeTodo( todo ) );
     }
     if ( existingIncidence->type() == Incidence::TypeEvent ) {
       Event::Ptr event = existingIncidence.staticCast<Event>();
       icalcomponent_add_component( calendarComponent,
-                                   d->mImpl->writeEvent( event ) );
+                                   impl->writeEvent( event ) );
     }
   } else {
-    icalcomponent_free( message );
-    return ScheduleMessage::Ptr( new ScheduleMessage( incidence, method,
-                                                      ScheduleMessage::Unknown ) );
+    return ScheduleMessage::Unknown;
   }
 
   icalproperty_xlicclass result =
@@ -624,12 +1222,168 @@ ScheduleMessage::Ptr ICalFormat::parseScheduleMessage( const Calendar::Ptr &cal,
     break;
   }
 
-  icalcomponent_free( message );
   icalcomponent_free( calendarComponent );
 
+  return status;
+}
+
+// Returns the VTIMEZONE components of an iCalendar text, as they appear in
+// the text.
+static QByteArray timeZoneBlocks( const QByteArray &text )
+{
+  static const QByteArray begin( "BEGIN:VTIMEZONE" );
+  static const QByteArray end( "END:VTIMEZONE" );
+  QByteArray blocks;
+  const QByteArray upper = text.toUpper();
+  int from = 0;
+  int pos;
+  while ( ( pos = upper.indexOf( begin, from ) ) >= 0 ) {
+    int last = upper.indexOf( end, pos );
+    if ( last < 0 ) {
+      break;
+    }
+    last = text.indexOf( '\n', last );
+    from = last < 0 ? text.size() : last + 1;
+    blocks += text.mid( pos, from - pos );
+    if ( last < 0 ) {
+      blocks += "\r\n";
+    }
+  }
+  return blocks;
+}
+
+// A scheduling message of a batch, once parsed.
+struct ParsedScheduleMessage
+{
+  ParsedScheduleMessage() : message( 0 ), method( iTIPNoMethod ),
+                            error( Exception::ParseErrorUnableToParse ) {}
+
+  icalcomponent *message;
+  IncidenceBase::Ptr incidence;
+  iTIPMethod method;
+  Exception::ErrorCode error;    // set when incidence is null
+};
+//@endcond
+
+ScheduleMessage::Ptr ICalFormat::parseScheduleMessage( const Calendar::Ptr &cal,
+                                                       const QString &messageText )
+{
+  setTimeSpec( cal->timeSpec() );
+  clearException();
+
+  if ( messageText.isEmpty() ) {
+    setException(
+      new Exception( Exception::ParseErrorEmptyMessage ) );
+    return ScheduleMessage::Ptr();
+  }
+
+  icalcomponent *message;
+  message = icalparser_parse_string( messageText.toUtf8() );
+
+  if ( !message ) {
+    setException(
+      new Exception( Exception::ParseErrorUnableToParse ) );
+
+    return ScheduleMessage::Ptr();
+  }
+
+  // Populate the message's time zone collection with all VTIMEZONE components
+  ICalTimeZones tzlist;
+  ICalTimeZoneSource tzs;
+  tzs.parse( message, tzlist );
+
+  IncidenceBase::Ptr incidence;
+  iTIPMethod method;
+  Exception::ErrorCode error;
+  if ( !readScheduleMessage( d->mImpl, message, &tzlist, incidence, method, error ) ) {
+    setException( new Exception( error ) );
+    icalcomponent_free( message );
+    return ScheduleMessage::Ptr();
+  }
+
+  const ScheduleMessage::Status status =
+    classifyScheduleMessage( d->mImpl, cal, message, incidence );
+
+  icalcomponent_free( message );
+
   return ScheduleMessage::Ptr( new ScheduleMessage( incidence, method, status ) );
 }
 
+QVector<ScheduleMessage::Ptr>
+ICalFormat::parseScheduleMessages( const Calendar::Ptr &cal,
+                                   const QList<QByteArray> &messages,
+                                   QHash<int, Exception::ErrorCode> *errors )
+{
+  setTimeSpec( cal->timeSpec() );
+  clearException();
+  if ( errors ) {
+    errors->clear();
+  }
+
+  // Invitations from the same organizer carry the same VTIMEZONE
+  // components, which are parsed once for all of them.
+  const int count = messages.count();
+  QHash<QByteArray, ICalTimeZones> zones;
+  QVector<const ICalTimeZones *> messageZones( count );
+  for ( int i = 0; i < count; ++i ) {
+    const QByteArray blocks = timeZoneBlocks( messages[i] );
+    QHash<QByteArray, ICalTimeZones>::Iterator it = zones.find( blocks );
+    if ( it == zones.end() ) {
+      it = zones.insert( blocks, ICalTimeZones() );
+      if ( !blocks.isEmpty() ) {
+        icalcomponent *calendar = icalparser_parse_string(
+          "BEGIN:VCALENDAR\r\n" + blocks + "END:VCALENDAR\r\n" );
+        if ( calendar ) {
+          ICalTimeZoneSource().parse( calendar, *it );
+          icalcomponent_free( calendar );
+        }
+      }
+    }
+    messageZones[i] = &it.value();
+  }
+
+  // Each message is read on its own, with its own copy of the zones which
+  // may receive the system zones it refers to.
+  QVector<ParsedScheduleMessage> parsed( count );
+  ParsedScheduleMessage *results = parsed.data();
+  const ICalTimeZones *const *resultZones = messageZones.constData();
+  Parallel::forEach( count, true, [&]( int i ) {
+      ParsedScheduleMessage &result = results[i];
+      if ( messages[i].isEmpty() ) {
+        result.error = Exception::ParseErrorEmptyMessage;
+        return;
+      }
+      result.message = icalparser_parse_string( messages[i].constData() );
+      if ( !result.message ) {
+        return;
+      }
+      ICalFormatImpl impl( this );
+      ICalTimeZones tzlist( *resultZones[i] );
+      if ( !readScheduleMessage( &impl, result.message, &tzlist,
+                                 result.incidence, result.method, result.error ) ) {
+        result.incidence.clear();
+      }
+    }, []( int, int ) {} );
+
+  // The calendar is only searched on this thread
+  QVector<ScheduleMessage::Ptr> result( count );
+  for ( int i = 0; i < count; ++i ) {
+    ParsedScheduleMessage &message = parsed[i];
+    if ( message.incidence ) {
+      const ScheduleMessage::Status status =
+        classifyScheduleMessage( d->mImpl, cal, message.message, message.incidence );
+      result[i] = ScheduleMessage::Ptr(
+        new ScheduleMessage( message.incidence, message.method, status ) );
+    } else if ( errors ) {
+      errors->insert( i, message.error );
+    }
+    if ( message.message ) {
+      icalcomponent_free( message.message );
+    }
+  }
+  return result;
+}
+
 void ICalFormat::setTimeSpec( const KDateTime::Spec &timeSpec )
 {
   d->mTimeSpec = timeSpec;
@@ -32,10 +32,14 @@
 #include "freebusy.h"
 #include "kcalcore_export.h"
 #include "calformat.h"
+#include "exceptions.h"
 #include "schedulemessage.h"
 
 #include <KDateTime>
 
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
 namespace KCalCore {
 
 class FreeBusy;
@@ -118,6 +122,11 @@ class KCALCORE_EXPORT ICalFormat : public CalFormat
     /**
       @copydoc
       CalFormat::toString()
+
+      @note The deleted incidences of a MemoryCalendar which are only
+      recorded by a tombstone are written with their UID, recurrence ID and
+      revision only.
+      @see MemoryCalendar::setDeletedIncidencesKept()
     */
     QString toString( const Calendar::Ptr &calendar,
                       const QString &notebook = QString(), bool deleted = false );
@@ -141,6 +150,49 @@ class KCALCORE_EXPORT ICalFormat : public CalFormat
     */
     QByteArray toRawString( const Incidence::Ptr &incidence );
 
+    /**
+      Converts the changed properties of an Incidence, as given by
+      IncidenceBase::dirtyFields(), to a delta which can be applied to
+      another copy of the incidence with applyDelta().
+
+      The delta is an iCalendar document holding a single incidence with
+      the changed properties, its UID and RECURRENCE-ID, and the time zones
+      these properties refer to. Properties which were cleared are listed
+      in the delta and cleared on the other side as well.
+
+      @param incidence is a pointer to the changed Incidence.
+      @return the delta, empty if no field changed.
+      @see applyDelta()
+      @since 4.11
+    */
+    QByteArray toRawDelta( const Incidence::Ptr &incidence );
+
+    /**
+      Converts the given fields of an Incidence to a delta.
+
+      @param incidence is a pointer to an Incidence.
+      @param fields are the fields to include in the delta.
+      IncidenceBase::FieldUnknown stands for all the fields.
+      @return the delta, empty if @p fields is empty.
+      @see applyDelta()
+      @since 4.11
+    */
+    QByteArray toRawDelta( const Incidence::Ptr &incidence,
+                           const QSet<IncidenceBase::Field> &fields );
+
+    /**
+      Applies a delta created by toRawDelta() to an Incidence of the same
+      type, UID and RECURRENCE-ID.
+
+      @param incidence is a pointer to the Incidence to update.
+      @param delta is the delta to apply.
+      @return true if the delta was applied, false if it could not be parsed
+      or belongs to another incidence.
+      @see toRawDelta()
+      @since 4.11
+    */
+    bool applyDelta( const Incidence::Ptr &incidence, const QByteArray &delta );
+
     /**
       Converts a RecurrenceRule to a QString.
       @param rule is a pointer to a RecurrenceRule object to be converted
@@ -183,6 +235,30 @@ class KCALCORE_EXPORT ICalFormat : public CalFormat
     ScheduleMessage::Ptr parseScheduleMessage( const Calendar::Ptr &calendar,
                                                const QString &string );
 
+    /**
+      Parses a list of calendar scheduling messages into ScheduleMessage
+      objects, as parseScheduleMessage() does for each of them.
+
+      The messages are parsed on several threads when there are enough of
+      them, and the time zones of identical VTIMEZONE components are parsed
+      once for the whole list. The incidences they refer to are then looked
+      up in @p calendar on the calling thread. The exception of the format
+      is not set by this method, see @p errors.
+
+      @param calendar is a pointer to a Calendar object associated with the
+      scheduling messages.
+      @param messages are the UTF-8 encoded messages to parse.
+      @param errors if not null, is set to the error code of each message
+      which could not be parsed, by index in @p messages.
+
+      @return the ScheduleMessage object of each message, in the order of
+      @p messages, null for those which could not be parsed.
+      @since 4.11
+    */
+    QVector<ScheduleMessage::Ptr> parseScheduleMessages(
+      const Calendar::Ptr &calendar, const QList<QByteArray> &messages,
+      QHash<int, Exception::ErrorCode> *errors = 0 );
+
     /**
       Converts a QString into a FreeBusy object.
 
@@ -42,6 +42,7 @@
 #include "icalformat.h"
 #include "icaltimezones.h"
 #include "incidencebase.h"
+#include "instrumentation.h"
 #include "journal.h"
 #include "memorycalendar.h"
 #include "todo.h"
@@ -51,6 +52,8 @@
 #include <KDebug>
 
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
 
 using namespace KCalCore;
 
@@ -58,6 +61,14 @@ static const char APP_NAME_FOR_XPROPERTIES[] = "KCALCORE";
 static const char ENABLED_ALARM_XPROPERTY[] = "ENABLED";
 static const char IMPLEMENTATION_VERSION_XPROPERTY[] = "X-KDE-ICAL-IMPLEMENTATION-VERSION";
 
+// Upper bound of the string pools, so that a long living parser which is
+// never asked to populate a whole calendar does not grow without limit.
+static const int STRING_POOL_LIMIT = 20000;
+
+// Setting this environment variable turns the string pools off, so that
+// their memory saving can be measured.
+static const char NO_STRING_POOL_ENV[] = "KCALCORE_NO_STRING_POOL";
+
 /* Static helpers */
 /*
 static void _dumpIcaltime( const icaltimetype& t)
@@ -150,20 +161,105 @@ class ICalFormatImpl::Private
 {
   public:
     Private( ICalFormatImpl *impl, ICalFormat *parent )
-      : mImpl( impl ), mParent( parent ), mCompat( new Compat ) {}
+      : mImpl( impl ), mParent( parent ), mCompat( new Compat ),
+        mTzidList( 0 ), mLoading( false ),
+        mInternStrings( qgetenv( NO_STRING_POOL_ENV ).isEmpty() ) {}
     ~Private()  { delete mCompat; }
     void writeIncidenceBase( icalcomponent *parent, IncidenceBase::Ptr );
     void readIncidenceBase( icalcomponent *parent, IncidenceBase::Ptr );
     void writeCustomProperties( icalcomponent *parent, CustomProperties * );
     void readCustomProperties( icalcomponent *parent, CustomProperties * );
 
+    // Return a copy of the string which shares its data with all equal strings
+    // read before, so that values repeated across incidences are stored once.
+    QString intern( const QString &string );
+    QByteArray intern( const QByteArray &key );
+    void clearPools();
+
+    // Return the TZIDs resolved so far in tzlist, kept for the whole
+    // load and otherwise for the incidence being read.
+    ICalFormatImpl::TzidSpecs *tzidSpecs( ICalTimeZones *tzlist );
+    void clearTzidSpecs();
+
     ICalFormatImpl *mImpl;
     ICalFormat *mParent;
     QString mLoadedProductId;         // PRODID string loaded from calendar file
     Event::List mEventsRelate;        // events with relations
     Todo::List  mTodosRelate;         // todos with relations
     Compat *mCompat;
+    QSet<QString> mStringPool;        // attendees, categories, ... read so far
+    QSet<QByteArray> mKeyPool;        // custom property names read so far
+    ICalFormatImpl::TzidSpecs mTzidSpecs; // TZIDs resolved so far in mTzidList
+    ICalTimeZones *mTzidList;
+    bool mLoading;                    // populating a calendar
+    bool mInternStrings;              // whether the string pools are used
 };
+
+template <typename T>
+static T internInPool( QSet<T> &pool, const T &value )
+{
+  if ( value.isEmpty() ) {
+    return value;
+  }
+  typename QSet<T>::const_iterator it = pool.constFind( value );
+  if ( it != pool.constEnd() ) {
+    return *it;
+  }
+  if ( pool.size() >= STRING_POOL_LIMIT ) {
+    pool.clear();
+  }
+  pool.insert( value );
+  return value;
+}
+
+QString ICalFormatImpl::Private::intern( const QString &string )
+{
+  return mInternStrings ? internInPool( mStringPool, string ) : string;
+}
+
+QByteArray ICalFormatImpl::Private::intern( const QByteArray &key )
+{
+  return mInternStrings ? internInPool( mKeyPool, key ) : key;
+}
+
+void ICalFormatImpl::Private::clearPools()
+{
+  mStringPool.clear();
+  mKeyPool.clear();
+  clearTzidSpecs();
+}
+
+void ICalFormatImpl::Private::clearTzidSpecs()
+{
+  mTzidSpecs.clear();
+  mTzidList = 0;
+}
+
+ICalFormatImpl::TzidSpecs *ICalFormatImpl::Private::tzidSpecs( ICalTimeZones *tzlist )
+{
+  if ( tzlist != mTzidList ) {
+    mTzidSpecs.clear();
+    mTzidList = tzlist;
+  }
+  return &mTzidSpecs;
+}
+
+// Writes a property for each date/time of a series. The time zones are
+// added to the lists when they change, not for each date/time.
+static void writeDateTimeList( icalcomponent *parent, icalproperty_kind kind,
+                               const DateTimeList &list,
+                               ICalTimeZones *tzlist, ICalTimeZones *tzUsedList )
+{
+  KDateTime::Spec spec;
+  foreach ( const KDateTime &dt, list ) {
+    const bool added = dt.timeSpec() == spec;
+    icalcomponent_add_property(
+      parent, ICalFormatImpl::writeICalDateTimeProperty( kind, dt,
+                                                         added ? 0 : tzlist,
+                                                         added ? 0 : tzUsedList ) );
+    spec = dt.timeSpec();
+  }
+}
 //@endcond
 
 inline icaltimetype ICalFormatImpl::writeICalUtcDateTime ( const KDateTime &dt )
@@ -577,12 +673,8 @@ void ICalFormatImpl::writeIncidence( icalcomponent *parent,
       parent, icalproperty_new_exdate( writeICalDate( *exIt ) ) );
   }
 
-  DateTimeList dateTimeList = incidence->recurrence()->exDateTimes();
-  DateTimeList::ConstIterator extIt;
-  for ( extIt = dateTimeList.constBegin(); extIt != dateTimeList.constEnd(); ++extIt ) {
-    icalcomponent_add_property(
-      parent, writeICalDateTimeProperty( ICAL_EXDATE_PROPERTY, *extIt, tzlist, tzUsedList ) );
-  }
+  writeDateTimeList( parent, ICAL_EXDATE_PROPERTY, incidence->recurrence()->exDateTimes(),
+                     tzlist, tzUsedList );
 
   dateList = incidence->recurrence()->rDates();
   DateList::ConstIterator rdIt;
@@ -590,12 +682,8 @@ void ICalFormatImpl::writeIncidence( icalcomponent *parent,
     icalcomponent_add_property(
       parent, icalproperty_new_rdate( writeICalDatePeriod( *rdIt ) ) );
   }
-  dateTimeList = incidence->recurrence()->rDateTimes();
-  DateTimeList::ConstIterator rdtIt;
-  for ( rdtIt = dateTimeList.constBegin(); rdtIt != dateTimeList.constEnd(); ++rdtIt ) {
-    icalcomponent_add_property(
-      parent, writeICalDateTimeProperty( ICAL_RDATE_PROPERTY, *rdtIt, tzlist, tzUsedList ) );
-  }
+  writeDateTimeList( parent, ICAL_RDATE_PROPERTY, incidence->recurrence()->rDateTimes(),
+                     tzlist, tzUsedList );
 
   // attachments
   Attachment::List attachments = incidence->attachments();
@@ -1124,14 +1212,14 @@ Todo::Ptr ICalFormatImpl::readTodo( icalcomponent *vtodo, ICalTimeZones *tzlist
     switch ( kind ) {
     case ICAL_DUE_PROPERTY:
     { // due date/time
-      KDateTime kdt = readICalDateTimeProperty( p, tzlist );
+      KDateTime kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       todo->setDtDue( kdt, true );
       todo->setHasDueDate( true );
       todo->setAllDay( kdt.isDateOnly() );
       break;
     }
     case ICAL_COMPLETED_PROPERTY:  // completion date/time
-      todo->setCompleted( readICalDateTimeProperty( p, tzlist ) );
+      todo->setCompleted( readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) ) );
       break;
 
     case ICAL_PERCENTCOMPLETE_PROPERTY:  // Percent completed
@@ -1153,7 +1241,7 @@ Todo::Ptr ICalFormatImpl::readTodo( icalcomponent *vtodo, ICalTimeZones *tzlist
       break;
     case ICAL_X_PROPERTY:
     {
-      const KDateTime dateTime = readICalDateTimeProperty( p, tzlist );
+      const KDateTime dateTime = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       if ( dateTime.isValid() ) {
         todo->setDtRecurrence( dateTime );
       } else {
@@ -1191,7 +1279,7 @@ Event::Ptr ICalFormatImpl::readEvent( icalcomponent *vevent, ICalTimeZones *tzli
     switch ( kind ) {
     case ICAL_DTEND_PROPERTY:
     { // end date and time
-      KDateTime kdt = readICalDateTimeProperty( p, tzlist );
+      KDateTime kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       if ( kdt.isDateOnly() ) {
         // End date is non-inclusive
         QDate endDate = kdt.date().addDays( -1 );
@@ -1345,12 +1433,13 @@ Attendee::Ptr ICalFormatImpl::readAttendee( icalproperty *attendee )
     return Attendee::Ptr();
   }
 
+  email = d->intern( email );
+
   QString name;
   QString uid;
   p = icalproperty_get_first_parameter( attendee, ICAL_CN_PARAMETER );
   if ( p ) {
-    name = QString::fromUtf8( icalparameter_get_cn( p ) );
-  } else {
+    name = d->intern( QString::fromUtf8( icalparameter_get_cn( p ) ) );
   }
 
   bool rsvp = false;
@@ -1421,7 +1510,7 @@ Attendee::Ptr ICalFormatImpl::readAttendee( icalproperty *attendee )
     if ( xname == "X-UID" ) {
       uid = xvalue;
     } else {
-      custom[xname.toUtf8()] = xvalue;
+      custom[d->intern( xname.toUtf8() )] = d->intern( xvalue );
     }
     p = icalproperty_get_next_parameter( attendee, ICAL_X_PARAMETER );
   }
@@ -1431,12 +1520,12 @@ Attendee::Ptr ICalFormatImpl::readAttendee( icalproperty *attendee )
 
   p = icalproperty_get_first_parameter( attendee, ICAL_DELEGATEDTO_PARAMETER );
   if ( p ) {
-    a->setDelegate( icalparameter_get_delegatedto( p ) );
+    a->setDelegate( d->intern( QString::fromUtf8( icalparameter_get_delegatedto( p ) ) ) );
   }
 
   p = icalproperty_get_first_parameter( attendee, ICAL_DELEGATEDFROM_PARAMETER );
   if ( p ) {
-    a->setDelegator( icalparameter_get_delegatedfrom( p ) );
+    a->setDelegator( d->intern( QString::fromUtf8( icalparameter_get_delegatedfrom( p ) ) ) );
   }
 
   return a;
@@ -1453,9 +1542,9 @@ Person::Ptr ICalFormatImpl::readOrganizer( icalproperty *organizer )
   icalparameter *p = icalproperty_get_first_parameter( organizer, ICAL_CN_PARAMETER );
 
   if ( p ) {
-    cn = QString::fromUtf8( icalparameter_get_cn( p ) );
+    cn = d->intern( QString::fromUtf8( icalparameter_get_cn( p ) ) );
   }
-  Person::Ptr org( new Person( cn, email ) );
+  Person::Ptr org( new Person( cn, d->intern( email ) ) );
   // TODO: Treat sent-by, dir and language here, too
   return org;
 }
@@ -1540,6 +1629,11 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
                                     Incidence::Ptr incidence,
                                     ICalTimeZones *tzlist )
 {
+  if ( !d->mLoading ) {
+    // The time zone list may have changed since the last incidence
+    d->clearTzidSpecs();
+  }
+
   d->readIncidenceBase( parent, incidence );
 
   icalproperty *p = icalcomponent_get_first_property( parent, ICAL_ANY_PROPERTY );
@@ -1549,6 +1643,8 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
   icaldurationtype icalduration;
   KDateTime kdt;
   KDateTime dtstamp;
+  DateList rDates, exDates;
+  DateTimeList rDateTimes, exDateTimes;
 
   QStringList categories;
 
@@ -1556,11 +1652,11 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
     icalproperty_kind kind = icalproperty_isa( p );
     switch ( kind ) {
     case ICAL_CREATED_PROPERTY:
-      incidence->setCreated( readICalDateTimeProperty( p, tzlist ) );
+      incidence->setCreated( readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) ) );
       break;
 
     case ICAL_DTSTAMP_PROPERTY:
-      dtstamp = readICalDateTimeProperty( p, tzlist );
+      dtstamp = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       break;
 
     case ICAL_SEQUENCE_PROPERTY:  // sequence
@@ -1569,11 +1665,11 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
       break;
 
     case ICAL_LASTMODIFIED_PROPERTY:  // last modification UTC date/time
-      incidence->setLastModified( readICalDateTimeProperty( p, tzlist ) );
+      incidence->setLastModified( readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) ) );
       break;
 
     case ICAL_DTSTART_PROPERTY:  // start date and time
-      kdt = readICalDateTimeProperty( p, tzlist );
+      kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       incidence->setDtStart( kdt );
       incidence->setAllDay( kdt.isDateOnly() );
       break;
@@ -1705,14 +1801,14 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
       foreach ( const QString &cat, val.split( ',', QString::SkipEmptyParts ) ) {
         // ensure no duplicates
         if ( !categories.contains( cat ) ) {
-          categories.append( cat );
+          categories.append( d->intern( cat ) );
         }
       }
       break;
     }
 
     case ICAL_RECURRENCEID_PROPERTY:  // recurrenceId
-      kdt = readICalDateTimeProperty( p, tzlist );
+      kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       if ( kdt.isValid() ) {
         incidence->setRecurrenceId( kdt );
       }
@@ -1723,12 +1819,12 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
       break;
 
     case ICAL_RDATE_PROPERTY:
-      kdt = readICalDateTimeProperty( p, tzlist );
+      kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       if ( kdt.isValid() ) {
         if ( kdt.isDateOnly() ) {
-          incidence->recurrence()->addRDate( kdt.date() );
+          rDates.append( kdt.date() );
         } else {
-          incidence->recurrence()->addRDateTime( kdt );
+          rDateTimes.append( kdt );
         }
       } else {
         // TODO: RDates as period are not yet implemented!
@@ -1740,11 +1836,11 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
       break;
 
     case ICAL_EXDATE_PROPERTY:
-      kdt = readICalDateTimeProperty( p, tzlist );
+      kdt = readICalDateTimeProperty( p, tzlist, false, d->tzidSpecs( tzlist ) );
       if ( kdt.isDateOnly() ) {
-        incidence->recurrence()->addExDate( kdt.date() );
+        exDates.append( kdt.date() );
       } else {
-        incidence->recurrence()->addExDateTime( kdt );
+        exDateTimes.append( kdt );
       }
       break;
 
@@ -1771,6 +1867,20 @@ void ICalFormatImpl::readIncidence( icalcomponent *parent,
     p = icalcomponent_get_next_property( parent, ICAL_ANY_PROPERTY );
   }
 
+  // Sort the dates of a long series once rather than inserting each in order
+  if ( !rDates.isEmpty() ) {
+    incidence->recurrence()->setRDates( rDates );
+  }
+  if ( !rDateTimes.isEmpty() ) {
+    incidence->recurrence()->setRDateTimes( rDateTimes );
+  }
+  if ( !exDates.isEmpty() ) {
+    incidence->recurrence()->setExDates( exDates );
+  }
+  if ( !exDateTimes.isEmpty() ) {
+    incidence->recurrence()->setExDateTimes( exDateTimes );
+  }
+
   // Set the scheduling ID
   const QString uid = incidence->customProperty( "LIBKCAL", "ID" );
   if ( !uid.isNull() ) {
@@ -1886,7 +1996,7 @@ void ICalFormatImpl::Private::readCustomProperties( icalcomponent *parent,
       if ( !property.isEmpty() ) {
         properties->setNonKDECustomProperty( property, value, parameters );
       }
-      property = name;
+      property = intern( nproperty );
       value = nvalue;
       QStringList parametervalues;
       for ( param = icalproperty_get_first_parameter( p, ICAL_ANY_PARAMETER );
@@ -1896,7 +2006,7 @@ void ICalFormatImpl::Private::readCustomProperties( icalcomponent *parent,
         const char *c = icalparameter_as_ical_string( param );
         parametervalues.push_back( c );
       }
-      parameters = parametervalues.join( ";" );
+      parameters = intern( parametervalues.join( ";" ) );
     } else {
       value = value.append( "," ).append( nvalue );
     }
@@ -2336,7 +2446,8 @@ icalproperty *ICalFormatImpl::writeICalDateTimeProperty( const icalproperty_kind
 KDateTime ICalFormatImpl::readICalDateTime( icalproperty *p,
                                             const icaltimetype &t,
                                             ICalTimeZones *tzlist,
-                                            bool utc )
+                                            bool utc,
+                                            TzidSpecs *tzidSpecs )
 {
 //  kDebug();
 //  _dumpIcaltime( t );
@@ -2352,8 +2463,13 @@ KDateTime ICalFormatImpl::readICalDateTime( icalproperty *p,
     icalparameter *param =
       p ? icalproperty_get_first_parameter( p, ICAL_TZID_PARAMETER ) : 0;
     const char *tzid = param ? icalparameter_get_tzid( param ) : 0;
+    const QByteArray tzidKey = QByteArray::fromRawData( tzid, qstrlen( tzid ) );
     if ( !tzid ) {
       timeSpec = KDateTime::ClockTime;
+    } else if ( tzidSpecs && tzidSpecs->contains( tzidKey ) ) {
+      // A calendar repeats a few TZIDs in all its date/times,
+      // each is resolved once.
+      timeSpec = tzidSpecs->value( tzidKey );
     } else {
       QString tzidStr = QString::fromUtf8( tzid );
       ICalTimeZone tz;
@@ -2362,7 +2478,10 @@ KDateTime ICalFormatImpl::readICalDateTime( icalproperty *p,
       }
       if ( !tz.isValid() ) {
         // The time zone is not in the existing list for the calendar.
-        // Try to read it from the system or libical databases.
+        // Try to read it from the system or libical databases, which are
+        // loaded on demand and not safe to search from several threads.
+        static QMutex standardZoneMutex;
+        QMutexLocker lock( &standardZoneMutex );
         ICalTimeZoneSource tzsource;
         ICalTimeZone newtz = tzsource.standardZone( tzidStr );
         if ( newtz.isValid() && tzlist ) {
@@ -2371,6 +2490,9 @@ KDateTime ICalFormatImpl::readICalDateTime( icalproperty *p,
         tz = newtz;
       }
       timeSpec = tz.isValid() ? KDateTime::Spec( tz ) : KDateTime::LocalZone;
+      if ( tzidSpecs ) {
+        tzidSpecs->insert( QByteArray( tzid ), timeSpec );
+      }
     }
   }
   KDateTime result;
@@ -2390,7 +2512,8 @@ QDate ICalFormatImpl::readICalDate( icaltimetype t )
 
 KDateTime ICalFormatImpl::readICalDateTimeProperty( icalproperty *p,
                                                     ICalTimeZones *tzlist,
-                                                    bool utc )
+                                                    bool utc,
+                                                    TzidSpecs *tzidSpecs )
 {
   icaldatetimeperiodtype tp;
   icalproperty_kind kind = icalproperty_isa( p );
@@ -2453,7 +2576,7 @@ KDateTime ICalFormatImpl::readICalDateTimeProperty( icalproperty *p,
   if ( tp.time.is_date ) {
     return KDateTime( readICalDate( tp.time ), KDateTime::Spec::ClockTime() );
   } else {
-    return readICalDateTime( p, tp.time, tzlist, utc );
+    return readICalDateTime( p, tp.time, tzlist, utc, tzidSpecs );
   }
 }
 
@@ -2576,6 +2699,7 @@ icalcomponent *ICalFormatImpl::createCalendarComponent( const Calendar::Ptr &cal
 bool ICalFormatImpl::populate( const Calendar::Ptr &cal, icalcomponent *calendar,
                                bool deleted, const QString &notebook )
 {
+  Instrumentation::Scope scope( Instrumentation::Populate );
   Q_UNUSED( notebook );
 
   // kDebug()<<"Populate called";
@@ -2661,6 +2785,10 @@ bool ICalFormatImpl::populate( const Calendar::Ptr &cal, icalcomponent *calendar
   d->mTodosRelate.clear();
   // TODO: make sure that only actually added events go to this lists.
 
+  // The TZIDs are resolved once for the whole calendar.
+  d->clearTzidSpecs();
+  d->mLoading = true;
+
   icalcomponent *c;
 
   c = icalcomponent_get_first_component( calendar, ICAL_VTODO_COMPONENT );
@@ -2768,6 +2896,10 @@ bool ICalFormatImpl::populate( const Calendar::Ptr &cal, icalcomponent *calendar
 
   // TODO: Remove any previous time zones no longer referenced in the calendar
 
+  // The loaded incidences keep sharing the interned strings.
+  d->mLoading = false;
+  d->clearPools();
+
   return true;
 }
 
@@ -44,6 +44,8 @@
 
 #include <KDateTime>
 
+#include <QtCore/QHash>
+
 #include <ical.h>
 
 class QDate;
@@ -89,6 +91,11 @@ class Todo;
 class ICalFormatImpl
 {
   public:
+    /**
+      Time specifications of the TZID parameters read, by TZID.
+    */
+    typedef QHash<QByteArray, KDateTime::Spec> TzidSpecs;
+
     /**
       Construct a new iCal format for calendar object.
       @param parent is a pointer to a valid ICalFormat object.
@@ -198,10 +205,13 @@ class ICalFormatImpl
       @param t      ICal format date/time
       @param tzlist time zones collection
       @param utc    UTC date/time is expected
+      @param tzidSpecs time specifications of the TZIDs already resolved
+      in @p tzlist, updated with the TZID of @p p
       @return date/time, converted to UTC if @p utc is @c true
     */
     static KDateTime readICalDateTime( icalproperty *p, const icaltimetype &t,
-                                       ICalTimeZones *tzlist, bool utc = false );
+                                       ICalTimeZones *tzlist, bool utc = false,
+                                       TzidSpecs *tzidSpecs = 0 );
 
     /**
       Converts a UTC date/time from ICal format.
@@ -226,11 +236,14 @@ class ICalFormatImpl
       @param tzlist time zones collection
       @param utc    true to read a UTC value, false to allow time zone
       to be specified.
+      @param tzidSpecs time specifications of the TZIDs already resolved
+      in @p tzlist, updated with the TZID of @p p
       @return date or date/time, or invalid if property doesn't contain
       a time value.
     */
     static KDateTime readICalDateTimeProperty( icalproperty *p,
-                                               ICalTimeZones *tzlist, bool utc = false );
+                                               ICalTimeZones *tzlist, bool utc = false,
+                                               TzidSpecs *tzidSpecs = 0 );
 
     /**
       Reads a UTC date/time value from a property.
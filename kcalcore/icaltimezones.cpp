@@ -30,8 +30,10 @@
 #include <KDateTime>
 #include <ksystemtimezone.h>
 
+#include <QtCore/QDataStream>
 #include <QtCore/QDateTime>
 #include <QtCore/QFile>
+#include <QtCore/QHash>
 #include <QtCore/QTextStream>
 
 extern "C" {
@@ -92,12 +94,93 @@ namespace KCalCore {
 /******************************************************************************/
 
 //@cond PRIVATE
+// The offsets and transitions of a zone, equal for zones which only differ
+// by their names, or empty if the zone has none.
+static QByteArray zoneKey( const ICalTimeZone &zone )
+{
+  QByteArray key;
+  QDataStream stream( &key, QIODevice::WriteOnly );
+  foreach ( const KTimeZone::Phase &phase, zone.phases() ) {
+    stream << qint32( phase.utcOffset() ) << phase.isDst();
+  }
+  foreach ( const KTimeZone::Transition &transition, zone.transitions() ) {
+    stream << transition.time() << qint32( transition.phase().utcOffset() )
+           << transition.phase().isDst();
+  }
+  return key;
+}
+
 class ICalTimeZonesPrivate
 {
   public:
-    ICalTimeZonesPrivate() {}
+    ICalTimeZonesPrivate() : keysDirty( false ) {}
+
+    void insert( const ICalTimeZone &zone );
+    ICalTimeZone take( const QString &name );
+    void rebuildKeys();
+
     ICalTimeZones::ZoneMap zones;
+    QHash<QString, ICalTimeZone> lookup;   // by name and alias
+    QHash<QString, QString> aliases;       // zone name by alias
+    QHash<QByteArray, QString> keys;       // zone name by zoneKey()
+    bool keysDirty;                        // keys need rebuildKeys()
 };
+
+void ICalTimeZonesPrivate::insert( const ICalTimeZone &zone )
+{
+  const QString name = zone.name();
+  aliases.remove( name );
+  zones.insert( name, zone );
+  lookup.insert( name, zone );
+  if ( keysDirty ) {
+    return;     // added by the next rebuildKeys()
+  }
+  const QByteArray key = zoneKey( zone );
+  if ( !key.isEmpty() && !keys.contains( key ) ) {
+    keys.insert( key, name );
+  }
+}
+
+ICalTimeZone ICalTimeZonesPrivate::take( const QString &name )
+{
+  const ICalTimeZone zone = zones.take( name );
+  lookup.remove( name );
+  QHash<QString, QString>::Iterator it = aliases.begin();
+  while ( it != aliases.end() ) {
+    if ( it.value() == name ) {
+      lookup.remove( it.key() );
+      it = aliases.erase( it );
+    } else {
+      ++it;
+    }
+  }
+
+  // Another zone with the same definition takes over
+  const QByteArray key = keysDirty ? QByteArray() : zoneKey( zone );
+  if ( !key.isEmpty() && keys.value( key ) == name ) {
+    keys.remove( key );
+    for ( ICalTimeZones::ZoneMap::ConstIterator z = zones.constBegin(); z != zones.constEnd(); ++z ) {
+      if ( zoneKey( z.value() ) == key ) {
+        keys.insert( key, z.key() );
+        break;
+      }
+    }
+  }
+  return zone;
+}
+
+// Zones updated in place no longer match their keys
+void ICalTimeZonesPrivate::rebuildKeys()
+{
+  keysDirty = false;
+  keys.clear();
+  for ( ICalTimeZones::ZoneMap::ConstIterator it = zones.constBegin(); it != zones.constEnd(); ++it ) {
+    const QByteArray key = zoneKey( it.value() );
+    if ( !key.isEmpty() && !keys.contains( key ) ) {
+      keys.insert( key, it.key() );
+    }
+  }
+}
 //@endcond
 
 ICalTimeZones::ICalTimeZones()
@@ -108,7 +191,7 @@ ICalTimeZones::ICalTimeZones()
 ICalTimeZones::ICalTimeZones( const ICalTimeZones &rhs )
   : d( new ICalTimeZonesPrivate() )
 {
-  d->zones = rhs.d->zones;
+  *d = *rhs.d;
 }
 
 ICalTimeZones &ICalTimeZones::operator=( const ICalTimeZones &rhs )
@@ -117,7 +200,7 @@ ICalTimeZones &ICalTimeZones::operator=( const ICalTimeZones &rhs )
   if ( &rhs == this ) {
     return *this;
   }
-  d->zones = rhs.d->zones;
+  *d = *rhs.d;
   return *this;
 }
 
@@ -136,20 +219,45 @@ bool ICalTimeZones::add( const ICalTimeZone &zone )
   if ( !zone.isValid() ) {
     return false;
   }
-  if ( d->zones.find( zone.name() ) != d->zones.end() ) {
+  if ( d->zones.contains( zone.name() ) ) {
     return false;    // name already exists
   }
 
-  d->zones.insert( zone.name(), zone );
+  d->insert( zone );
+  return true;
+}
+
+bool ICalTimeZones::addAlias( const QString &alias, const QString &name )
+{
+  if ( alias.isEmpty() || d->zones.contains( alias ) ) {
+    return false;
+  }
+  ZoneMap::ConstIterator it = d->zones.constFind( name );
+  if ( it == d->zones.constEnd() ) {
+    return false;
+  }
+
+  d->aliases.insert( alias, name );
+  d->lookup.insert( alias, it.value() );
+  return true;
+}
+
+bool ICalTimeZones::update( const ICalTimeZone &zone )
+{
+  ZoneMap::Iterator it = d->zones.find( zone.name() );
+  if ( it == d->zones.end() || !it.value().update( zone ) ) {
+    return false;
+  }
+  d->keysDirty = true;
   return true;
 }
 
 ICalTimeZone ICalTimeZones::remove( const ICalTimeZone &zone )
 {
   if ( zone.isValid() ) {
-    for ( ZoneMap::Iterator it = d->zones.begin(), end = d->zones.end();  it != end;  ++it ) {
+    for ( ZoneMap::ConstIterator it = d->zones.constBegin(), end = d->zones.constEnd();  it != end;  ++it ) {
       if ( it.value() == zone ) {
-        d->zones.erase( it );
+        d->take( it.key() );
         return ( zone == ICalTimeZone::utc() ) ? ICalTimeZone() : zone;
       }
     }
@@ -160,10 +268,12 @@ ICalTimeZone ICalTimeZones::remove( const ICalTimeZone &zone )
 ICalTimeZone ICalTimeZones::remove( const QString &name )
 {
   if ( !name.isEmpty() ) {
-    ZoneMap::Iterator it = d->zones.find( name );
-    if ( it != d->zones.end() ) {
-      const ICalTimeZone zone = it.value();
-      d->zones.erase(it);
+    if ( d->aliases.remove( name ) ) {
+      d->lookup.remove( name );
+      return ICalTimeZone();
+    }
+    if ( d->zones.contains( name ) ) {
+      const ICalTimeZone zone = d->take( name );
       return ( zone == ICalTimeZone::utc() ) ? ICalTimeZone() : zone;
     }
   }
@@ -173,6 +283,10 @@ ICalTimeZone ICalTimeZones::remove( const QString &name )
 void ICalTimeZones::clear()
 {
   d->zones.clear();
+  d->lookup.clear();
+  d->aliases.clear();
+  d->keys.clear();
+  d->keysDirty = false;
 }
 
 int ICalTimeZones::count()
@@ -183,8 +297,8 @@ int ICalTimeZones::count()
 ICalTimeZone ICalTimeZones::zone( const QString &name ) const
 {
   if ( !name.isEmpty() ) {
-    ZoneMap::ConstIterator it = d->zones.constFind( name );
-    if ( it != d->zones.constEnd() ) {
+    QHash<QString, ICalTimeZone>::ConstIterator it = d->lookup.constFind( name );
+    if ( it != d->lookup.constEnd() ) {
       return it.value();
     }
   }
@@ -194,28 +308,14 @@ ICalTimeZone ICalTimeZones::zone( const QString &name ) const
 ICalTimeZone ICalTimeZones::zone( const ICalTimeZone &zone ) const
 {
   if ( zone.isValid() ) {
-    QMapIterator<QString, ICalTimeZone> it(d->zones);
-    while ( it.hasNext() ) {
-      it.next();
-      const ICalTimeZone tz = it.value();
-      const QList<KTimeZone::Transition> list1 = tz.transitions();
-      const QList<KTimeZone::Transition> list2 = zone.transitions();
-      if ( list1.size() == list2.size() ) {
-        int i = 0;
-        int matches = 0;
-        for ( ; i < list1.size(); ++i ) {
-          const KTimeZone::Transition t1 = list1[ i ];
-          const KTimeZone::Transition t2 = list2[ i ];
-          if ( ( t1.time() == t2.time() ) &&
-               ( t1.phase().utcOffset() == t2.phase().utcOffset() ) &&
-               ( t1.phase().isDst() == t2.phase().isDst() ) ) {
-            matches++;
-          }
-        }
-        if ( matches == i ) {
-          // Existing zone has all the transitions of the given zone.
-          return tz;
-        }
+    const QByteArray key = zoneKey( zone );
+    if ( !key.isEmpty() ) {
+      if ( d->keysDirty ) {
+        d->rebuildKeys();
+      }
+      QHash<QByteArray, QString>::ConstIterator it = d->keys.constFind( key );
+      if ( it != d->keys.constEnd() ) {
+        return d->zones.value( it.value() );
       }
     }
   }
@@ -894,10 +994,18 @@ bool ICalTimeZoneSource::parse( icalcomponent *calendar, ICalTimeZones &zones )
       return false;
     }
     ICalTimeZone oldzone = zones.zone( zone.name() );
-    if ( oldzone.isValid() ) {
+    if ( oldzone.isValid() && oldzone.name() == zone.name() ) {
       // The zone already exists in the collection, so update the definition
       // of the zone rather than using a newly created one.
-      oldzone.update( zone );
+      zones.update( zone );
+      continue;
+    }
+    // The same definition under another TZID shares the existing zone
+    const ICalTimeZone same = zones.zone( zone );
+    if ( same.isValid() ) {
+      if ( same != oldzone && !zones.addAlias( zone.name(), same.name() ) ) {
+        return false;
+      }
     } else if ( !zones.add( zone ) ) {
       return false;
     }
@@ -1050,9 +1158,11 @@ ICalTimeZone ICalTimeZoneSource::parse( MSTimeZone *tz, ICalTimeZones &zones )
     }
     // A similar zone already exists in the collection, so don't add this
     // new zone, return old zone instead.
+    zones.addAlias( tz->StandardName, oldzone.name() );
     return oldzone;
   } else if ( zones.add( zone ) ) {
     // No similar zone, add and return new one.
+    zones.addAlias( tz->StandardName, zone.name() );
     return zone;
   }
   return ICalTimeZone(); // error
@@ -1131,7 +1241,7 @@ ICalTimeZone ICalTimeZoneSource::parse( const QString &name, const QStringList &
   oldzone = zones.zone( name );
   if ( oldzone.isValid() ) {
     // The zone already exists, so update
-    oldzone.update( zone );
+    zones.update( zone );
     return zone;
   } else if ( zones.add( zone ) ) {
     // No similar zone, add and return new one.
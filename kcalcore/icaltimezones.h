@@ -51,6 +51,8 @@ class ICalTimeZoneDataPrivate;
  *
  * Each individual time zone is defined in a ICalTimeZone instance. The time zones in the
  * collection are indexed by name, which must be unique within the collection.
+ * Other names, such as the long TZIDs written by some clients or Windows time
+ * zone names, can be added as aliases of a zone.
  *
  * Different calendars could define the same time zone differently. As a result,
  * to avoid conflicting definitions, each calendar should normally have its own
@@ -88,18 +90,18 @@ class KCALCORE_EXPORT ICalTimeZones
     ~ICalTimeZones();
 
     /**
-     * Returns the time zone with the given name.
+     * Returns the time zone with the given name or alias.
      * Note that the ICalTimeZone returned remains a member of the ICalTimeZones
      * collection, and should not be deleted without calling remove() first.
      *
-     * @param name name of time zone
+     * @param name name or alias of time zone
      * @return time zone, or invalid if not found
      */
     ICalTimeZone zone( const QString &name ) const;
 
     /**
-     * Returns the time zone with similar zone information regardless of
-     * the time zone names. This feature was added for Microsoft ActiveSync
+     * Returns the time zone with the same offsets and transitions regardless
+     * of the time zone names. This feature was added for Microsoft ActiveSync
      * which may have the same timezone specification separately for every
      * incidence.
      * Note that the ICalTimeZone returned remains a member of the ICalTimeZones
@@ -122,7 +124,8 @@ class KCALCORE_EXPORT ICalTimeZones
 
     /**
      * Adds a time zone to the collection.
-     * The time zone's name must be unique within the collection.
+     * The time zone's name must be unique within the collection. A time zone
+     * named like an alias replaces the alias.
      *
      * @param zone time zone to add
      * @return @c true if successful, @c false if zone's name duplicates one
@@ -130,6 +133,32 @@ class KCALCORE_EXPORT ICalTimeZones
      */
     bool add( const ICalTimeZone &zone );
 
+    /**
+     * Adds an alias for a time zone of the collection, so that zone()
+     * returns the time zone for the alias too. An alias already defined is
+     * redirected to the time zone.
+     *
+     * @param alias other name of the time zone
+     * @param name name of the time zone in the collection
+     * @return @c true if successful, @c false if there is no time zone
+     * named @p name, or if @p alias is the name of a time zone
+     * @since 4.11
+     */
+    bool addAlias( const QString &alias, const QString &name );
+
+    /**
+     * Updates the definition of the time zone of the collection named like
+     * @p zone, as ICalTimeZone::update() does. Zones of the collection must
+     * be updated through this method for zone(const ICalTimeZone&) to find
+     * them by their new definition.
+     *
+     * @param zone time zone holding the new definition
+     * @return @c true if successful, @c false if there is no time zone with
+     * the same name in the collection, or if the update failed
+     * @since 4.11
+     */
+    bool update( const ICalTimeZone &zone );
+
     /**
      * Removes a time zone from the collection.
      *
@@ -139,7 +168,8 @@ class KCALCORE_EXPORT ICalTimeZones
     ICalTimeZone remove( const ICalTimeZone &zone );
 
     /**
-     * Removes a time zone from the collection.
+     * Removes a time zone from the collection, with its aliases. If @p name
+     * is an alias, only the alias is removed.
      *
      * @param name name of time zone to remove
      * @return the time zone which was removed, or invalid if not found
@@ -427,7 +457,8 @@ class KCALCORE_EXPORT ICalTimeZoneSource : public KTimeZoneSource
     /**
      * Creates an ICalTimeZone instance for each iCalendar VTIMEZONE component
      * within a CALENDAR component. The ICalTimeZone instances are added to a
-     * ICalTimeZones collection.
+     * ICalTimeZones collection. A VTIMEZONE identical to a time zone of the
+     * collection but for its TZID is added as an alias of that time zone.
      *
      * If an error occurs while processing any time zone, any remaining time
      * zones are left unprocessed.
@@ -452,6 +483,7 @@ class KCALCORE_EXPORT ICalTimeZoneSource : public KTimeZoneSource
     /**
      * Creates an ICalTimeZone instance and adds it to a ICalTimeZones
      * collection or returns an existing instance for the MSTimeZone component.
+     * The standard name of @p tz is added as an alias of the time zone.
      *
      * @param tz       the MSTimeZone structure to parse
      * @param zones    the time zones collection to which the ICalTimeZone
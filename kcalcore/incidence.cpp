@@ -41,6 +41,7 @@
 
 #include <ktemporaryfile.h>
 
+#include <QtCore/QSharedData>
 #include <QTextDocument> // for Qt::escape() and Qt::mightBeRichText()
 #include <QTime>
 
@@ -54,44 +55,60 @@ using namespace KCalCore;
 class KCalCore::Incidence::Private
 {
   public:
+    /**
+      The plain value part of an incidence. It is implicitly shared between
+      copies of an incidence and only detached when one of them is modified,
+      so cloning an incidence does not copy the descriptive texts.
+    */
+    class Content : public QSharedData
+    {
+      public:
+        Content()
+          : mRevision( 0 ),
+            mDescriptionIsRich( false ),
+            mSummaryIsRich( false ),
+            mLocationIsRich( false ),
+            mStatus( StatusNone ),
+            mSecrecy( SecrecyPublic ),
+            mPriority( 0 ),
+            mGeoLatitude( INVALID_LATLON ),
+            mGeoLongitude( INVALID_LATLON ),
+            mHasGeo( false )
+        {
+        }
+
+        int mRevision;                      // revision number
+
+        QString mDescription;               // description string
+        bool mDescriptionIsRich;            // description string is richtext.
+        QString mSummary;                   // summary string
+        bool mSummaryIsRich;                // summary string is richtext.
+        QString mLocation;                  // location string
+        bool mLocationIsRich;               // location string is richtext.
+        QStringList mCategories;            // category list
+        QStringList mResources;             // resources list (not calendar resources)
+        Status mStatus;                     // status
+        QString mStatusString;              // status string, for custom status
+        Secrecy mSecrecy;                   // secrecy
+        int mPriority;                      // priority: 1 = highest, 2 = less, etc.
+        QString mSchedulingID;              // ID for scheduling mails
+
+        QMap<RelType,QString> mRelatedToUid;// incidence uid this is related to, for each relType
+        float mGeoLatitude;                 // Specifies latitude in decimal degrees
+        float mGeoLongitude;                // Specifies longitude in decimal degrees
+        bool mHasGeo;                       // if incidence has geo data
+    };
+
     Private()
-      : mRevision( 0 ),
-        mDescriptionIsRich( false ),
-        mSummaryIsRich( false ),
-        mLocationIsRich( false ),
+      : mContent( new Content ),
         mRecurrence( 0 ),
-        mStatus( StatusNone ),
-        mSecrecy( SecrecyPublic ),
-        mPriority( 0 ),
-        mGeoLatitude( INVALID_LATLON ),
-        mGeoLongitude( INVALID_LATLON ),
-        mHasGeo( false ),
         mLocalOnly( false )
     {
     }
 
     Private( const Private &p )
-      : mCreated( p.mCreated ),
-        mRevision( p.mRevision ),
-        mDescription( p.mDescription ),
-        mDescriptionIsRich( p.mDescriptionIsRich ),
-        mSummary( p.mSummary ),
-        mSummaryIsRich( p.mSummaryIsRich ),
-        mLocation( p.mLocation ),
-        mLocationIsRich( p.mLocationIsRich ),
-        mCategories( p.mCategories ),
-        mRecurrence ( 0 ),
-        mResources( p.mResources ),
-        mStatus( p.mStatus ),
-        mStatusString( p.mStatusString ),
-        mSecrecy( p.mSecrecy ),
-        mPriority( p.mPriority ),
-        mSchedulingID( p.mSchedulingID ),
-        mRelatedToUid( p.mRelatedToUid ),
-        mGeoLatitude( p.mGeoLatitude ),
-        mGeoLongitude( p.mGeoLongitude ),
-        mHasGeo( p.mHasGeo ),
-        mRecurrenceId( p.mRecurrenceId ),
+      : mContent( p.mContent ),
+        mRecurrence( 0 ),
         mLocalOnly( false )
     {
     }
@@ -106,33 +123,27 @@ class KCalCore::Incidence::Private
 
     void init( Incidence *dest, const Incidence &src )
     {
-      mRevision = src.d->mRevision;
+      mContent = src.d->mContent;
+      // Date/time values are not shared, see IncidenceBase
       mCreated = src.d->mCreated;
-      mDescription = src.d->mDescription;
-      mSummary = src.d->mSummary;
-      mCategories = src.d->mCategories;
-      mRelatedToUid = src.d->mRelatedToUid;
-      mResources = src.d->mResources;
-      mStatusString = src.d->mStatusString;
-      mStatus = src.d->mStatus;
-      mSecrecy = src.d->mSecrecy;
-      mPriority = src.d->mPriority;
-      mLocation = src.d->mLocation;
-      mGeoLatitude = src.d->mGeoLatitude;
-      mGeoLongitude = src.d->mGeoLongitude;
-      mHasGeo = src.d->mHasGeo;
+      mCreated.detach();
       mRecurrenceId = src.d->mRecurrenceId;
+      mRecurrenceId.detach();
       mLocalOnly = src.d->mLocalOnly;
 
       // Alarms and Attachments are stored in ListBase<...>, which is a QValueList<...*>.
       // We need to really duplicate the objects stored therein, otherwise deleting
       // i will also delete all attachments from this object (setAutoDelete...)
+      // They are handed out as modifiable pointers, so unlike the Content they
+      // cannot be shared between copies.
+      mAlarms.reserve( src.d->mAlarms.count() );
       foreach ( Alarm::Ptr alarm, src.d->mAlarms ) {
         Alarm::Ptr b ( new Alarm( *alarm.data() ) );
         b->setParent( dest );
         mAlarms.append( b );
       }
 
+      mAttachments.reserve( src.d->mAttachments.count() );
       foreach ( Attachment::Ptr attachment, src.d->mAttachments ) {
         Attachment::Ptr a( new Attachment( *attachment ) );
         mAttachments.append( a );
@@ -146,32 +157,19 @@ class KCalCore::Incidence::Private
       }
     }
 
+    // Read access, which must not detach the shared data.
+    const Content &content() const
+    {
+      return *mContent.constData();
+    }
+
+    QSharedDataPointer<Content> mContent; // shared value data, see Content
     KDateTime mCreated;                 // creation datetime
-    int mRevision;                      // revision number
-
-    QString mDescription;               // description string
-    bool mDescriptionIsRich;            // description string is richtext.
-    QString mSummary;                   // summary string
-    bool mSummaryIsRich;                // summary string is richtext.
-    QString mLocation;                  // location string
-    bool mLocationIsRich;               // location string is richtext.
-    QStringList mCategories;            // category list
+    KDateTime mRecurrenceId;            // recurrenceId
     mutable Recurrence *mRecurrence;    // recurrence
     Attachment::List mAttachments;      // attachments list
     Alarm::List mAlarms;                // alarms list
-    QStringList mResources;             // resources list (not calendar resources)
-    Status mStatus;                     // status
-    QString mStatusString;              // status string, for custom status
-    Secrecy mSecrecy;                   // secrecy
-    int mPriority;                      // priority: 1 = highest, 2 = less, etc.
-    QString mSchedulingID;              // ID for scheduling mails
-
-    QMap<RelType,QString> mRelatedToUid;// incidence uid this is related to, for each relType
-    float mGeoLatitude;                 // Specifies latitude in decimal degrees
-    float mGeoLongitude;                // Specifies longitude in decimal degrees
-    bool mHasGeo;                       // if incidence has geo data
     QHash<Attachment::Ptr,QString> mTempFiles; // Temporary files for writing attachments to.
-    KDateTime mRecurrenceId;            // recurrenceId
     bool mLocalOnly;                    // allow changes that won't go to the server
 };
 //@endcond
@@ -283,9 +281,9 @@ bool Incidence::equals( const IncidenceBase &incidence ) const
     categories() == i2->categories() &&
     stringCompare( relatedTo(), i2->relatedTo() ) &&
     resources() == i2->resources() &&
-    d->mStatus == i2->d->mStatus &&
-    ( d->mStatus == StatusNone ||
-      stringCompare( d->mStatusString, i2->d->mStatusString ) ) &&
+    d->content().mStatus == i2->d->content().mStatus &&
+    ( d->content().mStatus == StatusNone ||
+      stringCompare( d->content().mStatusString, i2->d->content().mStatusString ) ) &&
     secrecy() == i2->secrecy() &&
     priority() == i2->priority() &&
     stringCompare( location(), i2->location() ) &&
@@ -367,14 +365,14 @@ void Incidence::setRevision( int rev )
 
   update();
 
-  d->mRevision = rev;
+  d->mContent->mRevision = rev;
   setFieldDirty( FieldRevision );
   updated();
 }
 
 int Incidence::revision() const
 {
-  return d->mRevision;
+  return d->content().mRevision;
 }
 
 void Incidence::setDtStart( const KDateTime &dt )
@@ -404,8 +402,8 @@ void Incidence::setDescription( const QString &description, bool isRich )
     return;
   }
   update();
-  d->mDescription = description;
-  d->mDescriptionIsRich = isRich;
+  d->mContent->mDescription = description;
+  d->mContent->mDescriptionIsRich = isRich;
   setFieldDirty( FieldDescription );
   updated();
 }
@@ -417,25 +415,25 @@ void Incidence::setDescription( const QString &description )
 
 QString Incidence::description() const
 {
-  return d->mDescription;
+  return d->content().mDescription;
 }
 
 QString Incidence::richDescription() const
 {
   if ( descriptionIsRich() ) {
-    return d->mDescription;
+    return d->content().mDescription;
   } else {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
-    return d->mDescription.toHtmlEscaped().replace( '\n', "<br/>" );
+    return d->content().mDescription.toHtmlEscaped().replace( '\n', "<br/>" );
 #else
-    return Qt::escape( d->mDescription ).replace( '\n', "<br/>" );
+    return Qt::escape( d->content().mDescription ).replace( '\n', "<br/>" );
 #endif
   }
 }
 
 bool Incidence::descriptionIsRich() const
 {
-  return d->mDescriptionIsRich;
+  return d->content().mDescriptionIsRich;
 }
 
 void Incidence::setSummary( const QString &summary, bool isRich )
@@ -444,8 +442,8 @@ void Incidence::setSummary( const QString &summary, bool isRich )
     return;
   }
   update();
-  d->mSummary = summary;
-  d->mSummaryIsRich = isRich;
+  d->mContent->mSummary = summary;
+  d->mContent->mSummaryIsRich = isRich;
   setFieldDirty( FieldSummary );
   updated();
 }
@@ -457,25 +455,25 @@ void Incidence::setSummary( const QString &summary )
 
 QString Incidence::summary() const
 {
-  return d->mSummary;
+  return d->content().mSummary;
 }
 
 QString Incidence::richSummary() const
 {
   if ( summaryIsRich() ) {
-    return d->mSummary;
+    return d->content().mSummary;
   } else {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
-    return d->mSummary.toHtmlEscaped().replace( '\n', "<br/>" );
+    return d->content().mSummary.toHtmlEscaped().replace( '\n', "<br/>" );
 #else
-    return Qt::escape( d->mSummary ).replace( '\n', "<br/>" );
+    return Qt::escape( d->content().mSummary ).replace( '\n', "<br/>" );
 #endif
   }
 }
 
 bool Incidence::summaryIsRich() const
 {
-  return d->mSummaryIsRich;
+  return d->content().mSummaryIsRich;
 }
 
 void Incidence::setCategories( const QStringList &categories )
@@ -485,7 +483,7 @@ void Incidence::setCategories( const QStringList &categories )
   }
 
   update();
-  d->mCategories = categories;
+  d->mContent->mCategories = categories;
   updated();
 }
 
@@ -497,17 +495,17 @@ void Incidence::setCategories( const QString &catStr )
   update();
   setFieldDirty( FieldCategories );
 
-  d->mCategories.clear();
+  d->mContent->mCategories.clear();
 
   if ( catStr.isEmpty() ) {
     updated();
     return;
   }
 
-  d->mCategories = catStr.split( ',' );
+  d->mContent->mCategories = catStr.split( ',' );
 
   QStringList::Iterator it;
-  for ( it = d->mCategories.begin();it != d->mCategories.end(); ++it ) {
+  for ( it = d->mContent->mCategories.begin();it != d->mContent->mCategories.end(); ++it ) {
     *it = ( *it ).trimmed();
   }
 
@@ -516,12 +514,12 @@ void Incidence::setCategories( const QString &catStr )
 
 QStringList Incidence::categories() const
 {
-  return d->mCategories;
+  return d->content().mCategories;
 }
 
 QString Incidence::categoriesStr() const
 {
-  return d->mCategories.join( "," );
+  return d->content().mCategories.join( "," );
 }
 
 void Incidence::setRelatedTo( const QString &relatedToUid, RelType relType )
@@ -529,9 +527,9 @@ void Incidence::setRelatedTo( const QString &relatedToUid, RelType relType )
   // TODO: RFC says that an incidence can have more than one related-to field
   // even for the same relType.
 
-  if ( d->mRelatedToUid[relType] != relatedToUid ) {
+  if ( d->content().mRelatedToUid.value( relType ) != relatedToUid ) {
     update();
-    d->mRelatedToUid[relType] = relatedToUid;
+    d->mContent->mRelatedToUid[relType] = relatedToUid;
     setFieldDirty( FieldRelatedTo );
     updated();
   }
@@ -539,7 +537,7 @@ void Incidence::setRelatedTo( const QString &relatedToUid, RelType relType )
 
 QString Incidence::relatedTo( RelType relType ) const
 {
-  return d->mRelatedToUid.value( relType );
+  return d->content().mRelatedToUid.value( relType );
 }
 
 // %%%%%%%%%%%%  Recurrence-related methods %%%%%%%%%%%%%%%%%%%%
@@ -789,14 +787,14 @@ void Incidence::setResources( const QStringList &resources )
   }
 
   update();
-  d->mResources = resources;
+  d->mContent->mResources = resources;
   setFieldDirty( FieldResources );
   updated();
 }
 
 QStringList Incidence::resources() const
 {
-  return d->mResources;
+  return d->content().mResources;
 }
 
 void Incidence::setPriority( int priority )
@@ -806,14 +804,14 @@ void Incidence::setPriority( int priority )
   }
 
   update();
-  d->mPriority = priority;
+  d->mContent->mPriority = priority;
   setFieldDirty( FieldPriority );
   updated();
 }
 
 int Incidence::priority() const
 {
-  return d->mPriority;
+  return d->content().mPriority;
 }
 
 void Incidence::setStatus( Incidence::Status status )
@@ -823,8 +821,8 @@ void Incidence::setStatus( Incidence::Status status )
   }
 
   update();
-  d->mStatus = status;
-  d->mStatusString.clear();
+  d->mContent->mStatus = status;
+  d->mContent->mStatusString.clear();
   setFieldDirty( FieldStatus );
   updated();
 }
@@ -836,21 +834,21 @@ void Incidence::setCustomStatus( const QString &status )
   }
 
   update();
-  d->mStatus = status.isEmpty() ? StatusNone : StatusX;
-  d->mStatusString = status;
+  d->mContent->mStatus = status.isEmpty() ? StatusNone : StatusX;
+  d->mContent->mStatusString = status;
   setFieldDirty( FieldStatus );
   updated();
 }
 
 Incidence::Status Incidence::status() const
 {
-  return d->mStatus;
+  return d->content().mStatus;
 }
 
 QString Incidence::customStatus() const
 {
-  if ( d->mStatus == StatusX ) {
-    return d->mStatusString;
+  if ( d->content().mStatus == StatusX ) {
+    return d->content().mStatusString;
   } else {
     return QString();
   }
@@ -863,14 +861,14 @@ void Incidence::setSecrecy( Incidence::Secrecy secrecy )
   }
 
   update();
-  d->mSecrecy = secrecy;
+  d->mContent->mSecrecy = secrecy;
   setFieldDirty( FieldSecrecy );
   updated();
 }
 
 Incidence::Secrecy Incidence::secrecy() const
 {
-  return d->mSecrecy;
+  return d->content().mSecrecy;
 }
 
 Alarm::List Incidence::alarms() const
@@ -929,8 +927,8 @@ void Incidence::setLocation( const QString &location, bool isRich )
   }
 
   update();
-  d->mLocation = location;
-  d->mLocationIsRich = isRich;
+  d->mContent->mLocation = location;
+  d->mContent->mLocationIsRich = isRich;
   setFieldDirty( FieldLocation );
   updated();
 }
@@ -942,30 +940,30 @@ void Incidence::setLocation( const QString &location )
 
 QString Incidence::location() const
 {
-  return d->mLocation;
+  return d->content().mLocation;
 }
 
 QString Incidence::richLocation() const
 {
   if ( locationIsRich() ) {
-    return d->mLocation;
+    return d->content().mLocation;
   } else {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
-    return d->mLocation.toHtmlEscaped().replace( '\n', "<br/>" );
+    return d->content().mLocation.toHtmlEscaped().replace( '\n', "<br/>" );
 #else
-    return Qt::escape( d->mLocation ).replace( '\n', "<br/>" );
+    return Qt::escape( d->content().mLocation ).replace( '\n', "<br/>" );
 #endif
   }
 }
 
 bool Incidence::locationIsRich() const
 {
-  return d->mLocationIsRich;
+  return d->content().mLocationIsRich;
 }
 
 void Incidence::setSchedulingID( const QString &sid, const QString &uid )
 {
-  d->mSchedulingID = sid;
+  d->mContent->mSchedulingID = sid;
   if ( !uid.isEmpty() ) {
     setUid( uid );
   }
@@ -974,16 +972,16 @@ void Incidence::setSchedulingID( const QString &sid, const QString &uid )
 
 QString Incidence::schedulingID() const
 {
-  if ( d->mSchedulingID.isNull() ) {
+  if ( d->content().mSchedulingID.isNull() ) {
     // Nothing set, so use the normal uid
     return uid();
   }
-  return d->mSchedulingID;
+  return d->content().mSchedulingID;
 }
 
 bool Incidence::hasGeo() const
 {
-  return d->mHasGeo;
+  return d->content().mHasGeo;
 }
 
 void Incidence::setHasGeo( bool hasGeo )
@@ -992,12 +990,12 @@ void Incidence::setHasGeo( bool hasGeo )
     return;
   }
 
-  if ( hasGeo == d->mHasGeo ) {
+  if ( hasGeo == d->content().mHasGeo ) {
     return;
   }
 
   update();
-  d->mHasGeo = hasGeo;
+  d->mContent->mHasGeo = hasGeo;
   setFieldDirty( FieldGeoLatitude );
   setFieldDirty( FieldGeoLongitude );
   updated();
@@ -1005,7 +1003,7 @@ void Incidence::setHasGeo( bool hasGeo )
 
 float Incidence::geoLatitude() const
 {
-  return d->mGeoLatitude;
+  return d->content().mGeoLatitude;
 }
 
 void Incidence::setGeoLatitude( float geolatitude )
@@ -1015,21 +1013,21 @@ void Incidence::setGeoLatitude( float geolatitude )
   }
 
   update();
-  d->mGeoLatitude = geolatitude;
+  d->mContent->mGeoLatitude = geolatitude;
   setFieldDirty( FieldGeoLatitude );
   updated();
 }
 
 float Incidence::geoLongitude() const
 {
-  return d->mGeoLongitude;
+  return d->content().mGeoLongitude;
 }
 
 void Incidence::setGeoLongitude( float geolongitude )
 {
   if ( !mReadOnly ) {
     update();
-    d->mGeoLongitude = geolongitude;
+    d->mContent->mGeoLongitude = geolongitude;
     setFieldDirty( FieldGeoLongitude );
     updated();
   }
@@ -1062,6 +1060,7 @@ void Incidence::recurrenceUpdated( Recurrence *recurrence )
 {
   if ( recurrence == d->mRecurrence ) {
     update();
+    setFieldDirty( FieldRecurrence );
     updated();
   }
 }
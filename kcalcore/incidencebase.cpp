@@ -43,6 +43,7 @@
 
 #include <KUrl>
 
+#include <QtCore/QSharedData>
 #include <QtCore/QStringList>
 
 using namespace KCalCore;
@@ -55,19 +56,39 @@ using namespace KCalCore;
 class KCalCore::IncidenceBase::Private
 {
   public:
+    /**
+      The plain value part of an incidence. It is implicitly shared between
+      copies of an incidence and only detached when one of them is modified,
+      so cloning an incidence does not copy it. Date/time values are kept
+      out of it, see mDtStart.
+    */
+    class Core : public QSharedData
+    {
+      public:
+        Core()
+          : mOrganizer( new Person() ),
+            mAllDay( true ),
+            mHasDuration( false )
+        {}
+
+        Person::Ptr mOrganizer;      // incidence person (owner)
+        QString mUid;                // incidence unique id
+        Duration mDuration;          // incidence duration
+        bool mAllDay;                // true if the incidence is all-day
+        bool mHasDuration;           // true if the incidence has a duration
+        QStringList mComments;       // list of incidence comments
+        QStringList mContacts;       // list of incidence contacts
+    };
+
     Private()
-      : mOrganizer( new Person() ),
+      : mCore( new Core ),
         mUpdateGroupLevel( 0 ),
-        mUpdatedPending( false ),
-        mAllDay( true ),
-        mHasDuration( false )
+        mUpdatedPending( false )
     {}
 
     Private( const Private &other )
       : mUpdateGroupLevel( 0 ),
-        mUpdatedPending( false ),
-        mAllDay( true ),
-        mHasDuration( false )
+        mUpdatedPending( false )
     {
       init( other );
     }
@@ -78,18 +99,21 @@ class KCalCore::IncidenceBase::Private
 
     void init( const Private &other );
 
+    // Read access, which must not detach the shared data.
+    const Core &core() const
+    {
+      return *mCore.constData();
+    }
+
+    QSharedDataPointer<Core> mCore;   // shared value data, see Core
+    // Date/time values cache their conversions even in const methods, so
+    // each copy of an incidence has its own, and copies can be read from
+    // different threads.
     KDateTime mLastModified;     // incidence last modified date
     KDateTime mDtStart;          // incidence start time
-    Person::Ptr mOrganizer;           // incidence person (owner)
-    QString mUid;                // incidence unique id
-    Duration mDuration;          // incidence duration
     int mUpdateGroupLevel;       // if non-zero, suppresses update() calls
     bool mUpdatedPending;        // true if an update has occurred since startUpdates()
-    bool mAllDay;                // true if the incidence is all-day
-    bool mHasDuration;           // true if the incidence has a duration
     Attendee::List mAttendees;   // list of incidence attendees
-    QStringList mComments;       // list of incidence comments
-    QStringList mContacts;       // list of incidence contacts
     QList<IncidenceObserver*> mObservers; // list of incidence observers
     QSet<Field> mDirtyFields;    // Fields that changed since last time the incidence was created
                                  // or since resetDirtyFlags() was called
@@ -97,18 +121,16 @@ class KCalCore::IncidenceBase::Private
 
 void IncidenceBase::Private::init( const Private &other )
 {
+  mCore = other.mCore;
   mLastModified = other.mLastModified;
+  mLastModified.detach();
   mDtStart = other.mDtStart;
-  mOrganizer = other.mOrganizer;
-  mUid = other.mUid;
-  mDuration = other.mDuration;
-  mAllDay = other.mAllDay;
-  mHasDuration = other.mHasDuration;
-
-  mComments = other.mComments;
-  mContacts = other.mContacts;
+  mDtStart.detach();
 
+  // Attendees are handed out as modifiable pointers, so they cannot be
+  // shared between copies.
   mAttendees.clear();
+  mAttendees.reserve( other.mAttendees.count() );
   Attendee::List::ConstIterator it;
   for ( it = other.mAttendees.constBegin(); it != other.mAttendees.constEnd(); ++it ) {
     mAttendees.append( Attendee::Ptr( new Attendee( *( *it ) ) ) );
@@ -217,14 +239,14 @@ bool IncidenceBase::accept( Visitor &v, IncidenceBase::Ptr incidence )
 void IncidenceBase::setUid( const QString &uid )
 {
   update();
-  d->mUid = uid;
+  d->mCore->mUid = uid;
   d->mDirtyFields.insert( FieldUid );
   updated();
 }
 
 QString IncidenceBase::uid() const
 {
-  return d->mUid;
+  return d->core().mUid;
 }
 
 void IncidenceBase::setLastModified( const KDateTime &lm )
@@ -254,7 +276,7 @@ void IncidenceBase::setOrganizer( const Person::Ptr &o )
   // we don't check for readonly here, because it is
   // possible that by setting the organizer we are changing
   // the event's readonly status...
-  d->mOrganizer = o;
+  d->mCore->mOrganizer = o;
 
   d->mDirtyFields.insert( FieldOrganizer );
 
@@ -275,7 +297,7 @@ void IncidenceBase::setOrganizer( const QString &o )
 
 Person::Ptr IncidenceBase::organizer() const
 {
-  return d->mOrganizer;
+  return d->core().mOrganizer;
 }
 
 void IncidenceBase::setReadOnly( bool readOnly )
@@ -293,7 +315,7 @@ void IncidenceBase::setDtStart( const KDateTime &dtStart )
 //  if ( mReadOnly ) return;
   update();
   d->mDtStart = dtStart;
-  d->mAllDay = dtStart.isDateOnly();
+  d->mCore->mAllDay = dtStart.isDateOnly();
   d->mDirtyFields.insert( FieldDtStart );
   updated();
 }
@@ -305,16 +327,16 @@ KDateTime IncidenceBase::dtStart() const
 
 bool IncidenceBase::allDay() const
 {
-  return d->mAllDay;
+  return d->core().mAllDay;
 }
 
 void IncidenceBase::setAllDay( bool f )
 {
-  if ( mReadOnly || f == d->mAllDay ) {
+  if ( mReadOnly || f == d->core().mAllDay ) {
     return;
   }
   update();
-  d->mAllDay = f;
+  d->mCore->mAllDay = f;
   if ( d->mDtStart.isValid() ) {
     d->mDirtyFields.insert( FieldDtStart );
   }
@@ -325,6 +347,9 @@ void IncidenceBase::shiftTimes( const KDateTime::Spec &oldSpec,
                                 const KDateTime::Spec &newSpec )
 {
   update();
+  // Detach first: the conversion caches its result in the value, which must
+  // not be shared with other incidences shifted at the same time.
+  d->mDtStart.detach();
   d->mDtStart = d->mDtStart.toTimeSpec( oldSpec );
   d->mDtStart.setTimeSpec( newSpec );
   d->mDirtyFields.insert( FieldDtStart );
@@ -334,75 +359,63 @@ void IncidenceBase::shiftTimes( const KDateTime::Spec &oldSpec,
 
 void IncidenceBase::addComment( const QString &comment )
 {
-  d->mComments += comment;
+  d->mCore->mComments += comment;
 }
 
 bool IncidenceBase::removeComment( const QString &comment )
 {
-  bool found = false;
-  QStringList::Iterator i;
-
-  for ( i = d->mComments.begin(); !found && i != d->mComments.end(); ++i ) {
-    if ( ( *i ) == comment ) {
-      found = true;
-      d->mComments.erase( i );
-    }
-  }
-
-  if ( found ) {
-    d->mDirtyFields.insert( FieldComment );
+  // Look the string up first, so that a miss does not detach the shared data
+  const int index = d->core().mComments.indexOf( comment );
+  if ( index < 0 ) {
+    return false;
   }
 
-  return found;
+  d->mCore->mComments.removeAt( index );
+  d->mDirtyFields.insert( FieldComment );
+  return true;
 }
 
 void IncidenceBase::clearComments()
 {
   d->mDirtyFields.insert( FieldComment );
-  d->mComments.clear();
+  d->mCore->mComments.clear();
 }
 
 QStringList IncidenceBase::comments() const
 {
-  return d->mComments;
+  return d->core().mComments;
 }
 
 void IncidenceBase::addContact( const QString &contact )
 {
   if ( !contact.isEmpty() ) {
-    d->mContacts += contact;
+    d->mCore->mContacts += contact;
     d->mDirtyFields.insert( FieldContact );
   }
 }
 
 bool IncidenceBase::removeContact( const QString &contact )
 {
-  bool found = false;
-  QStringList::Iterator i;
-
-  for ( i = d->mContacts.begin(); !found && i != d->mContacts.end(); ++i ) {
-    if ( ( *i ) == contact ) {
-      found = true;
-      d->mContacts.erase( i );
-    }
-  }
-
-  if ( found ) {
-    d->mDirtyFields.insert( FieldContact );
+  // Look the string up first, so that a miss does not detach the shared data
+  const int index = d->core().mContacts.indexOf( contact );
+  if ( index < 0 ) {
+    return false;
   }
 
-  return found;
+  d->mCore->mContacts.removeAt( index );
+  d->mDirtyFields.insert( FieldContact );
+  return true;
 }
 
 void IncidenceBase::clearContacts()
 {
   d->mDirtyFields.insert( FieldContact );
-  d->mContacts.clear();
+  d->mCore->mContacts.clear();
 }
 
 QStringList IncidenceBase::contacts() const
 {
-  return d->mContacts;
+  return d->core().mContacts;
 }
 
 void IncidenceBase::addAttendee( const Attendee::Ptr &a, bool doupdate )
@@ -526,7 +539,7 @@ Attendee::Ptr IncidenceBase::attendeeByUid( const QString &uid ) const
 void IncidenceBase::setDuration( const Duration &duration )
 {
   update();
-  d->mDuration = duration;
+  d->mCore->mDuration = duration;
   setHasDuration( true );
   d->mDirtyFields.insert( FieldDuration );
   updated();
@@ -534,17 +547,17 @@ void IncidenceBase::setDuration( const Duration &duration )
 
 Duration IncidenceBase::duration() const
 {
-  return d->mDuration;
+  return d->core().mDuration;
 }
 
 void IncidenceBase::setHasDuration( bool hasDuration )
 {
-  d->mHasDuration = hasDuration;
+  d->mCore->mHasDuration = hasDuration;
 }
 
 bool IncidenceBase::hasDuration() const
 {
-  return d->mHasDuration;
+  return d->core().mHasDuration;
 }
 
 void IncidenceBase::registerObserver( IncidenceBase::IncidenceObserver *observer )
@@ -0,0 +1,219 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the Instrumentation class.
+*/
+#include "instrumentation.h"
+
+#include <KDebug>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+using namespace KCalCore;
+
+//@cond PRIVATE
+static const int MaxTraceEvents = 100000;
+
+static QAtomicInt s_enabled;
+
+static inline bool loadFlag( const QAtomicInt &flag )
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+  return flag.load();
+#else
+  return flag;
+#endif
+}
+
+namespace {
+
+struct TraceEvent
+{
+  Instrumentation::Operation operation;
+  qint64 start;
+  qint64 duration;
+  quintptr thread;
+};
+
+struct Data
+{
+  Data() : tracing( false )
+  {
+    timer.start();
+  }
+
+  QMutex mutex;
+  QElapsedTimer timer;
+  Instrumentation::Statistics statistics[Instrumentation::OperationCount];
+  QVector<TraceEvent> trace;
+  bool tracing;
+};
+
+}
+
+Q_GLOBAL_STATIC( Data, s_data )
+//@endcond
+
+Instrumentation::Scope::Scope( Operation operation )
+  : mOperation( operation ),
+    mStart( loadFlag( s_enabled ) ? s_data()->timer.nsecsElapsed() : -1 )
+{
+}
+
+Instrumentation::Scope::~Scope()
+{
+  if ( mStart < 0 ) {
+    return;
+  }
+
+  Data *data = s_data();
+  const qint64 duration = data->timer.nsecsElapsed() - mStart;
+  QMutexLocker lock( &data->mutex );
+  Statistics &statistics = data->statistics[mOperation];
+  ++statistics.count;
+  statistics.nanoseconds += duration;
+  if ( data->tracing && data->trace.count() < MaxTraceEvents ) {
+    const TraceEvent event = {
+      mOperation, mStart, duration,
+      reinterpret_cast<quintptr>( QThread::currentThreadId() )
+    };
+    data->trace.append( event );
+  }
+}
+
+void Instrumentation::setEnabled( bool enabled )
+{
+  // Start the timer before any scope can see the flag
+  s_data();
+  s_enabled.fetchAndStoreOrdered( enabled ? 1 : 0 );
+}
+
+bool Instrumentation::isEnabled()
+{
+  return loadFlag( s_enabled );
+}
+
+void Instrumentation::setTracing( bool tracing )
+{
+  Data *data = s_data();
+  QMutexLocker lock( &data->mutex );
+  data->tracing = tracing;
+}
+
+bool Instrumentation::isTracing()
+{
+  Data *data = s_data();
+  QMutexLocker lock( &data->mutex );
+  return data->tracing;
+}
+
+Instrumentation::Statistics Instrumentation::statistics( Operation operation )
+{
+  if ( operation < 0 || operation >= OperationCount ) {
+    return Statistics();
+  }
+
+  Data *data = s_data();
+  QMutexLocker lock( &data->mutex );
+  return data->statistics[operation];
+}
+
+const char *Instrumentation::operationName( Operation operation )
+{
+  switch ( operation ) {
+  case Parse:
+    return "parse";
+  case Populate:
+    return "populate";
+  case Add:
+    return "add";
+  case RangeQuery:
+    return "rangeQuery";
+  case RecurrenceExpansion:
+    return "recurrenceExpansion";
+  case AlarmScan:
+    return "alarmScan";
+  case Save:
+    return "save";
+  default:
+    return "unknown";
+  }
+}
+
+void Instrumentation::reset()
+{
+  Data *data = s_data();
+  QMutexLocker lock( &data->mutex );
+  for ( int i = 0; i < OperationCount; ++i ) {
+    data->statistics[i] = Statistics();
+  }
+  data->trace.clear();
+}
+
+bool Instrumentation::writeTrace( const QString &fileName )
+{
+  QVector<TraceEvent> trace;
+  {
+    Data *data = s_data();
+    QMutexLocker lock( &data->mutex );
+    trace = data->trace;
+  }
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+    kWarning() << "Cannot write trace to" << fileName << ":" << file.errorString();
+    return false;
+  }
+
+  // Chrome trace events use microseconds
+  const QByteArray pid = QByteArray::number( QCoreApplication::applicationPid() );
+  QByteArray json( "{\"traceEvents\":[" );
+  for ( int i = 0; i < trace.count(); ++i ) {
+    const TraceEvent &event = trace[i];
+    if ( i > 0 ) {
+      json += ',';
+    }
+    json += "\n{\"name\":\"";
+    json += operationName( event.operation );
+    json += "\",\"cat\":\"kcalcore\",\"ph\":\"X\",\"ts\":";
+    json += QByteArray::number( event.start / 1000.0, 'f', 3 );
+    json += ",\"dur\":";
+    json += QByteArray::number( event.duration / 1000.0, 'f', 3 );
+    json += ",\"pid\":";
+    json += pid;
+    json += ",\"tid\":";
+    json += QByteArray::number( quint64( event.thread ) );
+    json += '}';
+  }
+  json += "\n]}\n";
+
+  if ( file.write( json ) != json.size() ) {
+    kWarning() << "Cannot write trace to" << fileName << ":" << file.errorString();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,162 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the Instrumentation class.
+*/
+
+#ifndef KCALCORE_INSTRUMENTATION_H
+#define KCALCORE_INSTRUMENTATION_H
+
+#include "kcalcore_export.h"
+
+#include <QtCore/QtGlobal>
+
+class QString;
+
+namespace KCalCore {
+
+/**
+  @brief
+  Counts and times the main operations of calendars and calendar formats.
+
+  Instrumentation is disabled by default, in which case each instrumented
+  operation only costs a check of a flag. Once enabled with setEnabled(),
+  the number of calls and the cumulative time of each Operation are
+  collected for the whole process, and can be read with statistics().
+
+  When tracing is also enabled with setTracing(), every call is recorded as
+  well and can be written out with writeTrace() in the Chrome trace event
+  format, to be inspected in chrome://tracing or similar tools.
+
+  @since 4.11
+*/
+class KCALCORE_EXPORT Instrumentation
+{
+  public:
+    /**
+      The instrumented operations.
+    */
+    enum Operation {
+      Parse,               /**< parsing of iCalendar data by libical */
+      Populate,            /**< filling a calendar from parsed data */
+      Add,                 /**< adding an incidence to a calendar */
+      RangeQuery,          /**< retrieving incidences for a date or range */
+      RecurrenceExpansion, /**< computing the occurrences in an interval */
+      AlarmScan,           /**< retrieving the alarms due in an interval */
+      Save,                /**< writing a calendar to a file */
+      OperationCount       /**< number of operations, not an operation */
+    };
+
+    /**
+      Statistics collected for one operation.
+    */
+    struct Statistics {
+      Statistics() : count( 0 ), nanoseconds( 0 ) {}
+      quint64 count;       /**< number of calls */
+      qint64 nanoseconds;  /**< cumulative time spent in the calls */
+    };
+
+    /**
+      Records the time spent in an operation until the scope is left.
+      Nothing is recorded if instrumentation is disabled when the scope
+      is entered.
+    */
+    class KCALCORE_EXPORT Scope
+    {
+      public:
+        /**
+          Starts timing @p operation.
+        */
+        explicit Scope( Operation operation );
+
+        /**
+          Stops timing and records the operation.
+        */
+        ~Scope();
+
+      private:
+        Q_DISABLE_COPY( Scope )
+        Operation mOperation;
+        qint64 mStart;
+    };
+
+    /**
+      Enables or disables the collection of statistics.
+
+      @param enabled true to collect statistics.
+      @see isEnabled()
+    */
+    static void setEnabled( bool enabled );
+
+    /**
+      Returns true if statistics are collected.
+      @see setEnabled()
+    */
+    static bool isEnabled();
+
+    /**
+      Enables or disables the recording of trace events. Tracing only has
+      an effect while instrumentation is enabled. At most 100000 events are
+      kept, later ones are dropped until reset() is called.
+
+      @param tracing true to record every instrumented call.
+      @see writeTrace()
+    */
+    static void setTracing( bool tracing );
+
+    /**
+      Returns true if trace events are recorded.
+      @see setTracing()
+    */
+    static bool isTracing();
+
+    /**
+      Returns the statistics collected for @p operation since
+      instrumentation was enabled or last reset.
+    */
+    static Statistics statistics( Operation operation );
+
+    /**
+      Returns a short name for @p operation, as used in trace output.
+    */
+    static const char *operationName( Operation operation );
+
+    /**
+      Clears the collected statistics and trace events.
+    */
+    static void reset();
+
+    /**
+      Writes the recorded trace events to @p fileName as a Chrome trace
+      event JSON document.
+
+      @return true if the file could be written, false otherwise.
+      @see setTracing()
+    */
+    static bool writeTrace( const QString &fileName );
+
+  private:
+    Instrumentation();
+};
+
+}
+
+#endif
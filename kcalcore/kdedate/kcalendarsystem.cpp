@@ -24,6 +24,8 @@
 #include "kglobal.h"
 
 #include <QtCore/QDateTime>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
 
 #include "kcalendarsystemgregorian.h"
 #include "kcalendarsystemhebrew.h"
@@ -89,7 +91,8 @@ QString KCalendarSystem::calendarLabel( const QString &calendarType )
 class KCalendarSystemPrivate
 {
 public:
-    KCalendarSystemPrivate( KCalendarSystem *q ): q( q )
+    KCalendarSystemPrivate( KCalendarSystem *q ): q( q ),
+        cacheMutex( QMutex::Recursive ), cacheDisabled( false )
     {
     }
 
@@ -97,15 +100,81 @@ public:
     {
     }
 
+    // The month starts of a year, as Julian days
+    struct YearTable
+    {
+        int year;
+        QVector<int> monthStarts;
+        int nextYearStart;
+    };
+
     KCalendarSystem *q;
 
     bool setAnyDate( QDate &date, int year, int month, int day ) const;
 
     int stringToInteger( const QString &sNum, int &iLength );
 
+    const YearTable *yearTable( int jd ) const;
+
     const KLocale *locale;
+
+    // Recursive, as the conversions call back into the calendar system
+    mutable QMutex cacheMutex;
+    mutable QMap<int, YearTable> yearCache;    // by first day of the year
+    mutable bool cacheDisabled;
 };
 
+// Years are cached as they are converted, a few centuries at most
+static const int MaxCachedYears = 512;
+
+// Returns the table of the year containing Julian day @p jd, building it on
+// a miss, or 0 if the year cannot be cached. The caller holds cacheMutex.
+const KCalendarSystemPrivate::YearTable *KCalendarSystemPrivate::yearTable( int jd ) const
+{
+    QMap<int, YearTable>::ConstIterator it = yearCache.upperBound( jd );
+    if ( it != yearCache.constBegin() ) {
+        --it;
+        if ( jd < it->nextYearStart ) {
+            return &it.value();
+        }
+    }
+    if ( cacheDisabled ) {
+        return 0;
+    }
+
+    int year, month, day;
+    if ( !q->julianDayToDate( jd, year, month, day ) ) {
+        return 0;
+    }
+    YearTable table;
+    table.year = year;
+    int start;
+    for ( int m = 1; m <= 14 && q->dateToJulianDay( year, m, 1, start ); ++m ) {
+        if ( !table.monthStarts.isEmpty() && start <= table.monthStarts.last() ) {
+            cacheDisabled = true;
+            return 0;
+        }
+        table.monthStarts.append( start );
+    }
+    if ( table.monthStarts.isEmpty() ||
+         !q->dateToJulianDay( year + 1, 1, 1, table.nextYearStart ) ) {
+        return 0;   // first or last valid year
+    }
+
+    // Only cache the systems whose conversions agree both ways
+    if ( month < 1 || month > table.monthStarts.count() ||
+         table.monthStarts[month - 1] + day - 1 != jd ||
+         table.nextYearStart <= table.monthStarts.last() ) {
+        cacheDisabled = true;
+        return 0;
+    }
+
+    if ( yearCache.count() >= MaxCachedYears ) {
+        yearCache.clear();
+    }
+    return &yearCache.insert( table.monthStarts.first(), table ).value();
+}
+
 // Allows us to set dates outside publically valid range, USE WITH CARE!!!!
 bool KCalendarSystemPrivate::setAnyDate( QDate &date, int year, int month, int day ) const
 {
@@ -251,6 +320,50 @@ int KCalendarSystem::day( const QDate &date ) const
     return 0;
 }
 
+QVector<KCalendarSystem::YearMonthDay> KCalendarSystem::julianDaysToDates( int jd, int count ) const
+{
+    QVector<YearMonthDay> result( qMax( count, 0 ) );
+    const int firstValid = earliestValidDate().toJulianDay();
+    const int lastValid = latestValidDate().toJulianDay();
+
+    QMutexLocker locker( &d->cacheMutex );
+    int i = 0;
+    while ( i < result.count() ) {
+        const int day = jd + i;
+        YearMonthDay &date = result[i];
+        if ( day < firstValid || day > lastValid ) {
+            date.year = date.month = date.day = 0;
+            ++i;
+            continue;
+        }
+
+        const KCalendarSystemPrivate::YearTable *table = d->yearTable( day );
+        if ( !table ) {
+            if ( !julianDayToDate( day, date.year, date.month, date.day ) ) {
+                date.year = date.month = date.day = 0;
+            }
+            ++i;
+            continue;
+        }
+
+        // The rest of the year from the table
+        const QVector<int> &starts = table->monthStarts;
+        const int end = qMin( result.count(), qMin( table->nextYearStart, lastValid + 1 ) - jd );
+        int month = 1;
+        for ( ; i < end; ++i ) {
+            const int current = jd + i;
+            while ( month < starts.count() && starts[month] <= current ) {
+                ++month;
+            }
+            YearMonthDay &entry = result[i];
+            entry.year = table->year;
+            entry.month = month;
+            entry.day = current - starts[month - 1] + 1;
+        }
+    }
+    return result;
+}
+
 QDate KCalendarSystem::addYears( const QDate &date, int numYears ) const
 {
     if ( isValid( date ) ) {
@@ -26,6 +26,7 @@
 #include "klocale.h"  // needed for enums
 
 #include <QtCore/QStringList>
+#include <QtCore/QVector>
 
 class KCalendarSystemPrivate;
 
@@ -231,6 +232,29 @@ public:
      */
     virtual int day( const QDate &date ) const;
 
+    /**
+     * A date split into year, month and day in a calendar system.
+     */
+    struct YearMonthDay {
+        int year;     /**< year number */
+        int month;    /**< month number */
+        int day;      /**< day of month */
+    };
+
+    /**
+     * Converts @p count consecutive Julian days, starting from @p jd, into
+     * dates of the current calendar system, in one call.
+     *
+     * This is much faster than converting each day on its own, e.g. for the
+     * days shown by a month view: the first day and the month starts of each
+     * year are only computed once per calendar system instance, and cached.
+     *
+     * @param jd Julian day number of the first day to convert
+     * @param count number of days to convert
+     * @return the @p count dates, zeroed for days out of the valid range
+     */
+    QVector<YearMonthDay> julianDaysToDates( int jd, int count ) const;
+
     /**
      * Returns a QDate containing a date @p nyears years later.
      *
@@ -37,6 +37,9 @@
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QRegExp>
 #include <QtCore/QStringList>
 #include <QtCore/QTextStream>
@@ -51,6 +54,7 @@
 #include <kdebug.h>
 #include <kconfiggroup.h>
 #include "ktzfiletimezone.h"
+#include "ktzfiletimezone_p.h"
 
 #ifdef TIMED_SUPPORT
 # if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -120,6 +124,7 @@ class KSystemTimeZonesPrivate : public KTimeZones
 public:
     static KSystemTimeZonesPrivate *instance();
     static KTzfileTimeZoneSource *tzfileSource();
+    static const KTzfileTimeZoneOffsets *offsets(const QString &zoneName);
     static void setLocalZone();
     static void cleanup();
     static void readConfig(bool init);
@@ -143,6 +148,8 @@ private:
     static KSystemTimeZones *m_parent;
     static KSystemTimeZonesPrivate *m_instance;
     static KTzfileTimeZoneSource *m_tzfileSource;
+    static QHash<QString, KTzfileTimeZoneOffsets*> m_offsets;
+    static QReadWriteLock m_offsetsLock;
 };
 
 KTimeZone                KSystemTimeZonesPrivate::m_localZone;
@@ -151,6 +158,8 @@ QString                  KSystemTimeZonesPrivate::m_zoneinfoDir;
 QString                  KSystemTimeZonesPrivate::m_zonetab;
 KSystemTimeZoneSource   *KSystemTimeZonesPrivate::m_source = 0;
 KTzfileTimeZoneSource   *KSystemTimeZonesPrivate::m_tzfileSource = 0;
+QHash<QString, KTzfileTimeZoneOffsets*> KSystemTimeZonesPrivate::m_offsets;
+QReadWriteLock           KSystemTimeZonesPrivate::m_offsetsLock;
 KSystemTimeZones        *KSystemTimeZonesPrivate::m_parent = 0;
 KSystemTimeZonesPrivate *KSystemTimeZonesPrivate::m_instance = 0;
 
@@ -164,6 +173,34 @@ KTzfileTimeZoneSource *KSystemTimeZonesPrivate::tzfileSource()
     return m_tzfileSource;
 }
 
+/*
+ * Return the UTC offsets of a system time zone, which are parsed from its
+ * tzfile on first use, or null if the tzfile cannot be read.
+ * This may be called from any thread.
+ */
+const KTzfileTimeZoneOffsets *KSystemTimeZonesPrivate::offsets(const QString &zoneName)
+{
+    {
+        QReadLocker locker(&m_offsetsLock);
+        QHash<QString, KTzfileTimeZoneOffsets*>::ConstIterator it = m_offsets.constFind(zoneName);
+        if (it != m_offsets.constEnd())
+            return it.value();
+    }
+    QWriteLocker locker(&m_offsetsLock);
+    if (m_offsets.contains(zoneName))
+        return m_offsets.value(zoneName);   // parsed by another thread meanwhile
+    KTzfileTimeZoneOffsets *offsets = 0;
+    KTzfileTimeZoneSource *source = tzfileSource();
+    KTimeZoneData *data = source->parse(KTzfileTimeZone(source, zoneName));
+    if (data)
+    {
+        offsets = new KTzfileTimeZoneOffsets(*static_cast<KTzfileTimeZoneData*>(data));
+        delete data;
+    }
+    m_offsets.insert(zoneName, offsets);   // remember failures too
+    return offsets;
+}
+
 
 KSystemTimeZones::KSystemTimeZones()
   : d(0)
@@ -379,6 +416,8 @@ void KSystemTimeZonesPrivate::cleanup()
     delete m_instance;
     delete m_source;
     delete m_tzfileSource;
+    qDeleteAll(m_offsets);
+    m_offsets.clear();
 }
 
 #ifndef Q_OS_WIN
@@ -490,6 +529,19 @@ float KSystemTimeZonesPrivate::convertCoordinate(const QString &coordinate)
 
 /******************************************************************************/
 
+/* Serialises the conversions which switch the process wide TZ variable, for
+ * the zones whose tzfile cannot be read.
+ */
+static QMutex tzMutex;
+
+/* Return the number of seconds from 1970-01-01 00:00:00 to a date/time,
+ * ignoring its time spec.
+ */
+static qint64 epochSecs(const QDateTime &dt)
+{
+    return (qint64(dt.date().toJulianDay()) - 2440588) * 86400 + QTime(0, 0).secsTo(dt.time());
+}
+
 
 KSystemTimeZoneBackend::KSystemTimeZoneBackend(KSystemTimeZoneSource *source, const QString &name,
         const QString &countryCode, float latitude, float longitude, const QString &comment)
@@ -513,6 +565,12 @@ int KSystemTimeZoneBackend::offsetAtZoneTime(const KTimeZone *caller, const QDat
 {
     if (!caller->isValid()  ||  !zoneDateTime.isValid()  ||  zoneDateTime.timeSpec() != Qt::LocalTime)
         return 0;
+    if (const KTzfileTimeZoneOffsets *offsets = KSystemTimeZonesPrivate::offsets(caller->name()))
+        return offsets->offsetAtZoneTime(epochSecs(zoneDateTime), secondOffset);
+
+    // The zone file cannot be read: ask the C library, under a lock since
+    // the local time zone is process wide.
+    QMutexLocker locker(&tzMutex);
     // Make this time zone the current local time zone
     const QByteArray originalZone = qgetenv("TZ");   // save the original local time zone
     QByteArray tz = caller->name().toUtf8();
@@ -580,6 +638,11 @@ int KSystemTimeZoneBackend::offsetAtZoneTime(const KTimeZone *caller, const QDat
 
 int KSystemTimeZoneBackend::offsetAtUtc(const KTimeZone *caller, const QDateTime &utcDateTime) const
 {
+    if (caller->isValid()  &&  utcDateTime.isValid()  &&  utcDateTime.timeSpec() == Qt::UTC)
+    {
+        if (const KTzfileTimeZoneOffsets *offsets = KSystemTimeZonesPrivate::offsets(caller->name()))
+            return offsets->offset(epochSecs(utcDateTime));
+    }
     return offset(caller, KTimeZone::toTime_t(utcDateTime));
 }
 
@@ -587,7 +650,10 @@ int KSystemTimeZoneBackend::offset(const KTimeZone *caller, time_t t) const
 {
     if (!caller->isValid()  ||  t == KTimeZone::InvalidTime_t)
         return 0;
+    if (const KTzfileTimeZoneOffsets *offsets = KSystemTimeZonesPrivate::offsets(caller->name()))
+        return offsets->offset(t);
 
+    QMutexLocker locker(&tzMutex);
     // Make this time zone the current local time zone
     const QByteArray originalZone = qgetenv("TZ");   // save the original local time zone
     QByteArray tz = caller->name().toUtf8();
@@ -620,7 +686,15 @@ bool KSystemTimeZoneBackend::isDstAtUtc(const KTimeZone *caller, const QDateTime
 
 bool KSystemTimeZoneBackend::isDst(const KTimeZone *caller, time_t t) const
 {
-    Q_UNUSED(caller)
+    if (caller->isValid()  &&  t != KTimeZone::InvalidTime_t)
+    {
+        if (const KTzfileTimeZoneOffsets *offsets = KSystemTimeZonesPrivate::offsets(caller->name()))
+        {
+            bool dst;
+            offsets->offset(t, &dst);
+            return dst;
+        }
+    }
     if (t != (time_t)-1)
     {
 #ifdef _POSIX_THREAD_SAFE_FUNCTIONS
@@ -179,10 +179,14 @@ private:
  *
  * Typically, instances are created and accessed via the KSystemTimeZones class.
  *
- * @warning The KSystemTimeZone class uses the standard system libraries to
- * access time zone data, and its functionality is limited to what these libraries
- * provide. On many systems, dates earlier than 1970 are not handled, and on
- * non-GNU systems there is no guarantee that the time zone abbreviation returned
+ * UTC offsets and daylight savings time are read from the tzfile(5) definition
+ * file of the zone, which is parsed once and then shared by all instances of the
+ * zone, so conversions are fast and may be done in several threads at once. Only
+ * if the file cannot be read are they obtained from the standard system libraries.
+ *
+ * @warning The KSystemTimeZone class otherwise uses the standard system libraries
+ * to access time zone data, and its functionality is limited to what these libraries
+ * provide. On non-GNU systems there is no guarantee that the time zone abbreviation returned
  * for a given date will be correct if the abbreviations applicable then were
  * not those currently in use. Consider using KSystemTimeZones::readZone() or the
  * KTzfileTimeZone class instead, which provide accurate information from the time
@@ -285,8 +289,9 @@ public:
      * The offset is the number of seconds which you must add to UTC to get
      * local time in this time zone.
      *
-     * Note that system times are represented using time_t. An error occurs if the date
-     * falls outside the range supported by time_t.
+     * Note that if the zone's tzfile cannot be read, system times are represented
+     * using time_t. An error then occurs if the date falls outside the range
+     * supported by time_t.
      *
      * @param caller calling KSystemTimeZone object
      * @param utcDateTime the UTC date/time at which the offset is to be calculated.
@@ -35,6 +35,7 @@
 #include <climits>
 #include <cstdlib>
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QSet>
 #include <QtCore/QSharedData>
 #include <QtCore/QCoreApplication>
@@ -325,7 +326,7 @@ public:
     float   latitude;
     float   longitude;
     mutable KTimeZoneData *data;
-    int refCount;
+    QAtomicInt refCount;     // atomic, since copies of a zone may be used in several threads
 
 private:
     static KTimeZoneSource *mUtcSource;
@@ -418,12 +419,12 @@ KTimeZoneBackend::KTimeZoneBackend(KTimeZoneSource *source, const QString &name,
 KTimeZoneBackend::KTimeZoneBackend(const KTimeZoneBackend &other)
   : d(other.d)
 {
-    ++d->refCount;
+    d->refCount.ref();
 }
   
 KTimeZoneBackend::~KTimeZoneBackend()
 {
-    if (d && --d->refCount == 0)
+    if (d && !d->refCount.deref())
         delete d;
     d = 0;
 }
@@ -432,10 +433,10 @@ KTimeZoneBackend &KTimeZoneBackend::operator=(const KTimeZoneBackend &other)
 {
     if (d != other.d)
     {
-        if (--d->refCount == 0)
+        if (!d->refCount.deref())
             delete d;
         d = other.d;
-        ++d->refCount;
+        d->refCount.ref();
     }
     return *this;
 }
@@ -557,7 +558,7 @@ KTimeZone::KTimeZone(KTimeZoneBackend *impl)
   : d(impl)
 {
     // 'impl' should be a newly constructed object, with refCount = 1
-    Q_ASSERT(d->d->refCount == 1);
+    Q_ASSERT(d->d->refCount.testAndSetRelaxed(1, 1));
 }
 
 KTimeZone &KTimeZone::operator=(const KTimeZone &tz)
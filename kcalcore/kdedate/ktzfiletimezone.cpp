@@ -19,6 +19,7 @@
 */
 
 #include "ktzfiletimezone.h"
+#include "ktzfiletimezone_p.h"
 
 #include <config.h>
 
@@ -35,15 +36,43 @@
 
 #include <kdebug.h>
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
 
 // Use this replacement for QDateTime::setTime_t(uint) since our time
 // values are signed.
-static QDateTime fromTime_t(qint32 seconds)
+static QDateTime fromTime_t(qint64 seconds)
 {
     static QDate epochDate(1970,1,1);
     static QTime epochTime(0,0,0);
-    int secs = (seconds >= 0) ? seconds % 86400 : -(-seconds % 86400);
-    return QDateTime(epochDate.addDays(seconds / 86400), epochTime.addSecs(secs), Qt::UTC);
+    // Round the days down, so that the time of day is never negative
+    qint64 days = seconds / 86400;
+    int secs = seconds % 86400;
+    if (secs < 0)
+    {
+        --days;
+        secs += 86400;
+    }
+    if (days < INT_MIN  ||  days > INT_MAX)
+        return QDateTime();   // the "big bang" times of 64-bit data are out of range
+    return QDateTime(epochDate.addDays(days), epochTime.addSecs(secs), Qt::UTC);
+}
+
+// Read a transition or leap second time, which is 4 bytes long in the
+// version 1 data of a tzfile and 8 bytes long in the version 2 data.
+static qint64 readTime(QDataStream &str, int size)
+{
+    if (size == 8)
+    {
+        qint64 t;
+        str >> t;
+        return t;
+    }
+    qint32 t;
+    str >> t;
+    return t;
 }
 
 /******************************************************************************/
@@ -90,27 +119,29 @@ KTzfileTimeZone::~KTzfileTimeZone()
 class KTzfileTimeZoneDataPrivate
 {
 public:
+    QByteArray posixTz;
 };
 
 
 KTzfileTimeZoneData::KTzfileTimeZoneData()
-//  : d(new KTzfileTimeZoneDataPrivate)
+  : d(new KTzfileTimeZoneDataPrivate)
 { }
 
 KTzfileTimeZoneData::KTzfileTimeZoneData(const KTzfileTimeZoneData &rhs)
-  : KTimeZoneData(rhs)
-//    d(new KTzfileTimeZoneDataPrivate)
+  : KTimeZoneData(rhs),
+    d(new KTzfileTimeZoneDataPrivate(*rhs.d))
 {
 }
 
 KTzfileTimeZoneData::~KTzfileTimeZoneData()
 {
-//    delete d;
+    delete d;
 }
 
 KTzfileTimeZoneData &KTzfileTimeZoneData::operator=(const KTzfileTimeZoneData &rhs)
 {
     KTimeZoneData::operator=(rhs);
+    *d = *rhs.d;
     return *this;
 }
 
@@ -124,6 +155,11 @@ bool KTzfileTimeZoneData::hasTransitions() const
     return true;
 }
 
+QByteArray KTzfileTimeZoneData::posixTz() const
+{
+    return d->posixTz;
+}
+
 
 /******************************************************************************/
 
@@ -158,9 +194,9 @@ QString KTzfileTimeZoneSource::location() const
 KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
 {
     quint32 abbrCharCount;     // the number of characters of time zone abbreviation strings
-    quint32 ttisgmtcnt;
     quint8  is;
     quint8  T_, Z_, i_, f_;    // tzfile identifier prefix
+    quint8  version;           // 0, '2' or later
 
     QString path = zone.name();
     if (!path.startsWith('/'))
@@ -179,16 +215,15 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
     QDataStream str(&f);
 
     // Read the file type identifier
-    str >> T_ >> Z_ >> i_ >> f_;
+    str >> T_ >> Z_ >> i_ >> f_ >> version;
     if (T_ != 'T' || Z_ != 'Z' || i_ != 'i' || f_ != 'f')
     {
         kError() << "Not a TZFILE: " << f.fileName() << endl;
         return 0;
     }
-    // Discard 16 bytes reserved for future use
+    // Discard 15 bytes reserved for future use
+    str.skipRawData(15);
     unsigned i;
-    for (i = 0; i < 4; ++i)
-        str >> ttisgmtcnt;
 
     KTzfileTimeZoneData* data = new KTzfileTimeZoneData;
 
@@ -207,17 +242,43 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
     // kDebug() << "header: " << nIsUtc << ", " << nIsStandard << ", " << nLeapSecondAdjusts << ", " <<
     //    nTransitionTimes << ", " << nLocalTimeTypes << ", " << abbrCharCount << endl;
 
+    // Version 2 and later files follow the 32-bit data with the same data
+    // using 64-bit times, which also cover the years before 1901 and after
+    // 2038, and with a POSIX TZ string for the times after the last
+    // transition. Skip to the 64-bit data when there is some.
+    int timeSize = 4;
+    if (version >= '2')
+    {
+        str.skipRawData(nTransitionTimes * 5 + nLocalTimeTypes * 6 + abbrCharCount
+                        + nLeapSecondAdjusts * 8 + nIsStandard + nIsUtc);
+        str >> T_ >> Z_ >> i_ >> f_ >> version;
+        if (T_ != 'T' || Z_ != 'Z' || i_ != 'i' || f_ != 'f')
+        {
+            kError() << "Bad 64-bit data in TZFILE: " << f.fileName() << endl;
+            delete data;
+            return 0;
+        }
+        str.skipRawData(15);
+        str >> nIsUtc
+            >> nIsStandard
+            >> nLeapSecondAdjusts
+            >> nTransitionTimes
+            >> nLocalTimeTypes
+            >> abbrCharCount;
+        timeSize = 8;
+    }
+
     // Read the transition times, at which the rules for computing local time change
     struct TransitionTime
     {
-        qint32 time;            // time (as returned by time(2)) at which the rules for computing local time change
+        qint64 time;            // time (as returned by time(2)) at which the rules for computing local time change
         quint8 localTimeIndex;  // index into the LocalTimeType array
     };
 //kDebug()<<"Reading zone "<<zone.name();
     TransitionTime *transitionTimes = new TransitionTime[nTransitionTimes];
     for (i = 0;  i < nTransitionTimes;  ++i)
     {
-        str >> transitionTimes[i].time;
+        transitionTimes[i].time = readTime(str, timeSize);
     }
     for (i = 0;  i < nTransitionTimes;  ++i)
     {
@@ -289,12 +350,13 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
 
 
     // Read the leap second adjustments
-    qint32  t;
+    qint64  t;
     quint32 s;
     QList<KTimeZone::LeapSeconds> leapChanges;
     for (i = 0;  i < nLeapSecondAdjusts;  ++i)
     {
-        str >> t >> s;
+        t = readTime(str, timeSize);
+        str >> s;
         // kDebug() << "leap entry: " << t << ", " << s;
         // Don't use QDateTime::setTime_t() because it takes an unsigned argument
         leapChanges += KTimeZone::LeapSeconds(fromTime_t(t), static_cast<int>(s));
@@ -321,6 +383,21 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
         // kDebug() << "UTC: " << is;
     }
 
+    // Read the POSIX TZ string, which is enclosed in newlines
+    if (timeSize == 8)
+    {
+        char c;
+        if (f.getChar(&c)  &&  c == '\n')
+        {
+            QByteArray tz = f.readLine(256);
+            if (tz.endsWith('\n'))
+            {
+                tz.chop(1);
+                data->d->posixTz = tz;
+            }
+        }
+    }
+
 
     // Find the starting offset from UTC to use before the first transition time.
     // This is first non-daylight savings local time type, or if there is none,
@@ -371,10 +448,10 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
     }
     data->setPhases(phases, firstoffset);
 
-    // Compile the transition list
+    // Compile the transition list.
+    // Transition times are always in UTC: the standard/wall clock and UTC/local
+    // indicators only apply to POSIX TZ rules built from the local time types.
     QList<KTimeZone::Transition> transitions;
-    int stdoffset = firstoffset;
-    int offset    = stdoffset;
     TransitionTime *tt = transitionTimes;
     for (i = 0;  i < nTransitionTimes;  ++tt, ++i)
     {
@@ -384,25 +461,12 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
             continue;
         }
 
-        // Convert local transition times to UTC
-        ltt = &localTimeTypes[tt->localTimeIndex];
-        if (!ltt->isutc)
-        {
-            /* The transition time is in local time, so convert it to UTC.
-             * If the transition is in "local wall clock time", use the UTC offset
-             * set up by the previous transition; otherwise, the transition is in
-             * standard time, so use the UTC offset set up by the last non-daylight
-             * savings time transition.
-             */
-            tt->time -= ltt->isstd ? stdoffset : offset;
-            offset = ltt->gmtoff;     // keep note of latest offset
-            if (!ltt->isdst)
-                stdoffset = offset;   // keep note of latest standard time offset
-        }
-
+        QDateTime time = fromTime_t(tt->time);
+        if (!time.isValid())
+            continue;
         KTimeZone::Phase phase = phases[lttLookup[tt->localTimeIndex]];
-//kDebug(161) << "Transition time "<<i<<": "<<fromTime_t(tt->time)<<", offset="<<phase.utcOffset()/60;
-        transitions += KTimeZone::Transition(fromTime_t(tt->time), phase);
+//kDebug(161) << "Transition time "<<i<<": "<<time<<", offset="<<phase.utcOffset()/60;
+        transitions += KTimeZone::Transition(time, phase);
     }
     data->setTransitions(transitions);
 //for(int xxx=1;xxx<data->transitions().count();xxx++)
@@ -412,3 +476,296 @@ KTimeZoneData* KTzfileTimeZoneSource::parse(const KTimeZone &zone) const
 
     return data;
 }
+
+
+/******************************************************************************/
+
+static const qint64 epochJulianDay = 2440588;   // 1970-01-01
+
+class KTzfileTimeZoneOffsetsPrivate
+{
+public:
+    // A transition date of a POSIX TZ string
+    struct RuleDate
+    {
+        char kind;     // 'J' for Jn, 'M' for Mm.w.d, 'D' for n
+        int  month;
+        int  week;
+        int  day;
+        int  time;     // local time of the transition, in seconds from midnight
+    };
+
+    bool parseRule(const QByteArray &tz);
+    int ruleOffset(qint64 utcSecs, bool *isDst) const;
+
+    QVector<qint64> times;     // UTC transition times, in ascending order
+    QVector<int>    offsets;   // offset to UTC from each transition
+    QVector<bool>   dsts;      // whether daylight savings time applies from each transition
+    int  initialOffset;        // offset to UTC before the first transition
+    bool initialDst;
+    bool hasRule;              // whether the POSIX TZ string applies after the last transition
+    bool ruleHasDst;
+    int  stdOffset;
+    int  dstOffset;
+    RuleDate dstStart;
+    RuleDate dstEnd;
+};
+
+// Parse an unsigned decimal number, returning -1 if there is none.
+static int parseNumber(const char *&p)
+{
+    if (*p < '0'  ||  *p > '9')
+        return -1;
+    int n = 0;
+    while (*p >= '0'  &&  *p <= '9')
+    {
+        n = n * 10 + (*p++ - '0');
+        if (n > 1000000)
+            return -1;
+    }
+    return n;
+}
+
+// Skip a time zone abbreviation, either alphabetic or quoted in <>.
+static bool parseName(const char *&p)
+{
+    if (*p == '<')
+    {
+        const char *end = strchr(p, '>');
+        if (!end)
+            return false;
+        p = end + 1;
+        return true;
+    }
+    const char *start = p;
+    while ((*p >= 'A' && *p <= 'Z')  ||  (*p >= 'a' && *p <= 'z'))
+        ++p;
+    return p - start >= 3;
+}
+
+// Parse a time of the form [+-]hh[:mm[:ss]], in seconds.
+static bool parseTime(const char *&p, int &secs)
+{
+    int sign = 1;
+    if (*p == '+'  ||  *p == '-')
+        sign = (*p++ == '-') ? -1 : 1;
+    int hours = parseNumber(p);
+    int minutes = 0;
+    int seconds = 0;
+    if (hours < 0)
+        return false;
+    if (*p == ':')
+    {
+        minutes = parseNumber(++p);
+        if (minutes < 0)
+            return false;
+        if (*p == ':')
+        {
+            seconds = parseNumber(++p);
+            if (seconds < 0)
+                return false;
+        }
+    }
+    secs = sign * (hours * 3600 + minutes * 60 + seconds);
+    return true;
+}
+
+// Parse a transition date of the form Jn, n or Mm.w.d, with an optional /time.
+static bool parseRuleDate(const char *&p, KTzfileTimeZoneOffsetsPrivate::RuleDate &date)
+{
+    if (*p == 'M')
+    {
+        date.kind  = 'M';
+        date.month = parseNumber(++p);
+        if (*p++ != '.')
+            return false;
+        date.week = parseNumber(p);
+        if (*p++ != '.')
+            return false;
+        date.day = parseNumber(p);
+        if (date.month < 1 || date.month > 12 || date.week < 1 || date.week > 5 || date.day < 0 || date.day > 6)
+            return false;
+    }
+    else if (*p == 'J')
+    {
+        date.kind = 'J';
+        date.day  = parseNumber(++p);
+        if (date.day < 1  ||  date.day > 365)
+            return false;
+    }
+    else
+    {
+        date.kind = 'D';
+        date.day  = parseNumber(p);
+        if (date.day < 0  ||  date.day > 365)
+            return false;
+    }
+    date.time = 7200;
+    if (*p == '/')
+        return parseTime(++p, date.time);
+    return true;
+}
+
+// Return the local time of a transition date in a given year, in seconds
+// since 1970-01-01 00:00:00 local time.
+static qint64 ruleTime(const KTzfileTimeZoneOffsetsPrivate::RuleDate &date, int year)
+{
+    QDate day;
+    switch (date.kind)
+    {
+        case 'J':
+            // February 29th is never counted
+            day = QDate(year, 1, 1).addDays(date.day - 1);
+            if (QDate::isLeapYear(year)  &&  date.day >= 60)
+                day = day.addDays(1);
+            break;
+        case 'D':
+            day = QDate(year, 1, 1).addDays(date.day);
+            break;
+        default:
+        {
+            // Day d (0 = Sunday) of week w, week 5 being the last one
+            const QDate first(year, date.month, 1);
+            int mday = 1 + (date.day - first.dayOfWeek() % 7 + 7) % 7 + (date.week - 1) * 7;
+            while (mday > first.daysInMonth())
+                mday -= 7;
+            day = first.addDays(mday - 1);
+            break;
+        }
+    }
+    return (day.toJulianDay() - epochJulianDay) * 86400 + date.time;
+}
+
+// Parse a POSIX TZ string of the form std offset [dst [offset] ,start[/time],end[/time]].
+// Offsets in TZ strings are the number of seconds to add to local time to get UTC.
+bool KTzfileTimeZoneOffsetsPrivate::parseRule(const QByteArray &tz)
+{
+    const char *p = tz.constData();
+    int offset;
+    if (!parseName(p)  ||  !parseTime(p, offset))
+        return false;
+    stdOffset  = -offset;
+    ruleHasDst = false;
+    if (!*p)
+        return true;
+    if (!parseName(p))
+        return false;
+    dstOffset = stdOffset + 3600;
+    if (*p  &&  *p != ',')
+    {
+        if (!parseTime(p, offset))
+            return false;
+        dstOffset = -offset;
+    }
+    // The default transition dates are implementation defined: ignore them
+    if (*p++ != ','  ||  !parseRuleDate(p, dstStart)
+    ||  *p++ != ','  ||  !parseRuleDate(p, dstEnd)  ||  *p)
+        return false;
+    ruleHasDst = true;
+    return true;
+}
+
+int KTzfileTimeZoneOffsetsPrivate::ruleOffset(qint64 utcSecs, bool *isDst) const
+{
+    bool dst = false;
+    if (ruleHasDst)
+    {
+        // The start is in standard time and the end in daylight savings time.
+        // In the southern hemisphere, daylight savings time spans the new year.
+        qint64 days = (utcSecs + stdOffset) / 86400;
+        if ((utcSecs + stdOffset) % 86400 < 0)
+            --days;
+        const int year = QDate::fromJulianDay(days + epochJulianDay).year();
+        const qint64 start = ruleTime(dstStart, year) - stdOffset;
+        const qint64 end   = ruleTime(dstEnd, year) - dstOffset;
+        if (start < end)
+            dst = (utcSecs >= start  &&  utcSecs < end);
+        else
+            dst = (utcSecs < end  ||  utcSecs >= start);
+    }
+    if (isDst)
+        *isDst = dst;
+    return dst ? dstOffset : stdOffset;
+}
+
+
+KTzfileTimeZoneOffsets::KTzfileTimeZoneOffsets(const KTzfileTimeZoneData &data)
+  : d(new KTzfileTimeZoneOffsetsPrivate)
+{
+    // Before the first transition, the offset is the first standard time one
+    d->initialOffset = data.previousUtcOffset();
+    d->initialDst = true;
+    foreach (const KTimeZone::Phase &phase, data.phases())
+    {
+        if (!phase.isDst()  &&  phase.utcOffset() == d->initialOffset)
+        {
+            d->initialDst = false;
+            break;
+        }
+    }
+
+    const QList<KTimeZone::Transition> transitions = data.transitions();
+    d->times.reserve(transitions.count());
+    d->offsets.reserve(transitions.count());
+    d->dsts.reserve(transitions.count());
+    foreach (const KTimeZone::Transition &transition, transitions)
+    {
+        const QDateTime time = transition.time();
+        d->times   += (time.date().toJulianDay() - epochJulianDay) * 86400 + QTime(0, 0).secsTo(time.time());
+        d->offsets += transition.phase().utcOffset();
+        d->dsts    += transition.phase().isDst();
+    }
+
+    const QByteArray tz = data.posixTz();
+    d->hasRule = !tz.isEmpty()  &&  d->parseRule(tz);
+    if (!tz.isEmpty()  &&  !d->hasRule)
+        kWarning() << "Unsupported POSIX TZ string:" << tz;
+}
+
+KTzfileTimeZoneOffsets::~KTzfileTimeZoneOffsets()
+{
+    delete d;
+}
+
+int KTzfileTimeZoneOffsets::offset(qint64 utcSecs, bool *isDst) const
+{
+    // As the C library does, the TZ string only applies once the transitions
+    // are exhausted, and no transitions means a fixed offset.
+    if (d->times.isEmpty()  ||  utcSecs < d->times.first())
+    {
+        if (isDst)
+            *isDst = d->initialDst;
+        return d->initialOffset;
+    }
+    if (d->hasRule  &&  utcSecs >= d->times.last())
+        return d->ruleOffset(utcSecs, isDst);
+    const int i = std::upper_bound(d->times.constBegin(), d->times.constEnd(), utcSecs) - d->times.constBegin() - 1;
+    if (isDst)
+        *isDst = d->dsts[i];
+    return d->offsets[i];
+}
+
+int KTzfileTimeZoneOffsets::offsetAtZoneTime(qint64 zoneSecs, int *secondOffset) const
+{
+    // An offset applies if the UTC time it gives has the same offset. Only
+    // the offsets in force a day before and a day after need checking, since
+    // no zone has two shifts within a day.
+    const int before = offset(zoneSecs - 86400);
+    const int after  = offset(zoneSecs + 86400);
+    const bool beforeValid = (offset(zoneSecs - before) == before);
+    const bool afterValid  = (offset(zoneSecs - after) == after);
+    int first, second;
+    if (beforeValid  &&  afterValid)
+    {
+        // The local time occurs twice, first with the larger offset
+        first  = qMax(before, after);
+        second = qMin(before, after);
+    }
+    else if (beforeValid)
+        first = second = before;
+    else
+        first = second = after;   // the local time is valid, or skipped by a shift forward
+    if (secondOffset)
+        *secondOffset = second;
+    return first;
+}
@@ -210,9 +210,17 @@ public:
      */
     virtual bool hasTransitions() const;
 
+    /**
+     * Returns the POSIX TZ string stored at the end of version 2 and later
+     * tzfile files, which describes local time after the last transition,
+     * e.g. "EET-2EEST,M3.5.0/3,M10.5.0/4".
+     *
+     * @return TZ string, or empty if the file has none
+     */
+    QByteArray posixTz() const;
+
 private:
-    // Enable this if you add KDECORE_EXPORT to this class
-    //KTzfileTimeZoneDataPrivate * const d;
+    KTzfileTimeZoneDataPrivate * const d;
 };
 
 #endif
@@ -0,0 +1,85 @@
+/*
+   This file is part of the KDE libraries
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/** @file
+ * Internal offset tables of TZFILE time zones
+ */
+
+#ifndef _KTZFILETIMEZONE_P_H
+#define _KTZFILETIMEZONE_P_H
+
+#include "ktzfiletimezone.h"
+
+class KTzfileTimeZoneOffsetsPrivate;
+
+/**
+ * @internal
+ * The UTC offsets of a tzfile time zone, held in flat arrays which are
+ * searched without any QDateTime conversion. Times after the last transition
+ * are resolved with the POSIX TZ string of the file, as the C library does,
+ * so that offsets are also right for dates beyond the transition list.
+ *
+ * The offsets are never modified once built, so they may be read by several
+ * threads at once.
+ *
+ * @short UTC offsets of a tzfile(5) time zone
+ * @see KTzfileTimeZoneData
+ * @ingroup timezones
+ */
+class KTzfileTimeZoneOffsets
+{
+public:
+    /**
+     * Builds the offsets from parsed tzfile data.
+     *
+     * @param data parsed data, as returned by KTzfileTimeZoneSource::parse()
+     */
+    explicit KTzfileTimeZoneOffsets(const KTzfileTimeZoneData &data);
+    ~KTzfileTimeZoneOffsets();
+
+    /**
+     * Returns the offset to UTC at a given UTC time.
+     *
+     * @param utcSecs UTC time, in seconds since 1970-01-01 00:00:00 UTC
+     * @param isDst   if non-null, set to whether daylight savings time is in force
+     * @return number of seconds to add to UTC to get local time
+     */
+    int offset(qint64 utcSecs, bool *isDst = 0) const;
+
+    /**
+     * Returns the offset to UTC at a given local time.
+     *
+     * When the local time occurs twice, because of a shift back of the
+     * clocks, the offset of the first occurrence is returned and the one of
+     * the second occurrence is set in @p secondOffset. When the local time
+     * does not occur, because of a shift forward, the offset after the shift
+     * is returned, as mktime(3) does.
+     *
+     * @param zoneSecs     local time, in seconds since 1970-01-01 00:00:00 local time
+     * @param secondOffset if non-null, set to the offset of the second occurrence
+     * @return number of seconds to add to UTC to get local time
+     */
+    int offsetAtZoneTime(qint64 zoneSecs, int *secondOffset = 0) const;
+
+private:
+    Q_DISABLE_COPY(KTzfileTimeZoneOffsets)
+    KTzfileTimeZoneOffsetsPrivate * const d;
+};
+
+#endif
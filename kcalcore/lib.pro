@@ -17,6 +17,7 @@ DEFINES += MEEGO \
 equals(QT_MAJOR_VERSION, 5) {
     PKGCONFIG += timed-qt5
     DEFINES += TIMED_SUPPORT
+    QT += concurrent
 }
 
 QT += dbus
@@ -56,6 +57,7 @@ HEADERS += alarm.h \
            calformat.h \
            calstorage.h \
            compat.h \
+           conflictdetector.h \
            customproperties.h \
            duration.h \
            event.h \
@@ -70,15 +72,19 @@ HEADERS += alarm.h \
            icaltimezones.h \
            incidence.h \
            incidencebase.h \
+           instrumentation.h \
            invitationhandlerif.h \
            journal.h \
            kcalcore_export.h \
            memorycalendar.h \
+           packeddatetime_p.h \
+           parallel_p.h \
            period.h \
            person.h \
            recurrence.h \
            recurrencerule.h \
            schedulemessage.h \
+           searchindex.h \
            sortablelist.h \
            sorting.h \
            supertrait.h \
@@ -148,6 +154,7 @@ SOURCES += alarm.cpp \
            calformat.cpp \
            calstorage.cpp \
            compat.cpp \
+           conflictdetector.cpp \
            customproperties.cpp \
            duration.cpp \
            event.cpp \
@@ -162,6 +169,7 @@ SOURCES += alarm.cpp \
            icaltimezones.cpp \
            incidence.cpp \
            incidencebase.cpp \
+           instrumentation.cpp \
            journal.cpp \
            memorycalendar.cpp \
            period.cpp \
@@ -169,6 +177,7 @@ SOURCES += alarm.cpp \
            recurrence.cpp \
            recurrencerule.cpp \
            schedulemessage.cpp \
+           searchindex.cpp \
            sorting.cpp \
            todo.cpp \
            vcalformat.cpp \
@@ -33,9 +33,13 @@
  */
 
 #include "memorycalendar.h"
+#include "icaltimezones.h"
+#include "instrumentation.h"
+#include "parallel_p.h"
 
 #include <KDebug>
 #include <QDate>
+#include <QVector>
 
 using namespace KCalCore;
 
@@ -48,7 +52,7 @@ class KCalCore::MemoryCalendar::Private
 {
   public:
     Private( MemoryCalendar *qq )
-      : q( qq ), mFormat( 0 )
+      : q( qq ), mFormat( 0 ), mKeepDeleted( true ), mTombstoneLimit( -1 ), mNextTombstone( 0 )
     {
     }
     ~Private()
@@ -70,6 +74,16 @@ class KCalCore::MemoryCalendar::Private
      * First indexed by incidence->type(), then by incidence->uid();
      */
     QMap<IncidenceBase::IncidenceType, QMultiHash<QString, Incidence::Ptr> > mDeletedIncidences;
+    bool mKeepDeleted;
+
+    /**
+     * Tombstones of the deleted incidences, indexed by the order of their
+     * deletion, and their keys indexed by uid.
+     */
+    QMap<qint64, Tombstone> mTombstones;
+    QMultiHash<QString, qint64> mTombstonesByUid;
+    int mTombstoneLimit;
+    qint64 mNextTombstone;
 
     /**
      * Contains incidences ( to-dos; non-recurring, non-multiday events; journals; )
@@ -84,8 +98,56 @@ class KCalCore::MemoryCalendar::Private
      */
     QMap<IncidenceBase::IncidenceType, QMultiHash<QDate, IncidenceBase::Ptr> > mIncidencesForDate;
 
+    /**
+     * The dates a multi-day or recurring event may cover, in the calendar's
+     * time spec. Such events are not in mIncidencesForDate.
+     */
+    struct Span {
+      QDate first;   // first date the event may cover, invalid if unknown
+      QDate last;    // last date the event may cover, invalid if unbounded
+      int months;    // bit n - 1 is set if the event may cover month n
+    };
+
+    /**
+     * Multi-day and recurring events, indexed by each month their span
+     * covers, as year * 12 + month - 1. Events with an unknown, unbounded or
+     * very long span are kept in mOpenSpans instead, and mSpans holds the
+     * span of every indexed event.
+     */
+    QMultiHash<int, Event::Ptr> mSpansForMonth;
+    QHash<const IncidenceBase *, Event::Ptr> mOpenSpans;
+    QHash<const IncidenceBase *, Span> mSpans;
+
+    /**
+     * A recurring incidence and its exceptions, the incidences with the
+     * same uid and a recurrence ID.
+     */
+    struct Series {
+      Incidence::Ptr incidence;                       // null if not in the calendar
+      QMultiMap<qint64, Incidence::Ptr> exceptions;   // by recurrenceKey()
+    };
+
+    /**
+     * The series with exceptions, first indexed by type, then by uid. The
+     * incidences of a series are taken out of it between incidenceUpdate()
+     * and incidenceUpdated(), since their recurrence ID may change, and
+     * kept in mUpdatingSeries meanwhile.
+     */
+    QMap<IncidenceBase::IncidenceType, QHash<QString, Series> > mSeries;
+    QMultiHash<QString, Incidence::Ptr> mUpdatingSeries;
+
     void insertIncidence( Incidence::Ptr incidence );
 
+    void insertSeries( const Incidence::Ptr &incidence );
+    bool removeSeries( const Incidence::Ptr &incidence );
+    Incidence::List exceptions( const IncidenceBase::IncidenceType type,
+                                const QString &uid ) const;
+
+    Span eventSpan( const Event::Ptr &event ) const;
+    void insertSpan( const Incidence::Ptr &incidence );
+    void removeSpan( const Incidence::Ptr &incidence );
+    void clearSpans();
+
     Incidence::Ptr incidence( const QString &uid,
                               const IncidenceBase::IncidenceType type,
                               const KDateTime &recurrenceId = KDateTime() ) const;
@@ -96,6 +158,12 @@ class KCalCore::MemoryCalendar::Private
 
     void deleteAllIncidences( const IncidenceBase::IncidenceType type );
 
+    void addTombstone( const Incidence::Ptr &incidence );
+    void dropTombstone( QMap<qint64, Tombstone>::Iterator it );
+    void dropTombstones( int count );
+    void removeDeletedIncidence( const QString &uid, const KDateTime &recurrenceId,
+                                 const IncidenceBase::IncidenceType type );
+
 };
 //@endcond
 
@@ -119,19 +187,40 @@ MemoryCalendar::~MemoryCalendar()
 
 void MemoryCalendar::doSetTimeSpec( const KDateTime::Spec &timeSpec )
 {
-  // Reset date based hashes before storing for the new zone.
-  for (auto &table : d->mIncidencesForDate) {
-    table.clear();
-  }
-
+  // Collect the hashing times first, the conversion to the new zone is the
+  // expensive part and can be shared between threads for larger calendars.
+  QVector<IncidenceBase::Ptr> incidences;
+  QVector<KDateTime> times;
+  bool threadSafe = Parallel::isThreadSafe(timeSpec);
   for (auto &table : d->mIncidences) {
     for (const auto &incidence : table) {
-      const KDateTime dt = incidence->dateTime(Incidence::RoleCalendarHashing);
+      KDateTime dt = incidence->dateTime(Incidence::RoleCalendarHashing);
       if (dt.isValid()) {
-        d->mIncidencesForDate[incidence->type()].insert(dt.toTimeSpec(timeSpec).date(), incidence);
+        dt.detach();
+        threadSafe = threadSafe && Parallel::isThreadSafe(dt.timeSpec());
+        incidences.append(incidence);
+        times.append(dt);
       }
     }
   }
+
+  QVector<QDate> dates(times.count());
+  Parallel::forEach(times.count(), threadSafe,
+                    [&](int i) { dates[i] = times[i].toTimeSpec(timeSpec).date(); },
+                    [this](int processed, int total) { emit timeSpecChangeProgress(processed, total); });
+
+  // Reset date based hashes before storing for the new zone.
+  for (auto &table : d->mIncidencesForDate) {
+    table.clear();
+  }
+  for (int i = 0; i < incidences.count(); ++i) {
+    d->mIncidencesForDate[incidences[i]->type()].insert(dates[i], incidences[i]);
+  }
+
+  d->clearSpans();
+  for (const auto &incidence : d->mIncidences[Incidence::TypeEvent]) {
+    d->insertSpan(incidence);
+  }
 }
 
 void MemoryCalendar::close()
@@ -144,12 +233,54 @@ void MemoryCalendar::close()
   deleteAllJournals();
 
   d->mDeletedIncidences.clear();
+  d->mTombstones.clear();
+  d->mTombstonesByUid.clear();
 
   setModified( false );
 
   setObserversEnabled( true );
 }
 
+MemoryCalendar::Ptr MemoryCalendar::snapshot() const
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( timeSpec() ) );
+  cal->setTimeZones( new ICalTimeZones( *timeZones() ) );
+  cal->setViewTimeSpec( viewTimeSpec() );
+  cal->setProductId( productId() );
+  if ( owner() ) {
+    cal->setOwner( Person::Ptr( new Person( *owner() ) ) );
+  }
+  cal->copyNotebooks( *this );
+
+  // Copies of incidences share no data modified by const methods
+  cal->startBatchAdding();
+  for (const auto &table : d->mIncidences) {
+    for (const auto &incidence : table) {
+      const Incidence::Ptr copy( incidence->clone() );
+      cal->addIncidence( copy );
+      const QString notebook = this->notebook( incidence );
+      if ( !notebook.isEmpty() ) {
+        cal->setNotebook( copy, notebook );
+      }
+    }
+  }
+  cal->endBatchAdding();
+  for (auto it = d->mDeletedIncidences.constBegin(); it != d->mDeletedIncidences.constEnd(); ++it) {
+    for (const auto &incidence : it.value()) {
+      cal->d->mDeletedIncidences[it.key()].insert( incidence->uid(),
+                                                    Incidence::Ptr( incidence->clone() ) );
+    }
+  }
+  cal->d->mKeepDeleted = d->mKeepDeleted;
+  cal->d->mTombstones = d->mTombstones;
+  cal->d->mTombstonesByUid = d->mTombstonesByUid;
+  cal->d->mTombstoneLimit = d->mTombstoneLimit;
+  cal->d->mNextTombstone = d->mNextTombstone;
+
+  cal->setModified( false );
+  return cal;
+}
+
 bool MemoryCalendar::deleteIncidence( const Incidence::Ptr &incidence )
 {
   // Handle orphaned children
@@ -161,12 +292,15 @@ bool MemoryCalendar::deleteIncidence( const Incidence::Ptr &incidence )
   if ( d->mIncidences[type].remove( uid, incidence ) ) {
     setModified( true );
     notifyIncidenceDeleted( incidence );
-    d->mDeletedIncidences[type].insert( uid, incidence );
+    d->addTombstone( incidence );
 
     const KDateTime dt = incidence->dateTime( Incidence::RoleCalendarHashing );
     if ( dt.isValid() ) {
       d->mIncidencesForDate[type].remove( dt.toTimeSpec(timeSpec()).date(), incidence );
     }
+    d->removeSpan( incidence );
+    d->removeSeries( incidence );
+    d->mUpdatingSeries.remove( uid, incidence );
     // Delete child-incidences.
     if ( !incidence->hasRecurrenceId() ) {
       deleteIncidenceInstances( incidence );
@@ -181,42 +315,100 @@ bool MemoryCalendar::deleteIncidence( const Incidence::Ptr &incidence )
 bool MemoryCalendar::deleteIncidenceInstances( const Incidence::Ptr &incidence )
 {
   const Incidence::IncidenceType type = incidence->type();
-  QList<Incidence::Ptr> values = d->mIncidences[type].values( incidence->uid() );
-  QList<Incidence::Ptr>::const_iterator it;
-  for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
-    Incidence::Ptr i = *it;
-    if ( i->hasRecurrenceId() ) {
-      kDebug() << "deleting child"
-               << ", type=" << int( type )
-               << ", uid=" << i->uid()
-               << ", start=" << i->dtStart()
-               << " from calendar";
-      deleteIncidence( i );
-    }
+  foreach ( const Incidence::Ptr &i, d->exceptions( type, incidence->uid() ) ) {
+    kDebug() << "deleting child"
+             << ", type=" << int( type )
+             << ", uid=" << i->uid()
+             << ", start=" << i->dtStart()
+             << " from calendar";
+    deleteIncidence( i );
   }
 
   return true;
 }
 
 //@cond PRIVATE
+// The key of a recurrence ID in the series: its start in seconds since the
+// epoch, the lowest bit telling date-only values from the others. Equal
+// recurrence IDs of the same kind have equal keys. Floating and date-only
+// IDs are keyed by their wall-clock time, since converting them to UTC
+// depends on the system time zone, which may change while they are stored.
+static qint64 recurrenceKey( const KDateTime &recurrenceId )
+{
+  QDateTime start;
+  if ( recurrenceId.isDateOnly() ) {
+    start = QDateTime( recurrenceId.date(), QTime( 0, 0 ) );
+  } else if ( recurrenceId.isClockTime() ) {
+    start = QDateTime( recurrenceId.date(), recurrenceId.time() );
+  } else {
+    start = recurrenceId.toUtc().dateTime();
+  }
+  const qint64 secs = qint64( QDate( 1970, 1, 1 ).daysTo( start.date() ) ) * 86400 +
+                      QTime( 0, 0 ).secsTo( start.time() );
+  return secs * 2 + ( recurrenceId.isDateOnly() ? 1 : 0 );
+}
+
 void MemoryCalendar::Private::deleteAllIncidences( const Incidence::IncidenceType incidenceType )
 {
   QHashIterator<QString, Incidence::Ptr>i( mIncidences[incidenceType] );
   while ( i.hasNext() ) {
     i.next();
     q->notifyIncidenceDeleted( i.value() );
+    q->removeRelations( i.value() );
     // suppress update notifications for the relation removal triggered
     // by the following deletions
     i.value()->startUpdates();
   }
   mIncidences[incidenceType].clear();
   mIncidencesForDate[incidenceType].clear();
+  mSeries.remove( incidenceType );
+  QMultiHash<QString, Incidence::Ptr>::Iterator it = mUpdatingSeries.begin();
+  while ( it != mUpdatingSeries.end() ) {
+    if ( it.value()->type() == incidenceType ) {
+      it = mUpdatingSeries.erase( it );
+    } else {
+      ++it;
+    }
+  }
+  if ( incidenceType == Incidence::TypeEvent ) {
+    clearSpans();
+  }
 }
 
 Incidence::Ptr MemoryCalendar::Private::incidence( const QString &uid,
                                                    const Incidence::IncidenceType type,
                                                    const KDateTime &recurrenceId ) const
 {
+  QMap<IncidenceBase::IncidenceType, QHash<QString, Series> >::ConstIterator table =
+    mSeries.constFind( type );
+  if ( table != mSeries.constEnd() ) {
+    QHash<QString, Series>::ConstIterator series = table->constFind( uid );
+    if ( series != table->constEnd() ) {
+      if ( recurrenceId.isNull() ) {
+        if ( series->incidence ) {
+          return series->incidence;
+        }
+      } else {
+        const qint64 key = recurrenceKey( recurrenceId );
+        QMultiMap<qint64, Incidence::Ptr>::ConstIterator it = series->exceptions.constFind( key );
+        for ( ; it != series->exceptions.constEnd() && it.key() == key; ++it ) {
+          if ( ( *it )->recurrenceId() == recurrenceId ) {
+            return *it;
+          }
+        }
+      }
+      foreach ( const Incidence::Ptr &i, mUpdatingSeries.values( uid ) ) {
+        if ( i->type() == type &&
+             ( recurrenceId.isNull() ? !i->hasRecurrenceId() :
+               i->hasRecurrenceId() && i->recurrenceId() == recurrenceId ) ) {
+          return i;
+        }
+      }
+      return Incidence::Ptr();
+    }
+  }
+
+  // Incidences without exceptions are alone with their uid
   QList<Incidence::Ptr> values = mIncidences[type].values( uid );
   QList<Incidence::Ptr>::const_iterator it;
   for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
@@ -234,6 +426,140 @@ Incidence::Ptr MemoryCalendar::Private::incidence( const QString &uid,
   return Incidence::Ptr();
 }
 
+void MemoryCalendar::setDeletedIncidencesKept( bool keep )
+{
+  d->mKeepDeleted = keep;
+  if ( !keep ) {
+    d->mDeletedIncidences.clear();
+  }
+}
+
+bool MemoryCalendar::deletedIncidencesKept() const
+{
+  return d->mKeepDeleted;
+}
+
+MemoryCalendar::Tombstone::List MemoryCalendar::tombstones() const
+{
+  Tombstone::List result;
+  result.reserve( d->mTombstones.count() );
+  foreach ( const Tombstone &tombstone, d->mTombstones ) {
+    result.append( tombstone );
+  }
+  return result;
+}
+
+void MemoryCalendar::setTombstoneLimit( int count )
+{
+  d->mTombstoneLimit = count < 0 ? -1 : count;
+  if ( d->mTombstoneLimit >= 0 ) {
+    d->dropTombstones( d->mTombstones.count() - d->mTombstoneLimit );
+  }
+}
+
+int MemoryCalendar::tombstoneLimit() const
+{
+  return d->mTombstoneLimit;
+}
+
+int MemoryCalendar::compactTombstones( const KDateTime &before )
+{
+  const int count = d->mTombstones.count();
+  if ( !before.isValid() ) {
+    d->mDeletedIncidences.clear();
+    d->mTombstones.clear();
+    d->mTombstonesByUid.clear();
+    return count;
+  }
+
+  // Deletion times follow the clock, which may go back
+  QMap<qint64, Tombstone>::Iterator it = d->mTombstones.begin();
+  while ( it != d->mTombstones.end() ) {
+    if ( it->deleted < before ) {
+      QMap<qint64, Tombstone>::Iterator next = it + 1;
+      d->dropTombstone( it );
+      it = next;
+    } else {
+      ++it;
+    }
+  }
+  return count - d->mTombstones.count();
+}
+
+//@cond PRIVATE
+static bool sameRecurrenceId( const KDateTime &a, const KDateTime &b )
+{
+  return a.isNull() ? b.isNull() : !b.isNull() && a == b;
+}
+
+void MemoryCalendar::Private::addTombstone( const Incidence::Ptr &incidence )
+{
+  Tombstone tombstone;
+  tombstone.uid = incidence->uid();
+  if ( incidence->hasRecurrenceId() ) {
+    tombstone.recurrenceId = incidence->recurrenceId();
+  }
+  tombstone.type = incidence->type();
+  tombstone.deleted = KDateTime::currentUtcDateTime();
+  tombstone.notebook = q->notebook( incidence );
+  tombstone.revision = incidence->revision();
+
+  // An incidence deleted again replaces its previous tombstone
+  foreach ( qint64 key, mTombstonesByUid.values( tombstone.uid ) ) {
+    QMap<qint64, Tombstone>::Iterator it = mTombstones.find( key );
+    if ( it->type == tombstone.type &&
+         sameRecurrenceId( it->recurrenceId, tombstone.recurrenceId ) ) {
+      dropTombstone( it );
+      break;
+    }
+  }
+
+  if ( mKeepDeleted ) {
+    mDeletedIncidences[tombstone.type].insert( tombstone.uid, incidence );
+  }
+  mTombstonesByUid.insert( tombstone.uid, mNextTombstone );
+  mTombstones.insert( mNextTombstone++, tombstone );
+  if ( mTombstoneLimit >= 0 ) {
+    dropTombstones( mTombstones.count() - mTombstoneLimit );
+  }
+}
+
+void MemoryCalendar::Private::dropTombstone( QMap<qint64, Tombstone>::Iterator it )
+{
+  removeDeletedIncidence( it->uid, it->recurrenceId, it->type );
+  mTombstonesByUid.remove( it->uid, it.key() );
+  mTombstones.erase( it );
+}
+
+// Drops the @p count oldest tombstones.
+void MemoryCalendar::Private::dropTombstones( int count )
+{
+  for ( ; count > 0 && !mTombstones.isEmpty(); --count ) {
+    dropTombstone( mTombstones.begin() );
+  }
+}
+
+void MemoryCalendar::Private::removeDeletedIncidence( const QString &uid,
+                                                      const KDateTime &recurrenceId,
+                                                      const IncidenceBase::IncidenceType type )
+{
+  QMap<IncidenceBase::IncidenceType, QMultiHash<QString, Incidence::Ptr> >::Iterator table =
+    mDeletedIncidences.find( type );
+  if ( table == mDeletedIncidences.end() ) {
+    return;
+  }
+  QMultiHash<QString, Incidence::Ptr>::Iterator it = table->find( uid );
+  while ( it != table->end() && it.key() == uid ) {
+    const KDateTime id = ( *it )->hasRecurrenceId() ? ( *it )->recurrenceId() : KDateTime();
+    if ( sameRecurrenceId( id, recurrenceId ) ) {
+      it = table->erase( it );
+    } else {
+      ++it;
+    }
+  }
+}
+//@endcond
+
 Incidence::Ptr
 MemoryCalendar::Private::deletedIncidence( const QString &uid,
                                            const KDateTime &recurrenceId,
@@ -266,6 +592,8 @@ void MemoryCalendar::Private::insertIncidence( Incidence::Ptr incidence )
     if ( dt.isValid() ) {
       mIncidencesForDate[type].insert( dt.toTimeSpec(q->timeSpec()).date(), incidence );
     }
+    insertSpan( incidence );
+    insertSeries( incidence );
 
   } else {
 #ifndef NDEBUG
@@ -275,10 +603,204 @@ void MemoryCalendar::Private::insertIncidence( Incidence::Ptr incidence )
 #endif
   }
 }
+
+void MemoryCalendar::Private::insertSeries( const Incidence::Ptr &incidence )
+{
+  QHash<QString, Series> &table = mSeries[incidence->type()];
+  const QString uid = incidence->uid();
+  QHash<QString, Series>::Iterator series = table.find( uid );
+  if ( !incidence->hasRecurrenceId() ) {
+    if ( series != table.end() ) {
+      series->incidence = incidence;
+    }
+    return;
+  }
+
+  if ( series == table.end() ) {
+    // The first exception of the series, the recurring incidence may
+    // already be in the calendar
+    series = table.insert( uid, Series() );
+    foreach ( const Incidence::Ptr &i, mIncidences[incidence->type()].values( uid ) ) {
+      if ( !i->hasRecurrenceId() ) {
+        series->incidence = i;
+        break;
+      }
+    }
+  }
+  const qint64 key = recurrenceKey( incidence->recurrenceId() );
+  if ( !series->exceptions.contains( key, incidence ) ) {
+    series->exceptions.insert( key, incidence );
+  }
+}
+
+bool MemoryCalendar::Private::removeSeries( const Incidence::Ptr &incidence )
+{
+  QHash<QString, Series> &table = mSeries[incidence->type()];
+  QHash<QString, Series>::Iterator series = table.find( incidence->uid() );
+  if ( series == table.end() ) {
+    return false;
+  }
+
+  bool removed = false;
+  if ( series->incidence == incidence ) {
+    series->incidence.clear();
+    removed = true;
+  } else if ( incidence->hasRecurrenceId() ) {
+    removed = series->exceptions.remove( recurrenceKey( incidence->recurrenceId() ), incidence );
+  }
+  if ( series->exceptions.isEmpty() ) {
+    table.erase( series );
+  }
+  return removed;
+}
+
+Incidence::List MemoryCalendar::Private::exceptions( const IncidenceBase::IncidenceType type,
+                                                     const QString &uid ) const
+{
+  Incidence::List list;
+  QMap<IncidenceBase::IncidenceType, QHash<QString, Series> >::ConstIterator table =
+    mSeries.constFind( type );
+  if ( table != mSeries.constEnd() && table->contains( uid ) ) {
+    list = table->value( uid ).exceptions.values().toVector();
+    foreach ( const Incidence::Ptr &i, mUpdatingSeries.values( uid ) ) {
+      if ( i->type() == type && i->hasRecurrenceId() ) {
+        list.append( i );
+      }
+    }
+    return list;
+  }
+
+  QList<Incidence::Ptr> values = mIncidences[type].values( uid );
+  QList<Incidence::Ptr>::const_iterator it;
+  for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
+    if ( ( *it )->hasRecurrenceId() ) {
+      list.append( *it );
+    }
+  }
+  return list;
+}
+
+static const int AllMonths = 0xfff;
+
+// Spans longer than this go to the open spans rather than to every month
+static const int MaxSpanMonths = 24;
+
+static inline int monthKey( const QDate &date )
+{
+  return date.year() * 12 + date.month() - 1;
+}
+
+// The months in which a recurrence rule can have occurrences
+static int ruleMonths( const RecurrenceRule *rule )
+{
+  if ( !rule->byMonths().isEmpty() ) {
+    int months = 0;
+    foreach ( int month, rule->byMonths() ) {
+      if ( month >= 1 && month <= 12 ) {
+        months |= 1 << ( month - 1 );
+      }
+    }
+    return months ? months : AllMonths;
+  }
+  // A plain yearly rule repeats the month of its start
+  if ( rule->recurrenceType() == RecurrenceRule::rYearly &&
+       rule->byDays().isEmpty() && rule->byMonthDays().isEmpty() &&
+       rule->byYearDays().isEmpty() && rule->byWeekNumbers().isEmpty() &&
+       rule->startDt().isValid() ) {
+    return 1 << ( rule->startDt().date().month() - 1 );
+  }
+  return AllMonths;
+}
+
+MemoryCalendar::Private::Span MemoryCalendar::Private::eventSpan( const Event::Ptr &event ) const
+{
+  const KDateTime::Spec ts = q->timeSpec();
+  Span span;
+  span.months = AllMonths;
+  if ( !event->recurs() ) {
+    span.first = event->dtStart().toTimeSpec( ts ).date();
+    span.last = event->dtEnd().toTimeSpec( ts ).date();
+    return span;
+  }
+
+  // An occurrence covers the days up to its end, see rawEventsForDate()
+  const int extraDays = qMax( 0, event->dtStart().date().daysTo( event->dtEnd().date() ) );
+  const Recurrence *recurrence = event->recurrence();
+  span.first = recurrence->startDateTime().toTimeSpec( ts ).date();
+  const KDateTime end = recurrence->endDateTime();
+  if ( end.isValid() ) {
+    // Dates, as opposed to times, are not converted when matched
+    span.last = end.toTimeSpec( ts ).date().addDays( extraDays + 1 );
+  }
+
+  if ( recurrence->rDates().isEmpty() && recurrence->rDateTimes().isEmpty() &&
+       extraDays < 27 ) {
+    int months = 0;
+    foreach ( const RecurrenceRule *rule, recurrence->rRules() ) {
+      months |= ruleMonths( rule );
+    }
+    // The conversion to the calendar's spec and the days covered by an
+    // occurrence can reach into the neighbouring months
+    months |= ( months << 1 ) | ( months >> 11 ) | ( months >> 1 ) | ( months << 11 );
+    span.months = months & AllMonths;
+  }
+  return span;
+}
+
+void MemoryCalendar::Private::insertSpan( const Incidence::Ptr &incidence )
+{
+  if ( incidence->type() != Incidence::TypeEvent ) {
+    return;
+  }
+  removeSpan( incidence );
+  const Event::Ptr event = incidence.staticCast<Event>();
+  if ( !event->recurs() && !event->isMultiDay() ) {
+    // in mIncidencesForDate
+    return;
+  }
+
+  const Span span = eventSpan( event );
+  mSpans.insert( event.data(), span );
+  if ( span.first.isValid() && span.last.isValid() &&
+       monthKey( span.last ) - monthKey( span.first ) < MaxSpanMonths ) {
+    for ( int key = monthKey( span.first ); key <= monthKey( span.last ); ++key ) {
+      if ( span.months & ( 1 << ( key % 12 ) ) ) {
+        mSpansForMonth.insert( key, event );
+      }
+    }
+  } else {
+    mOpenSpans.insert( event.data(), event );
+  }
+}
+
+void MemoryCalendar::Private::removeSpan( const Incidence::Ptr &incidence )
+{
+  QHash<const IncidenceBase *, Span>::iterator it = mSpans.find( incidence.data() );
+  if ( it == mSpans.end() ) {
+    return;
+  }
+
+  const Span span = it.value();
+  mSpans.erase( it );
+  if ( !mOpenSpans.remove( incidence.data() ) ) {
+    const Event::Ptr event = incidence.staticCast<Event>();
+    for ( int key = monthKey( span.first ); key <= monthKey( span.last ); ++key ) {
+      mSpansForMonth.remove( key, event );
+    }
+  }
+}
+
+void MemoryCalendar::Private::clearSpans()
+{
+  mSpansForMonth.clear();
+  mOpenSpans.clear();
+  mSpans.clear();
+}
 //@endcond
 
 bool MemoryCalendar::addIncidence( const Incidence::Ptr &incidence )
 {
+  Instrumentation::Scope scope( Instrumentation::Add );
   notifyIncidenceAdded( incidence );
 
   d->insertIncidence( incidence );
@@ -385,19 +907,15 @@ Todo::List MemoryCalendar::todoInstances( const Incidence::Ptr &todo,
 {
   Todo::List list;
 
-  QList<Incidence::Ptr > values = d->mIncidences[Incidence::TypeTodo].values( todo->uid() );
-  QList<Incidence::Ptr>::const_iterator it;
-  for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
-    Todo::Ptr t = ( *it ).staticCast<Todo>();
-    if ( t->hasRecurrenceId() ) {
-      list.append( t );
-    }
+  foreach ( const Incidence::Ptr &i, d->exceptions( Incidence::TypeTodo, todo->uid() ) ) {
+    list.append( i.staticCast<Todo>() );
   }
   return Calendar::sortTodos( list, sortField, sortDirection );
 }
 
 Todo::List MemoryCalendar::rawTodosForDate( const QDate &date ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RangeQuery );
   Todo::List todoList;
   Todo::Ptr t;
 
@@ -430,6 +948,7 @@ Todo::List MemoryCalendar::rawTodos( const QDate &start,
                                      const KDateTime::Spec &timespec,
                                      bool inclusive ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RangeQuery );
   Q_UNUSED( inclusive ); // use only exact dtDue/dtStart, not dtStart and dtEnd
 
   Todo::List todoList;
@@ -490,6 +1009,7 @@ Alarm::List MemoryCalendar::alarmsTo( const KDateTime &to ) const
 
 Alarm::List MemoryCalendar::alarms( const KDateTime &from, const KDateTime &to ) const
 {
+  Instrumentation::Scope scope( Instrumentation::AlarmScan );
   Alarm::List alarmList;
   QHashIterator<QString, Incidence::Ptr>ie( d->mIncidences[Incidence::TypeEvent] );
   Event::Ptr e;
@@ -533,6 +1053,10 @@ void MemoryCalendar::incidenceUpdate( const QString &uid, const KDateTime &recur
     if ( dt.isValid() ) {
       d->mIncidencesForDate[type].remove( dt.toTimeSpec(timeSpec()).date(), inc );
     }
+    d->removeSpan( inc );
+    if ( d->removeSeries( inc ) ) {
+      d->mUpdatingSeries.insert( uid, inc );
+    }
   }
 }
 
@@ -553,6 +1077,10 @@ void MemoryCalendar::incidenceUpdated( const QString &uid, const KDateTime &recu
     if ( dt.isValid() ) {
       d->mIncidencesForDate[type].insert( dt.toTimeSpec(timeSpec()).date(), inc );
     }
+    d->insertSpan( inc );
+    d->mUpdatingSeries.remove( uid, inc );
+    d->insertSeries( inc );
+    setupRelations( inc );
 
     notifyIncidenceChanged( inc );
 
@@ -565,6 +1093,7 @@ Event::List MemoryCalendar::rawEventsForDate( const QDate &date,
                                               EventSortField sortField,
                                               SortDirection sortDirection ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RangeQuery );
   Event::List eventList;
 
   if ( !date.isValid() ) {
@@ -599,11 +1128,27 @@ Event::List MemoryCalendar::rawEventsForDate( const QDate &date,
     ++it;
   }
 
-  // Iterate over all events. Look for recurring events that occur on this date
-  QHashIterator<QString, Incidence::Ptr>i( d->mIncidences[Incidence::TypeEvent] );
-  while ( i.hasNext() ) {
-    i.next();
-    ev = i.value().staticCast<Event>();
+  // Collect the multi-day and recurring events which may cover this date
+  Event::List candidates;
+  const int month = 1 << ( date.month() - 1 );
+  QMultiHash<int, Event::Ptr>::const_iterator m = d->mSpansForMonth.constFind( monthKey( date ) );
+  for ( ; m != d->mSpansForMonth.constEnd() && m.key() == monthKey( date ); ++m ) {
+    const Private::Span span = d->mSpans.value( m.value().data() );
+    if ( span.first <= date && date <= span.last ) {
+      candidates.append( m.value() );
+    }
+  }
+  foreach ( const Event::Ptr &event, d->mOpenSpans ) {
+    const Private::Span span = d->mSpans.value( event.data() );
+    if ( ( span.months & month ) &&
+         ( !span.first.isValid() || span.first <= date ) &&
+         ( !span.last.isValid() || date <= span.last ) ) {
+      candidates.append( event );
+    }
+  }
+
+  // Look for the candidates that occur on this date
+  foreach ( ev, candidates ) {
     if ( ev->recurs() ) {
       if ( ev->isMultiDay() ) {
         int extraDays = ev->dtStart().date().daysTo( ev->dtEnd().date() );
@@ -635,6 +1180,7 @@ Event::List MemoryCalendar::rawEvents( const QDate &start,
                                        const KDateTime::Spec &timespec,
                                        bool inclusive ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RangeQuery );
   Event::List eventList;
   KDateTime::Spec ts = timespec.isValid() ? timespec : timeSpec();
   KDateTime st( start, ts );
@@ -727,13 +1273,8 @@ Event::List MemoryCalendar::eventInstances( const Incidence::Ptr &event,
 {
   Event::List list;
 
-  QList<Incidence::Ptr> values = d->mIncidences[Incidence::TypeEvent].values( event->uid() );
-  QList<Incidence::Ptr>::const_iterator it;
-  for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
-    Event::Ptr ev = ( *it ).staticCast<Event>();
-    if ( ev->hasRecurrenceId() ) {
-      list.append( ev );
-    }
+  foreach ( const Incidence::Ptr &i, d->exceptions( Incidence::TypeEvent, event->uid() ) ) {
+    list.append( i.staticCast<Event>() );
   }
   return Calendar::sortEvents( list, sortField, sortDirection );
 }
@@ -800,19 +1341,15 @@ Journal::List MemoryCalendar::journalInstances( const Incidence::Ptr &journal,
 {
   Journal::List list;
 
-  QList<Incidence::Ptr> values = d->mIncidences[Incidence::TypeJournal].values( journal->uid() );
-  QList<Incidence::Ptr>::const_iterator it;
-  for ( it = values.constBegin(); it != values.constEnd(); ++it ) {
-    Journal::Ptr j = ( *it ).staticCast<Journal>();
-    if ( j->hasRecurrenceId() ) {
-      list.append( j );
-    }
+  foreach ( const Incidence::Ptr &i, d->exceptions( Incidence::TypeJournal, journal->uid() ) ) {
+    list.append( i.staticCast<Journal>() );
   }
   return Calendar::sortJournals( list, sortField, sortDirection );
 }
 
 Journal::List MemoryCalendar::rawJournalsForDate( const QDate &date ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RangeQuery );
   Journal::List journalList;
   Journal::Ptr j;
 
@@ -77,6 +77,110 @@ class KCALCORE_EXPORT MemoryCalendar : public Calendar
     */
     void close();
 
+    /**
+      Returns a copy of the calendar as it is now, for use in another thread.
+
+      The snapshot holds copies of the incidences, of the deleted incidences
+      and their tombstones and of the notebook associations. The copies
+      share their texts and other values with the incidences of this calendar, but none of the
+      data which queries modify, such as the conversion caches of date/time
+      values. The snapshot can therefore be queried in another thread while
+      this calendar keeps being used and modified, and any number of
+      snapshots can be used in parallel, one per thread. Changes made to a
+      snapshot are not written back.
+
+      As for Calendar::shiftTimes(), this only holds for calendars using
+      UTC, fixed offsets, ICalTimeZone or KSystemTimeZone time zones:
+      other time zones parse their data on first use.
+
+      @since 4.11
+    */
+    MemoryCalendar::Ptr snapshot() const;
+
+    /**
+      The record of a deleted incidence.
+
+      @since 4.11
+    */
+    struct Tombstone {
+      QString uid;                         /**< UID of the incidence */
+      KDateTime recurrenceId;              /**< recurrence ID of the incidence */
+      IncidenceBase::IncidenceType type;   /**< type of the incidence */
+      KDateTime deleted;                   /**< time of the deletion, in UTC */
+      QString notebook;                    /**< notebook of the incidence */
+      int revision;                        /**< revision of the incidence */
+
+      /**
+        List of tombstones.
+      */
+      typedef QVector<Tombstone> List;
+    };
+
+    /**
+      Sets whether deleted incidences are kept as they are, as returned by
+      deletedEvents() and the other deleted incidence methods, or only
+      recorded by a tombstone. Tombstones are kept in both cases.
+
+      Deleted incidences are kept by default. Calendars deleting many
+      incidences during their lifetime, such as the ones of synchronization
+      sessions, can keep only tombstones to save memory. Switching keeping
+      off drops the deleted incidences already kept.
+
+      @param keep is true to keep deleted incidences.
+      @see deletedIncidencesKept(), tombstones()
+      @since 4.11
+    */
+    void setDeletedIncidencesKept( bool keep );
+
+    /**
+      Returns whether deleted incidences are kept as they are.
+
+      @see setDeletedIncidencesKept()
+      @since 4.11
+    */
+    bool deletedIncidencesKept() const;
+
+    /**
+      Returns the tombstones of the deleted incidences, the oldest deletion
+      first. An incidence deleted several times, after being added again,
+      has a single tombstone for its last deletion.
+
+      @see compactTombstones()
+      @since 4.11
+    */
+    Tombstone::List tombstones() const;
+
+    /**
+      Sets the maximum number of tombstones. When a deletion exceeds it, the
+      oldest tombstones are dropped, with their deleted incidences.
+
+      @param count is the maximum number of tombstones, or -1, the default,
+      for no limit.
+      @see compactTombstones()
+      @since 4.11
+    */
+    void setTombstoneLimit( int count );
+
+    /**
+      Returns the maximum number of tombstones, -1 if unlimited.
+
+      @see setTombstoneLimit()
+      @since 4.11
+    */
+    int tombstoneLimit() const;
+
+    /**
+      Drops the tombstones of the incidences deleted before @p before, with
+      their deleted incidences, for instance once they have been
+      synchronized.
+
+      @param before is the time before which deletions are forgotten, or
+      an invalid date/time to forget all of them.
+      @return the number of tombstones dropped.
+      @since 4.11
+    */
+    int compactTombstones( const KDateTime &before = KDateTime() );
+
     /**
       @copydoc Calendar::deleteIncidence()
     */
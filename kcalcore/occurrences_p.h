@@ -0,0 +1,172 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the internal expansion of event occurrences shared by
+  Calendar::occurrences() and ConflictDetector.
+
+  @internal
+*/
+#ifndef KCALCORE_OCCURRENCES_P_H
+#define KCALCORE_OCCURRENCES_P_H
+
+#include "calendar.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+#include <algorithm>
+
+namespace KCalCore {
+
+//@cond PRIVATE
+namespace Occurrences {
+
+/**
+  An occurrence with its bounds in seconds since the epoch, for
+  comparisons without time zone conversions.
+*/
+struct Interval
+{
+  qint64 start;
+  qint64 end;
+  Calendar::Occurrence occurrence;
+};
+
+inline bool occursBefore( const Interval &a, const Interval &b )
+{
+  if ( a.start != b.start ) {
+    return a.start < b.start;
+  }
+  if ( a.end != b.end ) {
+    return a.end < b.end;
+  }
+  return a.occurrence.event->uid() < b.occurrence.event->uid();
+}
+
+/**
+  Places all-day and floating date/times in @p spec.
+*/
+inline KDateTime absolute( const KDateTime &dt, const KDateTime::Spec &spec )
+{
+  if ( dt.isDateOnly() ) {
+    return KDateTime( dt.date(), QTime( 0, 0 ), spec );
+  }
+  if ( dt.isClockTime() ) {
+    return KDateTime( dt.date(), dt.time(), spec );
+  }
+  return dt;
+}
+
+inline qint64 toSecs( const KDateTime &dt, const KDateTime::Spec &spec )
+{
+  static const KDateTime epoch( QDate( 1970, 1, 1 ), QTime( 0, 0 ), KDateTime::UTC );
+  return epoch.secsTo_long( absolute( dt, spec ) );
+}
+
+/**
+  Expands the occurrences of @p events overlapping the range from @p start
+  to @p end, or starting in it for events without duration, sorted by start,
+  then by end. All-day and floating date/times are taken in @p spec.
+
+  Occurrences replaced by an exception, an event with the same UID and a
+  recurrence ID, are left out wherever the exception moved to. The
+  exceptions are the ones of @p events, and also the ones found by
+  Calendar::eventInstances() when @p calendar is given.
+*/
+inline QVector<Interval> expand( const Event::List &events,
+                                 const KDateTime &start, const KDateTime &end,
+                                 const KDateTime::Spec &spec,
+                                 const Calendar *calendar = 0 )
+{
+  QVector<Interval> intervals;
+  const qint64 windowStart = toSecs( start, spec );
+  const qint64 windowEnd = toSecs( end, spec );
+  if ( windowEnd <= windowStart ) {
+    return intervals;
+  }
+
+  // Original start times of the occurrences replaced by exceptions
+  QHash<QString, QSet<qint64> > replaced;
+  foreach ( const Event::Ptr &event, events ) {
+    if ( event->hasRecurrenceId() ) {
+      replaced[event->uid()].insert( toSecs( event->recurrenceId(), spec ) );
+    } else if ( calendar && event->recurs() ) {
+      foreach ( const Event::Ptr &exception, calendar->eventInstances( event ) ) {
+        replaced[event->uid()].insert( toSecs( exception->recurrenceId(), spec ) );
+      }
+    }
+  }
+
+  foreach ( const Event::Ptr &event, events ) {
+    const KDateTime dtStart = event->dtStart();
+    if ( !dtStart.isValid() ) {
+      continue;
+    }
+
+    const bool allDay = event->allDay();
+    const int days = allDay ? qMax( 0, dtStart.date().daysTo( event->dateEnd() ) ) + 1 : 0;
+    const qint64 length = allDay ? 0 : qMax( Q_INT64_C( 0 ), dtStart.secsTo_long( event->dtEnd() ) );
+
+    DateTimeList starts;
+    QSet<qint64> skipped;
+    if ( event->recurs() && !event->hasRecurrenceId() ) {
+      const KDateTime from = allDay ? start.addDays( -days ) : start.addSecs( -length );
+      starts = event->recurrence()->timesInInterval( from, end );
+      skipped = replaced.value( event->uid() );
+    } else {
+      starts.append( dtStart );
+    }
+
+    foreach ( const KDateTime &dt, starts ) {
+      Interval interval;
+      interval.start = toSecs( dt, spec );
+      if ( !skipped.isEmpty() && skipped.contains( interval.start ) ) {
+        continue;
+      }
+      if ( allDay ) {
+        interval.occurrence.start = KDateTime( dt.date(), dtStart.timeSpec() );
+        interval.occurrence.end = KDateTime( dt.date().addDays( days ), dtStart.timeSpec() );
+        interval.end = toSecs( interval.occurrence.end, spec );
+      } else {
+        interval.occurrence.start = dt;
+        interval.occurrence.end = dt.addSecs( length );
+        interval.end = interval.start + length;
+      }
+      if ( interval.start >= windowEnd ||
+           ( interval.end <= windowStart && interval.start < windowStart ) ) {
+        continue;
+      }
+      interval.occurrence.event = event;
+      intervals.append( interval );
+    }
+  }
+
+  std::sort( intervals.begin(), intervals.end(), occursBefore );
+  return intervals;
+}
+
+}
+//@endcond
+
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines an internal compact list of date/times.
+
+  @internal
+*/
+#ifndef KCALCORE_PACKEDDATETIME_P_H
+#define KCALCORE_PACKEDDATETIME_P_H
+
+#include <KDateTime>
+
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+namespace KCalCore {
+
+//@cond PRIVATE
+/**
+  A sorted list of date/times stored in 64 bits each, for the long lists
+  kept in memory, such as the occurrence caches of recurrence rules.
+
+  A KDateTime holds a pointer to about a hundred bytes of shared data. Here
+  each value packs the seconds of its local clock time since the epoch, an
+  index into the time specifications of the list and the date-only and
+  second occurrence flags. The values are converted back to KDateTime when
+  they are read, which needs no time zone conversion.
+
+  Values which do not fit, with milliseconds or invalid, are kept aside as
+  they are. The find methods give the same results as SortableList, and
+  compare packed values directly when they are in the same time
+  specification as the value searched for.
+*/
+class PackedDateTimeList
+{
+  public:
+    PackedDateTimeList()
+    {
+    }
+
+    explicit PackedDateTimeList( const QList<KDateTime> &list )
+    {
+      mValues.reserve( list.count() );
+      foreach ( const KDateTime &dt, list ) {
+        append( dt );
+      }
+    }
+
+    int count() const
+    {
+      return mValues.count();
+    }
+
+    bool isEmpty() const
+    {
+      return mValues.isEmpty();
+    }
+
+    void clear()
+    {
+      mValues.clear();
+      mSpecs.clear();
+      mUnpacked.clear();
+    }
+
+    void append( const KDateTime &dt )
+    {
+      int spec = specIndex( dt.timeSpec() );
+      if ( spec < 0 && mSpecs.count() <= SpecMask ) {
+        spec = mSpecs.count();
+        mSpecs.append( dt.timeSpec() );
+      }
+      qint64 value = pack( dt, spec );
+      if ( value == Unpacked ) {
+        value = ( qint64( mUnpacked.count() ) << SecsShift ) | UnpackedFlag;
+        mUnpacked.append( dt );
+      }
+      mValues.append( value );
+    }
+
+    KDateTime at( int i ) const
+    {
+      const qint64 value = mValues.at( i );
+      if ( value & UnpackedFlag ) {
+        return mUnpacked.at( int( value >> SecsShift ) );
+      }
+
+      const qint64 secs = value >> SecsShift;
+      const qint64 days = floorDays( value );
+      const QDate date = epoch().addDays( days );
+      const KDateTime::Spec &spec = mSpecs.at( int( ( value >> SpecShift ) & SpecMask ) );
+      if ( value & DateOnlyFlag ) {
+        return KDateTime( date, spec );
+      }
+      KDateTime dt( date, QTime( 0, 0 ).addSecs( int( secs - days * 86400 ) ), spec );
+      if ( value & SecondOccurrenceFlag ) {
+        dt.setSecondOccurrence( true );
+      }
+      return dt;
+    }
+
+    /**
+      Same as SortableList::findLT().
+    */
+    int findLT( const KDateTime &value, int start = 0 ) const
+    {
+      const qint64 key = pack( value, specIndex( value.timeSpec() ) );
+      int st = start - 1;
+      int end = mValues.count();
+      while ( end - st > 1 ) {
+        int i = ( st + end ) / 2;
+        if ( !lessThan( mValues.at( i ), key, i, value, true ) ) {
+          end = i;
+        } else {
+          st = i;
+        }
+      }
+      return ( end > start ) ? st : -1;
+    }
+
+    /**
+      Same as SortableList::findGE().
+    */
+    int findGE( const KDateTime &value, int start = 0 ) const
+    {
+      const qint64 key = pack( value, specIndex( value.timeSpec() ) );
+      int st = start - 1;
+      int end = mValues.count();
+      while ( end - st > 1 ) {
+        int i = ( st + end ) / 2;
+        if ( !lessThan( mValues.at( i ), key, i, value, true ) ) {
+          end = i;
+        } else {
+          st = i;
+        }
+      }
+      ++st;
+      return ( st == mValues.count() ) ? -1 : st;
+    }
+
+    /**
+      Same as SortableList::findGT().
+    */
+    int findGT( const KDateTime &value, int start = 0 ) const
+    {
+      const qint64 key = pack( value, specIndex( value.timeSpec() ) );
+      int st = start - 1;
+      int end = mValues.count();
+      while ( end - st > 1 ) {
+        int i = ( st + end ) / 2;
+        if ( lessThan( key, mValues.at( i ), i, value, false ) ) {
+          end = i;
+        } else {
+          st = i;
+        }
+      }
+      ++st;
+      return ( st == mValues.count() ) ? -1 : st;
+    }
+
+  private:
+    // Layout of a value: seconds in the upper 48 bits, then the index of
+    // the time specification and the flags.
+    enum {
+      DateOnlyFlag = 0x1,
+      SecondOccurrenceFlag = 0x2,
+      UnpackedFlag = 0x4,
+      SpecShift = 3,
+      SpecMask = 0x1fff,
+      SecsShift = 16
+    };
+    static const qint64 Unpacked = -1;
+
+    static const QDate &epoch()
+    {
+      static const QDate epoch( 1970, 1, 1 );
+      return epoch;
+    }
+
+    // Lists hold very few time specifications, usually a single one.
+    int specIndex( const KDateTime::Spec &spec ) const
+    {
+      for ( int i = 0; i < mSpecs.count(); ++i ) {
+        if ( mSpecs.at( i ) == spec ) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    // Packs @p dt with the time specification at index @p spec, or returns
+    // Unpacked.
+    static qint64 pack( const KDateTime &dt, int spec )
+    {
+      if ( spec < 0 || !dt.isValid() || dt.time().msec() ) {
+        return Unpacked;
+      }
+      const qint64 secs = epoch().daysTo( dt.date() ) * Q_INT64_C( 86400 ) +
+                          QTime( 0, 0 ).secsTo( dt.time() );
+      if ( secs >= ( Q_INT64_C( 1 ) << 47 ) || secs < -( Q_INT64_C( 1 ) << 47 ) ) {
+        return Unpacked;
+      }
+      return qint64( quint64( secs ) << SecsShift ) | ( qint64( spec ) << SpecShift ) |
+             ( dt.isDateOnly() ? DateOnlyFlag : 0 ) |
+             ( dt.isSecondOccurrence() ? SecondOccurrenceFlag : 0 );
+    }
+
+    // Returns whether @p a < @p b, as KDateTime compares them. One of them
+    // is entry @p i, the other one is @p value packed, @p b if @p valueSecond
+    // is true.
+    bool lessThan( qint64 a, qint64 b, int i, const KDateTime &value, bool valueSecond ) const
+    {
+      // Unpacked has every flag set
+      const qint64 specBits = qint64( SpecMask ) << SpecShift;
+      if ( !( ( a | b ) & UnpackedFlag ) && ( a & specBits ) == ( b & specBits ) ) {
+        // Same time specification, see KDateTime::operator<()
+        if ( ( a | b ) & DateOnlyFlag ) {
+          return floorDays( a ) < floorDays( b );
+        }
+        if ( ( a & SecondOccurrenceFlag ) == ( b & SecondOccurrenceFlag ) ) {
+          return ( a >> SecsShift ) < ( b >> SecsShift );
+        }
+      }
+      return valueSecond ? at( i ) < value : value < at( i );
+    }
+
+    static qint64 floorDays( qint64 value )
+    {
+      const qint64 secs = value >> SecsShift;
+      return secs >= 0 ? secs / 86400 : -( ( 86399 - secs ) / 86400 );
+    }
+
+    QVector<qint64> mValues;
+    QVector<KDateTime::Spec> mSpecs;    // time specifications of the values
+    QVector<KDateTime> mUnpacked;       // values which do not fit
+};
+//@endcond
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines internal helpers to process independent incidences on
+  several threads.
+
+  @internal
+*/
+#ifndef KCALCORE_PARALLEL_P_H
+#define KCALCORE_PARALLEL_P_H
+
+#include <KDateTime>
+
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtConcurrentMap>
+
+namespace KCalCore {
+
+//@cond PRIVATE
+namespace Parallel {
+
+/**
+  Work lists shorter than this are processed on the calling thread, where
+  the thread pool overhead would outweigh the gain.
+*/
+static const int MinParallelItems = 512;
+
+/**
+  Returns true if date/times in @p spec can be converted on several threads
+  at once. That is only the case for time zones whose data is complete when
+  they are created, and for system time zones, whose offsets are read from
+  tables shared under a lock: tzfile zones parse their data on first use.
+*/
+inline bool isThreadSafe( const KDateTime::Spec &spec )
+{
+  switch ( spec.type() ) {
+  case KDateTime::UTC:
+  case KDateTime::OffsetFromUTC:
+  case KDateTime::Invalid:
+    return true;
+  case KDateTime::TimeZone:
+    return spec.timeZone().type() == "ICalTimeZone" ||
+           spec.timeZone().type() == "KSystemTimeZone";
+  default:
+    return false;
+  }
+}
+
+/**
+  A range [begin, end) of indexes handled by one task.
+*/
+struct Chunk
+{
+  int begin;
+  int end;
+};
+
+/**
+  Calls @p function for each index in [0, @p count). When @p parallel is true
+  and the list is long enough, the indexes are split into chunks which are
+  spread over the global thread pool, so @p function must only touch data
+  belonging to its own index. @p progress is called on the calling thread
+  with the number of processed indexes after each batch of chunks.
+*/
+template <typename Function, typename Progress>
+void forEach( int count, bool parallel, Function function, Progress progress )
+{
+  if ( !parallel || count < MinParallelItems || QThread::idealThreadCount() < 2 ) {
+    for ( int i = 0; i < count; ++i ) {
+      function( i );
+    }
+    progress( count, count );
+    return;
+  }
+
+  // Several batches, so that progress can be reported in between
+  const int batches = 8;
+  const int chunksPerBatch = QThread::idealThreadCount() * 2;
+  const int chunkSize = qMax( MinParallelItems / 4,
+                              count / ( batches * chunksPerBatch ) + 1 );
+
+  QVector<Chunk> batch;
+  batch.reserve( chunksPerBatch );
+  int done = 0;
+  while ( done < count ) {
+    batch.resize( 0 );
+    int begin = done;
+    while ( batch.count() < chunksPerBatch && begin < count ) {
+      const Chunk chunk = { begin, qMin( begin + chunkSize, count ) };
+      batch.append( chunk );
+      begin = chunk.end;
+    }
+    QtConcurrent::blockingMap( batch, [&function]( Chunk &chunk ) {
+        for ( int i = chunk.begin; i < chunk.end; ++i ) {
+          function( i );
+        }
+      } );
+    done = begin;
+    progress( done, count );
+  }
+}
+
+}
+//@endcond
+
+}
+
+#endif
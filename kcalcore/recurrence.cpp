@@ -22,10 +22,12 @@
   Boston, MA 02110-1301, USA.
 */
 #include "recurrence.h"
+#include "instrumentation.h"
 
 #include <KDebug>
 
 #include <QtCore/QBitArray>
+#include <QtCore/QHash>
 #include <QtCore/QTime>
 
 using namespace KCalCore;
@@ -96,10 +98,22 @@ class KCalCore::Recurrence::Private
         mAllDay( p.mAllDay ),
         mRecurReadOnly( p.mRecurReadOnly )
     {
+      // Not shared with the copied recurrence, see IncidenceBase
+      mStartDateTime.detach();
+      for ( int i = 0; i < mRDateTimes.count(); ++i ) {
+        mRDateTimes[i].detach();
+      }
+      for ( int i = 0; i < mExDateTimes.count(); ++i ) {
+        mExDateTimes[i].detach();
+      }
     }
 
     bool operator==( const Private &p ) const;
 
+    bool recursOn( const Recurrence *q, const QDate &qd, const KDateTime::Spec &timeSpec ) const;
+    const QBitArray &occurrenceDays( const Recurrence *q, int year,
+                                     const KDateTime::Spec &timeSpec ) const;
+
     RecurrenceRule::List mExRules;
     RecurrenceRule::List mRRules;
     DateTimeList mRDateTimes;
@@ -112,6 +126,11 @@ class KCalCore::Recurrence::Private
     // Cache the type of the recurrence with the old system (e.g. MonthlyPos)
     mutable ushort mCachedType;
 
+    // Cache the days with occurrences in mDayCacheSpec, one bit per day of
+    // the year, for recursOn()
+    mutable QHash<int, QBitArray> mDayCache;
+    mutable KDateTime::Spec mDayCacheSpec;
+
     bool mAllDay;                // the recurrence has no time, just a date
     bool mRecurReadOnly;
 };
@@ -265,6 +284,7 @@ void Recurrence::updated()
 {
   // recurrenceType() re-calculates the type if it's rMax
   d->mCachedType = rMax;
+  d->mDayCache.clear();
   for ( int i = 0, end = d->mObservers.count();  i < end;  ++i ) {
     if ( d->mObservers[i] ) {
       d->mObservers[i]->recurrenceUpdated( this );
@@ -373,15 +393,17 @@ ushort Recurrence::recurrenceType( const RecurrenceRule *rrule )
   return rOther;
 }
 
-bool Recurrence::recursOn( const QDate &qd, const KDateTime::Spec &timeSpec ) const
+//@cond PRIVATE
+bool Recurrence::Private::recursOn( const Recurrence *q, const QDate &qd,
+                                    const KDateTime::Spec &timeSpec ) const
 {
   // Don't waste time if date is before the start of the recurrence
-  if ( KDateTime( qd, QTime( 23, 59, 59 ), timeSpec ) < d->mStartDateTime ) {
+  if ( KDateTime( qd, QTime( 23, 59, 59 ), timeSpec ) < mStartDateTime ) {
     return false;
   }
 
   // First handle dates. Exrules override
-  if ( d->mExDates.containsSorted( qd ) ) {
+  if ( mExDates.containsSorted( qd ) ) {
     return false;
   }
 
@@ -389,25 +411,25 @@ bool Recurrence::recursOn( const QDate &qd, const KDateTime::Spec &timeSpec ) co
   TimeList tms;
   // For all-day events a matching exrule excludes the whole day
   // since exclusions take precedence over inclusions, we know it can't occur on that day.
-  if ( allDay() ) {
-    for ( i = 0, end = d->mExRules.count();  i < end;  ++i ) {
-      if ( d->mExRules[i]->recursOn( qd, timeSpec ) ) {
+  if ( mAllDay ) {
+    for ( i = 0, end = mExRules.count();  i < end;  ++i ) {
+      if ( mExRules[i]->recursOn( qd, timeSpec ) ) {
         return false;
       }
     }
   }
 
-  if ( d->mRDates.containsSorted( qd ) ) {
+  if ( mRDates.containsSorted( qd ) ) {
     return true;
   }
 
   // Check if it might recur today at all.
-  bool recurs = ( startDate() == qd );
-  for ( i = 0, end = d->mRDateTimes.count();  i < end && !recurs;  ++i ) {
-    recurs = ( d->mRDateTimes[i].toTimeSpec( timeSpec ).date() == qd );
+  bool recurs = ( mStartDateTime.date() == qd );
+  for ( i = 0, end = mRDateTimes.count();  i < end && !recurs;  ++i ) {
+    recurs = ( mRDateTimes[i].toTimeSpec( timeSpec ).date() == qd );
   }
-  for ( i = 0, end = d->mRRules.count();  i < end && !recurs;  ++i ) {
-    recurs = d->mRRules[i]->recursOn( qd, timeSpec );
+  for ( i = 0, end = mRRules.count();  i < end && !recurs;  ++i ) {
+    recurs = mRRules[i]->recursOn( qd, timeSpec );
   }
   // If the event wouldn't recur at all, simply return false, don't check ex*
   if ( !recurs ) {
@@ -416,12 +438,12 @@ bool Recurrence::recursOn( const QDate &qd, const KDateTime::Spec &timeSpec ) co
 
   // Check if there are any times for this day excluded, either by exdate or exrule:
   bool exon = false;
-  for ( i = 0, end = d->mExDateTimes.count();  i < end && !exon;  ++i ) {
-    exon = ( d->mExDateTimes[i].toTimeSpec( timeSpec ).date() == qd );
+  for ( i = 0, end = mExDateTimes.count();  i < end && !exon;  ++i ) {
+    exon = ( mExDateTimes[i].toTimeSpec( timeSpec ).date() == qd );
   }
-  if ( !allDay() ) {     // we have already checked all-day times above
-    for ( i = 0, end = d->mExRules.count();  i < end && !exon;  ++i ) {
-      exon = d->mExRules[i]->recursOn( qd, timeSpec );
+  if ( !mAllDay ) {     // we have already checked all-day times above
+    for ( i = 0, end = mExRules.count();  i < end && !exon;  ++i ) {
+      exon = mExRules[i]->recursOn( qd, timeSpec );
     }
   }
 
@@ -433,11 +455,83 @@ bool Recurrence::recursOn( const QDate &qd, const KDateTime::Spec &timeSpec ) co
     // whole list of items for that day.
 //TODO: consider whether it would be more efficient to call
 //      Rule::recurTimesOn() instead of Rule::recursOn() from the start
-    TimeList timesForDay( recurTimesOn( qd, timeSpec ) );
+    TimeList timesForDay( q->recurTimesOn( qd, timeSpec ) );
     return !timesForDay.isEmpty();
   }
 }
 
+// Number of years kept in mDayCache before it is cleared
+static const int MaxCachedYears = 16;
+
+const QBitArray &Recurrence::Private::occurrenceDays( const Recurrence *q, int year,
+                                                      const KDateTime::Spec &timeSpec ) const
+{
+  if ( !( mDayCacheSpec == timeSpec ) ) {
+    mDayCache.clear();
+    mDayCacheSpec = timeSpec;
+  }
+  QHash<int, QBitArray>::const_iterator it = mDayCache.constFind( year );
+  if ( it != mDayCache.constEnd() ) {
+    return it.value();
+  }
+  if ( mDayCache.count() >= MaxCachedYears ) {
+    mDayCache.clear();
+  }
+
+  // Find the days the start, the rdates and the occurrences of the rrules
+  // fall on, in their own time spec and in timeSpec. Only these days can
+  // have occurrences, so they are the only ones checked in full.
+  const QDate first( year, 1, 1 );
+  QBitArray candidates( first.daysInYear() );
+  auto mark = [&]( const QDate &date ) {
+    if ( date.year() == year ) {
+      candidates.setBit( date.dayOfYear() - 1 );
+    }
+  };
+  mark( mStartDateTime.date() );
+  mark( mStartDateTime.toTimeSpec( timeSpec ).date() );
+  foreach ( const QDate &date, mRDates ) {
+    mark( date );
+  }
+  foreach ( const KDateTime &dt, mRDateTimes ) {
+    mark( dt.toTimeSpec( timeSpec ).date() );
+  }
+  // Time zone offsets can move an occurrence by up to two days
+  const KDateTime start( first.addDays( -2 ), QTime( 0, 0 ), timeSpec );
+  const KDateTime end( first.addYears( 1 ).addDays( 2 ), QTime( 0, 0 ), timeSpec );
+  foreach ( const RecurrenceRule *rule, mRRules ) {
+    if ( rule->recurrenceType() < RecurrenceRule::rDaily ) {
+      // Too many occurrences to list, check every day instead
+      candidates.fill( true );
+      break;
+    }
+    foreach ( const KDateTime &dt, rule->timesInInterval( start, end ) ) {
+      mark( dt.date() );
+      mark( dt.toTimeSpec( timeSpec ).date() );
+    }
+  }
+
+  QBitArray days( candidates.size() );
+  for ( int i = 0; i < candidates.size(); ++i ) {
+    if ( candidates.testBit( i ) && recursOn( q, first.addDays( i ), timeSpec ) ) {
+      days.setBit( i );
+    }
+  }
+  return mDayCache.insert( year, days ).value();
+}
+//@endcond
+
+bool Recurrence::recursOn( const QDate &qd, const KDateTime::Spec &timeSpec ) const
+{
+  if ( !qd.isValid() || !d->mStartDateTime.isValid() ) {
+    return d->recursOn( this, qd, timeSpec );
+  }
+
+  // The days of the whole year are computed once, and cached until the
+  // recurrence changes
+  return d->occurrenceDays( this, qd.year(), timeSpec ).testBit( qd.dayOfYear() - 1 );
+}
+
 bool Recurrence::recursAt( const KDateTime &dt ) const
 {
   // Convert to recurrence's time zone for date comparisons, and for more efficient time comparisons
@@ -562,15 +656,18 @@ void Recurrence::shiftTimes( const KDateTime::Spec &oldSpec, const KDateTime::Sp
     return;
   }
 
+  d->mStartDateTime.detach();
   d->mStartDateTime = d->mStartDateTime.toTimeSpec( oldSpec );
   d->mStartDateTime.setTimeSpec( newSpec );
 
   int i, end;
   for ( i = 0, end = d->mRDateTimes.count();  i < end;  ++i ) {
+    d->mRDateTimes[i].detach();
     d->mRDateTimes[i] = d->mRDateTimes[i].toTimeSpec( oldSpec );
     d->mRDateTimes[i].setTimeSpec( newSpec );
   }
   for ( i = 0, end = d->mExDateTimes.count();  i < end;  ++i ) {
+    d->mExDateTimes[i].detach();
     d->mExDateTimes[i] = d->mExDateTimes[i].toTimeSpec( oldSpec );
     d->mExDateTimes[i].setTimeSpec( newSpec );
   }
@@ -580,6 +677,7 @@ void Recurrence::shiftTimes( const KDateTime::Spec &oldSpec, const KDateTime::Sp
   for ( i = 0, end = d->mExRules.count();  i < end;  ++i ) {
     d->mExRules[i]->shiftTimes( oldSpec, newSpec );
   }
+  d->mDayCache.clear();
 }
 
 void Recurrence::unsetRecurs()
@@ -995,6 +1093,7 @@ TimeList Recurrence::recurTimesOn( const QDate &date, const KDateTime::Spec &tim
 
 DateTimeList Recurrence::timesInInterval( const KDateTime &start, const KDateTime &end ) const
 {
+  Instrumentation::Scope scope( Instrumentation::RecurrenceExpansion );
   int i, count;
   DateTimeList times;
   for ( i = 0, count = d->mRRules.count();  i < count;  ++i ) {
@@ -1352,6 +1451,7 @@ void Recurrence::setExDateTimes( const DateTimeList &exdates )
 
   d->mExDateTimes = exdates;
   d->mExDateTimes.sortUnique();
+  updated();
 }
 
 void Recurrence::addExDateTime( const KDateTime &exdate )
@@ -20,6 +20,7 @@
   Boston, MA 02110-1301, USA.
 */
 #include "recurrencerule.h"
+#include "packeddatetime_p.h"
 
 #include <KDebug>
 
@@ -731,6 +732,9 @@ class KCalCore::RecurrenceRule::Private
     Constraint getNextValidDateInterval( const KDateTime &preDate, PeriodType type ) const;
     Constraint getPreviousValidDateInterval( const KDateTime &afterDate, PeriodType type ) const;
     DateTimeList datesForInterval( const Constraint &interval, PeriodType type ) const;
+    bool clipInterval( const KDateTime &dtStart, const KDateTime &dtEnd,
+                       KDateTime &start, KDateTime &end ) const;
+    qint64 timedIndex( const KDateTime &dt, bool roundUp ) const;
 
     RecurrenceRule *mParent;
     QString mRRule;            // RRULE string
@@ -761,7 +765,7 @@ class KCalCore::RecurrenceRule::Private
     QList<RuleObserver*> mObservers;
 
     // Cache for duration
-    mutable DateTimeList mCachedDates;
+    mutable PackedDateTimeList mCachedDates;
     mutable KDateTime mCachedDateEnd;
     mutable KDateTime mCachedLastDate;   // when mCachedDateEnd invalid, last date checked
     mutable bool mCached;
@@ -796,6 +800,9 @@ RecurrenceRule::Private::Private( RecurrenceRule *parent, const Private &p )
     mAllDay( p.mAllDay ),
     mNoByRules( p.mNoByRules )
 {
+    // Not shared with the copied rule, see IncidenceBase
+    mDateStart.detach();
+    mDateEnd.detach();
     setDirty();
 }
 
@@ -809,9 +816,11 @@ RecurrenceRule::Private &RecurrenceRule::Private::operator=( const Private &p )
   mRRule = p.mRRule;
   mPeriod = p.mPeriod;
   mDateStart = p.mDateStart;
+  mDateStart.detach();
   mFrequency = p.mFrequency;
   mDuration = p.mDuration;
   mDateEnd = p.mDateEnd;
+  mDateEnd.detach();
 
   mBySeconds = p.mBySeconds;
   mByMinutes = p.mByMinutes;
@@ -1130,9 +1139,11 @@ void RecurrenceRule::setWeekStart( short weekStart )
 
 void RecurrenceRule::shiftTimes( const KDateTime::Spec &oldSpec, const KDateTime::Spec &newSpec )
 {
+  d->mDateStart.detach();
   d->mDateStart = d->mDateStart.toTimeSpec( oldSpec );
   d->mDateStart.setTimeSpec( newSpec );
   if ( d->mDuration == 0 ) {
+    d->mDateEnd.detach();
     d->mDateEnd = d->mDateEnd.toTimeSpec( oldSpec );
     d->mDateEnd.setTimeSpec( newSpec );
   }
@@ -1360,7 +1371,7 @@ bool RecurrenceRule::Private::buildCache() const
     dts.erase( dts.begin() + mDuration, dts.end() );
   }
   mCached = true;
-  mCachedDates = dts;
+  mCachedDates = PackedDateTimeList( dts );
 
 // it = dts.begin();
 // while ( it != dts.end() ) {
@@ -1639,7 +1650,7 @@ KDateTime RecurrenceRule::getPreviousDate( const KDateTime &afterDate ) const
     }
     int i = d->mCachedDates.findLT( toDate );
     if ( i >= 0 ) {
-      return d->mCachedDates[i];
+      return d->mCachedDates.at( i );
     }
     return KDateTime();
   }
@@ -1701,7 +1712,7 @@ KDateTime RecurrenceRule::getNextDate( const KDateTime &preDate ) const
     }
     int i = d->mCachedDates.findGT( fromDate );
     if ( i >= 0 ) {
-      return d->mCachedDates[i];
+      return d->mCachedDates.at( i );
     }
   }
 
@@ -1762,14 +1773,9 @@ DateTimeList RecurrenceRule::timesInInterval( const KDateTime &dtStart,
   if ( d->mTimedRepetition ) {
     // It's a simple sub-daily recurrence with no constraints
 
-    //Seconds to add to interval start, to get first occurrence which is within interval
-    qint64 offsetFromNextOccurrence;
-    if (d->mDateStart < start) {
-        offsetFromNextOccurrence = d->mTimedRepetition - (d->mDateStart.secsTo_long( start ) % d->mTimedRepetition);
-    } else {
-        offsetFromNextOccurrence = -(d->mDateStart.secsTo_long( start ) % d->mTimedRepetition);
-    }
-    KDateTime dt = start.addSecs( offsetFromNextOccurrence );
+    // First occurrence within the interval
+    const qint64 first = qMax( Q_INT64_C( 0 ), d->timedIndex( start, true ) );
+    KDateTime dt = d->mDateStart.addSecs( first * d->mTimedRepetition );
     if ( dt <= enddt ) {
       quint64 numberOfOccurrencesWithinInterval = ( dt.secsTo_long( enddt ) / d->mTimedRepetition ) + 1;
       // limit numberOfOccurrencesWithinInterval by a sane value else we can "explode".
@@ -1801,7 +1807,7 @@ DateTimeList RecurrenceRule::timesInInterval( const KDateTime &dtStart,
         done = true;
       }
       while ( i < iend ) {
-        result += d->mCachedDates[i++];
+        result += d->mCachedDates.at( i++ );
       }
     }
     if ( d->mCachedDateEnd.isValid() ) {
@@ -1844,6 +1850,277 @@ DateTimeList RecurrenceRule::timesInInterval( const KDateTime &dtStart,
   return result;
 }
 
+//@cond PRIVATE
+namespace {
+
+// Passes date/times to a visitor a chunk at a time.
+class ChunkWriter
+{
+  public:
+    ChunkWriter( RecurrenceRule::TimesVisitor *visitor, int chunkSize )
+      : mVisitor( visitor ), mChunkSize( qMax( 1, chunkSize ) ), mStopped( false )
+    {
+    }
+
+    // Returns false once the visitor stopped the enumeration.
+    bool add( const KDateTime &dt )
+    {
+      mChunk.append( dt );
+      return mChunk.count() < mChunkSize || flush();
+    }
+
+    bool flush()
+    {
+      if ( !mChunk.isEmpty() && !mStopped ) {
+        mStopped = !mVisitor->visitTimes( mChunk );
+        mChunk.clear();
+      }
+      return !mStopped;
+    }
+
+  private:
+    RecurrenceRule::TimesVisitor *mVisitor;
+    int mChunkSize;
+    bool mStopped;
+    DateTimeList mChunk;
+};
+
+class TimesCounter : public RecurrenceRule::TimesVisitor
+{
+  public:
+    TimesCounter()
+      : mCount( 0 )
+    {
+    }
+
+    bool visitTimes( const DateTimeList &times )
+    {
+      mCount += times.count();
+      return true;
+    }
+
+    qint64 mCount;
+};
+
+class NthTime : public RecurrenceRule::TimesVisitor
+{
+  public:
+    explicit NthTime( qint64 n )
+      : mRemaining( n )
+    {
+    }
+
+    bool visitTimes( const DateTimeList &times )
+    {
+      if ( mRemaining < times.count() ) {
+        mResult = times[int( mRemaining )];
+        return false;
+      }
+      mRemaining -= times.count();
+      return true;
+    }
+
+    qint64 mRemaining;
+    KDateTime mResult;
+};
+
+}
+
+// Converts the interval to the time spec of the rule and limits it to the
+// recurrence. An invalid end is left as it is. Returns false if the
+// interval is outside the recurrence.
+bool RecurrenceRule::Private::clipInterval( const KDateTime &dtStart, const KDateTime &dtEnd,
+                                           KDateTime &start, KDateTime &end ) const
+{
+  start = dtStart.toTimeSpec( mDateStart.timeSpec() );
+  end = dtEnd.isValid() ? dtEnd.toTimeSpec( mDateStart.timeSpec() ) : KDateTime();
+  if ( end.isValid() && end < mDateStart ) {
+    return false;    // before start of recurrence
+  }
+  if ( start < mDateStart ) {
+    start = mDateStart;
+  }
+  if ( mDuration >= 0 ) {
+    // The last timed repetition is known without building the cache
+    const KDateTime endRecur = ( mDuration > 0 && mTimedRepetition ) ?
+                               mDateStart.addSecs( qint64( mDuration - 1 ) * mTimedRepetition ) :
+                               mParent->endDt();
+    if ( endRecur.isValid() ) {
+      if ( start > endRecur ) {
+        return false;    // beyond end of recurrence
+      }
+      if ( !end.isValid() || end > endRecur ) {
+        end = endRecur;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns the number of the timed repetition at @p dt, rounded down or up,
+// negative before the start.
+qint64 RecurrenceRule::Private::timedIndex( const KDateTime &dt, bool roundUp ) const
+{
+  const qint64 secs = mDateStart.secsTo_long( dt );
+  const qint64 period = mTimedRepetition;
+  if ( roundUp ) {
+    return secs > 0 ? ( secs + period - 1 ) / period : -( -secs / period );
+  }
+  return secs >= 0 ? secs / period : -( ( period - 1 - secs ) / period );
+}
+//@endcond
+
+void RecurrenceRule::visitTimesInInterval( const KDateTime &dtStart, const KDateTime &dtEnd,
+                                           TimesVisitor *visitor, int chunkSize ) const
+{
+  KDateTime start;
+  KDateTime end;
+  if ( !visitor || !d->clipInterval( dtStart, dtEnd, start, end ) ) {
+    return;
+  }
+  ChunkWriter writer( visitor, chunkSize );
+
+  if ( d->mTimedRepetition ) {
+    // It's a simple sub-daily recurrence with no constraints
+    qint64 last = end.isValid() ? d->timedIndex( end, false ) : Q_INT64_C( 0x7fffffffffffffff );
+    if ( d->mDuration > 0 ) {
+      last = qMin( last, qint64( d->mDuration - 1 ) );
+    }
+    for ( qint64 i = qMax( Q_INT64_C( 0 ), d->timedIndex( start, true ) ); i <= last; ++i ) {
+      if ( !writer.add( d->mDateStart.addSecs( i * d->mTimedRepetition ) ) ) {
+        return;
+      }
+    }
+    writer.flush();
+    return;
+  }
+
+  // Occurrences still to come after the first one enumerated, -1 if unknown
+  qint64 remaining = -1;
+  KDateTime from = start;
+  if ( d->mDuration > 0 ) {
+    if ( !d->mCached ) {
+      d->buildCache();
+    }
+    for ( int i = d->mCachedDates.findGE( start ); i >= 0 && i < d->mCachedDates.count(); ++i ) {
+      const KDateTime dt = d->mCachedDates.at( i );
+      if ( end.isValid() && dt > end ) {
+        writer.flush();
+        return;
+      }
+      if ( !writer.add( dt ) ) {
+        return;
+      }
+    }
+    if ( d->mCachedDateEnd.isValid() ) {
+      writer.flush();
+      return;
+    }
+    // The cache is incomplete, go on counting the occurrences after it
+    remaining = d->mDuration - d->mCachedDates.count();
+    from = d->mCachedLastDate.addSecs( 1 );
+  }
+
+  // Unlike timesInInterval(), only stop after many intervals in a row
+  // without occurrences, which would be contradictory constraints.
+  Constraint interval( d->getNextValidDateInterval( from, recurrenceType() ) );
+  int emptyIntervals = 0;
+  bool first = true;
+  while ( emptyIntervals < LOOP_LIMIT ) {
+    const DateTimeList dts = d->datesForInterval( interval, recurrenceType() );
+    int i = first ? dts.findGE( from ) : 0;
+    first = false;
+    if ( i < 0 || i >= dts.count() ) {
+      ++emptyIntervals;
+    } else {
+      emptyIntervals = 0;
+      for ( ; i < dts.count(); ++i ) {
+        if ( ( end.isValid() && dts[i] > end ) || remaining == 0 ) {
+          writer.flush();
+          return;
+        }
+        if ( remaining > 0 ) {
+          --remaining;
+        }
+        if ( dts[i] >= start && !writer.add( dts[i] ) ) {
+          return;
+        }
+      }
+    }
+    interval.increase( recurrenceType(), frequency() );
+    if ( end.isValid() && interval.intervalDateTime( recurrenceType() ) > end ) {
+      break;
+    }
+  }
+  writer.flush();
+}
+
+qint64 RecurrenceRule::occurrenceCount( const KDateTime &dtStart, const KDateTime &dtEnd ) const
+{
+  KDateTime start;
+  KDateTime end;
+  if ( !dtEnd.isValid() || !d->clipInterval( dtStart, dtEnd, start, end ) ) {
+    return 0;
+  }
+
+  if ( d->mTimedRepetition ) {
+    qint64 last = d->timedIndex( end, false );
+    if ( d->mDuration > 0 ) {
+      last = qMin( last, qint64( d->mDuration - 1 ) );
+    }
+    return qMax( Q_INT64_C( 0 ), last - qMax( Q_INT64_C( 0 ), d->timedIndex( start, true ) ) + 1 );
+  }
+
+  if ( d->mDuration > 0 ) {
+    if ( !d->mCached ) {
+      d->buildCache();
+    }
+    if ( d->mCachedDateEnd.isValid() ) {
+      const int i = d->mCachedDates.findGE( start );
+      if ( i < 0 ) {
+        return 0;
+      }
+      const int j = d->mCachedDates.findGT( end, i );
+      return ( j < 0 ? d->mCachedDates.count() : j ) - i;
+    }
+  }
+
+  TimesCounter counter;
+  visitTimesInInterval( start, end, &counter );
+  return counter.mCount;
+}
+
+KDateTime RecurrenceRule::nthOccurrence( qint64 n ) const
+{
+  if ( n < 0 || ( d->mDuration > 0 && n >= d->mDuration ) || !d->mDateStart.isValid() ) {
+    return KDateTime();
+  }
+
+  if ( d->mTimedRepetition ) {
+    if ( n > Q_INT64_C( 0x7fffffffffffffff ) / d->mTimedRepetition ) {
+      return KDateTime();
+    }
+    const KDateTime dt = d->mDateStart.addSecs( n * d->mTimedRepetition );
+    return d->mDuration == 0 && dt > endDt() ? KDateTime() : dt;
+  }
+
+  if ( d->mDuration > 0 ) {
+    if ( !d->mCached ) {
+      d->buildCache();
+    }
+    if ( n < d->mCachedDates.count() ) {
+      return d->mCachedDates.at( int( n ) );
+    }
+    if ( d->mCachedDateEnd.isValid() ) {
+      return KDateTime();
+    }
+  }
+
+  NthTime nth( n );
+  visitTimesInInterval( d->mDateStart, KDateTime(), &nth );
+  return nth.mResult;
+}
+
 //@cond PRIVATE
 // Find the date/time of the occurrence at or before a date/time,
 // for a given period type.
@@ -2246,6 +2523,10 @@ RecurrenceRule::RuleObserver::~RuleObserver()
 {
 }
 
+RecurrenceRule::TimesVisitor::~TimesVisitor()
+{
+}
+
 RecurrenceRule::WDayPos::WDayPos( int ps, short dy )
   : mDay( dy ), mPos( ps )
 {
@@ -50,6 +50,24 @@ class KCALCORE_EXPORT RecurrenceRule
         /** This method is called on each change of the recurrence object */
         virtual void recurrenceChanged( RecurrenceRule * ) = 0;
     };
+
+    /**
+      Receives the occurrences enumerated by visitTimesInInterval(), a chunk
+      at a time.
+
+      @since 4.11
+    */
+    class TimesVisitor
+    {
+      public:
+        virtual ~TimesVisitor();
+        /**
+          Called with each chunk of occurrences, in chronological order.
+          @param times are the occurrences of the chunk.
+          @return true to go on, false to stop the enumeration.
+        */
+        virtual bool visitTimes( const DateTimeList &times ) = 0;
+    };
     typedef QList<RecurrenceRule*> List;
 
     /** enum for describing the frequency how an event recurs, if at all. */
@@ -233,12 +251,60 @@ class KCALCORE_EXPORT RecurrenceRule
      * this limit the list is incomplete, this is indicated by the last entry being
      * set to an invalid KDateTime value. If you need further values, call the
      * method again with a start time set to just after the last valid time returned.
+     * For long intervals, such as years of a rule recurring every minute, prefer
+     * occurrenceCount() or visitTimesInInterval().
      * @param start inclusive start of interval
      * @param end inclusive end of interval
      * @return list of date/time values
      */
     DateTimeList timesInInterval( const KDateTime &start, const KDateTime &end ) const;
 
+    /**
+      Enumerates the times at which the recurrence occurs between two times,
+      passing them to @p visitor in chunks of at most @p chunkSize times.
+      Unlike timesInInterval(), the number of times is not limited and the
+      whole list is never held in memory.
+
+      @param start inclusive start of interval
+      @param end inclusive end of interval, or an invalid date/time to go
+      on until the end of the recurrence. The visitor must then stop the
+      enumeration of recurrences without end.
+      @param visitor receives the times, and may stop the enumeration.
+      @param chunkSize is the maximum number of times passed at once.
+      @since 4.11
+    */
+    void visitTimesInInterval( const KDateTime &start, const KDateTime &end,
+                               TimesVisitor *visitor, int chunkSize = 1024 ) const;
+
+    /**
+      Returns the number of times at which the recurrence occurs between two
+      times, as timesInInterval() would return them without its limit.
+
+      The number is computed directly for sub-daily recurrences without BY
+      rules and for recurrences with a count, and by enumerating the times
+      otherwise.
+
+      @param start inclusive start of interval
+      @param end inclusive end of interval
+      @since 4.11
+    */
+    qint64 occurrenceCount( const KDateTime &start, const KDateTime &end ) const;
+
+    /**
+      Returns the time of the occurrence number @p n, the first one being
+      number 0. The start date/time counts only if it matches the rule.
+
+      The time is computed directly for sub-daily recurrences without BY
+      rules and for recurrences with a count, and by enumerating the times
+      otherwise.
+
+      @param n is the number of the occurrence.
+      @return the time of the occurrence, or an invalid date/time if the
+      recurrence ends before it.
+      @since 4.11
+    */
+    KDateTime nthOccurrence( qint64 n ) const;
+
     /** Returns the date and time of the next recurrence, after the specified date/time.
      * If the recurrence has no time, the next date after the specified date is returned.
      * @param preDateTime the date/time after which to find the recurrence.
@@ -0,0 +1,277 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the SearchIndex class.
+*/
+#include "searchindex.h"
+
+#include <QtCore/QMap>
+#include <QtCore/QVector>
+#include <QtCore/qmath.h>
+
+#include <algorithm>
+
+using namespace KCalCore;
+
+//@cond PRIVATE
+// Weights of the words of each field, a word found in several fields
+// or several times adds up.
+static const int SummaryWeight = 8;
+static const int LocationWeight = 4;
+static const int AttendeeWeight = 4;
+static const int DescriptionWeight = 1;
+
+namespace {
+
+typedef QHash<const Incidence *, int> Postings;
+
+struct Entry
+{
+  Incidence::Ptr incidence;
+  QStringList words;
+};
+
+struct Match
+{
+  double score;
+  Incidence::Ptr incidence;
+};
+
+bool moreRelevant( const Match &a, const Match &b )
+{
+  if ( a.score != b.score ) {
+    return a.score > b.score;
+  }
+  return a.incidence->uid() < b.incidence->uid();
+}
+
+}
+
+class KCalCore::SearchIndex::Private
+{
+  public:
+    explicit Private( const Calendar::Ptr &calendar )
+      : mCalendar( calendar )
+    {
+    }
+
+    void insert( const Incidence::Ptr &incidence );
+    void remove( const Incidence *incidence );
+
+    Calendar::Ptr mCalendar;
+    QMap<QString, Postings> mWords;       // sorted for prefix lookups
+    QHash<const Incidence *, Entry> mEntries;
+};
+
+static void addWords( QHash<QString, int> &weights, const QString &text, int weight )
+{
+  if ( text.isEmpty() ) {
+    return;
+  }
+  foreach ( const QString &word, SearchIndex::words( text ) ) {
+    weights[word] += weight;
+  }
+}
+
+void SearchIndex::Private::insert( const Incidence::Ptr &incidence )
+{
+  QHash<QString, int> weights;
+  addWords( weights, incidence->summary(), SummaryWeight );
+  addWords( weights, incidence->location(), LocationWeight );
+  addWords( weights, incidence->description(), DescriptionWeight );
+  foreach ( const Attendee::Ptr &attendee, incidence->attendees() ) {
+    addWords( weights, attendee->name(), AttendeeWeight );
+    addWords( weights, attendee->email(), AttendeeWeight );
+  }
+
+  Entry &entry = mEntries[incidence.data()];
+  entry.incidence = incidence;
+  entry.words = weights.keys();
+  for ( QHash<QString, int>::ConstIterator it = weights.constBegin();
+        it != weights.constEnd(); ++it ) {
+    mWords[it.key()].insert( incidence.data(), it.value() );
+  }
+}
+
+void SearchIndex::Private::remove( const Incidence *incidence )
+{
+  QHash<const Incidence *, Entry>::Iterator entry = mEntries.find( incidence );
+  if ( entry == mEntries.end() ) {
+    return;
+  }
+
+  foreach ( const QString &word, entry->words ) {
+    QMap<QString, Postings>::Iterator postings = mWords.find( word );
+    if ( postings != mWords.end() ) {
+      postings->remove( incidence );
+      if ( postings->isEmpty() ) {
+        mWords.erase( postings );
+      }
+    }
+  }
+  mEntries.erase( entry );
+}
+//@endcond
+
+SearchIndex::SearchIndex( const Calendar::Ptr &calendar )
+  : d( new KCalCore::SearchIndex::Private( calendar ) )
+{
+  if ( d->mCalendar ) {
+    d->mCalendar->registerObserver( this );
+  }
+  rebuild();
+}
+
+SearchIndex::~SearchIndex()
+{
+  if ( d->mCalendar ) {
+    d->mCalendar->unregisterObserver( this );
+  }
+  delete d;
+}
+
+Calendar::Ptr SearchIndex::calendar() const
+{
+  return d->mCalendar;
+}
+
+Incidence::List SearchIndex::search( const QString &query, int limit ) const
+{
+  Incidence::List result;
+  const QStringList terms = words( query );
+  if ( terms.isEmpty() || limit == 0 ) {
+    return result;
+  }
+
+  QHash<const Incidence *, double> scores;
+  for ( int i = 0; i < terms.count(); ++i ) {
+    const QString &term = terms[i];
+    QHash<const Incidence *, double> termScores;
+    for ( QMap<QString, Postings>::ConstIterator it = d->mWords.lowerBound( term );
+          it != d->mWords.constEnd() && it.key().startsWith( term ); ++it ) {
+      const double idf = qLn( 1.0 + double( d->mEntries.count() ) / it->count() );
+      const double factor = it.key().length() == term.length() ? 2.0 : 1.0;
+      for ( Postings::ConstIterator p = it->constBegin(); p != it->constEnd(); ++p ) {
+        double &score = termScores[p.key()];
+        score = qMax( score, p.value() * factor * idf );
+      }
+    }
+
+    // Incidences must match every term
+    if ( i == 0 ) {
+      scores = termScores;
+    } else {
+      QHash<const Incidence *, double>::Iterator it = scores.begin();
+      while ( it != scores.end() ) {
+        QHash<const Incidence *, double>::ConstIterator match = termScores.constFind( it.key() );
+        if ( match == termScores.constEnd() ) {
+          it = scores.erase( it );
+        } else {
+          it.value() += match.value();
+          ++it;
+        }
+      }
+    }
+    if ( scores.isEmpty() ) {
+      return result;
+    }
+  }
+
+  QVector<Match> matches;
+  matches.reserve( scores.count() );
+  for ( QHash<const Incidence *, double>::ConstIterator it = scores.constBegin();
+        it != scores.constEnd(); ++it ) {
+    const Match match = { it.value(), d->mEntries.value( it.key() ).incidence };
+    matches.append( match );
+  }
+  std::sort( matches.begin(), matches.end(), moreRelevant );
+
+  foreach ( const Match &match, matches ) {
+    // Skip incidences dropped without notification, see rebuild()
+    const Incidence::Ptr &incidence = match.incidence;
+    if ( d->mCalendar &&
+         d->mCalendar->incidence( incidence->uid(), incidence->recurrenceId() ) != incidence ) {
+      continue;
+    }
+    result.append( incidence );
+    if ( result.count() == limit ) {
+      break;
+    }
+  }
+  return result;
+}
+
+void SearchIndex::rebuild()
+{
+  d->mWords.clear();
+  d->mEntries.clear();
+  if ( d->mCalendar ) {
+    foreach ( const Incidence::Ptr &incidence, d->mCalendar->rawIncidences() ) {
+      d->insert( incidence );
+    }
+  }
+}
+
+QStringList SearchIndex::words( const QString &text )
+{
+  // The compatibility decomposition splits accented letters into a base
+  // letter and combining marks, which are dropped.
+  const QString folded = text.normalized( QString::NormalizationForm_KD ).toCaseFolded();
+  QStringList result;
+  QString word;
+  for ( int i = 0; i < folded.length(); ++i ) {
+    const QChar c = folded.at( i );
+    if ( c.isLetterOrNumber() ) {
+      word += c;
+    } else if ( c.category() == QChar::Mark_NonSpacing ) {
+      continue;
+    } else if ( !word.isEmpty() ) {
+      result.append( word );
+      word.clear();
+    }
+  }
+  if ( !word.isEmpty() ) {
+    result.append( word );
+  }
+  return result;
+}
+
+void SearchIndex::calendarIncidenceAdded( const Incidence::Ptr &incidence )
+{
+  d->remove( incidence.data() );
+  d->insert( incidence );
+}
+
+void SearchIndex::calendarIncidenceChanged( const Incidence::Ptr &incidence )
+{
+  d->remove( incidence.data() );
+  d->insert( incidence );
+}
+
+void SearchIndex::calendarIncidenceDeleted( const Incidence::Ptr &incidence )
+{
+  d->remove( incidence.data() );
+}
+
+void SearchIndex::calendarIncidenceAdditionCanceled( const Incidence::Ptr &incidence )
+{
+  d->remove( incidence.data() );
+}
@@ -0,0 +1,128 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the SearchIndex class.
+*/
+
+#ifndef KCALCORE_SEARCHINDEX_H
+#define KCALCORE_SEARCHINDEX_H
+
+#include "kcalcore_export.h"
+#include "calendar.h"
+
+namespace KCalCore {
+
+/**
+  @brief
+  A full-text index of the incidences of a calendar.
+
+  The index covers the summary, description and location of the incidences
+  and the names and email addresses of their attendees. Texts are split
+  into words, which are compared ignoring case and diacritics, so that
+  "Cafe" finds "café". Each word of a query matches the words of the
+  incidences starting with it, which allows searching as the user types.
+
+  Once created, the index follows the additions, changes and deletions
+  notified to the observers of the calendar. Observers are not notified
+  when a calendar is closed, call rebuild() after reloading it.
+
+  An index is not thread-safe, like the calendar it is attached to.
+
+  @since 4.11
+*/
+class KCALCORE_EXPORT SearchIndex : public Calendar::CalendarObserver
+{
+  public:
+    /**
+      Creates an index of the incidences of @p calendar and registers it
+      as an observer of the calendar.
+
+      @param calendar is the calendar to index.
+    */
+    explicit SearchIndex( const Calendar::Ptr &calendar );
+
+    /**
+      Unregisters the index from the calendar.
+    */
+    ~SearchIndex();
+
+    /**
+      Returns the calendar the index is attached to.
+    */
+    Calendar::Ptr calendar() const;
+
+    /**
+      Returns the incidences matching every word of @p query, the most
+      relevant first.
+
+      Words matched in the summary weigh more than words matched in the
+      location or the attendees, which weigh more than words matched in
+      the description. Whole words weigh more than prefixes, and rare
+      words more than common ones.
+
+      @param query is the text to search for.
+      @param limit is the maximum number of incidences returned, or
+      -1 to return them all.
+    */
+    Incidence::List search( const QString &query, int limit = -1 ) const;
+
+    /**
+      Indexes the incidences of the calendar again from scratch.
+    */
+    void rebuild();
+
+    /**
+      Splits @p text into words, folded to lower case and stripped of
+      diacritics, as the index stores them.
+    */
+    static QStringList words( const QString &text );
+
+    /**
+      @copydoc Calendar::CalendarObserver::calendarIncidenceAdded()
+    */
+    void calendarIncidenceAdded( const Incidence::Ptr &incidence );
+
+    /**
+      @copydoc Calendar::CalendarObserver::calendarIncidenceChanged()
+    */
+    void calendarIncidenceChanged( const Incidence::Ptr &incidence );
+
+    /**
+      @copydoc Calendar::CalendarObserver::calendarIncidenceDeleted()
+    */
+    void calendarIncidenceDeleted( const Incidence::Ptr &incidence );
+
+    /**
+      @copydoc Calendar::CalendarObserver::calendarIncidenceAdditionCanceled()
+    */
+    void calendarIncidenceAdditionCanceled( const Incidence::Ptr &incidence );
+
+  private:
+    Q_DISABLE_COPY( SearchIndex )
+    //@cond PRIVATE
+    class Private;
+    Private *const d;
+    //@endcond
+};
+
+}
+
+#endif
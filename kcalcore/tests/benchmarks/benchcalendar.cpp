@@ -0,0 +1,773 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "benchcalendar.h"
+#include "calendargenerator.h"
+#include "../../conflictdetector.h"
+#include "../../freebusy.h"
+#include "../../icalformat.h"
+#include "../../searchindex.h"
+
+#include <kcalendarsystem.h>
+#include <ksystemtimezone.h>
+
+#include <QtCore/QScopedPointer>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTextStream>
+
+#include <cstdlib>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( CalendarBenchmark, NoGUI )
+
+using namespace KCalCore;
+
+static void addSizes()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::newRow( "100" ) << 100;
+  QTest::newRow( "1000" ) << 1000;
+  QTest::newRow( "10000" ) << 10000;
+}
+
+// Resets the peak resident set size of the process, on Linux.
+static void resetPeakRss()
+{
+  QFile file( "/proc/self/clear_refs" );
+  if ( file.open( QIODevice::WriteOnly ) ) {
+    file.write( "5" );
+  }
+}
+
+// Returns a memory size of the process status in kB, on Linux, or -1.
+static qint64 statusSize( const QString &field )
+{
+  QFile file( "/proc/self/status" );
+  if ( file.open( QIODevice::ReadOnly ) ) {
+    QTextStream status( &file );
+    for ( QString line = status.readLine(); !line.isNull(); line = status.readLine() ) {
+      if ( line.startsWith( field ) ) {
+        return line.mid( field.length() ).remove( "kB" ).trimmed().toLongLong();
+      }
+    }
+  }
+  return -1;
+}
+
+// Returns the peak resident set size of the process in kB, or -1.
+static qint64 peakRss()
+{
+  return statusSize( "VmHWM:" );
+}
+
+// Returns the resident set size of the process in kB, or -1, after giving
+// the memory freed so far back to the system.
+static qint64 currentRss()
+{
+#ifdef __GLIBC__
+  malloc_trim( 0 );
+#endif
+  return statusSize( "VmRSS:" );
+}
+
+static KDateTime::Spec otherSpec()
+{
+  // A zone with daylight saving time if the system provides one.
+  const KTimeZone zone = KSystemTimeZones::zone( "Europe/Helsinki" );
+  return zone.isValid() ? KDateTime::Spec( zone ) : KDateTime::Spec::OffsetFromUTC( 7200 );
+}
+
+void CalendarBenchmark::benchSave_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchSave()
+{
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  ICalFormat format;
+  QBENCHMARK {
+    QVERIFY( format.save( cal, file.fileName() ) );
+  }
+}
+
+void CalendarBenchmark::benchLoad_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchLoad()
+{
+  QFETCH( int, count );
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  QVERIFY( ICalFormat().save( CalendarGenerator().calendar( count ), file.fileName() ) );
+
+  QBENCHMARK {
+    MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( ICalFormat().load( cal, file.fileName() ) );
+  }
+}
+
+void CalendarBenchmark::benchLoadLarge_data()
+{
+  QTest::addColumn<int>( "megabytes" );
+  QTest::newRow( "10 MB" ) << 10;
+  QTest::newRow( "50 MB" ) << 50;
+  QTest::newRow( "200 MB" ) << 200;
+}
+
+void CalendarBenchmark::benchLoadLarge()
+{
+  if ( qgetenv( "KCALCORE_BENCH_LARGE" ).isEmpty() ) {
+    QSKIP( "Set KCALCORE_BENCH_LARGE to load calendars of several hundred MB" );
+  }
+
+  QFETCH( int, megabytes );
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  ICalFormat format;
+  CalendarGenerator generator;
+  file.write( "BEGIN:VCALENDAR\r\nPRODID:-//kcalcore//benchmark//EN\r\nVERSION:2.0\r\n" );
+  while ( file.pos() < megabytes * Q_INT64_C( 1024 * 1024 ) ) {
+    file.write( format.toRawString( generator.event() ) );
+  }
+  file.write( "END:VCALENDAR\r\n" );
+  file.close();
+
+  resetPeakRss();
+  const qint64 before = peakRss();
+  QBENCHMARK_ONCE {
+    MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( format.load( cal, file.fileName() ) );
+  }
+  qDebug() << "peak RSS growth:" << peakRss() - before << "kB";
+}
+
+void CalendarBenchmark::benchLoadInterning()
+{
+  // A generated calendar of 50000 events, loaded without and with the
+  // string pools of the parser
+  const int count = 50000;
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  QVERIFY( ICalFormat().save( CalendarGenerator().calendar( count ), file.fileName() ) );
+  {
+    // Fill the caches which live longer than a calendar
+    MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( ICalFormat().load( cal, file.fileName() ) );
+  }
+
+  qint64 growth[2];
+  for ( int pooled = 0; pooled < 2; ++pooled ) {
+    if ( pooled ) {
+      ::unsetenv( "KCALCORE_NO_STRING_POOL" );
+    } else {
+      ::setenv( "KCALCORE_NO_STRING_POOL", "1", 1 );
+    }
+    const qint64 before = currentRss();
+    MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( ICalFormat().load( cal, file.fileName() ) );
+    QVERIFY( !cal->rawIncidences().isEmpty() );
+    growth[pooled] = currentRss() - before;
+  }
+  qDebug() << "RSS growth of" << count << "incidences without string pools:" << growth[0]
+           << "kB, with:" << growth[1] << "kB, saved:" << growth[0] - growth[1] << "kB";
+}
+
+void CalendarBenchmark::benchLoadExceptions_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchLoadExceptions()
+{
+  // Daily series in a time zone, with count exceptions each
+  QFETCH( int, count );
+  const KDateTime::Spec spec( KSystemTimeZones::zone( QLatin1String( "Europe/Helsinki" ) ) );
+  MemoryCalendar::Ptr source( new MemoryCalendar( spec ) );
+  for ( int i = 0; i < 20; ++i ) {
+    Event::Ptr event( new Event );
+    event->setSummary( QString::fromLatin1( "Series %1" ).arg( i ) );
+    event->setDtStart( KDateTime( QDate( 2010, 1, 1 ), QTime( 8 + i % 10, 0 ), spec ) );
+    event->setDtEnd( event->dtStart().addSecs( 1800 ) );
+    event->recurrence()->setDaily( 1 );
+    DateTimeList exceptions;
+    for ( int j = 0; j < count; ++j ) {
+      exceptions.append( event->dtStart().addDays( 2 * j + 1 ) );
+    }
+    event->recurrence()->setExDateTimes( exceptions );
+    source->addEvent( event );
+  }
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  QVERIFY( ICalFormat().save( source, file.fileName() ) );
+
+  QBENCHMARK {
+    MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( ICalFormat().load( cal, file.fileName() ) );
+  }
+}
+
+void CalendarBenchmark::benchExceptionLookup_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchExceptionLookup()
+{
+  // A daily series with count exceptions, looked up for each occurrence
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  const KDateTime start( QDate( 2010, 1, 4 ), QTime( 9, 0 ), KDateTime::UTC );
+  Event::Ptr series( new Event );
+  series->setUid( QLatin1String( "standup" ) );
+  series->setDtStart( start );
+  series->setDtEnd( start.addSecs( 900 ) );
+  series->recurrence()->setDaily( 1 );
+  cal->addEvent( series );
+  for ( int i = 0; i < count; ++i ) {
+    Event::Ptr exception( series->clone() );
+    exception->clearRecurrence();
+    exception->setRecurrenceId( start.addDays( 2 * i ) );
+    exception->setDtStart( start.addDays( 2 * i ).addSecs( 1800 ) );
+    exception->setDtEnd( exception->dtStart().addSecs( 900 ) );
+    cal->addEvent( exception );
+  }
+
+  int found = 0;
+  QBENCHMARK {
+    for ( int i = 0; i < 2 * count; ++i ) {
+      if ( cal->event( series->uid(), start.addDays( i ) ) ) {
+        ++found;
+      }
+    }
+    found += cal->instances( series ).count();
+  }
+  QVERIFY( found > 0 );
+}
+
+void CalendarBenchmark::benchRawEventsRange_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchRawEventsRange()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const QDate start = generator.base().date().addMonths( 5 );
+
+  QBENCHMARK {
+    cal->rawEvents( start, start.addMonths( 1 ) );
+  }
+}
+
+void CalendarBenchmark::benchRawEventsForDate_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchRawEventsForDate()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const QDate start = generator.base().date().addMonths( 5 );
+
+  QBENCHMARK {
+    for ( int i = 0; i < 31; ++i ) {
+      cal->rawEventsForDate( start.addDays( i ) );
+    }
+  }
+}
+
+void CalendarBenchmark::benchOccurrences_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchOccurrences()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const KDateTime start = generator.base().addMonths( 5 );
+
+  QBENCHMARK {
+    cal->occurrences( start, start.addMonths( 1 ) );
+  }
+}
+
+void CalendarBenchmark::benchAlarms_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchAlarms()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const KDateTime start = generator.base().addMonths( 5 );
+
+  QBENCHMARK {
+    cal->alarms( start, start.addDays( 7 ) );
+  }
+}
+
+void CalendarBenchmark::benchTimesInInterval_data()
+{
+  QTest::addColumn<int>( "kind" );
+  QTest::newRow( "minutely" ) << 0;
+  QTest::newRow( "hourly" ) << 1;
+  QTest::newRow( "daily" ) << 2;
+  QTest::newRow( "weekly" ) << 3;
+  QTest::newRow( "monthly by date" ) << 4;
+  QTest::newRow( "monthly by position" ) << 5;
+  QTest::newRow( "yearly by month" ) << 6;
+  QTest::newRow( "yearly by day" ) << 7;
+}
+
+void CalendarBenchmark::benchTimesInInterval()
+{
+  QFETCH( int, kind );
+  CalendarGenerator generator;
+  const Event::Ptr event = generator.recurringEvent( kind );
+  const KDateTime start = generator.base();
+
+  QBENCHMARK {
+    event->recurrence()->timesInInterval( start, start.addYears( 2 ) );
+  }
+}
+
+namespace {
+
+class TimesCounter : public RecurrenceRule::TimesVisitor
+{
+  public:
+    TimesCounter()
+      : mCount( 0 )
+    {
+    }
+
+    bool visitTimes( const DateTimeList &times )
+    {
+      mCount += times.count();
+      return true;
+    }
+
+    qint64 mCount;
+};
+
+}
+
+void CalendarBenchmark::benchOccurrenceCount_data()
+{
+  QTest::addColumn<int>( "method" );
+  QTest::newRow( "timesInInterval" ) << 0;
+  QTest::newRow( "visitTimesInInterval" ) << 1;
+  QTest::newRow( "occurrenceCount" ) << 2;
+}
+
+void CalendarBenchmark::benchOccurrenceCount()
+{
+  // Every minute over a year, which timesInInterval() truncates
+  QFETCH( int, method );
+  const KDateTime start = CalendarGenerator().base();
+  RecurrenceRule rule;
+  rule.setStartDt( start );
+  rule.setRecurrenceType( RecurrenceRule::rMinutely );
+  rule.setFrequency( 1 );
+  const KDateTime end = start.addYears( 1 );
+
+  qint64 count = 0;
+  QBENCHMARK {
+    if ( method == 0 ) {
+      count = rule.timesInInterval( start, end ).count();
+    } else if ( method == 1 ) {
+      TimesCounter counter;
+      rule.visitTimesInInterval( start, end, &counter );
+      count = counter.mCount;
+    } else {
+      count = rule.occurrenceCount( start, end );
+    }
+  }
+  qDebug() << "occurrences:" << count;
+}
+
+void CalendarBenchmark::benchRecurrenceCaches_data()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::newRow( "10000" ) << 10000;
+  QTest::newRow( "100000" ) << 100000;
+}
+
+void CalendarBenchmark::benchRecurrenceCaches()
+{
+  // The rules with a count cache all their occurrences on first use
+  QFETCH( int, count );
+  if ( count > 10000 && qgetenv( "KCALCORE_BENCH_LARGE" ).isEmpty() ) {
+    QSKIP( "Set KCALCORE_BENCH_LARGE to expand a calendar of 100000 incidences" );
+  }
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const KDateTime start = generator.base().addMonths( 5 );
+
+  resetPeakRss();
+  const qint64 before = peakRss();
+  QBENCHMARK_ONCE {
+    foreach ( const Event::Ptr &event, cal->rawEvents() ) {
+      if ( event->recurs() ) {
+        event->recurrence()->timesInInterval( start, start.addMonths( 1 ) );
+      }
+    }
+  }
+  qDebug() << "peak RSS growth:" << peakRss() - before << "kB";
+}
+
+void CalendarBenchmark::benchDeletedToString_data()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::addColumn<bool>( "kept" );
+  QTest::newRow( "1000 kept" ) << 1000 << true;
+  QTest::newRow( "1000 tombstones" ) << 1000 << false;
+  QTest::newRow( "10000 kept" ) << 10000 << true;
+  QTest::newRow( "10000 tombstones" ) << 10000 << false;
+}
+
+void CalendarBenchmark::benchDeletedToString()
+{
+  // What a synchronization session sends after deleting everything
+  QFETCH( int, count );
+  QFETCH( bool, kept );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+  cal->setDeletedIncidencesKept( kept );
+  foreach ( const Event::Ptr &event, cal->rawEvents() ) {
+    if ( !event->hasRecurrenceId() ) {
+      cal->deleteEvent( event );
+    }
+  }
+  QVERIFY( cal->rawEvents().isEmpty() );
+
+  ICalFormat format;
+  QBENCHMARK {
+    format.toString( cal, QString(), true );
+  }
+}
+
+void CalendarBenchmark::benchMonthGrids()
+{
+  CalendarGenerator generator;
+  Event::List events;
+  for ( int i = 0; i < 2000; ++i ) {
+    events.append( generator.recurringEvent( i % CalendarGenerator::RecurrenceKinds ) );
+  }
+  const QDate base = generator.base().date();
+
+  // The 6 weeks shown by a month view, for each month of the year
+  QBENCHMARK {
+    for ( int month = 0; month < 12; ++month ) {
+      const QDate first = base.addMonths( month );
+      const QDate start = first.addDays( 1 - first.dayOfWeek() );
+      for ( int day = 0; day < 42; ++day ) {
+        foreach ( const Event::Ptr &event, events ) {
+          event->recursOn( start.addDays( day ), KDateTime::UTC );
+        }
+      }
+    }
+  }
+}
+
+void CalendarBenchmark::benchCalendarSystems_data()
+{
+  QTest::addColumn<QString>( "system" );
+  QTest::addColumn<bool>( "bulk" );
+  foreach ( const QString &system, KCalendarSystem::calendarSystems() ) {
+    QTest::newRow( QString::fromLatin1( "%1, each day" ).arg( system ).toLatin1() ) << system << false;
+    QTest::newRow( QString::fromLatin1( "%1, bulk" ).arg( system ).toLatin1() ) << system << true;
+  }
+}
+
+void CalendarBenchmark::benchCalendarSystems()
+{
+  // The days shown by a month view, for each month of the year
+  QFETCH( QString, system );
+  QFETCH( bool, bulk );
+  QScopedPointer<KCalendarSystem> calendar( KCalendarSystem::create( system ) );
+  const QDate base( 2013, 1, 1 );
+
+  int sum = 0;
+  QBENCHMARK {
+    for ( int month = 0; month < 12; ++month ) {
+      const QDate first = base.addMonths( month );
+      const QDate start = first.addDays( 1 - first.dayOfWeek() );
+      if ( bulk ) {
+        foreach ( const KCalendarSystem::YearMonthDay &date,
+                  calendar->julianDaysToDates( start.toJulianDay(), 42 ) ) {
+          sum += date.day;
+        }
+      } else {
+        for ( int day = 0; day < 42; ++day ) {
+          const QDate date = start.addDays( day );
+          sum += calendar->year( date ) + calendar->month( date ) + calendar->day( date );
+        }
+      }
+    }
+  }
+  QVERIFY( sum > 0 );
+}
+
+void CalendarBenchmark::benchConflicts_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchConflicts()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const KDateTime start = generator.base().addMonths( 5 );
+
+  QBENCHMARK {
+    ConflictDetector detector( cal, start, start.addMonths( 1 ) );
+    detector.conflicts();
+  }
+}
+
+void CalendarBenchmark::benchFreeBusy_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchFreeBusy()
+{
+  QFETCH( int, count );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal = generator.calendar( count );
+  const KDateTime start = generator.base().addMonths( 5 );
+  const KDateTime end = start.addMonths( 1 );
+  const Event::List events = cal->rawEvents( start.date(), end.date() );
+
+  QBENCHMARK {
+    FreeBusy freeBusy( events, start, end );
+  }
+}
+
+void CalendarBenchmark::benchSearch_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchSearch()
+{
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+  const SearchIndex index( cal );
+
+  QBENCHMARK {
+    index.search( "room 1" );
+  }
+}
+
+void CalendarBenchmark::benchSearchLinear_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchSearchLinear()
+{
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+
+  // What applications do without an index
+  QBENCHMARK {
+    Incidence::List result;
+    foreach ( const Incidence::Ptr &incidence, cal->rawIncidences() ) {
+      const QString text = incidence->summary() + ' ' + incidence->description() +
+                           ' ' + incidence->location();
+      if ( text.contains( "room", Qt::CaseInsensitive ) &&
+           text.contains( "1", Qt::CaseInsensitive ) ) {
+        result.append( incidence );
+      }
+    }
+  }
+}
+
+void CalendarBenchmark::benchSortEvents_data()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::addColumn<int>( "field" );
+  QTest::newRow( "1000 by start" ) << 1000 << int( EventSortStartDate );
+  QTest::newRow( "1000 by summary" ) << 1000 << int( EventSortSummary );
+  QTest::newRow( "10000 by start" ) << 10000 << int( EventSortStartDate );
+  QTest::newRow( "10000 by summary" ) << 10000 << int( EventSortSummary );
+}
+
+void CalendarBenchmark::benchSortEvents()
+{
+  QFETCH( int, count );
+  QFETCH( int, field );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+  const Event::List events = cal->rawEvents();
+
+  QBENCHMARK {
+    Calendar::sortEvents( events, EventSortField( field ), SortDirectionAscending );
+  }
+}
+
+void CalendarBenchmark::benchSetTimeSpec_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchSetTimeSpec()
+{
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+  const KDateTime::Spec spec = otherSpec();
+
+  QBENCHMARK {
+    cal->setTimeSpec( spec );
+    cal->setTimeSpec( KDateTime::UTC );
+  }
+}
+
+void CalendarBenchmark::benchConvertTimes_data()
+{
+  addSizes();
+}
+
+void CalendarBenchmark::benchConvertTimes()
+{
+  QFETCH( int, count );
+  MemoryCalendar::Ptr cal = CalendarGenerator().calendar( count );
+  const Event::List events = cal->rawEvents();
+  const KDateTime::Spec spec = otherSpec();
+
+  QBENCHMARK {
+    foreach ( const Event::Ptr &event, events ) {
+      // A fresh value each time, the result of a conversion is cached.
+      const KDateTime dt = event->dtStart();
+      KDateTime( dt.date(), dt.time(), dt.timeSpec() ).toTimeSpec( spec );
+    }
+  }
+}
+
+void CalendarBenchmark::benchSystemZoneOffsets_data()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::addColumn<bool>( "libc" );
+  QTest::newRow( "1000 tables" ) << 1000 << false;
+  QTest::newRow( "1000 libc" ) << 1000 << true;
+  QTest::newRow( "10000 tables" ) << 10000 << false;
+  QTest::newRow( "10000 libc" ) << 10000 << true;
+}
+
+void CalendarBenchmark::benchSystemZoneOffsets()
+{
+  QFETCH( int, count );
+  QFETCH( bool, libc );
+  const KTimeZone zone = KSystemTimeZones::zone( "Europe/Helsinki" );
+  if ( !zone.isValid() ) {
+    QSKIP( "Europe/Helsinki is not installed" );
+  }
+  QVector<time_t> times;
+  for ( int i = 0; i < count; ++i ) {
+    times.append( time_t( 946684800 ) + i * 3607 * 7 );
+  }
+
+  int sum = 0;
+  QBENCHMARK {
+    foreach ( time_t t, times ) {
+      if ( libc ) {
+        // What system time zones used to do for each conversion
+        const QByteArray saved = qgetenv( "TZ" );
+        ::setenv( "TZ", ":Europe/Helsinki", 1 );
+        ::tzset();
+        tm tmtime;
+        localtime_r( &t, &tmtime );
+        sum += tmtime.tm_gmtoff;
+        if ( saved.isEmpty() ) {
+          ::unsetenv( "TZ" );
+        } else {
+          ::setenv( "TZ", saved.constData(), 1 );
+        }
+        ::tzset();
+      } else {
+        sum += zone.offset( t );
+      }
+    }
+  }
+  QVERIFY( sum != 0 );
+}
+
+void CalendarBenchmark::benchScheduleMessages_data()
+{
+  QTest::addColumn<int>( "count" );
+  QTest::addColumn<bool>( "batch" );
+  QTest::newRow( "1000 single" ) << 1000 << false;
+  QTest::newRow( "1000 batch" ) << 1000 << true;
+  QTest::newRow( "10000 single" ) << 10000 << false;
+  QTest::newRow( "10000 batch" ) << 10000 << true;
+}
+
+void CalendarBenchmark::benchScheduleMessages()
+{
+  // Invitations and replies in a few time zones, a third of them updates
+  QFETCH( int, count );
+  QFETCH( bool, batch );
+  CalendarGenerator generator;
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  const char *zoneNames[] = { "Europe/Helsinki", "America/New_York", "Asia/Tokyo" };
+  ICalFormat format;
+  QList<QByteArray> messages;
+  for ( int i = 0; i < count; ++i ) {
+    Event::Ptr event = generator.event();
+    const KTimeZone zone = KSystemTimeZones::zone( zoneNames[i % 3] );
+    if ( zone.isValid() ) {
+      event->setDtStart( event->dtStart().toTimeSpec( zone ) );
+      event->setDtEnd( event->dtEnd().toTimeSpec( zone ) );
+    }
+    if ( i % 3 == 0 ) {
+      cal->addEvent( Event::Ptr( event->clone() ) );
+    }
+    messages << format.createScheduleMessage( event, i % 2 ? iTIPReply : iTIPRequest ).toUtf8();
+  }
+
+  QBENCHMARK {
+    if ( batch ) {
+      QCOMPARE( format.parseScheduleMessages( cal, messages ).count(), count );
+    } else {
+      foreach ( const QByteArray &message, messages ) {
+        QVERIFY( format.parseScheduleMessage( cal, QString::fromUtf8( message ) ) );
+      }
+    }
+  }
+}
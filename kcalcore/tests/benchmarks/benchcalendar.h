@@ -0,0 +1,79 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BENCHCALENDAR_H
+#define BENCHCALENDAR_H
+
+#include <QtCore/QObject>
+
+class CalendarBenchmark : public QObject
+{
+  Q_OBJECT
+  private Q_SLOTS:
+    void benchSave_data();
+    void benchSave();
+    void benchLoad_data();
+    void benchLoad();
+    void benchLoadLarge_data();
+    void benchLoadLarge();
+    void benchLoadInterning();
+    void benchLoadExceptions_data();
+    void benchLoadExceptions();
+    void benchExceptionLookup_data();
+    void benchExceptionLookup();
+    void benchRawEventsRange_data();
+    void benchRawEventsRange();
+    void benchRawEventsForDate_data();
+    void benchRawEventsForDate();
+    void benchOccurrences_data();
+    void benchOccurrences();
+    void benchAlarms_data();
+    void benchAlarms();
+    void benchTimesInInterval_data();
+    void benchTimesInInterval();
+    void benchOccurrenceCount_data();
+    void benchOccurrenceCount();
+    void benchRecurrenceCaches_data();
+    void benchRecurrenceCaches();
+    void benchDeletedToString_data();
+    void benchDeletedToString();
+    void benchMonthGrids();
+    void benchCalendarSystems_data();
+    void benchCalendarSystems();
+    void benchConflicts_data();
+    void benchConflicts();
+    void benchFreeBusy_data();
+    void benchFreeBusy();
+    void benchSearch_data();
+    void benchSearch();
+    void benchSearchLinear_data();
+    void benchSearchLinear();
+    void benchSortEvents_data();
+    void benchSortEvents();
+    void benchSetTimeSpec_data();
+    void benchSetTimeSpec();
+    void benchConvertTimes_data();
+    void benchConvertTimes();
+    void benchSystemZoneOffsets_data();
+    void benchSystemZoneOffsets();
+    void benchScheduleMessages_data();
+    void benchScheduleMessages();
+};
+
+#endif
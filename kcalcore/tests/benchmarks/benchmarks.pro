@@ -0,0 +1,19 @@
+TEMPLATE = app
+TARGET = bench_calendar
+
+QT -= gui
+QT += testlib
+CONFIG += link_pkgconfig
+PKGCONFIG += libical uuid
+
+DEPENDPATH += . $$PWD/.. $$PWD/../.. $$PWD/../../versit $$PWD/../../klibport $$PWD/../../kdedate
+INCLUDEPATH += . $$PWD/.. $$PWD/../.. $$PWD/../../versit $$PWD/../../klibport $$PWD/../../kdedate /usr/include/libical
+
+QMAKE_LIBDIR += $$PWD/../..
+LIBS += -lkcalcoren-qt5
+
+HEADERS += benchcalendar.h \
+           calendargenerator.h
+SOURCES += benchcalendar.cpp
+
+target.path = /opt/tests/kcalcore-qt5/
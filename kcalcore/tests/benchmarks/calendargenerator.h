@@ -0,0 +1,206 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CALENDARGENERATOR_H
+#define CALENDARGENERATOR_H
+
+#include "../testincidencegenerator.h"
+#include "../../memorycalendar.h"
+
+#include <QtCore/QBitArray>
+
+/**
+  Builds synthetic calendars for the benchmarks. The content only depends
+  on the seed, so that runs on different machines and Qt versions measure
+  the same data: a year of single, multi-day and all-day events, recurring
+  events of every kind, todos, alarms and attendees.
+*/
+class CalendarGenerator
+{
+  public:
+    explicit CalendarGenerator( quint32 seed = 1 )
+      : mState( seed ), mSerial( 0 ),
+        mBase( QDate( 2020, 1, 1 ), QTime( 0, 0 ), KDateTime::UTC )
+    {
+    }
+
+    /**
+      The first day covered by the generated incidences.
+    */
+    KDateTime base() const
+    {
+      return mBase;
+    }
+
+    /**
+      Returns a new calendar holding @p count incidences.
+    */
+    MemoryCalendar::Ptr calendar( int count )
+    {
+      MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+      for ( int i = 0; i < count; ++i ) {
+        if ( i % 10 == 9 ) {
+          cal->addTodo( todo() );
+        } else if ( i % 5 == 4 ) {
+          cal->addEvent( recurringEvent( ( i / 5 ) % RecurrenceKinds ) );
+        } else {
+          cal->addEvent( event() );
+        }
+      }
+      cal->setModified( false );
+      return cal;
+    }
+
+    /**
+      Returns a non recurring event somewhere in the covered year.
+    */
+    Event::Ptr event()
+    {
+      Event::Ptr ev( makeTestEvent() );
+      ev->clearRecurrence();
+      fill( ev );
+
+      const int kind = random( 20 );
+      if ( kind == 0 ) {
+        ev->setAllDay( true );
+        ev->setDtEnd( ev->dtStart().addDays( random( 3 ) ) );
+      } else if ( kind == 1 ) {
+        ev->setDtEnd( ev->dtStart().addDays( 1 + random( 4 ) ) );
+      } else {
+        ev->setDtEnd( ev->dtStart().addSecs( 1800 * ( 1 + random( 4 ) ) ) );
+      }
+      return ev;
+    }
+
+    /**
+      The number of recurrence kinds recurringEvent() knows about.
+    */
+    static const int RecurrenceKinds = 8;
+
+    /**
+      Returns an event recurring according to @p kind, in the range
+      [0, RecurrenceKinds): minutely, hourly, daily, weekly, monthly by
+      date, monthly by position, yearly by month and yearly by day.
+    */
+    Event::Ptr recurringEvent( int kind )
+    {
+      Event::Ptr ev( makeTestEvent() );
+      fill( ev );
+      ev->setDtEnd( ev->dtStart().addSecs( 3600 ) );
+
+      Recurrence *recurrence = ev->recurrence();
+      QBitArray days( 7 );
+      switch ( kind ) {
+      case 0:
+        recurrence->setMinutely( 30 );
+        recurrence->setDuration( 500 );
+        break;
+      case 1:
+        recurrence->setHourly( 1 + random( 6 ) );
+        recurrence->setDuration( 1000 );
+        break;
+      case 2:
+        recurrence->setDaily( 1 + random( 3 ) );
+        break;
+      case 3:
+        days.setBit( random( 7 ) );
+        days.setBit( random( 7 ) );
+        recurrence->setWeekly( 1 + random( 2 ), days );
+        break;
+      case 4:
+        recurrence->setMonthly( 1 );
+        recurrence->addMonthlyDate( ev->dtStart().date().day() );
+        break;
+      case 5:
+        days.setBit( random( 7 ) );
+        recurrence->setMonthly( 1 );
+        recurrence->addMonthlyPos( 1 + random( 4 ), days );
+        break;
+      case 6:
+        recurrence->setYearly( 1 );
+        recurrence->addYearlyMonth( ev->dtStart().date().month() );
+        break;
+      default:
+        recurrence->setYearly( 1 );
+        recurrence->addYearlyDay( ev->dtStart().date().dayOfYear() );
+        break;
+      }
+      if ( kind > 1 && random( 3 ) == 0 ) {
+        recurrence->setEndDate( ev->dtStart().date().addDays( 90 + random( 365 ) ) );
+      }
+      if ( random( 4 ) == 0 ) {
+        recurrence->addExDateTime( ev->dtStart().addDays( 7 ) );
+      }
+      return ev;
+    }
+
+    /**
+      Returns a todo due somewhere in the covered year.
+    */
+    Todo::Ptr todo()
+    {
+      Todo::Ptr td( makeTestTodo() );
+      fill( td );
+      td->setDtDue( td->dtStart().addDays( random( 14 ) ), true );
+      td->setHasDueDate( true );
+      return td;
+    }
+
+    /**
+      Returns a pseudo random number in [0, @p max), from a linear
+      congruential generator so that the sequence is the same everywhere.
+    */
+    int random( int max )
+    {
+      mState = mState * 1103515245u + 12345u;
+      return int( ( mState >> 16 ) % quint32( max ) );
+    }
+
+  private:
+    void fill( const Incidence::Ptr &incidence )
+    {
+      const int serial = ++mSerial;
+      incidence->setUid( QString::fromLatin1( "benchmark-%1" ).arg( serial ) );
+      incidence->setSummary( QString::fromLatin1( "Incidence %1" ).arg( serial ) );
+      incidence->setLocation( QString::fromLatin1( "Room %1" ).arg( random( 50 ) ) );
+      incidence->setCategories( QStringList() <<
+                                QString::fromLatin1( "Category %1" ).arg( random( 8 ) ) );
+      incidence->setDtStart( mBase.addDays( random( 365 ) ).addSecs( 900 * random( 96 ) ) );
+
+      if ( random( 3 ) == 0 ) {
+        Alarm::Ptr alarm = incidence->newAlarm();
+        alarm->setDisplayAlarm( incidence->summary() );
+        alarm->setStartOffset( Duration( -900 ) );
+        alarm->setEnabled( true );
+      }
+      const int attendees = random( 4 );
+      for ( int i = 0; i < attendees; ++i ) {
+        const QString name = QString::fromLatin1( "Person %1" ).arg( random( 40 ) );
+        incidence->addAttendee(
+          Attendee::Ptr( new Attendee( name, name.toLower().remove( ' ' ) +
+                                       QLatin1String( "@example.com" ) ) ) );
+      }
+    }
+
+    quint32 mState;
+    int mSerial;
+    KDateTime mBase;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "testcalendarsystem.h"
+
+#include <kcalendarsystem.h>
+
+#include <QtCore/QScopedPointer>
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( CalendarSystemTest, NoGUI )
+
+void CalendarSystemTest::testJulianDaysToDates_data()
+{
+  QTest::addColumn<QString>( "system" );
+  foreach ( const QString &system, KCalendarSystem::calendarSystems() ) {
+    QTest::newRow( system.toLatin1() ) << system;
+  }
+}
+
+void CalendarSystemTest::testJulianDaysToDates()
+{
+  QFETCH( QString, system );
+  QScopedPointer<KCalendarSystem> calendar( KCalendarSystem::create( system ) );
+
+  // Several years, converted twice to go through the cached tables; the
+  // days follow each other
+  const int start = QDate( 2010, 12, 20 ).toJulianDay();
+  const int count = 4 * 366;
+  for ( int pass = 0; pass < 2; ++pass ) {
+    const QVector<KCalendarSystem::YearMonthDay> dates = calendar->julianDaysToDates( start, count );
+    QCOMPARE( dates.count(), count );
+    for ( int i = 1; i < count; ++i ) {
+      const KCalendarSystem::YearMonthDay &previous = dates[i - 1];
+      const KCalendarSystem::YearMonthDay &date = dates[i];
+      if ( date.day > 1 ) {
+        QCOMPARE( date.day, previous.day + 1 );
+        QCOMPARE( date.month, previous.month );
+        QCOMPARE( date.year, previous.year );
+      } else if ( date.month > 1 ) {
+        QCOMPARE( date.month, previous.month + 1 );
+        QCOMPARE( date.year, previous.year );
+      } else {
+        QCOMPARE( date.year, previous.year + 1 );
+      }
+    }
+    if ( system == QLatin1String( "gregorian" ) ) {
+      for ( int i = 0; i < count; ++i ) {
+        const QDate date = QDate::fromJulianDay( start + i );
+        QCOMPARE( dates[i].year, date.year() );
+        QCOMPARE( dates[i].month, date.month() );
+        QCOMPARE( dates[i].day, date.day() );
+      }
+    }
+  }
+
+  // Days out of the valid range
+  const int first = calendar->earliestValidDate().toJulianDay();
+  const QVector<KCalendarSystem::YearMonthDay> dates = calendar->julianDaysToDates( first - 2, 4 );
+  QCOMPARE( dates[0].year, 0 );
+  QCOMPARE( dates[1].day, 0 );
+  QVERIFY( dates[2].day > 0 );
+  QVERIFY( calendar->julianDaysToDates( start, 0 ).isEmpty() );
+}
@@ -0,0 +1,196 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "testconflictdetector.h"
+#include "../conflictdetector.h"
+#include "../memorycalendar.h"
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( ConflictDetectorTest, NoGUI )
+
+using namespace KCalCore;
+
+static KDateTime at( int day, int hour, int minute = 0 )
+{
+  return KDateTime( QDate( 2020, 3, day ), QTime( hour, minute ), KDateTime::UTC );
+}
+
+static Event::Ptr makeEvent( const QString &uid, const KDateTime &start, const KDateTime &end )
+{
+  Event::Ptr event( new Event() );
+  event->setUid( uid );
+  event->setDtStart( start );
+  event->setDtEnd( end );
+  return event;
+}
+
+static QStringList uids( const ConflictDetector::Occurrence::List &occurrences )
+{
+  QStringList result;
+  foreach ( const ConflictDetector::Occurrence &occurrence, occurrences ) {
+    result << occurrence.event->uid();
+  }
+  return result;
+}
+
+void ConflictDetectorTest::testConflicts()
+{
+  Event::List events;
+  events << makeEvent( "a", at( 2, 9 ), at( 2, 11 ) );
+  events << makeEvent( "b", at( 2, 10 ), at( 2, 12 ) );
+  events << makeEvent( "c", at( 2, 11 ), at( 2, 12 ) );
+  events << makeEvent( "transparent", at( 2, 9 ), at( 2, 10 ) );
+  events.last()->setTransparency( Event::Transparent );
+  events << makeEvent( "canceled", at( 2, 9 ), at( 2, 12 ) );
+  events.last()->setStatus( Incidence::StatusCanceled );
+  events << makeEvent( "empty", at( 2, 10 ), at( 2, 10 ) );
+  events << makeEvent( "outside", at( 3, 10 ), at( 3, 12 ) );
+
+  ConflictDetector detector( events, at( 2, 0 ), at( 3, 0 ) );
+  QCOMPARE( uids( detector.occurrences() ), QStringList() << "a" << "b" << "c" );
+
+  // a ends when c starts
+  const ConflictDetector::Conflict::List conflicts = detector.conflicts();
+  QCOMPARE( conflicts.count(), 2 );
+  QCOMPARE( conflicts[0].first.event->uid(), QString( "a" ) );
+  QCOMPARE( conflicts[0].second.event->uid(), QString( "b" ) );
+  QCOMPARE( conflicts[0].start, at( 2, 10 ) );
+  QCOMPARE( conflicts[0].end, at( 2, 11 ) );
+  QCOMPARE( conflicts[1].first.event->uid(), QString( "b" ) );
+  QCOMPARE( conflicts[1].second.event->uid(), QString( "c" ) );
+  QCOMPARE( conflicts[1].start, at( 2, 11 ) );
+  QCOMPARE( conflicts[1].end, at( 2, 12 ) );
+}
+
+void ConflictDetectorTest::testAllDay()
+{
+  Event::Ptr allDay( new Event() );
+  allDay->setUid( "allday" );
+  allDay->setDtStart( KDateTime( QDate( 2020, 3, 2 ), KDateTime::ClockTime ) );
+  allDay->setDtEnd( KDateTime( QDate( 2020, 3, 2 ), KDateTime::ClockTime ) );
+  allDay->setAllDay( true );
+
+  Event::List events;
+  events << allDay;
+  events << makeEvent( "evening", at( 2, 23 ), at( 2, 23, 30 ) );
+  events << makeEvent( "morning", at( 3, 0 ), at( 3, 1 ) );
+
+  ConflictDetector detector( events, at( 1, 0 ), at( 5, 0 ), KDateTime::UTC );
+  const ConflictDetector::Occurrence::List occurrences = detector.occurrences();
+  QCOMPARE( occurrences.count(), 3 );
+  QCOMPARE( occurrences[0].start, at( 2, 0 ) );
+  QCOMPARE( occurrences[0].end, at( 3, 0 ) );
+  const ConflictDetector::Conflict::List conflicts = detector.conflicts();
+  QCOMPARE( conflicts.count(), 1 );
+  QCOMPARE( conflicts[0].second.event->uid(), QString( "evening" ) );
+
+  // All-day events follow the time specification of the detector
+  ConflictDetector shifted( events, at( 1, 0 ), at( 5, 0 ),
+                            KDateTime::Spec::OffsetFromUTC( -3600 ) );
+  QCOMPARE( shifted.conflicts().count(), 2 );
+}
+
+void ConflictDetectorTest::testRecurrence()
+{
+  Event::Ptr daily = makeEvent( "daily", at( 1, 9 ), at( 1, 10 ) );
+  daily->recurrence()->setDaily( 1 );
+  Event::Ptr exception( daily->clone() );
+  exception->clearRecurrence();
+  exception->setRecurrenceId( at( 3, 9 ) );
+  exception->setDtStart( at( 3, 14 ) );
+  exception->setDtEnd( at( 3, 15 ) );
+
+  Event::List events;
+  events << daily << exception;
+  events << makeEvent( "single", at( 3, 9, 30 ), at( 3, 10 ) );
+  events << makeEvent( "late", at( 3, 14, 30 ), at( 3, 16 ) );
+
+  ConflictDetector detector( events, at( 1, 0 ), at( 6, 0 ) );
+  QCOMPARE( detector.occurrences().count(), 7 );
+  const ConflictDetector::Conflict::List conflicts = detector.conflicts();
+  QCOMPARE( conflicts.count(), 1 );
+  QCOMPARE( conflicts[0].first.event, exception );
+  QCOMPARE( conflicts[0].second.event->uid(), QString( "late" ) );
+
+  // Occurrences starting before the window are included
+  ConflictDetector window( events, at( 2, 9, 30 ), at( 2, 12 ) );
+  QCOMPARE( window.occurrences().count(), 1 );
+  QCOMPARE( window.occurrences()[0].start, at( 2, 9 ) );
+}
+
+void ConflictDetectorTest::testGroups()
+{
+  Event::List events;
+  events << makeEvent( "a", at( 2, 9 ), at( 2, 10 ) );
+  events << makeEvent( "b", at( 2, 9, 30 ), at( 2, 11 ) );
+  events << makeEvent( "c", at( 2, 10, 30 ), at( 2, 12 ) );
+  events << makeEvent( "d", at( 2, 13 ), at( 2, 14 ) );
+  events << makeEvent( "e", at( 2, 15 ), at( 2, 16 ) );
+  events << makeEvent( "f", at( 2, 15, 30 ), at( 2, 16 ) );
+
+  ConflictDetector detector( events, at( 2, 0 ), at( 3, 0 ) );
+  const QVector<ConflictDetector::Occurrence::List> groups = detector.groups();
+  QCOMPARE( groups.count(), 2 );
+  QCOMPARE( uids( groups[0] ), QStringList() << "a" << "b" << "c" );
+  QCOMPARE( uids( groups[1] ), QStringList() << "e" << "f" );
+}
+
+void ConflictDetectorTest::testOverlapping()
+{
+  Event::List events;
+  events << makeEvent( "long", at( 1, 0 ), at( 3, 0 ) );
+  events << makeEvent( "short", at( 2, 10 ), at( 2, 11 ) );
+
+  ConflictDetector detector( events, at( 1, 0 ), at( 5, 0 ) );
+  QCOMPARE( uids( detector.overlapping( at( 2, 10, 30 ), at( 2, 10, 45 ) ) ),
+            QStringList() << "long" << "short" );
+  QCOMPARE( uids( detector.overlapping( at( 2, 11 ), at( 2, 12 ) ) ),
+            QStringList() << "long" );
+  QVERIFY( detector.overlapping( at( 3, 0 ), at( 3, 1 ) ).isEmpty() );
+  QVERIFY( detector.overlapping( at( 2, 10 ), at( 2, 10 ) ).isEmpty() );
+}
+
+void ConflictDetectorTest::testCalendar()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  cal->addEvent( makeEvent( "a", at( 2, 9 ), at( 2, 11 ) ) );
+  cal->addEvent( makeEvent( "b", at( 2, 10 ), at( 2, 12 ) ) );
+  cal->addEvent( makeEvent( "c", at( 8, 10 ), at( 8, 12 ) ) );
+
+  ConflictDetector detector( cal, at( 1, 0 ), at( 5, 0 ) );
+  QCOMPARE( detector.occurrences().count(), 2 );
+  QCOMPARE( detector.conflicts().count(), 1 );
+
+  // An exception moved out of the window still replaces its occurrence
+  MemoryCalendar::Ptr moved( new MemoryCalendar( KDateTime::UTC ) );
+  Event::Ptr daily = makeEvent( "daily", at( 1, 9 ), at( 1, 10 ) );
+  daily->recurrence()->setDaily( 1 );
+  Event::Ptr exception( daily->clone() );
+  exception->clearRecurrence();
+  exception->setRecurrenceId( at( 4, 9 ) );
+  exception->setDtStart( at( 8, 14 ) );
+  exception->setDtEnd( at( 8, 15 ) );
+  QVERIFY( moved->addEvent( daily ) );
+  QVERIFY( moved->addEvent( exception ) );
+  QVERIFY( moved->addEvent( makeEvent( "d", at( 4, 9 ), at( 4, 10 ) ) ) );
+
+  ConflictDetector window( moved, at( 4, 0 ), at( 5, 0 ) );
+  QCOMPARE( uids( window.occurrences() ), QStringList() << "d" );
+  QVERIFY( window.conflicts().isEmpty() );
+}
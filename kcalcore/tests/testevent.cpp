@@ -114,3 +114,32 @@ void EventTest::testAssign()
   Event event2 = event1;
   QVERIFY( event1 == event2 );
 }
+
+void EventTest::testCloneDetach()
+{
+  QDate dt = QDate::currentDate();
+  Event event1;
+  event1.setDtStart( KDateTime( dt ) );
+  event1.setDtEnd( KDateTime( dt ).addDays( 1 ) );
+  event1.setSummary( "Event1 Summary" );
+  event1.setCategories( QStringList() << "Work" << "Travel" );
+  event1.addComment( "A comment" );
+
+  Event *event2 = event1.clone();
+  event2->setSummary( "Event2 Summary" );
+  event2->setDtStart( KDateTime( dt ).addDays( -1 ) );
+  event2->removeComment( "A comment" );
+  event2->setCategories( QStringList() << "Home" );
+
+  QCOMPARE( event1.summary(), QString( "Event1 Summary" ) );
+  QCOMPARE( event1.dtStart(), KDateTime( dt ) );
+  QCOMPARE( event1.comments(), QStringList() << "A comment" );
+  QCOMPARE( event1.categories(), QStringList() << "Work" << "Travel" );
+  QCOMPARE( event2->summary(), QString( "Event2 Summary" ) );
+  QVERIFY( event2->comments().isEmpty() );
+  QVERIFY( !( event1 == *event2 ) );
+
+  event1.setLocation( "the place" );
+  QVERIFY( event2->location().isEmpty() );
+  delete event2;
+}
@@ -33,6 +33,7 @@ class EventTest : public QObject
     void testClone();
     void testCopy();
     void testAssign();
+    void testCloneDetach();
 };
 
 #endif
@@ -24,6 +24,8 @@
 
 #include <KDebug>
 
+#include <QtCore/QFileInfo>
+
 #include <unistd.h>
 
 #include <qtest_kde.h>
@@ -167,3 +169,251 @@ void FileStorageTest::testSpecialChars()
 
   unlink( "bart.ics" );
 }
+
+static Event::Ptr journalEvent( const QString &uid, const QString &summary )
+{
+  Event::Ptr event = Event::Ptr( new Event() );
+  event->setUid( uid );
+  event->setDtStart( KDateTime( QDate( 2013, 3, 4 ), QTime( 10, 0 ), KDateTime::UTC ) );
+  event->setDtEnd( KDateTime( QDate( 2013, 3, 4 ), QTime( 11, 0 ), KDateTime::UTC ) );
+  event->setSummary( summary );
+  return event;
+}
+
+static MemoryCalendar::Ptr loadJournaled( const QString &fileName )
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage fs( cal, fileName );
+  fs.setJournalEnabled( true );
+  if ( !fs.open() || !fs.load() ) {
+    return MemoryCalendar::Ptr();
+  }
+  fs.close();
+  return cal;
+}
+
+static void removeJournaled( const QString &fileName )
+{
+  QFile::remove( fileName );
+  QFile::remove( fileName + QLatin1String( ".journal" ) );
+  QFile::remove( fileName + QLatin1String( ".journal.compacting" ) );
+}
+
+void FileStorageTest::testJournal()
+{
+  const QString fileName( QLatin1String( "journal.ics" ) );
+  removeJournaled( fileName );
+
+  MemoryCalendar::Ptr cal( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage fs( cal, fileName );
+  fs.setJournalEnabled( true );
+  QVERIFY( fs.isJournalEnabled() );
+  cal->addEvent( journalEvent( "1", "First" ) );
+  cal->addEvent( journalEvent( "2", "Second" ) );
+  QVERIFY( fs.open() );
+  QVERIFY( fs.save() );
+  QVERIFY( !QFile::exists( fs.journalFileName() ) );
+
+  // Later changes only go to the journal
+  const qint64 snapshotSize = QFileInfo( fileName ).size();
+  cal->incidence( "1" )->setSummary( "Changed" );
+  cal->addEvent( journalEvent( "3", "Third" ) );
+  QVERIFY( cal->deleteIncidence( cal->incidence( "2" ) ) );
+  QVERIFY( fs.save() );
+  QVERIFY( QFile::exists( fs.journalFileName() ) );
+  QCOMPARE( QFileInfo( fileName ).size(), snapshotSize );
+  QVERIFY( !cal->isModified() );
+  QVERIFY( fs.close() );
+
+  MemoryCalendar::Ptr loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QCOMPARE( loaded->rawIncidences().count(), 2 );
+  QCOMPARE( loaded->incidence( "1" )->summary(), QString( "Changed" ) );
+  QVERIFY( !loaded->incidence( "2" ) );
+  QCOMPARE( loaded->incidence( "3" )->summary(), QString( "Third" ) );
+
+  // Without the journal, only the calendar file is read
+  MemoryCalendar::Ptr plain( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage plainFs( plain, fileName );
+  QVERIFY( plainFs.load() );
+  QCOMPARE( plain->incidence( "1" )->summary(), QString( "First" ) );
+  QVERIFY( plain->incidence( "2" ) );
+
+  removeJournaled( fileName );
+}
+
+void FileStorageTest::testJournalTornRecord()
+{
+  const QString fileName( QLatin1String( "journal.ics" ) );
+  removeJournaled( fileName );
+
+  MemoryCalendar::Ptr cal( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage fs( cal, fileName );
+  fs.setJournalEnabled( true );
+  cal->addEvent( journalEvent( "1", "First" ) );
+  QVERIFY( fs.save() );
+  cal->addEvent( journalEvent( "2", "Second" ) );
+  QVERIFY( fs.save() );
+  const qint64 goodSize = QFileInfo( fs.journalFileName() ).size();
+  cal->addEvent( journalEvent( "3", "Third" ) );
+  QVERIFY( fs.save() );
+  QVERIFY( fs.close() );
+
+  // Simulate a crash in the middle of writing the last record
+  QFile journal( fs.journalFileName() );
+  QVERIFY( journal.resize( QFileInfo( fs.journalFileName() ).size() - 20 ) );
+
+  MemoryCalendar::Ptr loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QVERIFY( loaded->incidence( "1" ) );
+  QVERIFY( loaded->incidence( "2" ) );
+  QVERIFY( !loaded->incidence( "3" ) );
+  // The torn record is dropped, so that later records can be read back
+  QCOMPARE( QFileInfo( fs.journalFileName() ).size(), goodSize );
+
+  // A corrupted payload is detected as well
+  QVERIFY( journal.open( QIODevice::ReadWrite ) );
+  QByteArray data = journal.readAll();
+  data[data.size() - 10] = data[data.size() - 10] == 'X' ? 'Y' : 'X';
+  QVERIFY( journal.seek( 0 ) );
+  QCOMPARE( journal.write( data ), qint64( data.size() ) );
+  journal.close();
+  loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QVERIFY( loaded->incidence( "1" ) );
+  QVERIFY( !loaded->incidence( "2" ) );
+
+  // Damaged records followed by other ones are skipped
+  MemoryCalendar::Ptr more( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage moreFs( more, fileName );
+  moreFs.setJournalEnabled( true );
+  QVERIFY( moreFs.open() );
+  QVERIFY( moreFs.load() );
+  more->addEvent( journalEvent( "4", "Fourth" ) );
+  QVERIFY( moreFs.save() );
+  more->addEvent( journalEvent( "5", "Fifth" ) );
+  QVERIFY( moreFs.save() );
+  QVERIFY( moreFs.close() );
+  QVERIFY( journal.open( QIODevice::ReadWrite ) );
+  data = journal.readAll();
+  const int fourth = data.indexOf( "UID:4" );
+  QVERIFY( fourth > 0 );
+  data[fourth + 4] = '6';
+  QVERIFY( journal.seek( 0 ) );
+  QCOMPARE( journal.write( data ), qint64( data.size() ) );
+  journal.close();
+  loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QVERIFY( !loaded->incidence( "4" ) );
+  QVERIFY( !loaded->incidence( "6" ) );
+  QVERIFY( loaded->incidence( "5" ) );
+  QCOMPARE( QFileInfo( fs.journalFileName() ).size(), qint64( data.size() ) );
+
+  // Also when their header is damaged
+  QVERIFY( journal.open( QIODevice::ReadWrite ) );
+  data = journal.readAll();
+  const int header = data.lastIndexOf( "KCALJOURNAL ADD" );
+  QVERIFY( header > 0 );
+  data[header] = 'X';
+  data += "KCALJOURNAL ADD 1";
+  QVERIFY( journal.seek( 0 ) );
+  QCOMPARE( journal.write( data ), qint64( data.size() ) );
+  journal.close();
+  loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QVERIFY( loaded->incidence( "1" ) );
+  QVERIFY( !loaded->incidence( "5" ) );
+  // Only the torn end is dropped
+  QCOMPARE( QFileInfo( fs.journalFileName() ).size(), qint64( data.size() - 17 ) );
+
+  removeJournaled( fileName );
+}
+
+void FileStorageTest::testJournalCompaction()
+{
+  const QString fileName( QLatin1String( "journal.ics" ) );
+  removeJournaled( fileName );
+
+  MemoryCalendar::Ptr cal( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage fs( cal, fileName );
+  fs.setJournalEnabled( true );
+  fs.setCompactionThreshold( 1 );
+  QCOMPARE( fs.compactionThreshold(), qint64( 1 ) );
+  cal->addEvent( journalEvent( "1", "First" ) );
+  QVERIFY( fs.save() );
+  cal->addEvent( journalEvent( "2", "Second" ) );
+  QVERIFY( fs.save() );
+  // Wait for the compaction running in the background
+  QVERIFY( fs.close() );
+  QVERIFY( !QFile::exists( fs.journalFileName() ) );
+  QVERIFY( !QFile::exists( fileName + QLatin1String( ".journal.compacting" ) ) );
+
+  MemoryCalendar::Ptr plain( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage plainFs( plain, fileName );
+  QVERIFY( plainFs.load() );
+  QVERIFY( plain->incidence( "2" ) );
+
+  // Records left over by an interrupted compaction are replayed too
+  cal->incidence( "2" )->setSummary( "Changed" );
+  fs.setCompactionThreshold( 1024 * 1024 );
+  QVERIFY( fs.save() );
+  QVERIFY( QFile::rename( fs.journalFileName(), fileName + QLatin1String( ".journal.compacting" ) ) );
+  cal->addEvent( journalEvent( "3", "Third" ) );
+  QVERIFY( fs.save() );
+
+  MemoryCalendar::Ptr loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QCOMPARE( loaded->incidence( "2" )->summary(), QString( "Changed" ) );
+  QVERIFY( loaded->incidence( "3" ) );
+
+  QVERIFY( fs.compact() );
+  QVERIFY( !QFile::exists( fs.journalFileName() ) );
+  QVERIFY( !QFile::exists( fileName + QLatin1String( ".journal.compacting" ) ) );
+
+  removeJournaled( fileName );
+}
+
+void FileStorageTest::testJournalRecurrence()
+{
+  const QString fileName( QLatin1String( "journal.ics" ) );
+  removeJournaled( fileName );
+
+  MemoryCalendar::Ptr cal( new MemoryCalendar( QLatin1String( "UTC" ) ) );
+  FileStorage fs( cal, fileName );
+  fs.setJournalEnabled( true );
+  Event::Ptr parent = journalEvent( "series", "Series" );
+  parent->recurrence()->setDaily( 1 );
+  cal->addEvent( parent );
+  Event::Ptr first( parent->clone() );
+  first->clearRecurrence();
+  first->setRecurrenceId( parent->dtStart().addDays( 1 ) );
+  first->setSummary( "First exception" );
+  cal->addEvent( first );
+  QVERIFY( fs.save() );
+
+  // An exception and a change of the parent in the same batch, then
+  // another change of the parent
+  Event::Ptr second( parent->clone() );
+  second->clearRecurrence();
+  second->setRecurrenceId( parent->dtStart().addDays( 2 ) );
+  second->setSummary( "Second exception" );
+  cal->addEvent( second );
+  parent->setSummary( "Changed" );
+  QVERIFY( fs.save() );
+  parent->setLocation( "Here" );
+  QVERIFY( fs.save() );
+  QVERIFY( fs.close() );
+
+  MemoryCalendar::Ptr loaded = loadJournaled( fileName );
+  QVERIFY( loaded );
+  QCOMPARE( loaded->rawEvents().count(), 3 );
+  QCOMPARE( loaded->incidence( "series" )->summary(), QString( "Changed" ) );
+  QCOMPARE( loaded->incidence( "series" )->location(), QString( "Here" ) );
+  QCOMPARE( loaded->eventInstances( loaded->incidence( "series" ) ).count(), 2 );
+  QCOMPARE( loaded->incidence( "series", first->recurrenceId() )->summary(),
+            QString( "First exception" ) );
+  QCOMPARE( loaded->incidence( "series", second->recurrenceId() )->summary(),
+            QString( "Second exception" ) );
+
+  removeJournaled( fileName );
+}
@@ -35,6 +35,10 @@ class FileStorageTest : public QObject
         and compares both incidences. The comparison should yeld true.
     */
     void testSpecialChars();
+    void testJournal();
+    void testJournalTornRecord();
+    void testJournalCompaction();
+    void testJournalRecurrence();
 };
 
 #endif
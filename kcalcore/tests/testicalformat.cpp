@@ -22,12 +22,16 @@
 
 #include "testicalformat.h"
 #include "../event.h"
+#include "../todo.h"
 #include "../icalformat.h"
+#include "../icaltimezones.h"
 #include "../memorycalendar.h"
 
 #include <KDebug>
 #include <kdatetime.h>
 
+#include <QtCore/QTemporaryFile>
+
 #include <qtest_kde.h>
 
 #include <unistd.h>
@@ -120,3 +124,326 @@ void ICalFormatTest::testVolatileProperties()
   QCOMPARE( incidence->uid(), QLatin1String( "12345" ) );
   QVERIFY( incidence->customProperties().isEmpty() );
 }
+
+void ICalFormatTest::testSharedStrings()
+{
+  // Values repeated across incidences share their storage after loading
+  MemoryCalendar::Ptr calendar( new MemoryCalendar( "UTC" ) );
+  const QDate currentDate = QDate::currentDate();
+  for ( int i = 0; i < 2; ++i ) {
+    Event::Ptr event = Event::Ptr( new Event() );
+    event->setUid( QString::number( i ) );
+    event->setDtStart( KDateTime( currentDate ) );
+    event->setDtEnd( KDateTime( currentDate.addDays( 1 ) ) );
+    event->setCategories( QStringList() << "Meeting" );
+    event->addAttendee( Attendee::Ptr( new Attendee( "John Doe", "john@example.com" ) ) );
+    event->setNonKDECustomProperty( "X-MS-OLK-SENDER", "yes" );
+    calendar->addEvent( event );
+  }
+
+  ICalFormat format;
+  MemoryCalendar::Ptr calendar2( new MemoryCalendar( "UTC" ) );
+  QVERIFY( format.fromString( calendar2, format.toString( calendar.staticCast<Calendar>() ) ) );
+
+  Event::Ptr event0 = calendar2->event( "0" );
+  Event::Ptr event1 = calendar2->event( "1" );
+  QVERIFY( event0 && event1 );
+  QCOMPARE( event0->categories(), QStringList() << "Meeting" );
+  QVERIFY( event0->categories().first().constData() ==
+           event1->categories().first().constData() );
+  QCOMPARE( event0->attendees().first()->email(), QString( "john@example.com" ) );
+  QVERIFY( event0->attendees().first()->email().constData() ==
+           event1->attendees().first()->email().constData() );
+  QVERIFY( event0->attendees().first()->name().constData() ==
+           event1->attendees().first()->name().constData() );
+  QCOMPARE( event1->nonKDECustomProperty( "X-MS-OLK-SENDER" ), QString( "yes" ) );
+}
+
+void ICalFormatTest::testLoadEncodings()
+{
+  const QByteArray ics =
+    "BEGIN:VCALENDAR\r\n"
+    "PRODID:-//K Desktop Environment//NONSGML libkcal 4.3//EN\r\n"
+    "VERSION:2.0\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:encoding\r\n"
+    "DTSTART:20130304T100000Z\r\n"
+    "SUMMARY:\xC3\xA9t\xC3\xA9\r\n"
+    "END:VEVENT\r\n"
+    "END:VCALENDAR\r\n";
+
+  QList<QByteArray> contents;
+  contents << ics                                // plain UTF-8
+           << "\n  " + ics + "\n\n"             // surrounding white space
+           << "\xEF\xBB\xBF" + ics;              // UTF-8 byte order mark
+  foreach ( const QByteArray &content, contents ) {
+    QTemporaryFile file;
+    QVERIFY( file.open() );
+    QCOMPARE( file.write( content ), qint64( content.size() ) );
+    file.close();
+
+    ICalFormat format;
+    MemoryCalendar::Ptr calendar( new MemoryCalendar( "UTC" ) );
+    QVERIFY( format.load( calendar, file.fileName() ) );
+    Event::Ptr event = calendar->event( "encoding" );
+    QVERIFY( event );
+    QCOMPARE( event->summary(), QString::fromUtf8( "\xC3\xA9t\xC3\xA9" ) );
+  }
+
+  // Invalid UTF-8 is replaced instead of being handed to the parser
+  QByteArray invalid = ics;
+  invalid.replace( "\xC3\xA9t", "\xE9t" );
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  file.write( invalid );
+  file.close();
+
+  ICalFormat format;
+  MemoryCalendar::Ptr calendar( new MemoryCalendar( "UTC" ) );
+  QVERIFY( format.load( calendar, file.fileName() ) );
+  QVERIFY( calendar->event( "encoding" ) );
+
+  // Empty files are valid
+  QTemporaryFile empty;
+  QVERIFY( empty.open() );
+  empty.close();
+  QVERIFY( format.load( calendar, empty.fileName() ) );
+}
+
+void ICalFormatTest::testExceptionDates()
+{
+  const QByteArray ics =
+    "BEGIN:VCALENDAR\r\n"
+    "PRODID:-//K Desktop Environment//NONSGML libkcal 4.3//EN\r\n"
+    "VERSION:2.0\r\n"
+    "BEGIN:VTIMEZONE\r\n"
+    "TZID:Test/Zone\r\n"
+    "BEGIN:STANDARD\r\n"
+    "DTSTART:19700101T000000\r\n"
+    "TZOFFSETFROM:+0200\r\n"
+    "TZOFFSETTO:+0200\r\n"
+    "END:STANDARD\r\n"
+    "END:VTIMEZONE\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:first\r\n"
+    "DTSTART;TZID=Test/Zone:20130304T100000\r\n"
+    "RRULE:FREQ=DAILY\r\n"
+    "EXDATE;TZID=Test/Zone:20130310T100000\r\n"
+    "EXDATE;TZID=Test/Zone:20130306T100000\r\n"
+    "EXDATE;TZID=Test/Zone:20130310T100000\r\n"
+    "EXDATE;TZID=Unknown/Zone:20130308T100000\r\n"
+    "EXDATE;VALUE=DATE:20130312\r\n"
+    "EXDATE;VALUE=DATE:20130311\r\n"
+    "RDATE;TZID=Test/Zone:20130302T120000\r\n"
+    "RDATE;TZID=Test/Zone:20130301T120000\r\n"
+    "END:VEVENT\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:second\r\n"
+    "DTSTART;TZID=Test/Zone:20130304T110000\r\n"
+    "RRULE:FREQ=DAILY\r\n"
+    "EXDATE;TZID=Test/Zone:20130305T110000\r\n"
+    "END:VEVENT\r\n"
+    "END:VCALENDAR\r\n";
+
+  // The exceptions are sorted and made unique, and the TZIDs resolved
+  // for the first event are the same for the second one.
+  ICalFormat format;
+  MemoryCalendar::Ptr calendar( new MemoryCalendar( "UTC" ) );
+  QVERIFY( format.fromRawString( calendar, ics ) );
+  Event::Ptr first = calendar->event( "first" );
+  Event::Ptr second = calendar->event( "second" );
+  QVERIFY( first && second );
+
+  const DateTimeList exDateTimes = first->recurrence()->exDateTimes();
+  QCOMPARE( exDateTimes.count(), 3 );
+  QCOMPARE( exDateTimes[0].dateTime(), QDateTime( QDate( 2013, 3, 6 ), QTime( 10, 0 ) ) );
+  QCOMPARE( exDateTimes[0].timeZone().name(), QString( "Test/Zone" ) );
+  QCOMPARE( exDateTimes[1].dateTime(), QDateTime( QDate( 2013, 3, 8 ), QTime( 10, 0 ) ) );
+  QVERIFY( exDateTimes[1].isLocalZone() );
+  QCOMPARE( exDateTimes[2].dateTime(), QDateTime( QDate( 2013, 3, 10 ), QTime( 10, 0 ) ) );
+  QCOMPARE( first->recurrence()->exDates(),
+            DateList() << QDate( 2013, 3, 11 ) << QDate( 2013, 3, 12 ) );
+  const DateTimeList rDateTimes = first->recurrence()->rDateTimes();
+  QCOMPARE( rDateTimes.count(), 2 );
+  QCOMPARE( rDateTimes[0].dateTime(), QDateTime( QDate( 2013, 3, 1 ), QTime( 12, 0 ) ) );
+  QCOMPARE( second->recurrence()->exDateTimes().count(), 1 );
+  QCOMPARE( second->recurrence()->exDateTimes().first().timeZone().name(),
+            QString( "Test/Zone" ) );
+  QCOMPARE( second->recurrence()->exDateTimes().first().toUtc().time(), QTime( 9, 0 ) );
+
+  // Writing the exceptions back keeps their zone
+  MemoryCalendar::Ptr reloaded( new MemoryCalendar( "UTC" ) );
+  QVERIFY( format.fromString( reloaded, format.toString( calendar.staticCast<Calendar>() ) ) );
+  Event::Ptr copy = reloaded->event( "first" );
+  QVERIFY( copy );
+  QCOMPARE( copy->recurrence()->exDateTimes().count(), 3 );
+  QCOMPARE( copy->recurrence()->exDateTimes()[2].timeZone().name(), QString( "Test/Zone" ) );
+  QCOMPARE( copy->recurrence()->exDateTimes()[2], exDateTimes[2] );
+  QCOMPARE( copy->recurrence()->exDates(), first->recurrence()->exDates() );
+  QCOMPARE( copy->recurrence()->rDateTimes(), rDateTimes );
+}
+
+void ICalFormatTest::testScheduleMessages()
+{
+  ICalFormat format;
+  MemoryCalendar::Ptr zones( new MemoryCalendar( "UTC" ) );
+  QVERIFY( format.fromRawString( zones,
+                                 "BEGIN:VCALENDAR\r\n"
+                                 "PRODID:-//K Desktop Environment//NONSGML libkcal 4.3//EN\r\n"
+                                 "VERSION:2.0\r\n"
+                                 "BEGIN:VTIMEZONE\r\n"
+                                 "TZID:Test/Zone\r\n"
+                                 "BEGIN:STANDARD\r\n"
+                                 "DTSTART:19700101T000000\r\n"
+                                 "TZOFFSETFROM:+0200\r\n"
+                                 "TZOFFSETTO:+0200\r\n"
+                                 "END:STANDARD\r\n"
+                                 "END:VTIMEZONE\r\n"
+                                 "END:VCALENDAR\r\n" ) );
+  const KDateTime::Spec zone( zones->timeZones()->zone( "Test/Zone" ) );
+  QVERIFY( zone.isValid() );
+
+  // Messages in a time zone share their VTIMEZONE component
+  MemoryCalendar::Ptr calendar( new MemoryCalendar( "UTC" ) );
+  const KDateTime start( QDate( 2013, 3, 4 ), QTime( 10, 0 ), KDateTime::UTC );
+  QList<QByteArray> messages;
+  for ( int i = 0; i < 600; ++i ) {
+    Event::Ptr event( new Event );
+    event->setUid( QString::number( i ) );
+    event->setSummary( QString( "Meeting %1" ).arg( i ) );
+    event->setDtStart( start.addSecs( 3600 * i ).toTimeSpec( i % 2 ? zone : KDateTime::UTC ) );
+    event->setDtEnd( event->dtStart().addSecs( 1800 ) );
+    if ( i % 3 == 0 ) {
+      calendar->addEvent( Event::Ptr( event->clone() ) );
+    }
+    messages << format.createScheduleMessage( event, i % 2 ? iTIPReply : iTIPRequest ).toUtf8();
+  }
+  messages << QByteArray()
+           << "garbage"
+           << "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nBEGIN:VEVENT\r\nUID:x\r\n"
+              "END:VEVENT\r\nEND:VCALENDAR\r\n";
+
+  QHash<int, Exception::ErrorCode> errors;
+  const QVector<ScheduleMessage::Ptr> parsed =
+    format.parseScheduleMessages( calendar, messages, &errors );
+  QCOMPARE( parsed.count(), messages.count() );
+  for ( int i = 0; i < 600; ++i ) {
+    const ScheduleMessage::Ptr single =
+      format.parseScheduleMessage( calendar, QString::fromUtf8( messages[i] ) );
+    QVERIFY( single && parsed[i] );
+    QCOMPARE( parsed[i]->event()->uid(), QString::number( i ) );
+    QCOMPARE( parsed[i]->event()->uid(), single->event()->uid() );
+    QCOMPARE( parsed[i]->method(), single->method() );
+    QCOMPARE( parsed[i]->status(), single->status() );
+    const KDateTime dtStart = parsed[i]->event().staticCast<Event>()->dtStart();
+    QCOMPARE( dtStart, start.addSecs( 3600 * i ) );
+    QCOMPARE( dtStart.isUtc(), i % 2 == 0 );
+  }
+  QVERIFY( !parsed[600] && !parsed[601] && !parsed[602] );
+  QCOMPARE( errors.count(), 3 );
+  QCOMPARE( errors.value( 600 ), Exception::ParseErrorEmptyMessage );
+  QCOMPARE( errors.value( 602 ), Exception::ParseErrorMethodProperty );
+  QVERIFY( !format.exception() );
+}
+
+// The iCalendar text of an incidence, without the time stamps of the export
+// and of the last change, which a calendar sets when the delta is applied
+static QByteArray withoutStamp( const QByteArray &ics )
+{
+  QList<QByteArray> lines = ics.split( '\n' );
+  for ( int i = lines.count() - 1; i >= 0; --i ) {
+    if ( lines[i].startsWith( "DTSTAMP" ) || lines[i].startsWith( "LAST-MODIFIED" ) ) {
+      lines.removeAt( i );
+    }
+  }
+  return lines.join( "\n" );
+}
+
+void ICalFormatTest::testDelta()
+{
+  ICalFormat format;
+  const KDateTime start( QDate( 2020, 3, 2 ), QTime( 9, 0 ), KDateTime::UTC );
+
+  qsrand( 1 );
+  for ( int round = 0; round < 50; ++round ) {
+    Event::Ptr original( new Event );
+    original->setUid( "delta" );
+    original->setDtStart( start );
+    original->setDtEnd( start.addSecs( 3600 ) );
+    original->setSummary( "Summary" );
+    original->setLocation( "Location" );
+    original->setDescription( "Description" );
+    original->setCategories( QStringList() << "A" << "B" );
+    original->addAttendee( Attendee::Ptr( new Attendee( "One", "one@example.com" ) ) );
+    original->recurrence()->setWeekly( 1 );
+
+    MemoryCalendar::Ptr calendar( new MemoryCalendar( KDateTime::UTC ) );
+    QVERIFY( format.fromRawString( calendar, format.toRawString( original ) ) );
+    Event::Ptr target = calendar->event( "delta" );
+    QVERIFY( target );
+    original->resetDirtyFields();
+
+    const int edits = qrand();
+    if ( edits & 1 ) {
+      original->setSummary( QString::fromLatin1( "Summary %1" ).arg( round ) );
+    }
+    if ( edits & 2 ) {
+      original->setLocation( QString() );
+    }
+    if ( edits & 4 ) {
+      original->setDtStart( start.addDays( round ) );
+    }
+    if ( edits & 8 ) {
+      original->setDtEnd( start.addDays( round ).addSecs( 7200 ) );
+    }
+    if ( edits & 16 ) {
+      original->recurrence()->setDaily( 2 );
+      original->recurrence()->setDuration( 10 );
+    }
+    if ( edits & 32 ) {
+      original->clearRecurrence();
+    }
+    if ( edits & 64 ) {
+      original->addAttendee( Attendee::Ptr( new Attendee( "Two", "two@example.com" ) ) );
+    }
+    if ( edits & 128 ) {
+      original->setCategories( QStringList() );
+    }
+    if ( edits & 256 ) {
+      Alarm::Ptr alarm( new Alarm( original.data() ) );
+      alarm->setDisplayAlarm( "Alarm" );
+      alarm->setStartOffset( Duration( -600 ) );
+      alarm->setEnabled( true );
+      original->addAlarm( alarm );
+    }
+    if ( edits & 512 ) {
+      original->setDescription( "<b>Rich</b>", true );
+    }
+
+    const QByteArray delta = format.toRawDelta( original );
+    QCOMPARE( delta.isEmpty(), original->dirtyFields().isEmpty() );
+    if ( !delta.isEmpty() ) {
+      QVERIFY( format.applyDelta( target, delta ) );
+    }
+    QCOMPARE( withoutStamp( format.toRawString( target ) ),
+              withoutStamp( format.toRawString( original ) ) );
+  }
+
+  // A delta only applies to the same incidence, of the same type
+  Event::Ptr event( new Event );
+  event->setUid( "delta" );
+  event->setSummary( "Summary" );
+  QSet<IncidenceBase::Field> fields;
+  fields << IncidenceBase::FieldSummary;
+  const QByteArray delta = format.toRawDelta( event, fields );
+  QVERIFY( !delta.contains( "DTSTART" ) );
+
+  Event::Ptr other( new Event );
+  other->setUid( "other" );
+  QVERIFY( !format.applyDelta( other, delta ) );
+  QVERIFY( other->summary().isEmpty() );
+
+  Todo::Ptr todo( new Todo );
+  todo->setUid( "delta" );
+  QVERIFY( !format.applyDelta( todo, delta ) );
+}
@@ -31,6 +31,11 @@ class ICalFormatTest : public QObject
   private Q_SLOTS:
     void testCharsets();
     void testVolatileProperties();
+    void testSharedStrings();
+    void testLoadEncodings();
+    void testExceptionDates();
+    void testScheduleMessages();
+    void testDelta();
 };
 
 #endif
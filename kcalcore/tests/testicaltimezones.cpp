@@ -157,6 +157,66 @@ void ICalTimeZonesTest::parse()
     icalcomponent_free( calendar );
 }
 
+void ICalTimeZonesTest::aliases()
+{
+    // The Western zone a second time under a long TZID
+    const QString alias = QString::fromLatin1( "(UTC-05:00) Tryburgh, Western" );
+    QByteArray copy = VTZ_Western;
+    copy.replace( "TZID:Test-Dummy-Western", "TZID:" + alias.toLatin1() );
+    QByteArray text = calendarHeader;
+    text += VTZ_Western;
+    text += copy;
+    text += VTZ_other;
+    text += calendarFooter;
+
+    icalcomponent *calendar = loadCALENDAR( text );
+    QVERIFY( calendar );
+    ICalTimeZoneSource src;
+    ICalTimeZones timezones;
+    QVERIFY( src.parse( calendar, timezones ) );
+    icalcomponent_free( calendar );
+
+    const ICalTimeZone western = timezones.zone( "Test-Dummy-Western" );
+    QVERIFY( western.isValid() );
+    QCOMPARE( timezones.count(), 2 );
+    QCOMPARE( timezones.zone( alias ), western );
+    QVERIFY( !timezones.zones().contains( alias ) );
+    QCOMPARE( timezones.zone( timezones.zone( "Test-Dummy-Other" ) ).name(),
+              QString::fromLatin1( "Test-Dummy-Other" ) );
+
+    QVERIFY( timezones.addAlias( "Western Standard Time", "Test-Dummy-Western" ) );
+    QVERIFY( !timezones.addAlias( "Test-Dummy-Other", "Test-Dummy-Western" ) );
+    QVERIFY( !timezones.addAlias( "Eastern Standard Time", "Test-Dummy-Eastern" ) );
+    QCOMPARE( timezones.zone( "Western Standard Time" ), western );
+
+    // Copies keep the aliases
+    ICalTimeZones copied( timezones );
+    QCOMPARE( copied.zone( alias ), western );
+
+    // Removing an alias leaves the zone, removing the zone its aliases
+    QVERIFY( !timezones.remove( "Western Standard Time" ).isValid() );
+    QVERIFY( !timezones.zone( "Western Standard Time" ).isValid() );
+    QCOMPARE( timezones.zone( alias ), western );
+    QCOMPARE( timezones.remove( "Test-Dummy-Western" ), western );
+    QVERIFY( !timezones.zone( alias ).isValid() );
+    QVERIFY( !timezones.zone( western ).isValid() );
+    QCOMPARE( timezones.count(), 1 );
+    QCOMPARE( copied.count(), 2 );
+
+    // Zones updated through the collection are found by their new definition
+    QByteArray redefined = VTZ_Western;
+    redefined.replace( "TZID:Test-Dummy-Western", "TZID:Test-Dummy-Other" );
+    icalcomponent *vtimezone = loadVTIMEZONE( redefined.constData() );
+    QVERIFY( vtimezone );
+    const ICalTimeZone other = src.parse( vtimezone );
+    icalcomponent_free( vtimezone );
+    QVERIFY( copied.remove( "Test-Dummy-Western" ).isValid() );
+    QVERIFY( !copied.zone( western ).isValid() );
+    QVERIFY( copied.update( other ) );
+    QCOMPARE( copied.zone( western ).name(), QString::fromLatin1( "Test-Dummy-Other" ) );
+    QVERIFY( !copied.update( western ) );
+}
+
 
 /////////////////////
 // ICalTimeZone tests
@@ -19,6 +19,7 @@
   Boston, MA 02110-1301, USA.
 */
 #include "testincidencerelation.h"
+#include "../memorycalendar.h"
 #include "../todo.h"
 
 #include <qtest_kde.h>
@@ -26,6 +27,23 @@ QTEST_KDEMAIN( IncidenceRelationTest, NoGUI )
 
 using namespace KCalCore;
 
+static Todo::Ptr makeTodo( const QString &uid, const QString &parentUid = QString() )
+{
+  Todo::Ptr todo( new Todo() );
+  todo->setUid( uid );
+  todo->setRelatedTo( parentUid );
+  return todo;
+}
+
+static QStringList uids( const Incidence::List &incidences )
+{
+  QStringList result;
+  foreach ( const Incidence::Ptr &incidence, incidences ) {
+    result << incidence->uid();
+  }
+  return result;
+}
+
 void IncidenceRelationTest::testRelations()
 {
   // Build the following tree:
@@ -60,3 +78,106 @@ void IncidenceRelationTest::testRelations()
   QCOMPARE( todo2->relatedTo(), todo1->uid() );
   QCOMPARE( todo1->relatedTo(), QString() );
 }
+
+void IncidenceRelationTest::testCalendarRelations()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+
+  // Children added before and after their parent
+  Todo::Ptr early = makeTodo( "early", "parent" );
+  cal->addTodo( early );
+  Todo::Ptr parent = makeTodo( "parent" );
+  cal->addTodo( parent );
+  Todo::Ptr late = makeTodo( "late", "parent" );
+  cal->addTodo( late );
+  QCOMPARE( uids( cal->relations( "parent" ) ), QStringList() << "early" << "late" );
+  QVERIFY( cal->isAncestorOf( parent, late ) );
+  QVERIFY( !cal->isAncestorOf( late, parent ) );
+
+  // Changes of parent are followed
+  Todo::Ptr other = makeTodo( "other" );
+  cal->addTodo( other );
+  late->setRelatedTo( "other" );
+  QCOMPARE( uids( cal->relations( "parent" ) ), QStringList() << "early" );
+  QCOMPARE( uids( cal->relations( "other" ) ), QStringList() << "late" );
+  QVERIFY( !cal->isAncestorOf( parent, late ) );
+
+  // Children of a deleted parent stay related to it
+  cal->deleteTodo( parent );
+  QCOMPARE( early->relatedTo(), QString( "parent" ) );
+  QCOMPARE( uids( cal->relations( "parent" ) ), QStringList() << "early" );
+  cal->deleteTodo( early );
+  QVERIFY( cal->relations( "parent" ).isEmpty() );
+
+  cal->close();
+  QVERIFY( cal->relations( "other" ).isEmpty() );
+}
+
+void IncidenceRelationTest::testDeepHierarchy()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  const int depth = 3000;
+  Todo::List todos;
+  for ( int i = 0; i < depth; ++i ) {
+    todos << makeTodo( QString::number( i ), i ? QString::number( i - 1 ) : QString() );
+    cal->addTodo( todos.last() );
+  }
+
+  QVERIFY( cal->isAncestorOf( todos.first(), todos.last() ) );
+  QVERIFY( !cal->isAncestorOf( todos.last(), todos.first() ) );
+  QCOMPARE( cal->descendants( "0" ).count(), depth - 1 );
+  QCOMPARE( cal->descendants( QString::number( depth - 10 ) ).count(), 9 );
+  QCOMPARE( cal->descendants( "0" ).last(), Incidence::Ptr( todos.last() ) );
+
+  // Reattach the lower half at the root
+  todos[depth / 2]->setRelatedTo( QString() );
+  QCOMPARE( cal->descendants( "0" ).count(), depth / 2 - 1 );
+  QVERIFY( !cal->isAncestorOf( todos.first(), todos.last() ) );
+}
+
+void IncidenceRelationTest::testWideHierarchy()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  cal->addTodo( makeTodo( "root" ) );
+  const int width = 5000;
+  Todo::List children;
+  for ( int i = 0; i < width; ++i ) {
+    children << makeTodo( QString::number( i ), "root" );
+    cal->addTodo( children.last() );
+    cal->addTodo( makeTodo( QString::number( i ) + "-sub", QString::number( i ) ) );
+  }
+  QCOMPARE( cal->relations( "root" ).count(), width );
+  QCOMPARE( cal->descendants( "root" ).count(), 2 * width );
+  QCOMPARE( uids( cal->descendants( "root" ).mid( 0, 4 ) ),
+            QStringList() << "0" << "0-sub" << "1" << "1-sub" );
+
+  for ( int i = 0; i < width; i += 2 ) {
+    cal->deleteTodo( children[i] );
+  }
+  QCOMPARE( cal->relations( "root" ).count(), width / 2 );
+  QCOMPARE( cal->descendants( "root" ).count(), width );
+}
+
+void IncidenceRelationTest::testLoops()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  Todo::Ptr a = makeTodo( "a", "c" );
+  Todo::Ptr b = makeTodo( "b", "a" );
+  Todo::Ptr c = makeTodo( "c", "b" );
+  Todo::Ptr self = makeTodo( "self", "self" );
+  cal->addTodo( a );
+  cal->addTodo( b );
+  cal->addTodo( c );
+  cal->addTodo( self );
+
+  // The incidence closing a loop loses its parent
+  QCOMPARE( c->relatedTo(), QString() );
+  QCOMPARE( self->relatedTo(), QString() );
+  QCOMPARE( uids( cal->descendants( "c" ) ), QStringList() << "a" << "b" );
+  QVERIFY( cal->isAncestorOf( c, b ) );
+
+  // Also when the parent is changed
+  c->setRelatedTo( "b" );
+  QCOMPARE( c->relatedTo(), QString() );
+  QVERIFY( cal->relations( "b" ).isEmpty() );
+}
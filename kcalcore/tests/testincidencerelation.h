@@ -29,6 +29,10 @@ class IncidenceRelationTest : public QObject
   Q_OBJECT
   private Q_SLOTS:
     void testRelations();
+    void testCalendarRelations();
+    void testDeepHierarchy();
+    void testWideHierarchy();
+    void testLoops();
 };
 
 #endif
@@ -0,0 +1,100 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "testinstrumentation.h"
+#include "../event.h"
+#include "../icalformat.h"
+#include "../instrumentation.h"
+#include "../memorycalendar.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryFile>
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( InstrumentationTest, NoGUI )
+
+using namespace KCalCore;
+
+static MemoryCalendar::Ptr populatedCalendar()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  Event::Ptr event( new Event() );
+  event->setDtStart( KDateTime( QDate( 2013, 3, 4 ), QTime( 10, 0 ), KDateTime::UTC ) );
+  event->recurrence()->setDaily( 1 );
+  cal->addEvent( event );
+  cal->rawEventsForDate( QDate( 2013, 3, 5 ) );
+  cal->alarms( event->dtStart(), event->dtStart().addDays( 1 ) );
+  event->recurrence()->timesInInterval( event->dtStart(), event->dtStart().addDays( 7 ) );
+  return cal;
+}
+
+void InstrumentationTest::cleanup()
+{
+  Instrumentation::setTracing( false );
+  Instrumentation::setEnabled( false );
+  Instrumentation::reset();
+}
+
+void InstrumentationTest::testDisabled()
+{
+  QVERIFY( !Instrumentation::isEnabled() );
+  populatedCalendar();
+  for ( int i = 0; i < Instrumentation::OperationCount; ++i ) {
+    QCOMPARE( Instrumentation::statistics( Instrumentation::Operation( i ) ).count, quint64( 0 ) );
+  }
+}
+
+void InstrumentationTest::testStatistics()
+{
+  Instrumentation::setEnabled( true );
+  MemoryCalendar::Ptr cal = populatedCalendar();
+  QCOMPARE( Instrumentation::statistics( Instrumentation::Add ).count, quint64( 1 ) );
+  QVERIFY( Instrumentation::statistics( Instrumentation::RangeQuery ).count > 0 );
+  QCOMPARE( Instrumentation::statistics( Instrumentation::AlarmScan ).count, quint64( 1 ) );
+  QVERIFY( Instrumentation::statistics( Instrumentation::RecurrenceExpansion ).count > 0 );
+
+  ICalFormat format;
+  MemoryCalendar::Ptr copy( new MemoryCalendar( KDateTime::UTC ) );
+  QVERIFY( format.fromString( copy, format.toString( cal ) ) );
+  QCOMPARE( Instrumentation::statistics( Instrumentation::Parse ).count, quint64( 1 ) );
+  QCOMPARE( Instrumentation::statistics( Instrumentation::Populate ).count, quint64( 1 ) );
+  QVERIFY( Instrumentation::statistics( Instrumentation::Parse ).nanoseconds > 0 );
+
+  Instrumentation::reset();
+  QCOMPARE( Instrumentation::statistics( Instrumentation::Add ).count, quint64( 0 ) );
+}
+
+void InstrumentationTest::testTrace()
+{
+  Instrumentation::setEnabled( true );
+  Instrumentation::setTracing( true );
+  populatedCalendar();
+
+  QTemporaryFile file;
+  QVERIFY( file.open() );
+  QVERIFY( Instrumentation::writeTrace( file.fileName() ) );
+
+  QFile trace( file.fileName() );
+  QVERIFY( trace.open( QIODevice::ReadOnly ) );
+  const QByteArray json = trace.readAll();
+  QVERIFY( json.startsWith( "{\"traceEvents\":[" ) );
+  QVERIFY( json.contains( "\"name\":\"add\"" ) );
+  QVERIFY( json.contains( "\"name\":\"alarmScan\"" ) );
+  QVERIFY( json.contains( "\"ph\":\"X\"" ) );
+}
@@ -21,6 +21,7 @@
 
 #include "testmemorycalendar.h"
 #include "../filestorage.h"
+#include "../icalformat.h"
 #include "../memorycalendar.h"
 
 #include <kdebug.h>
@@ -28,6 +29,9 @@
 
 #include <unistd.h>
 
+#include <QSignalSpy>
+#include <QThread>
+
 #include <qtest_kde.h>
 QTEST_KDEMAIN( MemoryCalendarTest, NoGUI )
 
@@ -263,3 +267,503 @@ void MemoryCalendarTest::testRawEventsForDate()
 
     cal->close();
 }
+
+// The multi-day and recurring events on a date, found without any index
+static QSet<QString> spanningEventsOn(const MemoryCalendar::Ptr &cal, const QDate &date)
+{
+    QSet<QString> uids;
+    foreach (const Event::Ptr &event, cal->rawEvents()) {
+        if (event->recurs()) {
+            const int extraDays = event->dtStart().date().daysTo(event->dtEnd().date());
+            for (int i = 0; i <= extraDays; ++i) {
+                if (event->recursOn(date.addDays(-i), cal->timeSpec())) {
+                    uids.insert(event->uid());
+                    break;
+                }
+            }
+        } else if (event->isMultiDay()) {
+            if (event->dtStart().toTimeSpec(cal->timeSpec()).date() <= date
+                && event->dtEnd().toTimeSpec(cal->timeSpec()).date() >= date) {
+                uids.insert(event->uid());
+            }
+        }
+    }
+    return uids;
+}
+
+static QSet<QString> spanningEventsForDate(const MemoryCalendar::Ptr &cal, const QDate &date)
+{
+    QSet<QString> uids;
+    foreach (const Event::Ptr &event, cal->rawEventsForDate(date)) {
+        if (event->recurs() || event->isMultiDay()) {
+            uids.insert(event->uid());
+        }
+    }
+    return uids;
+}
+
+void MemoryCalendarTest::testRawEventsForDateSpans()
+{
+    MemoryCalendar::Ptr cal(new MemoryCalendar(KDateTime::Spec::OffsetFromUTC(-5 * 3600)));
+    const KDateTime start(QDate(2020, 1, 10), QTime(22, 0), KDateTime::UTC);
+
+    QList<Event::Ptr> events;
+    for (int i = 0; i < 12; ++i) {
+        Event::Ptr event(new Event());
+        event->setUid(QString::number(i));
+        event->setDtStart(start.addDays(i * 3));
+        event->setDtEnd(start.addDays(i * 3).addSecs(3600 * (1 + i % 3 * 30)));
+        events << event;
+    }
+    events[0]->setDtEnd(start.addDays(40));                   // multi-day
+    events[1]->setDtEnd(start.addYears(3));                   // longer than the months index
+    events[2]->recurrence()->setDaily(3);                     // unbounded
+    events[3]->recurrence()->setWeekly(1);
+    events[3]->recurrence()->setDuration(20);
+    events[4]->recurrence()->setYearly(1);                    // in the start month only
+    events[5]->recurrence()->setYearly(1);
+    events[5]->recurrence()->addYearlyMonth(6);
+    events[5]->recurrence()->addYearlyMonth(12);
+    events[6]->recurrence()->setMonthly(2);
+    events[6]->recurrence()->setEndDate(QDate(2020, 9, 1));
+    events[7]->recurrence()->addRDate(QDate(2020, 8, 15));
+    events[8]->recurrence()->setYearly(1);
+    events[8]->recurrence()->addYearlyDay(100);
+    events[9]->setAllDay(true);
+    events[9]->recurrence()->setMonthly(1);
+    events[9]->recurrence()->addMonthlyDate(-1);
+    foreach (const Event::Ptr &event, events) {
+        QVERIFY(cal->addEvent(event));
+    }
+
+    // Changes to events in the calendar are followed
+    events[4]->recurrence()->setYearly(2);
+    events[10]->recurrence()->setDaily(10);
+    events[11]->setDtEnd(start.addDays(60));
+    QVERIFY(cal->deleteEvent(events[3]));
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (QDate date(2019, 12, 1); date < QDate(2024, 1, 1); date = date.addDays(1)) {
+            QCOMPARE(spanningEventsForDate(cal, date), spanningEventsOn(cal, date));
+        }
+        cal->setTimeSpec(KDateTime::Spec::OffsetFromUTC(9 * 3600));
+    }
+
+    cal->close();
+}
+
+namespace {
+
+// Counts the occurrences of the events of a calendar in a year.
+class OccurrenceCounter : public QThread
+{
+public:
+    explicit OccurrenceCounter(const MemoryCalendar::Ptr &cal)
+        : mCalendar(cal), mCount(0)
+    {
+    }
+
+    void run()
+    {
+        for (QDate date(2020, 1, 1); date.year() == 2020; date = date.addDays(1)) {
+            foreach (const Event::Ptr &event, mCalendar->rawEvents()) {
+                if (event->recursOn(date, KDateTime::UTC)) {
+                    ++mCount;
+                }
+            }
+        }
+    }
+
+    MemoryCalendar::Ptr mCalendar;
+    int mCount;
+};
+
+}
+
+void MemoryCalendarTest::testExceptions()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  const KDateTime start( QDate( 2013, 3, 4 ), QTime( 9, 0 ), KDateTime::UTC );
+  const int count = 300;
+
+  // Exceptions added before and after the recurring event
+  QList<Event::Ptr> exceptions;
+  for ( int i = 0; i < count; ++i ) {
+    Event::Ptr exception( new Event );
+    exception->setUid( "standup" );
+    exception->setRecurrenceId( start.addDays( 2 * i ) );
+    exception->setDtStart( start.addDays( 2 * i ).addSecs( 1800 ) );
+    exceptions.append( exception );
+  }
+  for ( int i = 0; i < count / 2; ++i ) {
+    QVERIFY( cal->addEvent( exceptions[i] ) );
+  }
+  Event::Ptr series( new Event );
+  series->setUid( "standup" );
+  series->setDtStart( start );
+  series->recurrence()->setDaily( 1 );
+  QVERIFY( cal->addEvent( series ) );
+  for ( int i = count / 2; i < count; ++i ) {
+    QVERIFY( cal->addEvent( exceptions[i] ) );
+  }
+
+  QCOMPARE( cal->event( "standup" ), series );
+  for ( int i = 0; i < count; ++i ) {
+    QCOMPARE( cal->event( "standup", start.addDays( 2 * i ) ), exceptions[i] );
+    QVERIFY( !cal->event( "standup", start.addDays( 2 * i + 1 ) ) );
+  }
+  // Equal recurrence IDs in another time spec
+  QCOMPARE( cal->event( "standup", start.addDays( 2 ).toTimeSpec( KDateTime::Spec::OffsetFromUTC( 3600 ) ) ),
+            exceptions[1] );
+  QVERIFY( !cal->event( "standup", KDateTime( start.date() ) ) );
+  QCOMPARE( cal->instances( series ).count(), count );
+
+  // Floating and date-only recurrence IDs
+  const KDateTime floatingId( start.date(), start.time(), KDateTime::ClockTime );
+  const KDateTime dateId( start.date().addDays( 1 ), KDateTime::ClockTime );
+  Event::Ptr floating( new Event );
+  floating->setUid( "floating" );
+  floating->setRecurrenceId( floatingId );
+  floating->setDtStart( floatingId );
+  Event::Ptr allDay( new Event );
+  allDay->setUid( "floating" );
+  allDay->setRecurrenceId( dateId );
+  allDay->setDtStart( dateId );
+  QVERIFY( cal->addEvent( floating ) );
+  QVERIFY( cal->addEvent( allDay ) );
+  QCOMPARE( cal->event( "floating", floatingId ), floating );
+  QCOMPARE( cal->event( "floating", dateId ), allDay );
+  QVERIFY( !cal->event( "floating", KDateTime( start.date(), KDateTime::ClockTime ) ) );
+  QVERIFY( cal->deleteEvent( floating ) );
+  QVERIFY( cal->deleteEvent( allDay ) );
+  QCOMPARE( cal->eventInstances( series ).first(), exceptions.first() );
+
+  // Moved exception
+  exceptions[0]->setRecurrenceId( start.addDays( 1 ) );
+  QVERIFY( !cal->event( "standup", start ) );
+  QCOMPARE( cal->event( "standup", start.addDays( 1 ) ), exceptions[0] );
+
+  // Changes grouped while the exceptions are updated
+  exceptions[1]->startUpdates();
+  exceptions[1]->setRecurrenceId( start.addDays( 3 ) );
+  QCOMPARE( cal->event( "standup", start.addDays( 3 ) ), exceptions[1] );
+  QCOMPARE( cal->instances( series ).count(), count );
+  exceptions[1]->endUpdates();
+  QCOMPARE( cal->event( "standup", start.addDays( 3 ) ), exceptions[1] );
+  QVERIFY( !cal->event( "standup", start.addDays( 2 ) ) );
+
+  QVERIFY( cal->deleteEvent( exceptions[5] ) );
+  QVERIFY( !cal->event( "standup", start.addDays( 10 ) ) );
+  QCOMPARE( cal->instances( series ).count(), count - 1 );
+
+  // Deleting the series deletes its exceptions
+  QVERIFY( cal->deleteEvent( series ) );
+  QVERIFY( !cal->event( "standup" ) );
+  QVERIFY( !cal->event( "standup", start.addDays( 20 ) ) );
+  QVERIFY( cal->rawEvents().isEmpty() );
+
+  // A new exception with the uid of the deleted series
+  QVERIFY( cal->addEvent( exceptions[10] ) );
+  QCOMPARE( cal->event( "standup", start.addDays( 20 ) ), exceptions[10] );
+  QVERIFY( !cal->event( "standup" ) );
+  cal->close();
+  QVERIFY( !cal->event( "standup", start.addDays( 20 ) ) );
+}
+
+void MemoryCalendarTest::testOccurrences()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  const KDateTime start( QDate( 2013, 3, 4 ), QTime( 9, 0 ), KDateTime::UTC );
+
+  // Daily from 9:00 to 10:00, the second day excluded, the third moved
+  Event::Ptr series( new Event );
+  series->setUid( "standup" );
+  series->setDtStart( start );
+  series->setDtEnd( start.addSecs( 3600 ) );
+  series->recurrence()->setDaily( 1 );
+  series->recurrence()->addExDateTime( start.addDays( 1 ) );
+  QVERIFY( cal->addEvent( series ) );
+  Event::Ptr moved( new Event );
+  moved->setUid( "standup" );
+  moved->setRecurrenceId( start.addDays( 2 ) );
+  moved->setDtStart( start.addDays( 2 ).addSecs( 7200 ) );
+  moved->setDtEnd( start.addDays( 2 ).addSecs( 9000 ) );
+  QVERIFY( cal->addEvent( moved ) );
+  // Moved out of the range
+  Event::Ptr away( new Event );
+  away->setUid( "standup" );
+  away->setRecurrenceId( start.addDays( 3 ) );
+  away->setDtStart( start.addDays( 30 ) );
+  away->setDtEnd( start.addDays( 30 ).addSecs( 3600 ) );
+  QVERIFY( cal->addEvent( away ) );
+
+  Event::Ptr holiday( new Event );
+  holiday->setUid( "holiday" );
+  holiday->setDtStart( KDateTime( start.date().addDays( 4 ), KDateTime::ClockTime ) );
+  holiday->setDtEnd( KDateTime( start.date().addDays( 5 ), KDateTime::ClockTime ) );
+  holiday->setAllDay( true );
+  QVERIFY( cal->addEvent( holiday ) );
+
+  const KDateTime rangeStart( start.date(), QTime( 9, 30 ), KDateTime::UTC );
+  const Calendar::Occurrence::List occurrences =
+    cal->occurrences( rangeStart, rangeStart.addDays( 6 ) );
+  QCOMPARE( occurrences.count(), 6 );
+  QCOMPARE( occurrences[0].event, series );
+  QCOMPARE( occurrences[0].start, start );
+  QCOMPARE( occurrences[0].end, start.addSecs( 3600 ) );
+  QCOMPARE( occurrences[1].event, moved );
+  QCOMPARE( occurrences[1].start, moved->dtStart() );
+  QCOMPARE( occurrences[1].end, moved->dtEnd() );
+  QCOMPARE( occurrences[2].event, holiday );
+  // All-day occurrences end on the day after their last day
+  QCOMPARE( occurrences[2].start, KDateTime( start.date().addDays( 4 ), KDateTime::ClockTime ) );
+  QCOMPARE( occurrences[2].start.timeSpec(), holiday->dtStart().timeSpec() );
+  QVERIFY( occurrences[2].start.isDateOnly() );
+  QCOMPARE( occurrences[2].end, KDateTime( start.date().addDays( 6 ), KDateTime::ClockTime ) );
+  QCOMPARE( occurrences[2].end.timeSpec(), holiday->dtStart().timeSpec() );
+  QCOMPARE( occurrences[3].event, series );
+  QCOMPARE( occurrences[3].start, start.addDays( 4 ) );
+  QCOMPARE( occurrences[4].start, start.addDays( 5 ) );
+  QCOMPARE( occurrences[5].start, start.addDays( 6 ) );
+
+  QVERIFY( cal->occurrences( start.addDays( 50 ), start.addDays( 40 ) ).isEmpty() );
+  // The exception and the occurrence of the series at the same time
+  QCOMPARE( cal->occurrences( start.addDays( 30 ), start.addDays( 31 ) ).count(), 2 );
+}
+
+void MemoryCalendarTest::testSnapshot()
+{
+    MemoryCalendar::Ptr cal(new MemoryCalendar(KDateTime::UTC));
+    cal->addNotebook(QLatin1String("nb"), true);
+    cal->addNotebook(QLatin1String("empty"), false);
+    cal->addNotebook(QLatin1String("default"), true);
+    QVERIFY(cal->setDefaultNotebook(QLatin1String("default")));
+    for (int i = 0; i < 20; ++i) {
+        Event::Ptr event(new Event());
+        event->setUid(QString::number(i));
+        event->setSummary(QString::fromLatin1("Event %1").arg(i));
+        event->setDtStart(KDateTime(QDate(2020, 1, 1 + i), QTime(10, 0), KDateTime::UTC));
+        event->setDtEnd(event->dtStart().addSecs(3600));
+        event->recurrence()->setWeekly(1 + i % 3);
+        QVERIFY(cal->addEvent(event));
+        QVERIFY(cal->setNotebook(event, QLatin1String("nb")));
+    }
+    Event::Ptr deleted = cal->event(QLatin1String("19"));
+    QVERIFY(cal->deleteEvent(deleted));
+
+    MemoryCalendar::Ptr snapshot = cal->snapshot();
+    QCOMPARE(snapshot->rawEvents().count(), 19);
+    QVERIFY(!snapshot->isModified());
+    QVERIFY(snapshot->deletedEvent(QLatin1String("19")));
+    QCOMPARE(snapshot->notebook(QLatin1String("0")), QLatin1String("nb"));
+    // Notebooks without incidences are registered too
+    QVERIFY(snapshot->hasValidNotebook(QLatin1String("empty")));
+    QVERIFY(!snapshot->isVisible(QLatin1String("empty")));
+    QCOMPARE(snapshot->defaultNotebook(), QLatin1String("default"));
+
+    // Changes to the calendar are not seen by the snapshot
+    Event::Ptr event = cal->event(QLatin1String("0"));
+    event->setSummary(QLatin1String("Changed"));
+    event->setDtStart(event->dtStart().addDays(1));
+    QVERIFY(cal->deleteEvent(cal->event(QLatin1String("1"))));
+    QCOMPARE(snapshot->rawEvents().count(), 19);
+    QCOMPARE(snapshot->event(QLatin1String("0"))->summary(), QLatin1String("Event 0"));
+    QCOMPARE(snapshot->event(QLatin1String("0"))->dtStart().date(), QDate(2020, 1, 1));
+    QVERIFY(snapshot->event(QLatin1String("1")));
+
+    // Snapshots of the same calendar can be read in parallel
+    QList<OccurrenceCounter *> counters;
+    for (int i = 0; i < 4; ++i) {
+        counters.append(new OccurrenceCounter(snapshot->snapshot()));
+    }
+    foreach (OccurrenceCounter *counter, counters) {
+        counter->start();
+    }
+    OccurrenceCounter reference(snapshot);
+    reference.run();
+    foreach (OccurrenceCounter *counter, counters) {
+        QVERIFY(counter->wait());
+        QCOMPARE(counter->mCount, reference.mCount);
+    }
+    qDeleteAll(counters);
+
+    cal->close();
+}
+
+void MemoryCalendarTest::testNotebooks()
+{
+    MemoryCalendar::Ptr cal(new MemoryCalendar(KDateTime::UTC));
+    QVERIFY(cal->addNotebook(QLatin1String("work"), true));
+    QVERIFY(cal->addNotebook(QLatin1String("home"), true));
+    QVERIFY(!cal->addNotebook(QLatin1String("home"), false));
+
+    Todo::List todos;
+    for (int i = 0; i < 6; ++i) {
+        Todo::Ptr todo(new Todo());
+        todo->setUid(QString::number(i));
+        todo->setDtDue(KDateTime(QDate(2020, 5, 1 + i), QTime(12, 0), KDateTime::UTC));
+        todo->setHasDueDate(true);
+        QVERIFY(cal->addTodo(todo));
+        QVERIFY(cal->setNotebook(todo, QLatin1String(i % 2 ? "home" : "work")));
+        todos << todo;
+    }
+    // Setting the same notebook again does not add the incidence twice
+    QVERIFY(cal->setNotebook(todos[0], QLatin1String("work")));
+    QCOMPARE(cal->incidences(QLatin1String("work")).count(), 3);
+    QCOMPARE(cal->incidences(QLatin1String("home")).count(), 3);
+    QCOMPARE(cal->incidences(QString()).count(), 6);
+
+    const QDate start(2020, 5, 1);
+    const QDate end(2020, 5, 31);
+    QCOMPARE(cal->rawTodos(start, end).count(), 6);
+    foreach (const Todo::Ptr &todo, todos) {
+        QVERIFY(cal->isVisible(todo));
+    }
+
+    // Visibility follows the notebook
+    QVERIFY(cal->updateNotebook(QLatin1String("home"), false));
+    QVERIFY(!cal->isVisible(todos[1]));
+    QVERIFY(cal->isVisible(todos[0]));
+    QCOMPARE(cal->rawTodos(start, end).count(), 3);
+
+    // Moving between notebooks
+    QVERIFY(cal->setNotebook(todos[0], QLatin1String("home")));
+    QVERIFY(!cal->isVisible(todos[0]));
+    QCOMPARE(cal->incidences(QLatin1String("work")).count(), 2);
+    QCOMPARE(cal->incidences(QLatin1String("home")).count(), 4);
+    QVERIFY(cal->incidences(QLatin1String("home")).contains(todos[0]));
+    QCOMPARE(cal->rawTodos(start, end).count(), 2);
+
+    QVERIFY(cal->updateNotebook(QLatin1String("home"), true));
+    QVERIFY(cal->isVisible(todos[0]));
+    QCOMPARE(cal->rawTodos(start, end).count(), 6);
+
+    // Deleting a hidden notebook makes its incidences visible
+    QVERIFY(cal->updateNotebook(QLatin1String("work"), false));
+    QCOMPARE(cal->rawTodos(start, end).count(), 4);
+    QVERIFY(cal->deleteNotebook(QLatin1String("work")));
+    QVERIFY(cal->isVisible(todos[2]));
+    QCOMPARE(cal->rawTodos(start, end).count(), 6);
+
+    cal->clearNotebookAssociations();
+    QVERIFY(cal->notebooks().isEmpty());
+    QVERIFY(cal->incidences(QString()).isEmpty());
+
+    cal->close();
+}
+
+void MemoryCalendarTest::testSetTimeSpecLarge()
+{
+    // Enough events for the rehashing to be spread over several threads.
+    MemoryCalendar::Ptr cal(new MemoryCalendar(KDateTime::UTC));
+    const int count = 2400;
+    for (int i = 0; i < count; ++i) {
+        Event::Ptr event = Event::Ptr(new Event());
+        event->setDtStart(KDateTime(QDate(2019, 10, 29), QTime(i % 24, 30),
+                                    KDateTime::UTC));
+        QVERIFY(cal->addEvent(event));
+    }
+    QCOMPARE(cal->rawEventsForDate(QDate(2019, 10, 29)).count(), count);
+
+    QSignalSpy spy(cal.data(), SIGNAL(timeSpecChangeProgress(int,int)));
+    cal->setTimeSpec(KDateTime::Spec::OffsetFromUTC(-12 * 3600));
+    QVERIFY(spy.count() > 0);
+    QCOMPARE(spy.last().at(0).toInt(), count);
+    QCOMPARE(spy.last().at(1).toInt(), count);
+    // Events before noon UTC move to the day before.
+    QCOMPARE(cal->rawEventsForDate(QDate(2019, 10, 28)).count(), count / 2);
+    QCOMPARE(cal->rawEventsForDate(QDate(2019, 10, 29)).count(), count / 2);
+
+    spy.clear();
+    cal->shiftTimes(KDateTime::Spec::OffsetFromUTC(-12 * 3600), KDateTime::UTC);
+    QVERIFY(spy.count() > 0);
+    QCOMPARE(cal->rawEventsForDate(QDate(2019, 10, 28)).count(), count / 2);
+    QCOMPARE(cal->rawEventsForDate(QDate(2019, 10, 29)).count(), count / 2);
+    foreach (const Event::Ptr &event, cal->rawEvents()) {
+        QCOMPARE(event->dtStart().timeSpec(), KDateTime::Spec(KDateTime::UTC));
+    }
+
+    cal->close();
+}
+
+void MemoryCalendarTest::testTombstones()
+{
+    MemoryCalendar::Ptr cal(new MemoryCalendar(KDateTime::UTC));
+    QVERIFY(cal->deletedIncidencesKept());
+    QCOMPARE(cal->tombstoneLimit(), -1);
+    cal->addNotebook(QLatin1String("nb"), true);
+
+    const KDateTime start(QDate(2021, 3, 1), QTime(9, 0), KDateTime::UTC);
+    Event::Ptr series(new Event());
+    series->setUid(QLatin1String("series"));
+    series->setDtStart(start);
+    series->setDtEnd(start.addSecs(3600));
+    series->recurrence()->setDaily(1);
+    series->setRevision(3);
+    QVERIFY(cal->addEvent(series));
+    QVERIFY(cal->setNotebook(series, QLatin1String("nb")));
+    Event::Ptr exception(series->clone());
+    exception->clearRecurrence();
+    exception->setRecurrenceId(start.addDays(2));
+    QVERIFY(cal->addEvent(exception));
+    Todo::Ptr todo(new Todo());
+    todo->setUid(QLatin1String("todo"));
+    QVERIFY(cal->addTodo(todo));
+
+    // Deleting the series deletes its exception
+    QVERIFY(cal->deleteEvent(series));
+    MemoryCalendar::Tombstone::List tombstones = cal->tombstones();
+    QCOMPARE(tombstones.count(), 2);
+    QCOMPARE(tombstones[0].uid, QLatin1String("series"));
+    QVERIFY(tombstones[0].recurrenceId.isNull());
+    QCOMPARE(tombstones[0].type, Incidence::TypeEvent);
+    QCOMPARE(tombstones[0].notebook, QLatin1String("nb"));
+    QCOMPARE(tombstones[0].revision, 3);
+    QVERIFY(tombstones[0].deleted.isUtc());
+    QCOMPARE(tombstones[1].recurrenceId, start.addDays(2));
+    QCOMPARE(cal->deletedEvent(QLatin1String("series")), series);
+    QCOMPARE(cal->deletedEvents().count(), 2);
+
+    // Deleting an incidence again replaces its tombstone and deleted copy
+    QVERIFY(cal->addEvent(series));
+    QVERIFY(cal->deleteEvent(series));
+    QCOMPARE(cal->tombstones().count(), 2);
+    QCOMPARE(cal->tombstones().last().uid, QLatin1String("series"));
+    QCOMPARE(cal->deletedEvents().count(), 2);
+
+    // Only tombstones
+    cal->setDeletedIncidencesKept(false);
+    QVERIFY(cal->deletedEvents().isEmpty());
+    QVERIFY(!cal->deletedEvent(QLatin1String("series")));
+    QVERIFY(cal->deleteTodo(todo));
+    QVERIFY(cal->deletedTodos().isEmpty());
+    QCOMPARE(cal->tombstones().count(), 3);
+
+    // Tombstones are written to the deleted incidences of the notebook
+    ICalFormat format;
+    const QString text = format.toString(cal, QLatin1String("nb"), true);
+    QCOMPARE(text.count(QLatin1String("BEGIN:VEVENT")), 2);
+    QVERIFY(!text.contains(QLatin1String("BEGIN:VTODO")));
+    QVERIFY(text.contains(QLatin1String("UID:series")));
+    QVERIFY(text.contains(QLatin1String("SEQUENCE:3")));
+    MemoryCalendar::Ptr loaded(new MemoryCalendar(KDateTime::UTC));
+    QVERIFY(format.fromString(loaded, text, true));
+    QCOMPARE(loaded->deletedEvents().count(), 2);
+    QVERIFY(loaded->deletedEvent(QLatin1String("series"), start.addDays(2)));
+
+    MemoryCalendar::Ptr snapshot = cal->snapshot();
+    QVERIFY(!snapshot->deletedIncidencesKept());
+    QCOMPARE(snapshot->tombstones().count(), 3);
+
+    // Compaction drops the oldest tombstones
+    cal->setTombstoneLimit(2);
+    QCOMPARE(cal->tombstones().count(), 2);
+    QCOMPARE(cal->tombstones().last().uid, QLatin1String("todo"));
+    QCOMPARE(cal->compactTombstones(cal->tombstones().first().deleted), 0);
+    QCOMPARE(cal->compactTombstones(KDateTime::currentUtcDateTime().addSecs(1)), 2);
+    QVERIFY(cal->tombstones().isEmpty());
+    QCOMPARE(snapshot->compactTombstones(), 3);
+    QVERIFY(snapshot->tombstones().isEmpty());
+
+    cal->close();
+}
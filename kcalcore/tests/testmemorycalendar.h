@@ -34,6 +34,13 @@ class MemoryCalendarTest : public QObject
     void testRelationsCrash();
     void testRawEvents();
     void testRawEventsForDate();
+    void testRawEventsForDateSpans();
+    void testSetTimeSpecLarge();
+    void testExceptions();
+    void testOccurrences();
+    void testSnapshot();
+    void testTombstones();
+    void testNotebooks();
 };
 
 #endif
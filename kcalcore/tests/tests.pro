@@ -1,2 +1,2 @@
 TEMPLATE=subdirs
-SUBDIRS+=testtimesininterval.pro testmemorycalendar.pro
+SUBDIRS+=testtimesininterval.pro testmemorycalendar.pro benchmarks
@@ -0,0 +1,124 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "testsearchindex.h"
+#include "../memorycalendar.h"
+#include "../searchindex.h"
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( SearchIndexTest, NoGUI )
+
+using namespace KCalCore;
+
+static Event::Ptr addEvent( const MemoryCalendar::Ptr &cal, const QString &uid,
+                            const QString &summary, const QString &location = QString(),
+                            const QString &description = QString() )
+{
+  Event::Ptr event( new Event() );
+  event->setUid( uid );
+  event->setSummary( summary );
+  event->setLocation( location );
+  event->setDescription( description );
+  event->setDtStart( KDateTime( QDate( 2020, 3, 4 ), QTime( 10, 0 ), KDateTime::UTC ) );
+  cal->addEvent( event );
+  return event;
+}
+
+static QStringList uids( const Incidence::List &incidences )
+{
+  QStringList result;
+  foreach ( const Incidence::Ptr &incidence, incidences ) {
+    result << incidence->uid();
+  }
+  return result;
+}
+
+void SearchIndexTest::testWords()
+{
+  QCOMPARE( SearchIndex::words( QString::fromUtf8( "Café crème, ÉTÉ 2020!" ) ),
+            QStringList() << "cafe" << "creme" << "ete" << "2020" );
+  QCOMPARE( SearchIndex::words( "john.doe@example.com" ),
+            QStringList() << "john" << "doe" << "example" << "com" );
+  QVERIFY( SearchIndex::words( " - " ).isEmpty() );
+}
+
+void SearchIndexTest::testSearch()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  addEvent( cal, "1", "Team meeting", "Room 4" );
+  addEvent( cal, "2", QString::fromUtf8( "Lunch at the café" ) );
+  Event::Ptr review = addEvent( cal, "3", "Code review", QString(), "Meet in the lab" );
+  review->addAttendee( Attendee::Ptr( new Attendee( "Jane Roe", "jane@example.com" ) ) );
+
+  SearchIndex index( cal );
+  QCOMPARE( index.calendar(), Calendar::Ptr( cal ) );
+  QCOMPARE( uids( index.search( "CAFE" ) ), QStringList() << "2" );
+  QCOMPARE( uids( index.search( "team room" ) ), QStringList() << "1" );
+  QCOMPARE( uids( index.search( "jane" ) ), QStringList() << "3" );
+  QCOMPARE( uids( index.search( "review lab" ) ), QStringList() << "3" );
+  QVERIFY( index.search( "team lab" ).isEmpty() );
+  QVERIFY( index.search( "" ).isEmpty() );
+
+  // Words of a query are prefixes
+  QCOMPARE( uids( index.search( "meet" ) ), QStringList() << "1" << "3" );
+  QCOMPARE( uids( index.search( "meet", 1 ) ), QStringList() << "1" );
+  QVERIFY( index.search( "meet", 0 ).isEmpty() );
+}
+
+void SearchIndexTest::testRanking()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  addEvent( cal, "description", "Planning", QString(), "Budget" );
+  addEvent( cal, "location", "Planning", "Budget office" );
+  addEvent( cal, "summary", "Budget" );
+  addEvent( cal, "prefix", "Budgets" );
+
+  SearchIndex index( cal );
+  QCOMPARE( uids( index.search( "budget" ) ),
+            QStringList() << "summary" << "prefix" << "location" << "description" );
+}
+
+void SearchIndexTest::testUpdates()
+{
+  MemoryCalendar::Ptr cal( new MemoryCalendar( KDateTime::UTC ) );
+  SearchIndex index( cal );
+
+  Event::Ptr event = addEvent( cal, "1", "Dentist" );
+  QCOMPARE( uids( index.search( "dentist" ) ), QStringList() << "1" );
+
+  event->setSummary( "Doctor" );
+  QVERIFY( index.search( "dentist" ).isEmpty() );
+  QCOMPARE( uids( index.search( "doc" ) ), QStringList() << "1" );
+
+  Todo::Ptr todo( new Todo() );
+  todo->setUid( "2" );
+  todo->setSummary( "Call the doctor" );
+  cal->addTodo( todo );
+  QCOMPARE( index.search( "doctor" ).count(), 2 );
+
+  cal->deleteEvent( event );
+  QCOMPARE( uids( index.search( "doctor" ) ), QStringList() << "2" );
+
+  // Closing does not notify observers
+  cal->close();
+  QVERIFY( index.search( "doctor" ).isEmpty() );
+  addEvent( cal, "3", "Doctor" );
+  index.rebuild();
+  QCOMPARE( uids( index.search( "doctor" ) ), QStringList() << "3" );
+}
@@ -0,0 +1,322 @@
+/*
+  This file is part of the kcalcore library.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "testsystemtimezone.h"
+
+#include <kdatetime.h>
+#include <ksystemtimezone.h>
+
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include <qtest_kde.h>
+QTEST_KDEMAIN( SystemTimeZoneTest, NoGUI )
+
+// 1902-01-01 to 2200-01-01, or 2038 with a 32-bit time_t
+static const qint64 FirstTime = Q_INT64_C( -2145916800 );
+static const qint64 LastTime = sizeof( time_t ) > 4 ? Q_INT64_C( 7258118400 ) : INT_MAX - 86400;
+
+static const qint64 Hour = 3600;
+static const qint64 Day = 86400;
+
+static void addZones()
+{
+  // Shifts of half an hour, southern hemisphere zones, negative daylight
+  // saving time and zones whose files end with a POSIX TZ rule.
+  QTest::addColumn<QString>( "name" );
+  QTest::newRow( "Helsinki" ) << "Europe/Helsinki";
+  QTest::newRow( "New York" ) << "America/New_York";
+  QTest::newRow( "Sao Paulo" ) << "America/Sao_Paulo";
+  QTest::newRow( "Sydney" ) << "Australia/Sydney";
+  QTest::newRow( "Lord Howe" ) << "Australia/Lord_Howe";
+  QTest::newRow( "Chatham" ) << "Pacific/Chatham";
+  QTest::newRow( "Kolkata" ) << "Asia/Kolkata";
+  QTest::newRow( "Tehran" ) << "Asia/Tehran";
+  QTest::newRow( "Dublin" ) << "Europe/Dublin";
+  QTest::newRow( "Casablanca" ) << "Africa/Casablanca";
+  QTest::newRow( "Nuuk" ) << "America/Nuuk";
+}
+
+static QDateTime toDateTime( qint64 secs, Qt::TimeSpec spec )
+{
+  qint64 days = secs / Day;
+  if ( secs % Day < 0 ) {
+    --days;
+  }
+  return QDateTime( QDate( 1970, 1, 1 ).addDays( days ), QTime( 0, 0 ).addSecs( secs - days * Day ), spec );
+}
+
+namespace {
+
+// Makes a zone the local time zone of the C library for its lifetime, as
+// system time zones used to do for each conversion.
+class LibcZone
+{
+  public:
+    explicit LibcZone( const QString &name )
+      : mSaved( qgetenv( "TZ" ) )
+    {
+      ::setenv( "TZ", QByteArray( ':' + name.toUtf8() ).constData(), 1 );
+      ::tzset();
+    }
+
+    ~LibcZone()
+    {
+      if ( mSaved.isEmpty() ) {
+        ::unsetenv( "TZ" );
+      } else {
+        ::setenv( "TZ", mSaved.constData(), 1 );
+      }
+      ::tzset();
+    }
+
+    static int offset( qint64 t, bool *isDst = 0 )
+    {
+      const time_t tt = t;
+      tm tmtime;
+      localtime_r( &tt, &tmtime );
+      if ( isDst ) {
+        *isDst = tmtime.tm_isdst > 0;
+      }
+      return tmtime.tm_gmtoff;
+    }
+
+    // The offsets of a local time found with mktime(), as system time zones
+    // used to. Returns false if the time is skipped by a shift forward.
+    static bool offsetAtZoneTime( const QDateTime &local, int *first, int *second )
+    {
+      tm tmtime;
+      memset( &tmtime, 0, sizeof( tmtime ) );
+      tmtime.tm_sec = local.time().second();
+      tmtime.tm_min = local.time().minute();
+      tmtime.tm_hour = local.time().hour();
+      tmtime.tm_mday = local.date().day();
+      tmtime.tm_mon = local.date().month() - 1;
+      tmtime.tm_year = local.date().year() - 1900;
+      tmtime.tm_isdst = -1;
+      const time_t t = mktime( &tmtime );
+      if ( t == time_t( -1 ) || tmtime.tm_hour != local.time().hour() ||
+           tmtime.tm_min != local.time().minute() ) {
+        return false;
+      }
+
+      // A shift back within an hour makes the time occur twice
+      *first = offset( t );
+      *second = offset( t + Hour );
+      if ( *second < *first ) {
+        *second = offset( t + *first - *second );
+      } else if ( ( *second = offset( t - Hour ) ) > *first ) {
+        *second = offset( t - ( *second - *first ) );
+        qSwap( *first, *second );
+      } else {
+        *second = *first;
+      }
+      return true;
+    }
+
+  private:
+    QByteArray mSaved;
+};
+
+// Converts UTC times to a zone and counts the offsets which differ from
+// the expected ones.
+class OffsetChecker : public QThread
+{
+  public:
+    OffsetChecker( const QList<KTimeZone> &zones, const QVector<qint64> &times,
+                   const QVector<QVector<int> > &expected )
+      : mZones( zones ), mTimes( times ), mExpected( expected ), mErrors( 0 )
+    {
+    }
+
+    void run()
+    {
+      for ( int pass = 0; pass < 5; ++pass ) {
+        for ( int z = 0; z < mZones.count(); ++z ) {
+          const KTimeZone &zone = mZones.at( z );
+          for ( int i = 0; i < mTimes.count(); ++i ) {
+            const KDateTime utc( toDateTime( mTimes.at( i ), Qt::UTC ), KDateTime::UTC );
+            if ( zone.offset( mTimes.at( i ) ) != mExpected.at( z ).at( i ) ||
+                 utc.toZone( zone ).utcOffset() != mExpected.at( z ).at( i ) ) {
+              ++mErrors;
+            }
+          }
+        }
+      }
+    }
+
+    QList<KTimeZone> mZones;
+    QVector<qint64> mTimes;
+    QVector<QVector<int> > mExpected;
+    int mErrors;
+};
+
+}
+
+void SystemTimeZoneTest::testOffsets_data()
+{
+  addZones();
+}
+
+void SystemTimeZoneTest::testOffsets()
+{
+  QFETCH( QString, name );
+  const KTimeZone zone = KSystemTimeZones::zone( name );
+  if ( !zone.isValid() ) {
+    QSKIP( "Zone not installed" );
+  }
+
+  LibcZone libc( name );
+  int previous = LibcZone::offset( FirstTime );
+  for ( qint64 t = FirstTime; t < LastTime; t += 6 * Hour ) {
+    bool isDst;
+    const int offset = LibcZone::offset( t, &isDst );
+    QCOMPARE( zone.offset( t ), offset );
+    QCOMPARE( zone.isDst( t ), isDst );
+    QCOMPARE( zone.offsetAtUtc( toDateTime( t, Qt::UTC ) ), offset );
+
+    if ( offset != previous ) {
+      // Check both sides of the shift, to the second
+      qint64 before = t - 6 * Hour;
+      qint64 after = t;
+      while ( after - before > 1 ) {
+        const qint64 middle = before + ( after - before ) / 2;
+        if ( LibcZone::offset( middle ) == previous ) {
+          before = middle;
+        } else {
+          after = middle;
+        }
+      }
+      QCOMPARE( zone.offset( before ), LibcZone::offset( before ) );
+      QCOMPARE( zone.offset( after ), LibcZone::offset( after ) );
+      previous = offset;
+    }
+  }
+}
+
+void SystemTimeZoneTest::testZoneTimes_data()
+{
+  addZones();
+}
+
+void SystemTimeZoneTest::testZoneTimes()
+{
+  QFETCH( QString, name );
+  const KTimeZone zone = KSystemTimeZones::zone( name );
+  if ( !zone.isValid() ) {
+    QSKIP( "Zone not installed" );
+  }
+
+  // Local times around each shift from 1970 to 2100, and a sample of others
+  LibcZone libc( name );
+  const qint64 last = qMin( LastTime, Q_INT64_C( 4102444800 ) );
+  int previous = LibcZone::offset( 0 );
+  for ( qint64 t = 0; t < last; t += Hour ) {
+    const int offset = LibcZone::offset( t );
+    const bool shift = ( offset != previous );
+    previous = offset;
+    if ( !shift && t % ( 7 * Day ) != 0 ) {
+      continue;
+    }
+    // mktime() was only trusted for shifts of up to an hour
+    if ( qAbs( LibcZone::offset( t - Day ) - LibcZone::offset( t + Day ) ) > Hour ) {
+      continue;
+    }
+    for ( qint64 local = t + offset - 3 * Hour; local < t + offset + 3 * Hour; local += 600 ) {
+      int first, second;
+      if ( !LibcZone::offsetAtZoneTime( toDateTime( local, Qt::LocalTime ), &first, &second ) ) {
+        continue;
+      }
+      int zoneSecond;
+      QCOMPARE( zone.offsetAtZoneTime( toDateTime( local, Qt::LocalTime ), &zoneSecond ), first );
+      QCOMPARE( zoneSecond, second );
+    }
+  }
+}
+
+void SystemTimeZoneTest::testEarlyTransitions()
+{
+  const KTimeZone zone = KSystemTimeZones::zone( QLatin1String( "America/New_York" ) );
+  if ( !zone.isValid() ) {
+    QSKIP( "Zone not installed" );
+  }
+
+  // The first daylight saving time in New York, 1918-03-31 07:00 UTC. Times
+  // before 1970 are negative, and must not move to the following day.
+  const qint64 shift = Q_INT64_C( -1633280400 );
+  const QDateTime time = toDateTime( shift, Qt::UTC );
+  QCOMPARE( time, QDateTime( QDate( 1918, 3, 31 ), QTime( 7, 0 ), Qt::UTC ) );
+  bool found = false;
+  foreach ( const KTimeZone::Transition &transition, zone.transitions() ) {
+    found = found || transition.time() == time;
+  }
+  QVERIFY( found );
+  QCOMPARE( zone.offset( shift - 1 ), int( -5 * Hour ) );
+  QCOMPARE( zone.offset( shift ), int( -4 * Hour ) );
+  QCOMPARE( zone.offset( shift + 12 * Hour ), int( -4 * Hour ) );
+  QCOMPARE( zone.offsetAtUtc( toDateTime( shift + 20 * Hour, Qt::UTC ) ), int( -4 * Hour ) );
+}
+
+void SystemTimeZoneTest::testThreads()
+{
+  QList<KTimeZone> zones;
+  QVector<qint64> times;
+  QVector<QVector<int> > expected;
+  for ( qint64 t = Q_INT64_C( -631152000 ); t < Q_INT64_C( 2145916800 ); t += 7 * Day + 5 * Hour + 7 ) {
+    times.append( t );
+  }
+  foreach ( const char *name, QList<const char *>() << "Europe/Helsinki" << "America/New_York"
+                                                     << "Australia/Sydney" << "Asia/Kolkata" ) {
+    const KTimeZone zone = KSystemTimeZones::zone( QLatin1String( name ) );
+    if ( !zone.isValid() ) {
+      continue;
+    }
+    LibcZone libc( zone.name() );
+    QVector<int> offsets;
+    foreach ( qint64 t, times ) {
+      offsets.append( LibcZone::offset( t ) );
+    }
+    zones.append( zone );
+    expected.append( offsets );
+  }
+  if ( zones.isEmpty() ) {
+    QSKIP( "Zones not installed" );
+  }
+
+  // The threads share the zones, which are copied by each conversion
+  QList<OffsetChecker *> checkers;
+  for ( int i = 0; i < 8; ++i ) {
+    checkers.append( new OffsetChecker( zones, times, expected ) );
+  }
+  foreach ( OffsetChecker *checker, checkers ) {
+    checker->start();
+  }
+  int errors = 0;
+  foreach ( OffsetChecker *checker, checkers ) {
+    checker->wait();
+    errors += checker->mErrors;
+  }
+  qDeleteAll( checkers );
+  QCOMPARE( errors, 0 );
+}
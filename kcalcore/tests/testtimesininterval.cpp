@@ -24,11 +24,37 @@
 #include "testtimesininterval.h"
 #include "../event.h"
 
+#include <ksystemtimezone.h>
+
 #include <qtest_kde.h>
 QTEST_KDEMAIN( TimesInIntervalTest, NoGUI )
 
 using namespace KCalCore;
 
+namespace {
+
+// Collects the times of an enumeration, stopping after a number of chunks.
+class TimesCollector : public RecurrenceRule::TimesVisitor
+{
+  public:
+    explicit TimesCollector( int maxChunks = -1 )
+      : mChunks( 0 ), mMaxChunks( maxChunks )
+    {
+    }
+
+    bool visitTimes( const DateTimeList &times )
+    {
+      mTimes += times;
+      return ++mChunks != mMaxChunks;
+    }
+
+    DateTimeList mTimes;
+    int mChunks;
+    int mMaxChunks;
+};
+
+}
+
 void TimesInIntervalTest::test()
 {
   const KDateTime currentDate( QDate::currentDate() );
@@ -325,3 +351,156 @@ void TimesInIntervalTest::testClockTimeHandlingNonAllDay()
   }
   QCOMPARE(timesInInterval.size(), expectedDays.size());
 }
+
+void TimesInIntervalTest::testRecursOnCache()
+{
+  const KDateTime start( QDate( 2020, 1, 6 ), QTime( 23, 0 ), KDateTime::UTC );
+  Recurrence recurrence;
+  recurrence.setStartDateTime( start );
+  recurrence.setWeekly( 1 );
+  recurrence.setDuration( 30 );
+  recurrence.addExDateTime( start.addDays( 14 ) );
+  recurrence.addRDateTime( start.addDays( 3 ) );
+
+  QList<KDateTime::Spec> specs;
+  specs << KDateTime::Spec( KDateTime::UTC ) << KDateTime::Spec::OffsetFromUTC( 3600 );
+  foreach ( const KDateTime::Spec &spec, specs ) {
+    QSet<QDate> expected;
+    foreach ( const KDateTime &dt, recurrence.timesInInterval(
+                KDateTime( QDate( 2019, 12, 1 ), QTime( 0, 0 ), spec ),
+                KDateTime( QDate( 2021, 2, 1 ), QTime( 0, 0 ), spec ) ) ) {
+      expected.insert( dt.toTimeSpec( spec ).date() );
+    }
+    QCOMPARE( expected.count(), 30 );
+    // Twice, the second pass being answered from the cache
+    for ( int pass = 0; pass < 2; ++pass ) {
+      for ( QDate date( 2019, 12, 1 ); date < QDate( 2021, 2, 1 ); date = date.addDays( 1 ) ) {
+        QCOMPARE( recurrence.recursOn( date, spec ), expected.contains( date ) );
+      }
+    }
+  }
+
+  // Changes to the recurrence invalidate the cache
+  const QDate date( 2020, 1, 13 );
+  QVERIFY( recurrence.recursOn( date, KDateTime::UTC ) );
+  recurrence.addExDate( date );
+  QVERIFY( !recurrence.recursOn( date, KDateTime::UTC ) );
+  recurrence.setExDates( DateList() );
+  QVERIFY( recurrence.recursOn( date, KDateTime::UTC ) );
+  recurrence.setExDateTimes( DateTimeList() << KDateTime( date, QTime( 23, 0 ), KDateTime::UTC ) );
+  QVERIFY( !recurrence.recursOn( date, KDateTime::UTC ) );
+  recurrence.defaultRRule()->setDuration( 1 );
+  QVERIFY( !recurrence.recursOn( QDate( 2020, 1, 20 ), KDateTime::UTC ) );
+  QVERIFY( recurrence.recursOn( QDate( 2020, 1, 6 ), KDateTime::UTC ) );
+  recurrence.shiftTimes( KDateTime::Spec::OffsetFromUTC( 3600 ), KDateTime::UTC );
+  QVERIFY( !recurrence.recursOn( QDate( 2020, 1, 6 ), KDateTime::UTC ) );
+  QVERIFY( recurrence.recursOn( QDate( 2020, 1, 7 ), KDateTime::UTC ) );
+}
+
+void TimesInIntervalTest::testCountCache()
+{
+  // Daily in a time zone over a daylight saving time change, the occurrences
+  // of rules with a count being cached
+  const KDateTime::Spec spec( KSystemTimeZones::zone( QLatin1String( "Europe/Helsinki" ) ) );
+  const KDateTime start( QDate( 2020, 10, 20 ), QTime( 9, 30 ), spec );
+  RecurrenceRule rule;
+  rule.setStartDt( start );
+  rule.setRecurrenceType( RecurrenceRule::rDaily );
+  rule.setFrequency( 1 );
+  rule.setDuration( 10 );
+
+  const DateTimeList times = rule.timesInInterval( start.addDays( -5 ), start.addDays( 20 ) );
+  QCOMPARE( times.count(), 10 );
+  for ( int i = 0; i < times.count(); ++i ) {
+    QCOMPARE( times[i], start.addDays( i ) );
+    QCOMPARE( times[i].timeSpec(), spec );
+    QCOMPARE( times[i].time(), QTime( 9, 30 ) );
+  }
+  QCOMPARE( rule.endDt(), start.addDays( 9 ) );
+
+  // In the rule's time zone and in UTC
+  QCOMPARE( rule.getNextDate( start.addDays( 3 ) ), start.addDays( 4 ) );
+  QCOMPARE( rule.getNextDate( start.addDays( 3 ).toUtc() ), start.addDays( 4 ) );
+  QCOMPARE( rule.getPreviousDate( start.addDays( 7 ) ), start.addDays( 6 ) );
+  QCOMPARE( rule.getPreviousDate( start.addDays( 7 ).toUtc().addSecs( 1 ) ), start.addDays( 7 ) );
+  QCOMPARE( rule.timesInInterval( start.addDays( 2 ), start.addDays( 4 ) ).count(), 3 );
+  QVERIFY( !rule.getNextDate( start.addDays( 9 ) ).isValid() );
+
+  // All-day, compared with date/times
+  RecurrenceRule allDay;
+  allDay.setStartDt( KDateTime( QDate( 2020, 3, 1 ) ) );
+  allDay.setAllDay( true );
+  allDay.setRecurrenceType( RecurrenceRule::rYearly );
+  allDay.setFrequency( 1 );
+  allDay.setDuration( 3 );
+  const DateTimeList days =
+    allDay.timesInInterval( KDateTime( QDate( 2020, 1, 1 ) ), KDateTime( QDate( 2040, 1, 1 ) ) );
+  QCOMPARE( days.count(), 3 );
+  QVERIFY( days[0].isDateOnly() );
+  QCOMPARE( days[1].date(), QDate( 2021, 3, 1 ) );
+  QCOMPARE( allDay.getNextDate( KDateTime( QDate( 2021, 3, 1 ), QTime( 12, 0 ) ) ).date(),
+            QDate( 2022, 3, 1 ) );
+  QCOMPARE( allDay.getPreviousDate( KDateTime( QDate( 2021, 3, 1 ), QTime( 12, 0 ) ) ).date(),
+            QDate( 2020, 3, 1 ) );
+}
+
+void TimesInIntervalTest::testOccurrenceCount()
+{
+  // Every minute for a year, beyond the limit of timesInInterval()
+  const KDateTime start( QDate( 2021, 1, 1 ), QTime( 8, 0 ), KDateTime::UTC );
+  RecurrenceRule minutely;
+  minutely.setStartDt( start );
+  minutely.setRecurrenceType( RecurrenceRule::rMinutely );
+  minutely.setFrequency( 1 );
+  const KDateTime yearEnd = start.addDays( 365 );
+  QCOMPARE( minutely.occurrenceCount( start, yearEnd ), qint64( 365 * 24 * 60 + 1 ) );
+  QCOMPARE( minutely.occurrenceCount( start.addSecs( 1 ), yearEnd.addSecs( -1 ) ),
+            qint64( 365 * 24 * 60 - 1 ) );
+  QCOMPARE( minutely.occurrenceCount( start.addDays( -1 ), start ), qint64( 1 ) );
+  QCOMPARE( minutely.occurrenceCount( yearEnd, start ), qint64( 0 ) );
+  QCOMPARE( minutely.nthOccurrence( 0 ), start );
+  QCOMPARE( minutely.nthOccurrence( 100000 ), start.addSecs( 100000 * 60 ) );
+  QVERIFY( !minutely.nthOccurrence( -1 ).isValid() );
+
+  TimesCollector collector( 3 );
+  minutely.visitTimesInInterval( start.addSecs( 30 ), yearEnd, &collector, 1000 );
+  QCOMPARE( collector.mChunks, 3 );
+  QCOMPARE( collector.mTimes.count(), 3000 );
+  QCOMPARE( collector.mTimes.first(), start.addSecs( 60 ) );
+  QCOMPARE( collector.mTimes.last(), start.addSecs( 3000 * 60 ) );
+
+  // An interval starting on an occurrence includes it
+  const DateTimeList times = minutely.timesInInterval( start.addSecs( 120 ), start.addSecs( 240 ) );
+  QCOMPARE( times.count(), 3 );
+  QCOMPARE( times.first(), start.addSecs( 120 ) );
+
+  // With a count or an end
+  minutely.setDuration( 5 );
+  QCOMPARE( minutely.occurrenceCount( start.addDays( -1 ), yearEnd ), qint64( 5 ) );
+  QCOMPARE( minutely.nthOccurrence( 4 ), start.addSecs( 4 * 60 ) );
+  QVERIFY( !minutely.nthOccurrence( 5 ).isValid() );
+  minutely.setEndDt( start.addSecs( 90 ) );
+  QCOMPARE( minutely.occurrenceCount( start, yearEnd ), qint64( 2 ) );
+  QVERIFY( !minutely.nthOccurrence( 2 ).isValid() );
+
+  // Rules with BY rules are enumerated, and agree with timesInInterval()
+  RecurrenceRule weekly;
+  weekly.setStartDt( start );
+  weekly.setRecurrenceType( RecurrenceRule::rWeekly );
+  weekly.setFrequency( 1 );
+  weekly.setByDays( QList<RecurrenceRule::WDayPos>() << RecurrenceRule::WDayPos( 0, 1 )
+                                                      << RecurrenceRule::WDayPos( 0, 3 ) );
+  const DateTimeList weeklyTimes = weekly.timesInInterval( start, yearEnd );
+  QCOMPARE( weekly.occurrenceCount( start, yearEnd ), qint64( weeklyTimes.count() ) );
+  QCOMPARE( weekly.nthOccurrence( 0 ), weeklyTimes[0] );
+  QCOMPARE( weekly.nthOccurrence( 50 ), weeklyTimes[50] );
+  TimesCollector all;
+  weekly.visitTimesInInterval( start, yearEnd, &all, 7 );
+  QCOMPARE( all.mTimes, weeklyTimes );
+  QCOMPARE( all.mChunks, ( weeklyTimes.count() + 6 ) / 7 );
+
+  weekly.setDuration( 20 );
+  QCOMPARE( weekly.occurrenceCount( start, yearEnd ), qint64( 20 ) );
+  QCOMPARE( weekly.nthOccurrence( 19 ), weeklyTimes[19] );
+  QVERIFY( !weekly.nthOccurrence( 20 ).isValid() );
+}
@@ -37,6 +37,9 @@ class TimesInIntervalTest : public QObject
     void testWeeklyDayOfWeekRecurrenceDtStart();
     void testClockTimeHandlingAllDay();
     void testClockTimeHandlingNonAllDay();
+    void testRecursOnCache();
+    void testCountCache();
+    void testOccurrenceCount();
 };
 
 #endif
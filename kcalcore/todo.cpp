@@ -76,9 +76,13 @@ class KCalCore::Todo::Private
 
 void KCalCore::Todo::Private::init( const KCalCore::Todo::Private &other )
 {
+  // Not shared with the copied to-do, see IncidenceBase
   mDtDue = other.mDtDue;
+  mDtDue.detach();
   mDtRecurrence = other.mDtRecurrence;
+  mDtRecurrence.detach();
   mCompleted = other.mCompleted;
+  mCompleted.detach();
   mPercentComplete = other.mPercentComplete;
   mHasDueDate = other.mHasDueDate;
   mHasStartDate = other.mHasStartDate;
@@ -394,13 +398,16 @@ void Todo::shiftTimes( const KDateTime::Spec &oldSpec,
                        const KDateTime::Spec &newSpec )
 {
   Incidence::shiftTimes( oldSpec, newSpec );
+  d->mDtDue.detach();
   d->mDtDue = d->mDtDue.toTimeSpec( oldSpec );
   d->mDtDue.setTimeSpec( newSpec );
   if ( recurs() ) {
+    d->mDtRecurrence.detach();
     d->mDtRecurrence = d->mDtRecurrence.toTimeSpec( oldSpec );
     d->mDtRecurrence.setTimeSpec( newSpec );
   }
   if ( d->mHasCompletedDate ) {
+    d->mCompleted.detach();
     d->mCompleted = d->mCompleted.toTimeSpec( oldSpec );
     d->mCompleted.setTimeSpec( newSpec );
   }